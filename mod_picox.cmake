@@ -44,6 +44,10 @@ set(picox_sources
     ${picox_dir}/allocator/xstack_allocator.c
     ${picox_dir}/allocator/xfixed_allocator.c
     ${picox_dir}/allocator/xpico_allocator.c
+    ${picox_dir}/allocator/xtlsf_allocator.c
+    ${picox_dir}/allocator/xmt_allocator.c
+    ${picox_dir}/allocator/xpool_allocator.c
+    ${picox_dir}/allocator/xallocator_stats.c
     ${picox_dir}/string/xdynamic_string.c
     ${picox_dir}/misc/xtokenizer.c
     ${picox_dir}/misc/xargparser.c
@@ -52,6 +52,10 @@ SOURCES += $$picox_dir/filesystem/xspiffs.c
 SOURCES += $$picox_dir/allocator/xstack_allocator.c
 SOURCES += $$picox_dir/allocator/xfixed_allocator.c
 SOURCES += $$picox_dir/allocator/xpico_allocator.c
+SOURCES += $$picox_dir/allocator/xtlsf_allocator.c
+SOURCES += $$picox_dir/allocator/xmt_allocator.c
+SOURCES += $$picox_dir/allocator/xpool_allocator.c
+SOURCES += $$picox_dir/allocator/xallocator_stats.c
 SOURCES += $$picox_dir/string/xdynamic_string.c
 SOURCES += $$picox_dir/misc/xtokenizer.c
 SOURCES += $$picox_dir/misc/xargparser.c
@@ -86,6 +90,10 @@ SOURCES += $$libfixmath_dir/uint32.c
 
 HEADERS += $$picox_dir/allocator/xfixed_allocator.h
 HEADERS += $$picox_dir/allocator/xpico_allocator.h
+HEADERS += $$picox_dir/allocator/xtlsf_allocator.h
+HEADERS += $$picox_dir/allocator/xmt_allocator.h
+HEADERS += $$picox_dir/allocator/xpool_allocator.h
+HEADERS += $$picox_dir/allocator/xallocator_stats.h
 HEADERS += $$picox_dir/allocator/xstack_allocator.h
 HEADERS += $$picox_dir/container/xbyte_array.h
 HEADERS += $$picox_dir/container/xfifo_buffer.h
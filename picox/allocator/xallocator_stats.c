@@ -0,0 +1,232 @@
+/**
+ *       @file  xallocator_stats.c
+ *      @brief
+ *
+ *    @details
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <picox/allocator/xallocator_stats.h>
+
+
+static void X__RemoveRecord(XAllocatorStats* self, size_t index);
+
+
+void xastats_init(XAllocatorStats* self)
+{
+    X_ASSERT(self);
+    memset(self, 0, sizeof(*self));
+}
+
+
+void xastats_record_alloc(XAllocatorStats* self, const void* ptr, size_t request, size_t size,
+                          const char* file, int line)
+{
+    size_t bin;
+
+    if (!self)
+        return;
+
+    if (!ptr)
+    {
+        self->num_failures++;
+        return;
+    }
+
+    bin = request ? (size_t)x_find_msb_pos32((uint32_t)X_MIN(request, UINT32_MAX)) : 0;
+    if (bin >= XASTATS_NUM_BINS)
+        bin = XASTATS_NUM_BINS - 1;
+    self->histogram[bin]++;
+
+    self->num_allocs++;
+    self->cur_count++;
+    self->cur_bytes += size;
+    if (self->cur_count > self->max_count)
+        self->max_count = self->cur_count;
+    if (self->cur_bytes > self->max_bytes)
+        self->max_bytes = self->cur_bytes;
+
+    if (self->num_records < X_COUNT_OF(self->records))
+    {
+        XAllocatorStatsRecord* const record = &self->records[self->num_records++];
+        record->ptr = ptr;
+        record->size = size;
+        record->file = file;
+        record->line = line;
+    }
+    else
+    {
+        self->num_untracked++;
+    }
+}
+
+
+void xastats_record_free(XAllocatorStats* self, const void* ptr, size_t size)
+{
+    size_t i;
+
+    if ((!self) || (!ptr))
+        return;
+
+    /* 直前に確保したブロックほど早く解放されることが多いので、後ろから探す */
+    for (i = self->num_records; i > 0; i--)
+    {
+        if (self->records[i - 1].ptr == ptr)
+            break;
+    }
+
+    if (i > 0)
+        X__RemoveRecord(self, i - 1);
+    else if (self->num_untracked > 0)
+        self->num_untracked--;
+    else
+        return; /* 統計情報を登録する前に確保されたブロック */
+
+    self->num_frees++;
+    self->cur_count--;
+    self->cur_bytes -= X_MIN(size, self->cur_bytes);
+}
+
+
+void xastats_record_release(XAllocatorStats* self, const void* begin, const void* end, size_t size)
+{
+    size_t num_released = 0;
+    size_t i;
+
+    if (!self)
+        return;
+
+    self->cur_bytes -= X_MIN(size, self->cur_bytes);
+
+    i = 0;
+    while (i < self->num_records)
+    {
+        if (x_is_within_ptr(self->records[i].ptr, begin, end))
+        {
+            X__RemoveRecord(self, i);
+            num_released++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (self->cur_bytes == 0)
+    {
+        num_released = self->cur_count;
+        self->num_untracked = 0;
+    }
+
+    self->num_frees += num_released;
+    self->cur_count -= num_released;
+}
+
+
+const XAllocatorStatsRecord* xastats_record(const XAllocatorStats* self, size_t index)
+{
+    X_ASSERT(self);
+    X_ASSERT(index < self->num_records);
+    return &self->records[index];
+}
+
+
+size_t xastats_num_records(const XAllocatorStats* self)
+{
+    X_ASSERT(self);
+    return self->num_records;
+}
+
+
+int xastats_fragmentation(size_t free_bytes, size_t largest_free)
+{
+    X_ASSERT(largest_free <= free_bytes);
+
+    if (free_bytes == 0)
+        return 0;
+
+    return (int)(((uint64_t)(free_bytes - largest_free) * 100) / free_bytes);
+}
+
+
+XError xastats_dump(const XAllocatorStats* self, XStream* stream)
+{
+    size_t i;
+
+    X_ASSERT(self);
+    X_ASSERT(stream);
+
+    xstream_printf(stream, "allocs %lu  frees %lu  failures %lu\n",
+                   (unsigned long)self->num_allocs,
+                   (unsigned long)self->num_frees,
+                   (unsigned long)self->num_failures);
+    xstream_printf(stream, "in use %lu blocks %lu bytes  peak %lu blocks %lu bytes\n",
+                   (unsigned long)self->cur_count,
+                   (unsigned long)self->cur_bytes,
+                   (unsigned long)self->max_count,
+                   (unsigned long)self->max_bytes);
+
+    for (i = 0; i < XASTATS_NUM_BINS; i++)
+    {
+        if (!self->histogram[i])
+            continue;
+
+        if (i < XASTATS_NUM_BINS - 1)
+            xstream_printf(stream, "  size %6lu-%-6lu %10lu\n",
+                           1UL << i, (1UL << (i + 1)) - 1, (unsigned long)self->histogram[i]);
+        else
+            xstream_printf(stream, "  size %6lu-       %10lu\n",
+                           1UL << i, (unsigned long)self->histogram[i]);
+    }
+
+    for (i = 0; i < self->num_records; i++)
+    {
+        const XAllocatorStatsRecord* const record = &self->records[i];
+        xstream_printf(stream, "  leak %p %8lu bytes at %s:%d\n",
+                       record->ptr, (unsigned long)record->size,
+                       record->file ? record->file : "?", record->line);
+    }
+
+    if (self->num_untracked)
+        xstream_printf(stream, "  leak %lu untracked blocks\n", (unsigned long)self->num_untracked);
+
+    return xstream_error(stream) ? X_ERR_IO : X_ERR_NONE;
+}
+
+
+static void X__RemoveRecord(XAllocatorStats* self, size_t index)
+{
+    /* 順番は保たなくてよいので、最後の記録で埋める */
+    self->num_records--;
+    self->records[index] = self->records[self->num_records];
+}
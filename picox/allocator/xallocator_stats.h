@@ -0,0 +1,227 @@
+/**
+ *       @file  xallocator_stats.h
+ *      @brief  Allocator statistics and leak tracking
+ *
+ *    @details
+ *
+ *      メモリアロケータの使用状況を収集する統計情報です。
+ *
+ *      XPicoAllocator, XFixedAllocator, XStackAllocatorに共通で使用します。各ア
+ *      ロケータのxxx_set_stats()でXAllocatorStatsを登録すると、確保、解放のたび
+ *      に以下の情報が記録されます。
+ *
+ *      + 確保、解放、確保失敗の回数
+ *      + 使用中のバイト数とブロック数、およびその最大値
+ *      + 確保要求サイズの2のべき乗ごとのヒストグラム
+ *      + 使用中のブロックごとの確保位置(ファイル名と行番号)
+ *
+ *      X_CONF_USE_ALLOCATOR_STATSが0以外の時、xpalloc_allocate()等の確保関数は
+ *      マクロになり、X_ASSERT()と同じく呼び出し元の__FILE__, __LINE__を記録しま
+ *      す。関数ポインタ経由で呼び出した場合は位置は記録されません。
+ *      xastats_dump()で解放されていないブロックを確保位置とともに出力できるので、
+ *      メモリリークの調査に使用できます。
+ *
+ *      使用中のブロックの記録表はX_CONF_ALLOCATOR_STATS_MAX_RECORDS個で、溢れた
+ *      ブロックは数だけを記録します。統計情報はアロケータの外部に置くので、使用
+ *      しないアロケータのメモリは増えません。
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef picox_allocator_xallocator_stats_h_
+#define picox_allocator_xallocator_stats_h_
+
+
+#include <picox/core/xcore.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** サイズのヒストグラムの階級数です
+ *
+ *  i番目の階級は[2^i, 2^(i+1))バイトの確保を数えます。最後の階級はそれ以上の
+ *  サイズを全て含みます。
+ */
+#define XASTATS_NUM_BINS    (16)
+
+
+/** 確保位置として記録するファイル名です
+ *
+ *  X_CONF_NO_STRINGIZE_ASSERTが0以外の時は、ファイル名の文字列化を抑止して行番
+ *  号だけを記録します。
+ */
+#if X_CONF_NO_STRINGIZE_ASSERT == 0
+    #define XASTATS_FILE    __FILE__
+#else
+    #define XASTATS_FILE    NULL
+#endif
+
+
+/** 使用中のブロックの記録です
+ */
+typedef struct XAllocatorStatsRecord
+{
+    /** ブロックのアドレス */
+    const void*     ptr;
+
+    /** ブロックのバイト数 */
+    size_t          size;
+
+    /** 確保したファイル名。不明な時はNULL */
+    const char*     file;
+
+    /** 確保した行番号。不明な時は0 */
+    int             line;
+} XAllocatorStatsRecord;
+
+
+/** アロケータの統計情報です
+ *
+ *  メンバは読み取り専用です。
+ */
+typedef struct XAllocatorStats
+{
+    /** 確保に成功した回数 */
+    size_t                  num_allocs;
+
+    /** 解放した回数 */
+    size_t                  num_frees;
+
+    /** 確保に失敗した回数 */
+    size_t                  num_failures;
+
+    /** 使用中のブロック数 */
+    size_t                  cur_count;
+
+    /** 使用中のブロック数の最大値 */
+    size_t                  max_count;
+
+    /** 使用中のバイト数 */
+    size_t                  cur_bytes;
+
+    /** 使用中のバイト数の最大値 */
+    size_t                  max_bytes;
+
+    /** 確保要求サイズのヒストグラム */
+    size_t                  histogram[XASTATS_NUM_BINS];
+
+    /** 記録表に入りきらなかった使用中のブロック数 */
+    size_t                  num_untracked;
+
+/// privatesection
+    size_t                  num_records;
+    XAllocatorStatsRecord   records[X_CONF_ALLOCATOR_STATS_MAX_RECORDS];
+} XAllocatorStats;
+
+
+/** 統計情報を初期化します
+ */
+void xastats_init(XAllocatorStats* self);
+
+
+/** 確保を記録します
+ *
+ *  @param ptr      確保したブロック。NULLの時は確保失敗として記録します
+ *  @param request  要求されたバイト数
+ *  @param size     ブロックが実際に占めるバイト数
+ *  @param file     確保位置のファイル名。NULL可
+ *  @param line     確保位置の行番号
+ *
+ *  selfがNULLの時は何もしません。アロケータの実装から呼び出すための関数です。
+ */
+void xastats_record_alloc(XAllocatorStats* self, const void* ptr, size_t request, size_t size,
+                          const char* file, int line);
+
+
+/** 解放を記録します
+ *
+ *  selfがNULLか、ptrがNULLの時は何もしません。記録表になく、溢れたブロックも
+ *  ない場合は、統計情報を登録する前に確保されたブロックとして無視します。
+ */
+void xastats_record_free(XAllocatorStats* self, const void* ptr, size_t size);
+
+
+/** [begin, end)の範囲にあるブロックをまとめて解放したことを記録します
+ *
+ *  @param size     解放したバイト数
+ *
+ *  XStackAllocatorの巻き戻しのように、ブロックを個別に解放しないアロケータ用で
+ *  す。記録表から溢れたブロックは範囲を判定できないので、使用中のバイト数が0に
+ *  なった時にだけ解放済みとして数えます。
+ */
+void xastats_record_release(XAllocatorStats* self, const void* begin, const void* end, size_t size);
+
+
+/** 記録表にある使用中のブロックを返します
+ *
+ *  @param index    0からxastats_num_records() - 1までの番号
+ *
+ *  解放により記録の順番は入れ替わります。
+ */
+const XAllocatorStatsRecord* xastats_record(const XAllocatorStats* self, size_t index);
+
+
+/** 記録表にある使用中のブロック数を返します
+ */
+size_t xastats_num_records(const XAllocatorStats* self);
+
+
+/** 空きメモリの断片化率を百分率で返します
+ *
+ *  断片化率は 1 - (最大の空きブロック / 空き容量の合計) です。空きが1つのブロ
+ *  ックにまとまっていれば0、細かく分かれているほど100に近づきます。
+ *
+ *  @param free_bytes       空き容量の合計
+ *  @param largest_free     最大の空きブロックのバイト数
+ */
+int xastats_fragmentation(size_t free_bytes, size_t largest_free);
+
+
+/** 統計情報と使用中のブロックの一覧をstreamに出力します
+ *
+ *  @retval X_ERR_NONE  成功
+ *  @retval X_ERR_IO    出力エラー
+ */
+XError xastats_dump(const XAllocatorStats* self, XStream* stream);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // picox_allocator_xallocator_stats_h_
@@ -40,6 +40,7 @@
 
 
 static void X__MakeBlocks(XFixedAllocator* self);
+static void* X__AllocateAt(XFixedAllocator* self, const char* file, int line);
 #define X__IS_VALID_RANGE(x) (x_is_within_ptr(x, self->top, self->top + 1 + (self->block_size * (self->num_blocks - 1))))
 
 
@@ -52,6 +53,9 @@ void xfalloc_init(XFixedAllocator* self, void* heap, size_t heap_size, size_t bl
     X_ASSERT(block_size > 0);
 
     self->heap = heap;
+#if X_CONF_USE_ALLOCATOR_STATS
+    self->stats = NULL;
+#endif
 
     /* heapをアライメントで切り上げたアドレスが実際のtop位置になる。 */
     p = X_ROUNDUP_MULTIPLE_PTR(heap, X_ALIGN_OF(XMaxAlign));
@@ -84,10 +88,22 @@ void xfalloc_clear(XFixedAllocator* self)
 
     /* ブロックを再構築 */
     X__MakeBlocks(self);
+
+#if X_CONF_USE_ALLOCATOR_STATS
+    if (self->stats)
+        xastats_record_release(self->stats, self->top, self->top + self->block_size * self->num_blocks,
+                               self->stats->cur_bytes);
+#endif
+}
+
+
+void* (xfalloc_allocate)(XFixedAllocator* self)
+{
+    return X__AllocateAt(self, NULL, 0);
 }
 
 
-void* xfalloc_allocate(XFixedAllocator* self)
+static void* X__AllocateAt(XFixedAllocator* self, const char* file, int line)
 {
     uint8_t* block;
     X_ASSERT(self);
@@ -101,6 +117,13 @@ void* xfalloc_allocate(XFixedAllocator* self)
     self->next = *(uint8_t**)block;
     self->remain_blocks--;
 
+#if X_CONF_USE_ALLOCATOR_STATS
+    xastats_record_alloc(self->stats, block, self->block_size, self->block_size, file, line);
+#else
+    X_UNUSED(file);
+    X_UNUSED(line);
+#endif
+
     return block;
 }
 
@@ -122,6 +145,10 @@ void xfalloc_deallocate(XFixedAllocator* self, void* ptr)
     *(uint8_t**)block = self->next;
     self->next = block;
     self->remain_blocks++;
+
+#if X_CONF_USE_ALLOCATOR_STATS
+    xastats_record_free(self->stats, ptr, self->block_size);
+#endif
 }
 
 
@@ -153,6 +180,56 @@ size_t xfalloc_remain_blocks(const XFixedAllocator* self)
 }
 
 
+size_t xfalloc_largest_free_block(const XFixedAllocator* self)
+{
+    X_ASSERT(self);
+    return self->remain_blocks ? self->block_size : 0;
+}
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+void* xfalloc_allocate_at(XFixedAllocator* self, const char* file, int line)
+{
+    return X__AllocateAt(self, file, line);
+}
+
+
+void xfalloc_set_stats(XFixedAllocator* self, XAllocatorStats* stats)
+{
+    X_ASSERT(self);
+    self->stats = stats;
+}
+
+
+XAllocatorStats* xfalloc_stats(const XFixedAllocator* self)
+{
+    X_ASSERT(self);
+    return self->stats;
+}
+
+
+XError xfalloc_dump_stats(const XFixedAllocator* self, XStream* stream)
+{
+    X_ASSERT(self);
+    X_ASSERT(stream);
+
+    xstream_printf(stream, "block size %lu  blocks %lu  remain %lu\n",
+                   (unsigned long)self->block_size,
+                   (unsigned long)self->num_blocks,
+                   (unsigned long)self->remain_blocks);
+
+    if (self->stats)
+        return xastats_dump(self->stats, stream);
+
+    return xstream_error(stream) ? X_ERR_IO : X_ERR_NONE;
+}
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
 static void X__MakeBlocks(XFixedAllocator* self)
 {
     uint8_t* p;
@@ -80,6 +80,7 @@
 
 
 #include <picox/core/xcore.h>
+#include <picox/allocator/xallocator_stats.h>
 
 
 #ifdef __cplusplus
@@ -99,6 +100,9 @@ typedef struct XFixedAllocator
     size_t      num_blocks;
     size_t      remain_blocks;
     size_t      alignment;
+#if X_CONF_USE_ALLOCATOR_STATS
+    XAllocatorStats* stats;
+#endif
 } XFixedAllocator;
 
 
@@ -163,6 +167,50 @@ size_t xfalloc_num_blocks(const XFixedAllocator* self);
 size_t xfalloc_remain_blocks(const XFixedAllocator* self);
 
 
+/** 最大の空きブロックのバイト数を返します
+ *
+ *  全てのブロックが同じサイズなので、断片化は起こりません。空きブロックがあれ
+ *  ばブロックサイズを、なければ0を返します。
+ */
+size_t xfalloc_largest_free_block(const XFixedAllocator* self);
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+/** 統計情報を登録します
+ *
+ *  statsはxastats_init()で初期化しておいてください。NULLを渡すと記録を止めます。
+ *  xfalloc_clear()は全てのブロックの解放として記録されます。
+ */
+void xfalloc_set_stats(XFixedAllocator* self, XAllocatorStats* stats);
+
+
+/** 登録されている統計情報を返します
+ */
+XAllocatorStats* xfalloc_stats(const XFixedAllocator* self);
+
+
+/** ブロックの使用状況と統計情報をstreamに出力します
+ *
+ *  @retval X_ERR_NONE  成功
+ *  @retval X_ERR_IO    出力エラー
+ */
+XError xfalloc_dump_stats(const XFixedAllocator* self, XStream* stream);
+
+
+/** 確保位置を指定してxfalloc_allocate()を行います
+ */
+void* xfalloc_allocate_at(XFixedAllocator* self, const char* file, int line);
+
+
+#define xfalloc_allocate(self) \
+    xfalloc_allocate_at((self), XASTATS_FILE, __LINE__)
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
 #ifdef __cplusplus
 }
 #endif
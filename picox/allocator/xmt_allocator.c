@@ -0,0 +1,354 @@
+/**
+ *       @file  xmt_allocator.c
+ *      @brief
+ *
+ *    @details
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <picox/allocator/xmt_allocator.h>
+
+
+/* キャッシュ中のブロックは先頭に次のブロックへのポインタを格納して、サイズク
+ * ラスごとの単方向リストにつなぐ。
+ *
+ * XPicoAllocatorは空きリストの管理領域を格納できるサイズまでブロックを切り上げ
+ * るので、最小のブロックの使用できるサイズはalignmentより大きいことがある。確保
+ * 時と解放時で同じサイズクラスになるように、サイズクラスcはその最小サイズから
+ * c * alignmentバイト大きいブロックとし、どちらもxpalloc_usable_size()と同じ使
+ * 用できるサイズからサイズクラスを求める。
+ */
+typedef struct X__Cache
+{
+    XMtAllocator*       owner;
+    void*               bins[X_CONF_XMTALLOC_NUM_CLASSES];
+    size_t              counts[X_CONF_XMTALLOC_NUM_CLASSES];
+} X__Cache;
+
+
+static X__Cache* X__GetCache(XMtAllocator* self);
+static void X__ReleaseCache(X__Cache* cache);
+static void X__DestroyCache(void* cache);
+static bool X__Refill(XMtAllocator* self, X__Cache* cache, size_t index);
+static void X__Flush(XMtAllocator* self, X__Cache* cache, size_t index, size_t count);
+static void* X__LockedAllocate(XMtAllocator* self, size_t size);
+static void X__LockedDeallocate(XMtAllocator* self, void* ptr);
+static size_t X__ClassIndex(const XMtAllocator* self, size_t usable_size);
+#define X__ALIGN                (self->arena.alignment)
+#define X__CLASS_SIZE(index)    (self->min_cached_size + (index) * X__ALIGN)
+
+
+bool xmtalloc_init(XMtAllocator* self, void* heap, size_t size, size_t alignment)
+{
+    X_ASSERT(self);
+
+    if (!xpalloc_init(&self->arena, heap, size, alignment))
+        return false;
+
+    if (pthread_key_create(&self->key, X__DestroyCache) != 0)
+    {
+        xpalloc_deinit(&self->arena);
+        return false;
+    }
+
+    pthread_mutex_init(&self->lock, NULL);
+
+    /* 最小のブロックの使用できるサイズを、実際に確保して調べる */
+    {
+        void* const ptr = xpalloc_allocate(&self->arena, 1);
+        self->min_cached_size = ptr ? xpalloc_usable_size(&self->arena, ptr) : X__ALIGN;
+        xpalloc_deallocate(&self->arena, ptr);
+    }
+    self->max_cached_size = X__CLASS_SIZE(X_CONF_XMTALLOC_NUM_CLASSES - 1);
+
+    return true;
+}
+
+
+void xmtalloc_deinit(XMtAllocator* self)
+{
+    X_ASSERT(self);
+
+    /* キーを削除すると、生存中のスレッドが終了してもデストラクタは呼ばれない */
+    pthread_key_delete(self->key);
+    pthread_mutex_destroy(&self->lock);
+    xpalloc_deinit(&self->arena);
+}
+
+
+void* xmtalloc_allocate(XMtAllocator* self, size_t size)
+{
+    X__Cache* cache;
+    size_t index;
+    void* ptr;
+
+    X_ASSERT(self);
+    X_ASSERT(size > 0);
+
+    if (size > self->max_cached_size)
+        return X__LockedAllocate(self, size);
+
+    index = X__ClassIndex(self, x_roundup_multiple(size, X__ALIGN));
+    cache = X__GetCache(self);
+    if (!cache)
+        return X__LockedAllocate(self, X__CLASS_SIZE(index));
+
+    if ((!cache->bins[index]) && (!X__Refill(self, cache, index)))
+        return NULL;
+
+    ptr = cache->bins[index];
+    cache->bins[index] = *(void**)ptr;
+    cache->counts[index]--;
+
+    return ptr;
+}
+
+
+void* xmtalloc_reallocate(XMtAllocator* self, void* old_mem, size_t size)
+{
+    size_t old_size;
+    void* new_mem;
+
+    X_ASSERT(self);
+    X_ASSERT(size > 0);
+
+    if (!old_mem)
+        return xmtalloc_allocate(self, size);
+
+    old_size = xpalloc_usable_size(&self->arena, old_mem);
+    if (size <= old_size)
+        return old_mem;
+
+    new_mem = xmtalloc_allocate(self, size);
+    if (!new_mem)
+        return NULL;
+
+    memcpy(new_mem, old_mem, (old_size < size) ? old_size : size);
+    xmtalloc_deallocate(self, old_mem);
+
+    return new_mem;
+}
+
+
+void xmtalloc_deallocate(XMtAllocator* self, void* ptr)
+{
+    X__Cache* cache;
+    size_t size;
+    size_t index;
+
+    X_ASSERT(self);
+
+    if (ptr == NULL)
+        return;
+
+    /* ブロックは呼び出し元が所有しているので、サイズ情報はロックなしで読める */
+    size = xpalloc_usable_size(&self->arena, ptr);
+    if (size > self->max_cached_size)
+    {
+        X__LockedDeallocate(self, ptr);
+        return;
+    }
+
+    index = X__ClassIndex(self, size);
+    cache = X__GetCache(self);
+    if (!cache)
+    {
+        X__LockedDeallocate(self, ptr);
+        return;
+    }
+
+    *(void**)ptr = cache->bins[index];
+    cache->bins[index] = ptr;
+    cache->counts[index]++;
+
+    if (cache->counts[index] > X_CONF_XMTALLOC_BATCH_SIZE * 2)
+        X__Flush(self, cache, index, X_CONF_XMTALLOC_BATCH_SIZE);
+}
+
+
+void xmtalloc_flush_thread_cache(XMtAllocator* self)
+{
+    X__Cache* cache;
+
+    X_ASSERT(self);
+
+    cache = pthread_getspecific(self->key);
+    if (cache)
+    {
+        pthread_setspecific(self->key, NULL);
+        X__ReleaseCache(cache);
+    }
+}
+
+
+XPicoAllocator* xmtalloc_arena(XMtAllocator* self)
+{
+    X_ASSERT(self);
+    return &self->arena;
+}
+
+
+bool xmtalloc_is_owner(const XMtAllocator* self, const void* ptr)
+{
+    X_ASSERT(self);
+    return xpalloc_is_owner(&self->arena, ptr);
+}
+
+
+/* 使用できるサイズがusable_size以上になる最小のサイズクラスを返す */
+static size_t X__ClassIndex(const XMtAllocator* self, size_t usable_size)
+{
+    X_ASSERT(usable_size % X__ALIGN == 0);
+    X_ASSERT(usable_size <= self->max_cached_size);
+
+    if (usable_size <= self->min_cached_size)
+        return 0;
+    return (usable_size - self->min_cached_size) / X__ALIGN;
+}
+
+
+static X__Cache* X__GetCache(XMtAllocator* self)
+{
+    X__Cache* cache = pthread_getspecific(self->key);
+
+    if (cache)
+        return cache;
+
+    /* キャッシュが作れない時は、呼び出し元がアリーナを直接使用する */
+    cache = X__LockedAllocate(self, sizeof(X__Cache));
+    if (!cache)
+        return NULL;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->owner = self;
+
+    if (pthread_setspecific(self->key, cache) != 0)
+    {
+        X__LockedDeallocate(self, cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+static void X__ReleaseCache(X__Cache* cache)
+{
+    XMtAllocator* const self = cache->owner;
+    size_t i;
+
+    pthread_mutex_lock(&self->lock);
+    for (i = 0; i < X_CONF_XMTALLOC_NUM_CLASSES; i++)
+    {
+        void* ptr = cache->bins[i];
+        while (ptr)
+        {
+            void* const next = *(void**)ptr;
+            xpalloc_deallocate(&self->arena, ptr);
+            ptr = next;
+        }
+    }
+
+    xpalloc_deallocate(&self->arena, cache);
+    pthread_mutex_unlock(&self->lock);
+}
+
+
+/* スレッド終了時にpthreadから呼び出される */
+static void X__DestroyCache(void* cache)
+{
+    X__ReleaseCache(cache);
+}
+
+
+static bool X__Refill(XMtAllocator* self, X__Cache* cache, size_t index)
+{
+    const size_t size = X__CLASS_SIZE(index);
+    size_t i;
+
+    pthread_mutex_lock(&self->lock);
+    for (i = 0; i < X_CONF_XMTALLOC_BATCH_SIZE; i++)
+    {
+        void* const ptr = xpalloc_allocate(&self->arena, size);
+        if (!ptr)
+            break;
+
+        *(void**)ptr = cache->bins[index];
+        cache->bins[index] = ptr;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    cache->counts[index] += i;
+
+    return i > 0;
+}
+
+
+static void X__Flush(XMtAllocator* self, X__Cache* cache, size_t index, size_t count)
+{
+    void* ptr = cache->bins[index];
+    size_t i;
+
+    pthread_mutex_lock(&self->lock);
+    for (i = 0; (i < count) && ptr; i++)
+    {
+        void* const next = *(void**)ptr;
+        xpalloc_deallocate(&self->arena, ptr);
+        ptr = next;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    cache->bins[index] = ptr;
+    cache->counts[index] -= i;
+}
+
+
+static void* X__LockedAllocate(XMtAllocator* self, size_t size)
+{
+    void* ptr;
+
+    pthread_mutex_lock(&self->lock);
+    ptr = xpalloc_allocate(&self->arena, size);
+    pthread_mutex_unlock(&self->lock);
+
+    return ptr;
+}
+
+
+static void X__LockedDeallocate(XMtAllocator* self, void* ptr)
+{
+    pthread_mutex_lock(&self->lock);
+    xpalloc_deallocate(&self->arena, ptr);
+    pthread_mutex_unlock(&self->lock);
+}
@@ -0,0 +1,164 @@
+/**
+ *       @file  xmt_allocator.h
+ *      @brief  Thread-safe variable memory allocator
+ *
+ *    @details
+ *
+ *      XPicoAllocatorを複数のスレッドから使用するためのアロケータです。
+ *
+ *      XPicoAllocatorはロックを持たないので、単純に共有するには確保と解放の度に
+ *      全体を1つのミューテックスで保護するしかなく、スレッド数を増やしても速く
+ *      なりません。XMtAllocatorは小さいメモリブロックをスレッドごとのキャッシュ
+ *      に保持し、共有のXPicoAllocator(アリーナ)とはまとめてやり取りします。
+ *
+ *      + アリーナの最小のブロックからalignment刻みの
+ *        X_CONF_XMTALLOC_NUM_CLASSES個のサイズクラスに収まる確保は、スレッドの
+ *        キャッシュからロックなしで行う
+ *      + キャッシュが空になったら、ロックを1回取ってアリーナから
+ *        X_CONF_XMTALLOC_BATCH_SIZE個をまとめて補充する
+ *      + 解放したブロックは解放したスレッドのキャッシュに入り、
+ *        X_CONF_XMTALLOC_BATCH_SIZEの2倍を越えたら、半分をまとめてアリーナに返
+ *        す
+ *      + それより大きいメモリは、ロックを取ってアリーナから直接確保する
+ *      + スレッドが終了すると、そのスレッドのキャッシュはアリーナに返される
+ *
+ *      他のスレッドのキャッシュにあるブロックは使えないので、空き容量に余裕のな
+ *      いヒープでは、XPicoAllocatorを直接使用した場合より早く確保に失敗すること
+ *      があります。
+ *
+ *      POSIXスレッドを使用します。
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef picox_allocator_xmt_allocator_h_
+#define picox_allocator_xmt_allocator_h_
+
+
+#include <picox/core/xcore.h>
+#include <picox/allocator/xpico_allocator.h>
+#include <pthread.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** スレッドセーフな可変長メモリアロケータ管理クラスです
+ */
+typedef struct XMtAllocator
+{
+/// privatesection
+    XPicoAllocator      arena;
+    pthread_mutex_t     lock;
+    pthread_key_t       key;
+    size_t              min_cached_size;
+    size_t              max_cached_size;
+} XMtAllocator;
+
+
+/** アロケータを初期化します
+ *
+ *  引数と事前条件はxpalloc_init()と同じです。
+ *
+ *  @retval true    初期化成功
+ *  @retval false   メモリ確保失敗
+ */
+bool xmtalloc_init(XMtAllocator* self, void* heap, size_t size, size_t alignment);
+
+
+/** オブジェクトの終了処理を行います
+ *
+ *  @pre
+ *  + 他のスレッドがこのアロケータを使用していないこと
+ *
+ *  各スレッドのキャッシュは、アリーナのメモリごと破棄されます。
+ */
+void xmtalloc_deinit(XMtAllocator* self);
+
+
+/** ヒープからsizeバイトのメモリを切り出して返します
+ *
+ *  @pre
+ *  + size > 0
+ */
+void* xmtalloc_allocate(XMtAllocator* self, size_t size);
+
+
+/** realloc()相当の処理を行います
+ */
+void* xmtalloc_reallocate(XMtAllocator* self, void* old_mem, size_t size);
+
+
+/** ヒープにメモリを返却します
+ *
+ *  確保したスレッドとは別のスレッドから解放できます。
+ *
+ *  @pre
+ *  + xmtalloc_is_owner(self, ptr) == true
+ *  @note
+ *  ptr == NULLの時は何もしません。
+ */
+void xmtalloc_deallocate(XMtAllocator* self, void* ptr);
+
+
+/** 呼び出したスレッドのキャッシュをアリーナに返します
+ *
+ *  キャッシュ自身の管理領域も解放されます。次にこのスレッドで確保を行うと、キ
+ *  ャッシュは作り直されます。
+ */
+void xmtalloc_flush_thread_cache(XMtAllocator* self);
+
+
+/** 共有のアリーナを返します
+ *
+ *  返したアロケータはロックなしで参照されることに注意してください。容量の確認
+ *  やxpalloc_walk_heap()による走査は、他のスレッドがアロケータを使用していない
+ *  時に行ってください。
+ */
+XPicoAllocator* xmtalloc_arena(XMtAllocator* self);
+
+
+/** ポインタがヒープ領域の範囲内かどうかを返します。
+ */
+bool xmtalloc_is_owner(const XMtAllocator* self, const void* ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // picox_allocator_xmt_allocator_h_
@@ -54,9 +54,18 @@ typedef struct X__Chunk
 } X__Chunk;
 
 
+static void* X__AllocateAt(XPicoAllocator* self, size_t size, const char* file, int line);
+static void* X__ReallocateAt(XPicoAllocator* self, void* old_mem, size_t new_size, const char* file, int line);
 static void* X__Allocate(XPicoAllocator* self, size_t size);
 static void X__Deallocate(XPicoAllocator* self, void* ptr, size_t size);
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+static int X__BinIndex(const XPicoAllocator* self, size_t size);
+static void* X__PopBin(XPicoAllocator* self, size_t size);
+static bool X__PushBin(XPicoAllocator* self, void* ptr, size_t size);
+static void X__FlushBins(XPicoAllocator* self);
+#endif
 #define X__ALIGN        (self->alignment)
+#define X__BIN_BIT(index)   ((uint32_t)1 << (index))
 
 
 bool xpalloc_init(XPicoAllocator* self, void* heap, size_t size, size_t alignment)
@@ -73,6 +82,14 @@ bool xpalloc_init(XPicoAllocator* self, void* heap, size_t size, size_t alignmen
     self->reserve = 0;
     self->max_used = 0;
     self->ownmemory = false;
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    memset(self->bins, 0, sizeof(self->bins));
+    self->bin_map = 0;
+    self->num_classes = 0;
+#endif
+#if X_CONF_USE_ALLOCATOR_STATS
+    self->stats = NULL;
+#endif
 
     if (! heap)
     {
@@ -111,8 +128,21 @@ void xpalloc_deinit(XPicoAllocator* self)
 }
 
 
-void* xpalloc_allocate(XPicoAllocator* self, size_t size)
+void* (xpalloc_allocate)(XPicoAllocator* self, size_t size)
 {
+    return X__AllocateAt(self, size, NULL, 0);
+}
+
+
+void* (xpalloc_reallocate)(XPicoAllocator* self, void* old_mem, size_t new_size)
+{
+    return X__ReallocateAt(self, old_mem, new_size, NULL, 0);
+}
+
+
+static void* X__AllocateAt(XPicoAllocator* self, size_t size, const char* file, int line)
+{
+    const size_t request = size;
     char* ptr;
     X_ASSERT(self);
     X_ASSERT(size > 0);
@@ -123,7 +153,22 @@ void* xpalloc_allocate(XPicoAllocator* self, size_t size)
     if (size <= sizeof(X__Chunk))
         size = x_roundup_multiple(sizeof(X__Chunk) + 1, X__ALIGN);
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    ptr = X__PopBin(self, size);
+    if (!ptr)
+    {
+        ptr = X__Allocate(self, size);
+
+        /* サイズクラスに保持しているブロックを結合すれば確保できるかもしれない */
+        if ((!ptr) && self->bin_map)
+        {
+            X__FlushBins(self);
+            ptr = X__Allocate(self, size);
+        }
+    }
+#else
     ptr = X__Allocate(self, size);
+#endif
     X_ASSERT_MALLOC_NULL(ptr);
 
     if (ptr != NULL)
@@ -140,11 +185,19 @@ void* xpalloc_allocate(XPicoAllocator* self, size_t size)
             self->max_used = used;
     }
 
+#if X_CONF_USE_ALLOCATOR_STATS
+    xastats_record_alloc(self->stats, ptr, request, size, file, line);
+#else
+    X_UNUSED(request);
+    X_UNUSED(file);
+    X_UNUSED(line);
+#endif
+
     return ptr;
 }
 
 
-void* xpalloc_reallocate(XPicoAllocator* self, void* old_mem, size_t new_size)
+static void* X__ReallocateAt(XPicoAllocator* self, void* old_mem, size_t new_size, const char* file, int line)
 {
     size_t old_size = 0;
     void* new_mem;
@@ -160,7 +213,7 @@ void* xpalloc_reallocate(XPicoAllocator* self, void* old_mem, size_t new_size)
         old_size = *(size_t*)p;
     }
 
-    new_mem = xpalloc_allocate(self, new_size);
+    new_mem = X__AllocateAt(self, new_size, file, line);
     if (!new_mem)
         return NULL;
 
@@ -199,8 +252,17 @@ void xpalloc_deallocate(XPicoAllocator* self, void* ptr)
     p = ((char*)ptr) - X__ALIGN;
     size = *(size_t*)p;
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    if (!X__PushBin(self, p, size))
+        X__Deallocate(self, p, size);
+#else
     X__Deallocate(self, p, size);
+#endif
     self->reserve += size;
+
+#if X_CONF_USE_ALLOCATOR_STATS
+    xastats_record_free(self->stats, ptr, size);
+#endif
 }
 
 
@@ -211,10 +273,19 @@ void xpalloc_clear(XPicoAllocator* self)
     self->reserve = self->capacity;
     self->top = x_roundup_multiple_ptr(self->heap, X__ALIGN);
     self->max_used = 0;
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    memset(self->bins, 0, sizeof(self->bins));
+    self->bin_map = 0;
+#endif
 
     X__Chunk* chunk = (X__Chunk*)self->top;
     chunk->next = NULL;
     chunk->size = self->capacity;
+
+#if X_CONF_USE_ALLOCATOR_STATS
+    if (self->stats)
+        xastats_record_release(self->stats, self->top, self->top + self->capacity, self->stats->cur_bytes);
+#endif
 }
 
 
@@ -226,6 +297,16 @@ size_t xpalloc_allocation_overhead(const XPicoAllocator* self, size_t n)
 }
 
 
+size_t xpalloc_usable_size(const XPicoAllocator* self, const void* ptr)
+{
+    X_ASSERT(self);
+    X_ASSERT(ptr);
+    X_ASSERT(x_is_aligned(ptr, X__ALIGN));
+
+    return *(const size_t*)(((const char*)ptr) - X__ALIGN) - X__ALIGN;
+}
+
+
 void xpalloc_walk_heap(const XPicoAllocator* self, XPicoAllocatorWalker walker, void* user)
 {
     const X__Chunk* chunk;
@@ -238,6 +319,17 @@ void xpalloc_walk_heap(const XPicoAllocator* self, XPicoAllocatorWalker walker,
         walker((const uint8_t*)chunk, chunk->size, user);
         chunk = chunk->next;
     }
+
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    {
+        size_t i;
+        for (i = 0; i < self->num_classes; i++)
+        {
+            for (chunk = self->bins[i]; chunk; chunk = chunk->next)
+                walker((const uint8_t*)chunk, chunk->size, user);
+        }
+    }
+#endif
 }
 
 
@@ -247,6 +339,25 @@ bool xpalloc_is_owner(const XPicoAllocator* self, const void* ptr)
 }
 
 
+static void X__FindLargest(const uint8_t* chunk, size_t size, void* user)
+{
+    size_t* const largest = user;
+    X_UNUSED(chunk);
+    if (size > *largest)
+        *largest = size;
+}
+
+
+size_t xpalloc_largest_free_block(const XPicoAllocator* self)
+{
+    size_t largest = 0;
+    X_ASSERT(self);
+
+    xpalloc_walk_heap(self, X__FindLargest, &largest);
+    return largest;
+}
+
+
 uint8_t* xpalloc_heap(const XPicoAllocator* self)
 {
     X_ASSERT(self);
@@ -275,6 +386,74 @@ size_t xpalloc_max_used(const XPicoAllocator* self)
 }
 
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+
+
+void xpalloc_set_size_classes(XPicoAllocator* self, size_t num_classes)
+{
+    X_ASSERT(self);
+    X_ASSERT(num_classes <= X_CONF_XPALLOC_MAX_SIZE_CLASSES);
+
+    X__FlushBins(self);
+    self->num_classes = num_classes;
+}
+
+
+#endif /* if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0 */
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+void* xpalloc_allocate_at(XPicoAllocator* self, size_t size, const char* file, int line)
+{
+    return X__AllocateAt(self, size, file, line);
+}
+
+
+void* xpalloc_reallocate_at(XPicoAllocator* self, void* old_mem, size_t size, const char* file, int line)
+{
+    return X__ReallocateAt(self, old_mem, size, file, line);
+}
+
+
+void xpalloc_set_stats(XPicoAllocator* self, XAllocatorStats* stats)
+{
+    X_ASSERT(self);
+    self->stats = stats;
+}
+
+
+XAllocatorStats* xpalloc_stats(const XPicoAllocator* self)
+{
+    X_ASSERT(self);
+    return self->stats;
+}
+
+
+XError xpalloc_dump_stats(const XPicoAllocator* self, XStream* stream)
+{
+    const size_t largest = xpalloc_largest_free_block(self);
+
+    X_ASSERT(stream);
+
+    xstream_printf(stream, "capacity %lu  reserve %lu  max used %lu  largest free %lu  fragmentation %d%%\n",
+                   (unsigned long)self->capacity,
+                   (unsigned long)self->reserve,
+                   (unsigned long)self->max_used,
+                   (unsigned long)largest,
+                   xastats_fragmentation(self->reserve, largest));
+
+    if (self->stats)
+        return xastats_dump(self->stats, stream);
+
+    return xstream_error(stream) ? X_ERR_IO : X_ERR_NONE;
+}
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
 static void* X__Allocate(XPicoAllocator* self, size_t size)
 {
     /* ここはかなりトリッキーなので解説しておく。
@@ -336,6 +515,15 @@ static void X__Deallocate(XPicoAllocator* self, void* ptr, size_t size)
     X_ASSERT(xpalloc_is_owner(self, ptr));
     X_ASSERT((uint8_t*)ptr + size <= self->heap + self->capacity);
 
+    /* ヒープを使い切っていると、空きリストは空になっている */
+    if (chunk == NULL)
+    {
+        blk->next = NULL;
+        blk->size = size;
+        self->top = (uint8_t*)blk;
+        return;
+    }
+
     for(;;)
     {
         next_chunk = chunk->next;
@@ -393,3 +581,77 @@ static void X__Deallocate(XPicoAllocator* self, void* ptr, size_t size)
         X_ASSERT((blk >= ((X__Chunk*)((uint8_t*)chunk + chunk->size))));
     }
 }
+
+
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+
+
+/* ブロックサイズは常にアライメントの倍数なので、アライメント単位でサイズクラス
+ * を割り当てる。サイズクラスで扱わないサイズなら-1を返す。
+ */
+static int X__BinIndex(const XPicoAllocator* self, size_t size)
+{
+    const size_t index = size / X__ALIGN - 1;
+    return (index < self->num_classes) ? (int)index : -1;
+}
+
+
+static void* X__PopBin(XPicoAllocator* self, size_t size)
+{
+    const int index = X__BinIndex(self, size);
+    X__Chunk* chunk;
+
+    if ((index < 0) || !(self->bin_map & X__BIN_BIT(index)))
+        return NULL;
+
+    chunk = self->bins[index];
+    self->bins[index] = chunk->next;
+    if (!chunk->next)
+        self->bin_map &= ~X__BIN_BIT(index);
+
+    return chunk;
+}
+
+
+static bool X__PushBin(XPicoAllocator* self, void* ptr, size_t size)
+{
+    const int index = X__BinIndex(self, size);
+    X__Chunk* const chunk = ptr;
+
+    if (index < 0)
+        return false;
+
+    X_ASSERT(xpalloc_is_owner(self, ptr));
+    chunk->next = self->bins[index];
+    chunk->size = size;
+    self->bins[index] = chunk;
+    self->bin_map |= X__BIN_BIT(index);
+
+    return true;
+}
+
+
+/* サイズクラスに保持している全てのブロックを、アドレス順の空きリストに戻して結
+ * 合させる
+ */
+static void X__FlushBins(XPicoAllocator* self)
+{
+    while (self->bin_map)
+    {
+        const int index = x_find_lsb_pos32(self->bin_map);
+        X__Chunk* chunk = self->bins[index];
+
+        while (chunk)
+        {
+            X__Chunk* const next = chunk->next;
+            X__Deallocate(self, chunk, chunk->size);
+            chunk = next;
+        }
+
+        self->bins[index] = NULL;
+        self->bin_map &= ~X__BIN_BIT(index);
+    }
+}
+
+
+#endif /* if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0 */
@@ -56,6 +56,7 @@
 
 
 #include <picox/core/xcore.h>
+#include <picox/allocator/xallocator_stats.h>
 
 
 #ifdef __cplusplus
@@ -63,6 +64,11 @@ extern "C" {
 #endif
 
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 32
+    #error X_CONF_XPALLOC_MAX_SIZE_CLASSES must be 32 or less
+#endif
+
+
 /** 可変長メモリアロケータ管理クラスです
  */
 typedef struct XPicoAllocator
@@ -75,6 +81,14 @@ typedef struct XPicoAllocator
     size_t          alignment;
     size_t          max_used;
     bool            ownmemory;
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    void*           bins[X_CONF_XPALLOC_MAX_SIZE_CLASSES];
+    uint32_t        bin_map;
+    size_t          num_classes;
+#endif
+#if X_CONF_USE_ALLOCATOR_STATS
+    XAllocatorStats* stats;
+#endif
 } XPicoAllocator;
 
 
@@ -167,6 +181,16 @@ size_t xpalloc_max_used(const XPicoAllocator* self);
 size_t xpalloc_allocation_overhead(const XPicoAllocator* self, size_t n);
 
 
+/** xpalloc_allocate()が返したメモリの、実際に使用できるバイト数を返します
+ *
+ *  アライメントへの切り上げにより、確保時に指定したサイズ以上になります。
+ *
+ *  @pre
+ *  + xpallloc_is_owner(self, ptr) == true
+ */
+size_t xpalloc_usable_size(const XPicoAllocator* self, const void* ptr);
+
+
 /** ヒープの空きブロック走査用コールバック関数です
  *
  *  @param chunk    空きブロックのポインタ
@@ -191,6 +215,89 @@ void xpalloc_walk_heap(const XPicoAllocator* self, XPicoAllocatorWalker walker,
 bool xpalloc_is_owner(const XPicoAllocator* self, const void* ptr);
 
 
+/** 最大の空きブロックのバイト数を返します
+ *
+ *  xpalloc_reserve()と合わせて、xastats_fragmentation()で断片化率を求められま
+ *  す。空きリストを全て走査するので、空きブロック数に比例した時間がかかります。
+ */
+size_t xpalloc_largest_free_block(const XPicoAllocator* self);
+
+
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+
+
+/** 小さいメモリブロックをサイズクラスごとの空きリストで管理します
+ *
+ *  管理領域を含めたブロックサイズがalignment * num_classes以下のメモリは、解放
+ *  時にアドレス順の空きリストに戻さず、同じサイズのブロック専用の空きリストに
+ *  つなぎます。同じサイズの確保要求にはそこからO(1)で割り当てるので、空きリス
+ *  トが断片化して長くなっても、小さいメモリの確保と解放の時間は増えません。
+ *
+ *  サイズクラスの空きリストにあるブロックは結合されません。通常の確保に失敗し
+ *  た時は、全てのブロックを空きリストに戻して結合してから再試行します。
+ *  xpalloc_reserve()はこれらのブロックも空きとして数え、xpalloc_walk_heap()は
+ *  アドレス順の空きリストの後に、サイズクラスごとに報告します。
+ *
+ *  @param num_classes  サイズクラス数。0で無効にします
+ *
+ *  @pre
+ *  + num_classes <= X_CONF_XPALLOC_MAX_SIZE_CLASSES
+ *
+ *  @note
+ *  xpalloc_init()直後はサイズクラスは無効です。サイズクラス数を変更すると、保
+ *  持していたブロックは空きリストに戻されます。
+ */
+void xpalloc_set_size_classes(XPicoAllocator* self, size_t num_classes);
+
+
+#endif /* if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0 */
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+/** 統計情報を登録します
+ *
+ *  statsはxastats_init()で初期化しておいてください。NULLを渡すと記録を止めます。
+ *  登録前に確保したブロックの解放は統計に含まれないので、xpalloc_init()の直後に
+ *  登録することをおすすめします。xpalloc_clear()は全てのブロックの解放として記
+ *  録されます。
+ */
+void xpalloc_set_stats(XPicoAllocator* self, XAllocatorStats* stats);
+
+
+/** 登録されている統計情報を返します
+ */
+XAllocatorStats* xpalloc_stats(const XPicoAllocator* self);
+
+
+/** ヒープの使用状況と統計情報をstreamに出力します
+ *
+ *  @retval X_ERR_NONE  成功
+ *  @retval X_ERR_IO    出力エラー
+ */
+XError xpalloc_dump_stats(const XPicoAllocator* self, XStream* stream);
+
+
+/** 確保位置を指定してxpalloc_allocate()を行います
+ */
+void* xpalloc_allocate_at(XPicoAllocator* self, size_t size, const char* file, int line);
+
+
+/** 確保位置を指定してxpalloc_reallocate()を行います
+ */
+void* xpalloc_reallocate_at(XPicoAllocator* self, void* old_mem, size_t size, const char* file, int line);
+
+
+#define xpalloc_allocate(self, size) \
+    xpalloc_allocate_at((self), (size), XASTATS_FILE, __LINE__)
+#define xpalloc_reallocate(self, old_mem, size) \
+    xpalloc_reallocate_at((self), (old_mem), (size), XASTATS_FILE, __LINE__)
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
 #ifdef __cplusplus
 }
 #endif
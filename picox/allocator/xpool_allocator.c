@@ -0,0 +1,390 @@
+/**
+ *       @file  xpool_allocator.c
+ *      @brief
+ *
+ *    @details
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <picox/allocator/xpool_allocator.h>
+#include <picox/allocator/xfixed_allocator.h>
+
+
+/** スラブ
+ *
+ * ブロック領域の直前に置く。親のアロケータから確保したスラブは、memoryに確保
+ * したアドレスを保持し、ヒープから切り出したスラブはNULLとする。
+ *
+ * XFixedAllocatorのブロックは、先頭に所属するスラブへのポインタを置き、その後
+ * ろを利用者に返す。解放時はこのポインタからスラブとクラスが分かるので、スラブ
+ * を探す必要がない。
+ */
+typedef struct X__Slab
+{
+    XIntrusiveNode      node;
+    XPoolAllocatorClass* klass;
+    XFixedAllocator     blocks;
+    uint8_t*            begin;
+    uint8_t*            end;
+    void*               memory;
+} X__Slab;
+
+
+static size_t X__SlabSize(size_t block_size, size_t num_blocks);
+static X__Slab* X__MakeSlab(void* mem, XPoolAllocatorClass* klass, size_t num_blocks);
+static X__Slab* X__Grow(XPoolAllocator* self, XPoolAllocatorClass* klass);
+static X__Slab* X__FindSlab(XPoolAllocator* self, const void* ptr, XPoolAllocatorClass** o_class);
+#define X__NODE_TO_SLAB(n)          xnode_entry(n, X__Slab, node)
+#define X__HEADER_SIZE              X_ROUNDUP_MULTIPLE(sizeof(X__Slab), X_ALIGN_OF(XMaxAlign))
+#define X__BLOCK_SIZE(size)         X_ROUNDUP_MULTIPLE(size, X_ALIGN_OF(void*))
+#define X__BLOCK_HEADER_SIZE        X_ROUNDUP_MULTIPLE(sizeof(X__Slab*), X_ALIGN_OF(void*))
+#define X__BLOCK_STRIDE(size)       (X__BLOCK_SIZE(size) + X__BLOCK_HEADER_SIZE)
+
+
+size_t xpoolalloc_heap_size(const XPoolAllocatorSizeClass* classes, size_t num_classes)
+{
+    size_t size = 0;
+    size_t i;
+
+    X_ASSERT(classes);
+
+    for (i = 0; i < num_classes; i++)
+    {
+        if (classes[i].num_blocks)
+            size += X__SlabSize(classes[i].block_size, classes[i].num_blocks);
+    }
+
+    /* ヒープ先頭のアライメント調整分 */
+    return size + X_ALIGN_OF(XMaxAlign);
+}
+
+
+bool xpoolalloc_init(XPoolAllocator* self, void* heap, size_t heap_size,
+                     const XPoolAllocatorSizeClass* classes, size_t num_classes)
+{
+    uint8_t* p;
+    size_t i;
+
+    X_ASSERT(self);
+    X_ASSERT(classes);
+    X_ASSERT(num_classes > 0);
+    X_ASSERT(num_classes <= X_CONF_XPOOLALLOC_MAX_CLASSES);
+    X_ASSERT(heap_size >= xpoolalloc_heap_size(classes, num_classes));
+
+    self->heap = heap;
+    self->ownmemory = false;
+    self->parent_malloc = NULL;
+    self->parent_free = NULL;
+    self->grow_blocks = 0;
+    self->num_classes = num_classes;
+
+    if (! heap)
+    {
+        heap = x_malloc(heap_size);
+        if (!heap)
+            return false;
+        self->heap = heap;
+        self->ownmemory = true;
+    }
+
+    p = X_ROUNDUP_MULTIPLE_PTR(heap, X_ALIGN_OF(XMaxAlign));
+    for (i = 0; i < num_classes; i++)
+    {
+        XPoolAllocatorClass* const klass = &self->classes[i];
+
+        X_ASSERT(classes[i].block_size > 0);
+        X_ASSERT((i == 0) || (classes[i - 1].block_size < classes[i].block_size));
+
+        xilist_init(&klass->slabs);
+        klass->block_size = X__BLOCK_SIZE(classes[i].block_size);
+        klass->num_blocks = classes[i].num_blocks;
+        klass->used_blocks = 0;
+        klass->max_used_blocks = 0;
+        klass->num_slabs = 0;
+
+        if (classes[i].num_blocks)
+        {
+            X__Slab* const slab = X__MakeSlab(p, klass, klass->num_blocks);
+            xilist_push_back(&klass->slabs, &slab->node);
+            klass->num_slabs++;
+            p += X__SlabSize(klass->block_size, klass->num_blocks);
+        }
+    }
+
+    return true;
+}
+
+
+void xpoolalloc_deinit(XPoolAllocator* self)
+{
+    size_t i;
+
+    X_ASSERT(self);
+
+    for (i = 0; i < self->num_classes; i++)
+    {
+        XPoolAllocatorClass* const klass = &self->classes[i];
+        while (!xilist_empty(&klass->slabs))
+        {
+            X__Slab* const slab = X__NODE_TO_SLAB(xilist_front(&klass->slabs));
+            xnode_unlink(&slab->node);
+            if (slab->memory)
+                self->parent_free(slab->memory);
+        }
+    }
+    self->num_classes = 0;
+
+    if (self->ownmemory)
+    {
+        x_free(self->heap);
+        self->heap = NULL;
+        self->ownmemory = false;
+    }
+}
+
+
+void xpoolalloc_set_parent(XPoolAllocator* self, XMallocFunc malloc_func, XFreeFunc free_func, size_t grow_blocks)
+{
+    X_ASSERT(self);
+    X_ASSERT((!malloc_func) || (free_func && (grow_blocks > 0)));
+
+    self->parent_malloc = malloc_func;
+    self->parent_free = free_func;
+    self->grow_blocks = grow_blocks;
+}
+
+
+void* xpoolalloc_allocate(XPoolAllocator* self, size_t size)
+{
+    size_t i;
+
+    X_ASSERT(self);
+    X_ASSERT(size > 0);
+
+    for (i = 0; i < self->num_classes; i++)
+    {
+        XPoolAllocatorClass* const klass = &self->classes[i];
+        X__Slab* slab = NULL;
+        void* ptr;
+
+        if (klass->block_size < size)
+            continue;
+
+        /* 空きのあるスラブは常にリストの先頭側にある */
+        if (!xilist_empty(&klass->slabs))
+            slab = X__NODE_TO_SLAB(xilist_front(&klass->slabs));
+        if ((!slab) || (xfalloc_remain_blocks(&slab->blocks) == 0))
+        {
+            slab = X__Grow(self, klass);
+            if (!slab)
+                continue;
+        }
+
+        ptr = xfalloc_allocate(&slab->blocks);
+        *(X__Slab**)ptr = slab;
+        if (xfalloc_remain_blocks(&slab->blocks) == 0)
+            xilist_move_back(&klass->slabs, &slab->node);
+
+        klass->used_blocks++;
+        if (klass->used_blocks > klass->max_used_blocks)
+            klass->max_used_blocks = klass->used_blocks;
+
+        return (uint8_t*)ptr + X__BLOCK_HEADER_SIZE;
+    }
+
+    X_ASSERT_MALLOC_NULL(NULL);
+    return NULL;
+}
+
+
+void xpoolalloc_deallocate(XPoolAllocator* self, void* ptr)
+{
+    XPoolAllocatorClass* klass;
+    X__Slab* slab;
+    uint8_t* block;
+
+    X_ASSERT(self);
+
+    if (ptr == NULL)
+        return;
+
+    block = (uint8_t*)ptr - X__BLOCK_HEADER_SIZE;
+    slab = *(X__Slab**)block;
+    X_ASSERT(x_is_within_ptr(block, slab->begin, slab->end));
+    klass = slab->klass;
+
+    xfalloc_deallocate(&slab->blocks, block);
+    xilist_move_front(&klass->slabs, &slab->node);
+    klass->used_blocks--;
+}
+
+
+size_t xpoolalloc_shrink(XPoolAllocator* self)
+{
+    XIntrusiveNode* ite;
+    size_t released = 0;
+    size_t i;
+
+    X_ASSERT(self);
+
+    for (i = 0; i < self->num_classes; i++)
+    {
+        XPoolAllocatorClass* const klass = &self->classes[i];
+
+        ite = xilist_front(&klass->slabs);
+        while (ite != xilist_end(&klass->slabs))
+        {
+            X__Slab* const slab = X__NODE_TO_SLAB(ite);
+            ite = ite->next;
+
+            if (slab->memory &&
+                (xfalloc_remain_blocks(&slab->blocks) == xfalloc_num_blocks(&slab->blocks)))
+            {
+                xnode_unlink(&slab->node);
+                klass->num_blocks -= xfalloc_num_blocks(&slab->blocks);
+                klass->num_slabs--;
+                self->parent_free(slab->memory);
+                released++;
+            }
+        }
+    }
+
+    return released;
+}
+
+
+size_t xpoolalloc_num_classes(const XPoolAllocator* self)
+{
+    X_ASSERT(self);
+    return self->num_classes;
+}
+
+
+void xpoolalloc_occupancy(const XPoolAllocator* self, size_t index, XPoolAllocatorOccupancy* o_occupancy)
+{
+    const XPoolAllocatorClass* klass;
+
+    X_ASSERT(self);
+    X_ASSERT(index < self->num_classes);
+    X_ASSERT(o_occupancy);
+
+    klass = &self->classes[index];
+    o_occupancy->block_size = klass->block_size;
+    o_occupancy->num_blocks = klass->num_blocks;
+    o_occupancy->used_blocks = klass->used_blocks;
+    o_occupancy->max_used_blocks = klass->max_used_blocks;
+    o_occupancy->num_slabs = klass->num_slabs;
+}
+
+
+bool xpoolalloc_is_owner(const XPoolAllocator* self, const void* ptr)
+{
+    XPoolAllocatorClass* klass;
+
+    X_ASSERT(self);
+    return X__FindSlab((XPoolAllocator*)self, ptr, &klass) != NULL;
+}
+
+
+static size_t X__SlabSize(size_t block_size, size_t num_blocks)
+{
+    return X__HEADER_SIZE + X_ROUNDUP_MULTIPLE(X__BLOCK_STRIDE(block_size) * num_blocks, X_ALIGN_OF(XMaxAlign));
+}
+
+
+static X__Slab* X__MakeSlab(void* mem, XPoolAllocatorClass* klass, size_t num_blocks)
+{
+    X__Slab* const slab = mem;
+    const size_t block_size = X__BLOCK_STRIDE(klass->block_size);
+    const size_t size = block_size * num_blocks;
+
+    X_ASSERT(x_is_aligned(mem, X_ALIGN_OF(XMaxAlign)));
+
+    slab->begin = (uint8_t*)mem + X__HEADER_SIZE;
+    slab->end = slab->begin + size;
+    slab->memory = NULL;
+    slab->klass = klass;
+    xfalloc_init(&slab->blocks, slab->begin, size, block_size);
+    X_ASSERT(xfalloc_num_blocks(&slab->blocks) == num_blocks);
+
+    return slab;
+}
+
+
+static X__Slab* X__Grow(XPoolAllocator* self, XPoolAllocatorClass* klass)
+{
+    X__Slab* slab;
+    void* mem;
+
+    if (!self->parent_malloc)
+        return NULL;
+
+    /* 親のアロケータが返すアドレスのアライメントは分からないので、切り上げ分を
+     * 余分に確保する */
+    mem = self->parent_malloc(X__SlabSize(klass->block_size, self->grow_blocks) + X_ALIGN_OF(XMaxAlign));
+    if (!mem)
+        return NULL;
+
+    slab = X__MakeSlab(X_ROUNDUP_MULTIPLE_PTR(mem, X_ALIGN_OF(XMaxAlign)), klass, self->grow_blocks);
+    slab->memory = mem;
+    xilist_push_front(&klass->slabs, &slab->node);
+    klass->num_blocks += self->grow_blocks;
+    klass->num_slabs++;
+
+    return slab;
+}
+
+
+static X__Slab* X__FindSlab(XPoolAllocator* self, const void* ptr, XPoolAllocatorClass** o_class)
+{
+    XIntrusiveNode* ite;
+    size_t i;
+
+    for (i = 0; i < self->num_classes; i++)
+    {
+        XPoolAllocatorClass* const klass = &self->classes[i];
+
+        xilist_foreach(&klass->slabs, ite)
+        {
+            X__Slab* const slab = X__NODE_TO_SLAB(ite);
+            if (x_is_within_ptr(ptr, slab->begin, slab->end))
+            {
+                *o_class = klass;
+                return slab;
+            }
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,235 @@
+/**
+ *       @file  xpool_allocator.h
+ *      @brief  Multi-size-class pool allocator
+ *
+ *    @details
+ *
+ *      複数のサイズクラスを持つ固定サイズメモリアロケータです。
+ *
+ *      サイズクラスごとにXFixedAllocatorのスラブを持ち、要求されたサイズが収まる
+ *      最小のクラスからブロックを割り当てます。サイズの違う小さいオブジェクトを
+ *      扱う場合に、XFixedAllocatorを複数用意してサイズごとに振り分ける手間を省
+ *      けます。
+ *
+ *      + 初期のスラブはxpoolalloc_init()に渡したヒープから、クラスごとに指定し
+ *        た数のブロック分を切り出す
+ *      + xpoolalloc_set_parent()で親のアロケータを設定すると、クラスのブロック
+ *        を使い切った時に、親から新しいスラブを確保して拡張する
+ *      + 親が設定されていないか、親からの確保に失敗した時は、次に大きいクラスか
+ *        ら割り当てる
+ *
+ *      空きブロックを持つスラブをクラスごとのリストの先頭に置くので、確保はクラ
+ *      ス数以内の手順で終わります。各ブロックの直前に所属するスラブへのポインタ
+ *      を置くので、解放はスラブ数によらずO(1)です。そのため、1ブロックあたりポ
+ *      インタ1個分のメモリを余分に使用します。拡張を使用しない場合、スラブはクラ
+ *      スごとに1つです。
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef picox_allocator_xpool_allocator_h_
+#define picox_allocator_xpool_allocator_h_
+
+
+#include <picox/core/xcore.h>
+#include <picox/container/xintrusive_list.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/** サイズクラスの設定です
+ */
+typedef struct XPoolAllocatorSizeClass
+{
+    /** 1ブロックのサイズ */
+    size_t      block_size;
+
+    /** 初期化時にヒープから切り出すブロック数 */
+    size_t      num_blocks;
+} XPoolAllocatorSizeClass;
+
+
+/** サイズクラスごとの使用状況です
+ */
+typedef struct XPoolAllocatorOccupancy
+{
+    /** 1ブロックのサイズ */
+    size_t      block_size;
+
+    /** 全スラブの総ブロック数 */
+    size_t      num_blocks;
+
+    /** 使用中のブロック数 */
+    size_t      used_blocks;
+
+    /** 使用中のブロック数の最大値 */
+    size_t      max_used_blocks;
+
+    /** スラブの数 */
+    size_t      num_slabs;
+} XPoolAllocatorOccupancy;
+
+
+/// @cond IGNORE
+typedef struct XPoolAllocatorClass
+{
+    XIntrusiveList  slabs;
+    size_t          block_size;
+    size_t          num_blocks;
+    size_t          used_blocks;
+    size_t          max_used_blocks;
+    size_t          num_slabs;
+} XPoolAllocatorClass;
+/// @endcond IGNORE
+
+
+/** 複数サイズクラスのプールアロケータ管理クラスです
+ */
+typedef struct XPoolAllocator
+{
+/// privatesection
+    uint8_t*            heap;
+    bool                ownmemory;
+    XMallocFunc         parent_malloc;
+    XFreeFunc           parent_free;
+    size_t              grow_blocks;
+    size_t              num_classes;
+    XPoolAllocatorClass classes[X_CONF_XPOOLALLOC_MAX_CLASSES];
+} XPoolAllocator;
+
+
+/** classesの初期スラブに必要なヒープのバイト数を返します
+ */
+size_t xpoolalloc_heap_size(const XPoolAllocatorSizeClass* classes, size_t num_classes);
+
+
+/** アロケータを初期化します
+ *
+ *  @param heap         初期スラブに使用するメモリ領域
+ *  @param heap_size    heap領域のサイズ
+ *  @param classes      サイズクラスの設定
+ *  @param num_classes  サイズクラスの数
+ *
+ *  heap == NULLの場合はheap_sizeバイトのメモリをx_malloc()で確保します。
+ *
+ *  @pre
+ *  + 0 < num_classes <= X_CONF_XPOOLALLOC_MAX_CLASSES
+ *  + classesはblock_sizeの昇順に並んでいること
+ *  + heap_size >= xpoolalloc_heap_size(classes, num_classes)
+ *
+ *  @retval true    初期化成功
+ *  @retval false   メモリ確保失敗
+ *
+ *  @note
+ *  num_blocksが0のクラスは、親のアロケータから拡張するまでブロックを持ちませ
+ *  ん。
+ */
+bool xpoolalloc_init(XPoolAllocator* self, void* heap, size_t heap_size,
+                     const XPoolAllocatorSizeClass* classes, size_t num_classes);
+
+
+/** オブジェクトの終了処理を行います
+ *
+ *  親のアロケータから確保したスラブも解放されます。
+ */
+void xpoolalloc_deinit(XPoolAllocator* self);
+
+
+/** ブロックを使い切った時の拡張に使用するアロケータを設定します
+ *
+ *  @param malloc_func  スラブの確保関数。NULLで拡張を無効にします
+ *  @param free_func    スラブの解放関数
+ *  @param grow_blocks  1回の拡張で増やすブロック数
+ *
+ *  @pre
+ *  + malloc_func == NULLまたは、free_func != NULLかつgrow_blocks > 0
+ */
+void xpoolalloc_set_parent(XPoolAllocator* self, XMallocFunc malloc_func, XFreeFunc free_func, size_t grow_blocks);
+
+
+/** sizeバイト以上の最小のサイズクラスからブロックを割り当てます
+ *
+ *  @pre
+ *  + size > 0
+ */
+void* xpoolalloc_allocate(XPoolAllocator* self, size_t size);
+
+
+/** ブロックを返却します
+ *
+ *  @pre
+ *  + xpoolalloc_is_owner(self, ptr) == true
+ *  @note
+ *  ptr == NULLの時は何もしません。
+ */
+void xpoolalloc_deallocate(XPoolAllocator* self, void* ptr);
+
+
+/** 親のアロケータから確保したスラブのうち、全てのブロックが空いているものを
+ *  解放します
+ *
+ *  @return 解放したスラブの数
+ */
+size_t xpoolalloc_shrink(XPoolAllocator* self);
+
+
+/** サイズクラスの数を返します
+ */
+size_t xpoolalloc_num_classes(const XPoolAllocator* self);
+
+
+/** サイズクラスの使用状況を取得します
+ *
+ *  @pre
+ *  + index < xpoolalloc_num_classes(self)
+ */
+void xpoolalloc_occupancy(const XPoolAllocator* self, size_t index, XPoolAllocatorOccupancy* o_occupancy);
+
+
+/** ポインタがいずれかのスラブのブロックかどうかを返します。
+ *
+ *  全てのスラブを走査するので、スラブ数に比例した時間がかかります。
+ */
+bool xpoolalloc_is_owner(const XPoolAllocator* self, const void* ptr);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // picox_allocator_xpool_allocator_h_
@@ -40,6 +40,9 @@
 #include <picox/allocator/xstack_allocator.h>
 
 
+static void* X__AllocateAt(XStackAllocator* self, size_t size, const char* file, int line);
+
+
 X_INLINE uint8_t*
 X__GetBeginOrigin(XStackAllocator* self)
 {
@@ -65,6 +68,9 @@ void xsalloc_init(XStackAllocator* self, void* heap, size_t size, size_t alignme
 
     self->heap = heap;
     self->alignment = alignment;
+#if X_CONF_USE_ALLOCATOR_STATS
+    self->stats = NULL;
+#endif
 
     /* heapをアライメントで切り上げたアドレスが実際のtop位置になる。 */
     self->begin = X__GetBeginOrigin(self);
@@ -85,8 +91,15 @@ void xsalloc_init(XStackAllocator* self, void* heap, size_t size, size_t alignme
 }
 
 
-void* xsalloc_allocate(XStackAllocator* self, size_t size)
+void* (xsalloc_allocate)(XStackAllocator* self, size_t size)
+{
+    return X__AllocateAt(self, size, NULL, 0);
+}
+
+
+static void* X__AllocateAt(XStackAllocator* self, size_t size, const char* file, int line)
 {
+    const size_t request = size;
     size_t reserve;
     void* ret;
     X_ASSERT(self);
@@ -108,6 +121,14 @@ void* xsalloc_allocate(XStackAllocator* self, size_t size)
         ret = self->end;
     }
 
+#if X_CONF_USE_ALLOCATOR_STATS
+    xastats_record_alloc(self->stats, ret, request, size, file, line);
+#else
+    X_UNUSED(request);
+    X_UNUSED(file);
+    X_UNUSED(line);
+#endif
+
     return ret;
 }
 
@@ -118,6 +139,11 @@ void xsalloc_clear(XStackAllocator* self)
     self->begin = X__GetBeginOrigin(self);
     self->end = self->begin + self->capacity;
     self->growth_upward = true;
+
+#if X_CONF_USE_ALLOCATOR_STATS
+    if (self->stats)
+        xastats_record_release(self->stats, self->begin, self->end, self->stats->cur_bytes);
+#endif
 }
 
 
@@ -143,6 +169,15 @@ void xsalloc_rewind(XStackAllocator* self, void* begin, void* end)
     X_ASSERT(X__IsValidRange(self, b));
     X_ASSERT(X__IsValidRange(self, e));
 
+#if X_CONF_USE_ALLOCATOR_STATS
+    {
+        const size_t old_reserve = xsalloc_reserve(self);
+        const size_t new_reserve = e - b;
+        xastats_record_release(self->stats, b, e,
+                               (new_reserve > old_reserve) ? new_reserve - old_reserve : 0);
+    }
+#endif
+
     self->begin = b;
     self->end   = e;
 }
@@ -220,3 +255,51 @@ uint8_t* xsalloc_end(const XStackAllocator* self)
     X_ASSERT(self);
     return self->end;
 }
+
+
+size_t xsalloc_largest_free_block(const XStackAllocator* self)
+{
+    return xsalloc_reserve(self);
+}
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+void* xsalloc_allocate_at(XStackAllocator* self, size_t size, const char* file, int line)
+{
+    return X__AllocateAt(self, size, file, line);
+}
+
+
+void xsalloc_set_stats(XStackAllocator* self, XAllocatorStats* stats)
+{
+    X_ASSERT(self);
+    self->stats = stats;
+}
+
+
+XAllocatorStats* xsalloc_stats(const XStackAllocator* self)
+{
+    X_ASSERT(self);
+    return self->stats;
+}
+
+
+XError xsalloc_dump_stats(const XStackAllocator* self, XStream* stream)
+{
+    X_ASSERT(self);
+    X_ASSERT(stream);
+
+    xstream_printf(stream, "capacity %lu  reserve %lu\n",
+                   (unsigned long)self->capacity,
+                   (unsigned long)xsalloc_reserve(self));
+
+    if (self->stats)
+        return xastats_dump(self->stats, stream);
+
+    return xstream_error(stream) ? X_ERR_IO : X_ERR_NONE;
+}
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
@@ -78,6 +78,7 @@
 
 
 #include <picox/core/xcore.h>
+#include <picox/allocator/xallocator_stats.h>
 
 
 #ifdef __cplusplus
@@ -96,6 +97,9 @@ typedef struct XStackAllocator
     size_t      capacity;
     size_t      alignment;
     bool        growth_upward;
+#if X_CONF_USE_ALLOCATOR_STATS
+    XAllocatorStats* stats;
+#endif
 } XStackAllocator;
 
 
@@ -180,6 +184,50 @@ uint8_t* xsalloc_bedin(const XStackAllocator* self);
 uint8_t* xsalloc_end(const XStackAllocator* self);
 
 
+/** 最大の空きブロックのバイト数を返します
+ *
+ *  空き領域は常に連続しているので、xsalloc_reserve()と同じ値です。
+ */
+size_t xsalloc_largest_free_block(const XStackAllocator* self);
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+/** 統計情報を登録します
+ *
+ *  statsはxastats_init()で初期化しておいてください。NULLを渡すと記録を止めます。
+ *  ブロックは個別に解放されないので、xsalloc_rewind()で空きに戻った範囲のブロッ
+ *  クと、xsalloc_clear()で全てのブロックが解放として記録されます。
+ */
+void xsalloc_set_stats(XStackAllocator* self, XAllocatorStats* stats);
+
+
+/** 登録されている統計情報を返します
+ */
+XAllocatorStats* xsalloc_stats(const XStackAllocator* self);
+
+
+/** ヒープの使用状況と統計情報をstreamに出力します
+ *
+ *  @retval X_ERR_NONE  成功
+ *  @retval X_ERR_IO    出力エラー
+ */
+XError xsalloc_dump_stats(const XStackAllocator* self, XStream* stream);
+
+
+/** 確保位置を指定してxsalloc_allocate()を行います
+ */
+void* xsalloc_allocate_at(XStackAllocator* self, size_t size, const char* file, int line);
+
+
+#define xsalloc_allocate(self, size) \
+    xsalloc_allocate_at((self), (size), XASTATS_FILE, __LINE__)
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
 #ifdef __cplusplus
 }
 #endif
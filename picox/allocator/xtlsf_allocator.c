@@ -0,0 +1,550 @@
+/**
+ *       @file  xtlsf_allocator.c
+ *      @brief
+ *
+ *    @details
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <picox/allocator/xtlsf_allocator.h>
+
+
+/** メモリブロック
+ *
+ * ブロックはヒープ上に隙間なく並び、sizeをたどると物理的に次のブロック、
+ * prev_physで物理的に直前のブロックに移動できる。ヒープの末尾にはサイズ0の使用
+ * 中ブロックを番兵として置いてあるので、次のブロックの有無を確認する必要はな
+ * い。
+ *
+ * next_free, prev_freeは空きブロックの時だけ使用し、使用中のブロックではユー
+ * ザー領域と重なる。
+ */
+typedef struct X__Block
+{
+    struct X__Block*    prev_phys;
+    size_t              size;
+    struct X__Block*    next_free;
+    struct X__Block*    prev_free;
+} X__Block;
+
+
+static void X__Reset(XTlsfAllocator* self);
+static size_t X__AdjustSize(const XTlsfAllocator* self, size_t size);
+static void X__Mapping(const XTlsfAllocator* self, size_t size, int* fl, int* sl);
+static X__Block* X__FindSuitable(const XTlsfAllocator* self, size_t size);
+static void X__InsertFree(XTlsfAllocator* self, X__Block* block);
+static void X__RemoveFree(XTlsfAllocator* self, X__Block* block);
+static void X__Trim(XTlsfAllocator* self, X__Block* block, size_t size);
+static void X__UpdateMaxUsed(XTlsfAllocator* self);
+#define X__ALIGN            (self->alignment)
+#define X__SL_COUNT_LOG2    (4)
+#define X__FREE_BIT         ((size_t)1)
+#define X__ROUNDUP(x)       (((x) + X__ALIGN - 1) & ~(X__ALIGN - 1))
+#define X__HEADER_SIZE      (X__ROUNDUP((size_t)X_OFFSET_OF(X__Block, next_free)))
+#define X__MIN_BLOCK_SIZE   (X__ROUNDUP(sizeof(X__Block)))
+#define X__SMALL_SIZE       (X__ALIGN << X__SL_COUNT_LOG2)
+#define X__SIZE(b)          ((b)->size & ~X__FREE_BIT)
+#define X__IS_FREE(b)       (((b)->size & X__FREE_BIT) != 0)
+#define X__NEXT(b)          ((X__Block*)((uint8_t*)(b) + X__SIZE(b)))
+#define X__TO_BLOCK(p)      ((X__Block*)((uint8_t*)(p) - X__HEADER_SIZE))
+#define X__TO_PTR(b)        ((void*)((uint8_t*)(b) + X__HEADER_SIZE))
+
+
+X_STATIC_ASSERT(X_TLSF_SL_COUNT == (1 << X__SL_COUNT_LOG2));
+
+
+bool xtalloc_init(XTlsfAllocator* self, void* heap, size_t size, size_t alignment)
+{
+    size_t usable;
+    size_t max_block;
+    int limit;
+    X_ASSERT(self);
+    X_ASSERT(alignment);
+    X_ASSERT(x_is_power_of_two(alignment));
+
+    self->heap = heap;
+    self->alignment = 0;
+    self->top = NULL;
+    self->capacity = 0;
+    self->reserve = 0;
+    self->max_used = 0;
+    self->ownmemory = false;
+
+    if (! heap)
+    {
+        heap = x_malloc(size);
+        if (!heap)
+            return false;
+        self->ownmemory = true;
+    }
+
+    self->heap = heap;
+    self->alignment = x_roundup_multiple(alignment, X_ALIGN_OF(size_t));
+    self->align_shift = x_find_msb_pos32(self->alignment);
+    self->top = x_roundup_multiple_ptr(heap, X__ALIGN);
+
+    X_ASSERT(size > (size_t)(self->top - self->heap));
+    usable = (size - (self->top - self->heap)) & ~(X__ALIGN - 1);
+
+    /* 第1レベルのインデックスに収まらないサイズのブロックは管理できないので、
+     * ヒープの末尾を切り捨てる。 */
+    limit = X_CONF_XTALLOC_FL_COUNT + self->align_shift + X__SL_COUNT_LOG2 - 1;
+    if (limit > 31)
+        limit = 31;
+    max_block = ((size_t)1 << limit) - X__ALIGN;
+    if (usable - X__HEADER_SIZE > max_block)
+        usable = max_block + X__HEADER_SIZE;
+
+    X_ASSERT(usable >= X__HEADER_SIZE + X__MIN_BLOCK_SIZE);
+    self->capacity = usable - X__HEADER_SIZE;
+    X__Reset(self);
+
+    return true;
+}
+
+
+void xtalloc_deinit(XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    if (self->ownmemory)
+    {
+        x_free(self->heap);
+        self->heap = NULL;
+        self->ownmemory = false;
+    }
+}
+
+
+void* xtalloc_allocate(XTlsfAllocator* self, size_t size)
+{
+    X__Block* block;
+    X_ASSERT(self);
+    X_ASSERT(size > 0);
+
+    size = X__AdjustSize(self, size);
+    block = (size <= self->capacity) ? X__FindSuitable(self, size) : NULL;
+    X_ASSERT_MALLOC_NULL(block);
+    if (!block)
+        return NULL;
+
+    X__RemoveFree(self, block);
+    block->size &= ~X__FREE_BIT;
+    self->reserve -= block->size;
+    X__Trim(self, block, size);
+    X__UpdateMaxUsed(self);
+
+    return X__TO_PTR(block);
+}
+
+
+void* xtalloc_reallocate(XTlsfAllocator* self, void* old_mem, size_t new_size)
+{
+    X__Block* block;
+    X__Block* next;
+    size_t size;
+    size_t cur_size;
+    void* new_mem;
+
+    X_ASSERT(self);
+    X_ASSERT(new_size > 0);
+
+    if (!old_mem)
+        return xtalloc_allocate(self, new_size);
+
+    X_ASSERT(x_is_aligned(old_mem, X__ALIGN));
+    block = X__TO_BLOCK(old_mem);
+    X_ASSERT(!X__IS_FREE(block));
+
+    size = X__AdjustSize(self, new_size);
+    cur_size = X__SIZE(block);
+
+    /* 縮小なら余りを切り離すだけでよい */
+    if (size <= cur_size)
+    {
+        X__Trim(self, block, size);
+        return old_mem;
+    }
+
+    /* 後ろの空きブロックと合わせて足りるなら、その場で拡張する */
+    next = X__NEXT(block);
+    if (X__IS_FREE(next) && (cur_size + X__SIZE(next) >= size))
+    {
+        X__RemoveFree(self, next);
+        self->reserve -= X__SIZE(next);
+        block->size = cur_size + X__SIZE(next);
+        X__NEXT(block)->prev_phys = block;
+        X__Trim(self, block, size);
+        X__UpdateMaxUsed(self);
+        return old_mem;
+    }
+
+    new_mem = xtalloc_allocate(self, new_size);
+    if (!new_mem)
+        return NULL;
+
+    memcpy(new_mem, old_mem, cur_size - X__HEADER_SIZE);
+    xtalloc_deallocate(self, old_mem);
+
+    return new_mem;
+}
+
+
+void xtalloc_deallocate(XTlsfAllocator* self, void* ptr)
+{
+    X__Block* block;
+    X__Block* next;
+    X__Block* prev;
+
+    X_ASSERT(self);
+
+    if (ptr == NULL)
+        return;
+
+    X_ASSERT(x_is_aligned(ptr, X__ALIGN));
+    block = X__TO_BLOCK(ptr);
+
+    /* 二重解放 */
+    X_ASSERT(!X__IS_FREE(block));
+    self->reserve += block->size;
+
+    /* 物理的に隣接する空きブロックと結合する。結合は解放の度に行うので、空き
+     * ブロックが隣り合うことはなく、前後1つずつを見れば十分である。 */
+    next = X__NEXT(block);
+    if (X__IS_FREE(next))
+    {
+        X__RemoveFree(self, next);
+        block->size += X__SIZE(next);
+    }
+
+    prev = block->prev_phys;
+    if (prev && X__IS_FREE(prev))
+    {
+        X__RemoveFree(self, prev);
+        prev->size += block->size;
+        block = prev;
+    }
+
+    block->size |= X__FREE_BIT;
+    X__NEXT(block)->prev_phys = block;
+    X__InsertFree(self, block);
+}
+
+
+void xtalloc_clear(XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    X__Reset(self);
+}
+
+
+size_t xtalloc_allocation_overhead(const XTlsfAllocator* self, size_t n)
+{
+    X_ASSERT(self);
+    X_ASSERT(n > 0);
+    return X__AdjustSize(self, n) - n;
+}
+
+
+void xtalloc_walk_heap(const XTlsfAllocator* self, XTlsfAllocatorWalker walker, void* user)
+{
+    const X__Block* block;
+    X_ASSERT(self);
+    X_ASSERT(walker);
+
+    for (block = (const X__Block*)self->top; X__SIZE(block) != 0; block = X__NEXT(block))
+    {
+        if (X__IS_FREE(block))
+            walker((const uint8_t*)block, X__SIZE(block), user);
+    }
+}
+
+
+bool xtalloc_is_owner(const XTlsfAllocator* self, const void* ptr)
+{
+    return x_is_within_ptr(ptr, self->top, self->top + self->capacity);
+}
+
+
+uint8_t* xtalloc_heap(const XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    return self->heap;
+}
+
+
+size_t xtalloc_reserve(const XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    return self->reserve;
+}
+
+
+size_t xtalloc_capacity(const XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    return self->capacity;
+}
+
+
+size_t xtalloc_max_used(const XTlsfAllocator* self)
+{
+    X_ASSERT(self);
+    return self->max_used;
+}
+
+
+#if X_CONF_USE_XTALLOC_MALLOC
+
+
+static XTlsfAllocator X__global;
+
+
+bool xtalloc_init_global(void* heap, size_t size)
+{
+    /* x_malloc()自身がこのアロケータを使うので、ヒープの確保はできない */
+    X_ASSERT(heap);
+    return xtalloc_init(&X__global, heap, size, X_ALIGN_OF(XMaxAlign));
+}
+
+
+XTlsfAllocator* xtalloc_global(void)
+{
+    return &X__global;
+}
+
+
+void* xtalloc_global_allocate(size_t size)
+{
+    if ((!X__global.heap) || (size == 0))
+        return NULL;
+    return xtalloc_allocate(&X__global, size);
+}
+
+
+void xtalloc_global_deallocate(void* ptr)
+{
+    if (X__global.heap)
+        xtalloc_deallocate(&X__global, ptr);
+}
+
+
+#endif /* if X_CONF_USE_XTALLOC_MALLOC */
+
+
+static void X__Reset(XTlsfAllocator* self)
+{
+    X__Block* block;
+    X__Block* sentinel;
+
+    self->fl_bitmap = 0;
+    memset(self->sl_bitmap, 0, sizeof(self->sl_bitmap));
+    memset(self->blocks, 0, sizeof(self->blocks));
+    self->reserve = self->capacity;
+    self->max_used = 0;
+
+    block = (X__Block*)self->top;
+    block->prev_phys = NULL;
+    block->size = self->capacity | X__FREE_BIT;
+
+    sentinel = X__NEXT(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    X__InsertFree(self, block);
+}
+
+
+static size_t X__AdjustSize(const XTlsfAllocator* self, size_t size)
+{
+    size = X__ROUNDUP(size + X__HEADER_SIZE);
+    if (size < X__MIN_BLOCK_SIZE)
+        size = X__MIN_BLOCK_SIZE;
+    return size;
+}
+
+
+/* sizeが属するリストのインデックスを求める。
+ *
+ * 第1レベルは2のべき乗ごとの区分で、第2レベルはそれをさらに16等分する。
+ * X__SMALL_SIZE未満のサイズは第1レベル0にまとめ、alignmentごとに区分する。
+ */
+static void X__Mapping(const XTlsfAllocator* self, size_t size, int* fl, int* sl)
+{
+    if (size < X__SMALL_SIZE)
+    {
+        *fl = 0;
+        *sl = (int)(size >> self->align_shift);
+    }
+    else
+    {
+        const int msb = x_find_msb_pos32((uint32_t)size);
+        *sl = (int)(size >> (msb - X__SL_COUNT_LOG2)) ^ X_TLSF_SL_COUNT;
+        *fl = msb - (self->align_shift + X__SL_COUNT_LOG2) + 1;
+    }
+}
+
+
+/* size以上のブロックを探す。
+ *
+ * リスト内のブロックはサイズがばらばらなので、sizeを次の区分の先頭まで切り上げ
+ * てから検索すれば、見つかったリストの先頭ブロックは必ず要求を満たす。切り上げ
+ * たせいで見つからなかった時は、sizeそのものが属するリストの先頭を確認する。
+ */
+static X__Block* X__FindSuitable(const XTlsfAllocator* self, size_t size)
+{
+    X__Block* block;
+    uint32_t sl_map;
+    uint32_t fl_map;
+    int fl;
+    int sl;
+    size_t search = size;
+
+    if (size >= X__SMALL_SIZE)
+        search += ((size_t)1 << (x_find_msb_pos32((uint32_t)size) - X__SL_COUNT_LOG2)) - 1;
+
+    X__Mapping(self, search, &fl, &sl);
+    if (fl < X_CONF_XTALLOC_FL_COUNT)
+    {
+        sl_map = self->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+        if (!sl_map)
+        {
+            fl_map = (fl + 1 < X_CONF_XTALLOC_FL_COUNT) ? self->fl_bitmap & (~(uint32_t)0 << (fl + 1)) : 0;
+            if (fl_map)
+            {
+                fl = x_find_lsb_pos32(fl_map);
+                sl_map = self->sl_bitmap[fl];
+            }
+        }
+
+        if (sl_map)
+        {
+            sl = x_find_lsb_pos32(sl_map);
+            return self->blocks[fl][sl];
+        }
+    }
+
+    X__Mapping(self, size, &fl, &sl);
+    block = self->blocks[fl][sl];
+    if (block && (X__SIZE(block) >= size))
+        return block;
+
+    return NULL;
+}
+
+
+static void X__InsertFree(XTlsfAllocator* self, X__Block* block)
+{
+    X__Block* head;
+    int fl;
+    int sl;
+
+    X__Mapping(self, X__SIZE(block), &fl, &sl);
+    head = self->blocks[fl][sl];
+
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head)
+        head->prev_free = block;
+
+    self->blocks[fl][sl] = block;
+    self->fl_bitmap |= (uint32_t)1 << fl;
+    self->sl_bitmap[fl] |= (uint32_t)1 << sl;
+}
+
+
+static void X__RemoveFree(XTlsfAllocator* self, X__Block* block)
+{
+    int fl;
+    int sl;
+
+    X__Mapping(self, X__SIZE(block), &fl, &sl);
+
+    if (block->next_free)
+        block->next_free->prev_free = block->prev_free;
+
+    if (block->prev_free)
+    {
+        block->prev_free->next_free = block->next_free;
+    }
+    else
+    {
+        self->blocks[fl][sl] = block->next_free;
+        if (!block->next_free)
+        {
+            self->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+            if (!self->sl_bitmap[fl])
+                self->fl_bitmap &= ~((uint32_t)1 << fl);
+        }
+    }
+}
+
+
+/* 使用中のブロックをsizeまで縮め、余りを空きブロックとして返却する。
+ *
+ * 余りが空きブロックとして管理できないほど小さければ何もしない。
+ */
+static void X__Trim(XTlsfAllocator* self, X__Block* block, size_t size)
+{
+    X__Block* rest;
+    X__Block* next;
+    const size_t rest_size = block->size - size;
+
+    if (rest_size < X__MIN_BLOCK_SIZE)
+        return;
+
+    block->size = size;
+    rest = X__NEXT(block);
+    rest->prev_phys = block;
+    rest->size = rest_size;
+    self->reserve += rest_size;
+
+    next = X__NEXT(rest);
+    if (X__IS_FREE(next))
+    {
+        X__RemoveFree(self, next);
+        rest->size += X__SIZE(next);
+    }
+
+    rest->size |= X__FREE_BIT;
+    X__NEXT(rest)->prev_phys = rest;
+    X__InsertFree(self, rest);
+}
+
+
+static void X__UpdateMaxUsed(XTlsfAllocator* self)
+{
+    const size_t used = self->capacity - self->reserve;
+    if (used > self->max_used)
+        self->max_used = used;
+}
@@ -0,0 +1,248 @@
+/**
+ *       @file  xtlsf_allocator.h
+ *      @brief  TLSF variable memory allocator
+ *
+ *    @details
+ *
+ *      TLSF(Two-Level Segregated Fit)アルゴリズムによる可変長メモリアロケータで
+ *      す。XPicoAllocatorと同じ使い方ができます。
+ *
+ *      XPicoAllocatorは空きブロックをアドレス順の単方向リストで管理するので、断
+ *      片化が進むと確保と解放の時間がブロック数に比例して伸びていきます。
+ *      XTlsfAllocatorは空きブロックをサイズごとに2段階に分類したリストで管理し、
+ *      ビットマップから適合するリストを探すので、確保と解放はヒープの状態に関わ
+ *      らず一定時間で完了します。最悪実行時間が見積もれることが必要なリアルタイ
+ *      ム処理には、こちらを使用してください。
+ *
+ *      [XPicoAllocatorとの違い]
+ *
+ *      + 確保、解放の実行時間がO(1)
+ *      + 解放時に物理的に隣接する空きブロックと即座に結合する
+ *      + 各ブロックに直前のブロックへのポインタを持つので、ブロック毎の管理領域
+ *        がポインタ1つ分大きい
+ *      + 空きリストの先頭を保持する配列の分だけ、管理構造体が大きい
+ *      + xtalloc_reallocate()は後ろの空きブロックを取り込んで、その場で拡張で
+ *        きる
+ *
+ *
+ *     @author  MaskedW
+ *
+ *   @internal
+ *     Created  2026/10/17
+ * ===================================================================
+ */
+
+/*
+ * License: MIT license
+ * Copyright (c) <2015> <MaskedW [maskedw00@gmail.com]>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef picox_allocator_xtlsf_allocator_h_
+#define picox_allocator_xtlsf_allocator_h_
+
+
+#include <picox/core/xcore.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#if (X_CONF_XTALLOC_FL_COUNT < 1) || (X_CONF_XTALLOC_FL_COUNT > 32)
+    #error X_CONF_XTALLOC_FL_COUNT must be between 1 and 32
+#endif
+
+
+/** 第2レベルの分割数です
+ */
+#define X_TLSF_SL_COUNT     (16)
+
+
+/** TLSFメモリアロケータ管理クラスです
+ */
+typedef struct XTlsfAllocator
+{
+/// privatesection
+    uint8_t*        heap;
+    uint8_t*        top;
+    size_t          capacity;
+    size_t          reserve;
+    size_t          alignment;
+    size_t          max_used;
+    bool            ownmemory;
+    int             align_shift;
+    uint32_t        fl_bitmap;
+    uint32_t        sl_bitmap[X_CONF_XTALLOC_FL_COUNT];
+    void*           blocks[X_CONF_XTALLOC_FL_COUNT][X_TLSF_SL_COUNT];
+} XTlsfAllocator;
+
+
+/** メモリブロックを初期化します
+ *
+ *  @param heap         heapとして利用するメモリ領域
+ *  @param size         heap領域のサイズ
+ *  @param alignment    allocatorが返すメモリアドレスのアライメント
+ *
+ *  heap == NULLの場合はsizeバイトのメモリをx_malloc()で確保します。
+ *
+ *  @pre
+ *  + heapをアライメント調整したあとのサイズが、管理領域2つ分より大きいこと
+ *  + alignment == 2のべき乗
+ *
+ *  @retval true    初期化成功
+ *  @retval false   メモリ確保失敗
+ *
+ *  @note
+ *  alignmentは内部的に最低でもX_ALIGN_OF(size_t)まで切り上げられます。管理でき
+ *  る最大のブロックサイズは2^(X_CONF_XTALLOC_FL_COUNT + log2(alignment) + 3)未
+ *  満(最大2GB未満)で、それを越えるヒープの末尾は使用されません。
+ */
+bool xtalloc_init(XTlsfAllocator* self, void* heap, size_t size, size_t alignment);
+
+
+/** オブジェクトの終了処理を行います
+ */
+void xtalloc_deinit(XTlsfAllocator* self);
+
+
+/** ヒープからsizeバイトのメモリを切り出して返します
+ *
+ *  @pre
+ *  + size > 0
+ */
+void* xtalloc_allocate(XTlsfAllocator* self, size_t size);
+
+
+/** realloc()相当の処理を行います
+ *
+ *  縮小する場合と、後ろに隣接する空きブロックを取り込めば足りる場合は、メモリ
+ *  の移動を行わずにold_memをそのまま返します。
+ */
+void* xtalloc_reallocate(XTlsfAllocator* self, void* old_mem, size_t size);
+
+
+/** ヒープにメモリを返却します
+ *
+ *  @pre
+ *  + xtalloc_is_owner(self, ptr) == true
+ *  @note
+ *  ptr == NULLの時は何もしません。
+ */
+void xtalloc_deallocate(XTlsfAllocator* self, void* ptr);
+
+
+/** ヒープを初期状態に戻します
+ */
+void xtalloc_clear(XTlsfAllocator* self);
+
+
+/** ヒープメモリ自身を返します
+ */
+uint8_t* xtalloc_heap(const XTlsfAllocator* self);
+
+
+/** 空きメモリバイト数を返します
+ */
+size_t xtalloc_reserve(const XTlsfAllocator* self);
+
+
+/** ヒープのサイズを返します
+ */
+size_t xtalloc_capacity(const XTlsfAllocator* self);
+
+
+/** ヒープの最大使用バイト数を返します
+ */
+size_t xtalloc_max_used(const XTlsfAllocator* self);
+
+
+/** nバイトのメモリ確保を行った場合に必要な余分なメモリサイズを返します。
+ */
+size_t xtalloc_allocation_overhead(const XTlsfAllocator* self, size_t n);
+
+
+/** ヒープの空きブロック走査用コールバック関数です
+ *
+ *  @param chunk    空きブロックのポインタ
+ *  @param size     空きブロックのサイズ
+ *  @param user     ユーザーデータポインタ
+ */
+typedef void (*XTlsfAllocatorWalker)(const uint8_t* chunk, size_t size, void* user);
+
+
+/** ヒープ内の空きブロックをアドレス順に走査し、ブロックごとにwalkerを呼び出します
+ *
+ *  デバッグ用です。walkerがデータを収集することで、断片化状況等を確認できます。
+ *
+ *  @param walker   空きブロック検出毎に呼び出される関数
+ *  @param user     walker呼び出し時に渡されるポインタ
+ */
+void xtalloc_walk_heap(const XTlsfAllocator* self, XTlsfAllocatorWalker walker, void* user);
+
+
+/** ポインタがヒープ領域の範囲内かどうかを返します。
+ */
+bool xtalloc_is_owner(const XTlsfAllocator* self, const void* ptr);
+
+
+#if X_CONF_USE_XTALLOC_MALLOC
+
+
+/** x_malloc()のバックエンドとして使用するヒープを初期化します
+ *
+ *  X_CONF_USE_XTALLOC_MALLOCが有効な場合、x_malloc(), x_free()はこの関数で初期
+ *  化したXTlsfAllocatorからメモリを確保します。初期化前のx_malloc()はNULLを返
+ *  します。
+ *
+ *  @pre
+ *  + heap != NULL
+ */
+bool xtalloc_init_global(void* heap, size_t size);
+
+
+/** x_malloc()のバックエンドとして使用しているアロケータを返します
+ */
+XTlsfAllocator* xtalloc_global(void);
+
+
+/** X_CONF_MALLOCから呼び出される確保関数です
+ */
+void* xtalloc_global_allocate(size_t size);
+
+
+/** X_CONF_FREEから呼び出される解放関数です
+ */
+void xtalloc_global_deallocate(void* ptr);
+
+
+#endif /* if X_CONF_USE_XTALLOC_MALLOC */
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // picox_allocator_xtlsf_allocator_h_
@@ -321,6 +321,40 @@ xcbuf_push_back_n(XCircularBuffer* self, const void* src, size_t n)
 }
 
 
+/** @brief バッファ末尾に続く、連続した空き領域を返します
+ *
+ *  @param o_size 戻り値から連続して書き込めるバイト数の格納先
+ *
+ *  空き領域に直接書き込んだデータは、xcbuf_commit_back_n()でバッファ末尾に追加
+ *  できます。
+ */
+static inline uint8_t*
+xcbuf_back_space(XCircularBuffer* self, size_t* o_size)
+{
+    if (xcbuf_full(self))
+        *o_size = 0;
+    else
+        *o_size = ((self->m_first <= self->m_last) ? self->m_end : self->m_first) - self->m_last;
+
+    return self->m_last;
+}
+
+
+/** @brief xcbuf_back_space()の領域に書き込んだnバイトをバッファ末尾に追加します
+ *
+ *  @pre
+ *  + n <= xcbuf_back_space()で得られたバイト数
+ */
+static inline void
+xcbuf_commit_back_n(XCircularBuffer* self, size_t n)
+{
+    X_ASSERT(n <= xcbuf_reserve(self));
+
+    self->m_last = XCBUF__ADD(self->m_last, n);
+    self->m_size += n;
+}
+
+
 /** @brief バッファ先頭に要素を追加します
  *
  *  バッファが満タンの場合は後方要素が除去されます
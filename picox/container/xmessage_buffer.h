@@ -70,6 +70,12 @@ typedef union XMessageHeader
 } XMessageHeader;
 
 
+/* xmsgbuf_commit()がリングバッファの終端に挿入する詰め物のヘッダに立てるビッ
+ * トです
+ */
+#define XMSGBUF__PADDING_FLAG   ((size_t)1 << (sizeof(size_t) * CHAR_BIT - 1))
+
+
 /** @brief 可変長バイトデータの管理構造体
  *
  *  @note
@@ -184,6 +190,57 @@ xmsgbuf_full(const XMessageBuffer* self)
 }
 
 
+/* posからヘッダを読み込み、ヘッダの次の位置を返します */
+static inline size_t
+xmsgbuf__read_header(const XMessageBuffer* self, size_t pos, XMessageHeader* o_header)
+{
+    int i;
+    for (i = 0; i < (int)sizeof(XMessageHeader); i++)
+    {
+        o_header->bytes[i] = self->data[pos++];
+        if (pos == self->capacity)
+            pos = 0;
+    }
+
+    return pos;
+}
+
+
+/* posへヘッダを書き込み、ヘッダの次の位置を返します */
+static inline size_t
+xmsgbuf__write_header(XMessageBuffer* self, size_t pos, const XMessageHeader* header)
+{
+    int i;
+    for (i = 0; i < (int)sizeof(XMessageHeader); i++)
+    {
+        self->data[pos++] = header->bytes[i];
+        if (pos == self->capacity)
+            pos = 0;
+    }
+
+    return pos;
+}
+
+
+/* 先頭が詰め物であれば読み飛ばします */
+static inline void
+xmsgbuf__skip_padding(XMessageBuffer* self)
+{
+    XMessageHeader header;
+
+    if (self->size == 0)
+        return;
+
+    xmsgbuf__read_header(self, self->first, &header);
+    if (header.size & XMSGBUF__PADDING_FLAG)
+    {
+        header.size &= ~XMSGBUF__PADDING_FLAG;
+        self->first = (self->first + sizeof(XMessageHeader) + header.size) % self->capacity;
+        self->size -= sizeof(XMessageHeader) + header.size;
+    }
+}
+
+
 /** @brief 先頭メッセージのバイト数を返します
  */
 static inline size_t
@@ -228,6 +285,13 @@ xmsgbuf_num(const XMessageBuffer* self)
             if (first == self->capacity)
                 first = 0;
         }
+        if (hdr.size & XMSGBUF__PADDING_FLAG)
+        {
+            hdr.size &= ~XMSGBUF__PADDING_FLAG;
+            size -= (sizeof(XMessageHeader) + hdr.size);
+            first = (first + hdr.size) % self->capacity;
+            continue;
+        }
         size -= (sizeof(XMessageHeader) + hdr.size);
         first = (first + hdr.size) % self->capacity;
         n++;
@@ -260,6 +324,7 @@ xmsgbuf_skip(XMessageBuffer* self)
     first = (first + hdr.size) % self->capacity;
     self->size -= sizeof(XMessageHeader) + hdr.size;
     self->first = first;
+    xmsgbuf__skip_padding(self);
 }
 
 
@@ -362,11 +427,132 @@ xmsgbuf_pull(XMessageBuffer* self, void* dst)
         pos = 0;
     self->first = pos;
     self->size -= header.size + sizeof(XMessageHeader);
+    xmsgbuf__skip_padding(self);
 
     return header.size;
 }
 
 
+/** @brief メッセージを直接書き込むための、sizeバイトの連続した領域を返します
+ *
+ *  書き込み後にxmsgbuf_commit()を呼び出すと、メッセージとしてバッファに追加され
+ *  ます。xmsgbuf_commit()を呼び出すまでは、他のメッセージを追加してはいけませ
+ *  ん。
+ *
+ *  領域がリングバッファの終端をまたぐ場合は、終端までを詰め物として読み飛ばし、
+ *  バッファの先頭から領域を確保します。そのため、xmsgbuf_reserve()が
+ *  size + sizeof(XMessageHeader)以上であっても、NULLが返る場合があります。
+ *
+ *  @pre
+ *  + size > 0
+ *
+ *  @retval NULL 連続した空き領域が足りない
+ */
+static inline uint8_t*
+xmsgbuf_prepare(XMessageBuffer* self, size_t size)
+{
+    X_ASSERT(self);
+    X_ASSERT(size > 0);
+
+    size_t pos;
+
+    /* 空であれば先頭から詰め直して、連続した領域を確保しやすくする */
+    if (self->size == 0)
+        self->first = self->last = 0;
+
+    pos = self->last + sizeof(XMessageHeader);
+    if (pos >= self->capacity)
+        pos -= self->capacity;
+
+    if (pos + size <= self->capacity)
+    {
+        if (xmsgbuf_reserve(self) < sizeof(XMessageHeader) + size)
+            return NULL;
+        return self->data + pos;
+    }
+
+    /* 終端までの詰め物の後ろに、先頭からヘッダとメッセージを配置する。終端まで
+     * に詰め物のヘッダを置けない場合は、バッファが空になるまで待つしかない。
+     */
+    if (self->last + sizeof(XMessageHeader) > self->capacity)
+        return NULL;
+    if (xmsgbuf_reserve(self) < (self->capacity - self->last) + sizeof(XMessageHeader) + size)
+        return NULL;
+
+    return self->data + sizeof(XMessageHeader);
+}
+
+
+/** @brief xmsgbuf_prepare()で確保した領域のsizeバイトをメッセージとして追加します
+ *
+ *  @param msg  xmsgbuf_prepare()が返した領域
+ *  @param size メッセージのバイト数
+ *
+ *  @pre
+ *  + 0 < size <= xmsgbuf_prepare()に指定したバイト数
+ */
+static inline void
+xmsgbuf_commit(XMessageBuffer* self, const uint8_t* msg, size_t size)
+{
+    X_ASSERT(self);
+    X_ASSERT(msg);
+    X_ASSERT(size > 0);
+
+    XMessageHeader header;
+    size_t pos = self->last + sizeof(XMessageHeader);
+    if (pos >= self->capacity)
+        pos -= self->capacity;
+
+    if (msg != self->data + pos)
+    {
+        header.size = (self->capacity - pos) | XMSGBUF__PADDING_FLAG;
+        xmsgbuf__write_header(self, self->last, &header);
+        self->size += self->capacity - self->last;
+        self->last = 0;
+    }
+
+    header.size = size;
+    pos = xmsgbuf__write_header(self, self->last, &header);
+    X_ASSERT(msg == self->data + pos);
+
+    pos += size;
+    if (pos == self->capacity)
+        pos = 0;
+    self->last = pos;
+    self->size += sizeof(XMessageHeader) + size;
+}
+
+
+/** @brief 先頭メッセージのアドレスを返します
+ *
+ *  メッセージはバッファから取り除かれません。
+ *  xmsgbuf_push()で追加したメッセージはリングバッファの終端をまたいで格納されて
+ *  いる可能性があるため、xmsgbuf_commit()で追加したメッセージにのみ使用してくだ
+ *  さい。
+ *
+ *  @param o_size   メッセージのバイト数の格納先
+ *  @retval NULL    バッファが空
+ */
+static inline uint8_t*
+xmsgbuf_peek(const XMessageBuffer* self, size_t* o_size)
+{
+    X_ASSERT(self);
+    X_ASSERT(o_size);
+
+    XMessageHeader header;
+    size_t pos;
+
+    if (xmsgbuf_empty(self))
+        return NULL;
+
+    pos = xmsgbuf__read_header(self, self->first, &header);
+    X_ASSERT(pos + header.size <= self->capacity);
+    *o_size = header.size;
+
+    return self->data + pos;
+}
+
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -37,6 +37,9 @@
  */
 
 #include <picox/core/xcore.h>
+#if X_CONF_USE_XTALLOC_MALLOC
+#include <picox/allocator/xtlsf_allocator.h>
+#endif
 
 
 
@@ -38,23 +38,68 @@
  */
 
 
+/* X_CONF_FIBER_STACK_GUARD使用時のMAP_ANONYMOUSとmincore()は、glibcでは
+ * _POSIX_C_SOURCEだけでは宣言されない。
+ */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE
+#endif
+
+
 #include <picox/multitask/xfiber.h>
 #include <picox/container/xintrusive_list.h>
 #include <picox/container/xcircular_buffer.h>
 #include <picox/container/xmessage_buffer.h>
 #include <picox/allocator/xpico_allocator.h>
 #include <picox/allocator/xfixed_allocator.h>
+#include <picox/allocator/xstack_allocator.h>
+#include <picox/allocator/xtlsf_allocator.h>
 #include <picox/multitask/xvtimer.h>
 
 
 #define X__NODE_TO_FIBER(node)     xnode_entry(node, XFiber, m_node)
+#define X__IS_VALID_WAIT_MODE(mode) \
+    (((mode) == X_FIBER_WAIT_FIFO) || ((mode) == X_FIBER_WAIT_PRIORITY))
+#define X__QUEUE_CAN_SEND(queue) \
+    (!(queue)->m_reserving && (xcbuf_reserve(&(queue)->m_buffer) >= (queue)->m_item_size))
+#define X__QUEUE_CAN_RECEIVE(queue) \
+    (!(queue)->m_peeking && (xcbuf_size(&(queue)->m_buffer) >= (queue)->m_item_size))
+#define X__CHANNEL_CAN_RECEIVE(channel) \
+    (!(channel)->m_peeking && !xmsgbuf_empty(&(channel)->m_buffer))
+#define X__HAS_WAITERS(object) \
+    (!xilist_empty(&(object)->m_pending_tasks) || !xilist_empty(&(object)->m_selectors))
+/* 割込みハンドラとファイバーの間でロックなしで共有する変数へのアクセスです。
+ * GCC互換コンパイラではメモリバリアを伴うアトミック操作を使用します。それ以外
+ * ではシングルコアを前提に、volatileアクセスで代用します。
+ */
+#if defined(__GNUC__)
+    #define X__ATOMIC_LOAD(ptr)             __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+    #define X__ATOMIC_STORE(ptr, value)     __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+    #define X__ATOMIC_EXCHANGE(ptr, value)  __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#else
+    #define X__ATOMIC_LOAD(ptr)             (*(ptr))
+    #define X__ATOMIC_STORE(ptr, value)     (void)(*(ptr) = (value))
+    #define X__ATOMIC_EXCHANGE(ptr, value)  X__AtomicExchange((ptr), (value))
+#endif
+/* カーネルのヒープに使用するアロケータです */
+#if X_CONF_FIBER_USE_TLSF_HEAP
+    typedef XTlsfAllocator                  X__HeapAllocator;
+    #define X__HEAP_INIT(a, heap, size)     xtalloc_init((a), (heap), (size), X_ALIGN_OF(XMaxAlign))
+    #define X__HEAP_ALLOCATE(a, size)       xtalloc_allocate((a), (size))
+    #define X__HEAP_DEALLOCATE(a, ptr)      xtalloc_deallocate((a), (ptr))
+#else
+    typedef XPicoAllocator                  X__HeapAllocator;
+    #define X__HEAP_INIT(a, heap, size)     xpalloc_init((a), (heap), (size), X_ALIGN_OF(XMaxAlign))
+    #define X__HEAP_ALLOCATE(a, size)       xpalloc_allocate((a), (size))
+    #define X__HEAP_DEALLOCATE(a, ptr)      xpalloc_deallocate((a), (ptr))
+#endif
 #define X__CHECK_POLL(timeout)       \
     do                                  \
     {                                   \
         if ((timeout) == 0)             \
         {                               \
             err = X_ERR_TIMED_OUT;      \
-            X_FIBER_EXIT_CRITICAL();    \
+            X__EXIT_CRITICAL();         \
             goto x__exit;               \
         }                               \
     } while (0)
@@ -78,16 +123,137 @@
     typedef ucontext_t              XFiberContext;
 
 #elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_PLATFORM_DEPEND
-    #error not implemented yet
+
+    #if !defined(__GNUC__) || !(defined(__x86_64__) || defined(__aarch64__))
+        #error X_FIBER_IMPL_TYPE_PLATFORM_DEPEND supports only x86-64 and AArch64 with GCC compatible compilers
+    #endif
+
+    /* 呼び出し先保存レジスタは全てスタックに退避するので、コンテキストはスタ
+     * ックポインタだけで表現できる。
+     */
+    struct XFiberContext
+    {
+        void*       m_sp;
+    };
+
+    typedef struct XFiberContext    XFiberContext;
+
 #else
     #error invalid configuration
 #endif
 
 
+#if X_CONF_FIBER_STACK_GUARD
+
+    #if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
+        #error X_CONF_FIBER_STACK_GUARD requires a fiber implementation with per-fiber stacks
+    #endif
+
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+        #define MAP_ANONYMOUS   MAP_ANON
+    #endif
+
+#endif
+
+
+#if X_CONF_FIBER_USE_EPOLL
+
+    #include <sys/epoll.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <errno.h>
+
+    /* 1回のepoll_wait()で受け取るイベント数の上限 */
+    #define X__IO_MAX_EVENTS    (16)
+
+#endif
+
+
+/* 仮想時刻ではアイドル時にだけ時刻を進めるので、現在時刻は前回の更新時刻のま
+ * まになる
+ */
+#if X_CONF_FIBER_VIRTUAL_TICKS
+    #define X__TICKS_NOW()      (priv->m_timepoint)
+#else
+    #define X__TICKS_NOW()      x_ticks_now()
+#endif
+
+
+/* 生成済みの全ファイバーをカーネルのリストで管理するかどうか */
+#define X__TRACK_FIBERS     (X_CONF_FIBER_USE_STATS || X_CONF_FIBER_STACK_GUARD)
+
+
+#if X_CONF_FIBER_USE_SMP
+
+    #if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
+        #error X_CONF_FIBER_USE_SMP requires a fiber implementation with per-fiber stacks
+    #endif
+
+    #include <pthread.h>
+    #include <time.h>
+    #define X__MAX_WORKERS      X_CONF_FIBER_SMP_MAX_WORKERS
+
+    /* X_FIBER_ENTER_CRITICALに加えて、全ワーカーで共有するカーネルロックを獲
+     * 得する。
+     */
+    #define X__ENTER_CRITICAL()                             \
+        do                                                  \
+        {                                                   \
+            X_FIBER_ENTER_CRITICAL();                       \
+            pthread_mutex_lock(&x_g_fiber_kernel.m_lock);   \
+        } while (0)
+
+    /* ワーカーへの通知はロックの解放後に送る */
+    #define X__EXIT_CRITICAL()                              \
+        do                                                  \
+        {                                                   \
+            pthread_mutex_unlock(&x_g_fiber_kernel.m_lock); \
+            X__FlushWakeups();                              \
+            X_FIBER_EXIT_CRITICAL();                        \
+        } while (0)
+
+#else
+
+    #define X__MAX_WORKERS      (1)
+    #define X__ENTER_CRITICAL   X_FIBER_ENTER_CRITICAL
+    #define X__EXIT_CRITICAL    X_FIBER_EXIT_CRITICAL
+
+#endif
+
+
+#if (X_FIBER_PRIORITY_MAX < 1) || (X_FIBER_PRIORITY_MAX > 32)
+    #error X_CONF_FIBER_PRIORITY_MAX must be in the range 1 to 32
+#endif
+
+
+/* レディキューの空でない優先度を表すビットマップです。優先度がpのキューが空で
+ * なければbit pがセットされ、最上位のセットビットが次に実行する優先度になりま
+ * す。
+ */
+#if X_FIBER_PRIORITY_MAX <= 8
+    typedef uint_fast8_t    X__PriorityMap;
+    #define X__FIND_HIGHEST_PRIORITY(map)   x_find_msb_pos8(map)
+#else
+    typedef uint32_t        X__PriorityMap;
+    #if X_GNUC_PREREQ(3, 4)
+        /* clz命令に展開されるので、優先度数によらずO(1)で求まる */
+        #define X__FIND_HIGHEST_PRIORITY(map) \
+            ((int)(sizeof(unsigned long) * CHAR_BIT - 1) - __builtin_clzl((unsigned long)(map)))
+    #else
+        #define X__FIND_HIGHEST_PRIORITY(map)   x_find_msb_pos32(map)
+    #endif
+#endif
+
+#define X__PRIORITY_BIT(priority)   ((X__PriorityMap)1 << (priority))
+
+
 typedef enum
 {
     X_FIBER_STATE_READY,
     X_FIBER_STATE_RUNNING,
+    X_FIBER_STATE_EXITED,
     X_FIBER_STATE_WAITING_EVENT,
     X_FIBER_STATE_WAITING_DELAY,
     X_FIBER_STATE_WAITING_SIGNAL,
@@ -96,9 +262,17 @@ typedef enum
     X_FIBER_STATE_WAITING_SEND_CHANNEL,
     X_FIBER_STATE_WAITING_RECV_CHANNEL,
     X_FIBER_STATE_WAITING_MUTEX,
+    X_FIBER_STATE_WAITING_READ_LOCK,
+    X_FIBER_STATE_WAITING_WRITE_LOCK,
+    X_FIBER_STATE_WAITING_COND,
     X_FIBER_STATE_WAITING_SEMAPHORE,
     X_FIBER_STATE_WAITING_RECV_MAILBOX,
     X_FIBER_STATE_WAITING_POOL,
+    X_FIBER_STATE_WAITING_RECV_RING,
+    X_FIBER_STATE_WAITING_SELECT,
+    X_FIBER_STATE_WAITING_JOIN,
+    X_FIBER_STATE_WAITING_FUTURE,
+    X_FIBER_STATE_WAITING_IO,
     X_FIBER_STATE_SUSPEND = (1 << 8),
     X_FIBER_STATE_SUSPEND_AND_WAITING_EVENT        = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_EVENT,
     X_FIBER_STATE_SUSPEND_AND_WAITING_DELAY        = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_DELAY,
@@ -108,9 +282,17 @@ typedef enum
     X_FIBER_STATE_SUSPEND_AND_WAITING_SEND_CHANNEL = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_SEND_CHANNEL,
     X_FIBER_STATE_SUSPEND_AND_WAITING_RECV_CHANNEL = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_RECV_CHANNEL,
     X_FIBER_STATE_SUSPEND_AND_WAITING_MUTEX        = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_MUTEX,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_READ_LOCK    = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_READ_LOCK,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_WRITE_LOCK   = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_WRITE_LOCK,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_COND         = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_COND,
     X_FIBER_STATE_SUSPEND_AND_WAITING_SEMAPHORE    = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_SEMAPHORE,
     X_FIBER_STATE_SUSPEND_AND_WAITING_RECV_MAILBOX = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_RECV_MAILBOX,
     X_FIBER_STATE_SUSPEND_AND_WAITING_POOL         = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_POOL,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_RECV_RING    = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_RECV_RING,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_SELECT       = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_SELECT,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_JOIN         = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_JOIN,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_FUTURE       = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_FUTURE,
+    X_FIBER_STATE_SUSPEND_AND_WAITING_IO           = X_FIBER_STATE_SUSPEND | X_FIBER_STATE_WAITING_IO,
 } XFiberState;
 
 
@@ -118,9 +300,11 @@ typedef enum
 
 #define X_FIBER_IS_READY(state)             ((state) == X_FIBER_STATE_READY)
 #define X_FIBER_IS_RUNNING(state)           ((state) == X_FIBER_STATE_RUNNING)
+#define X_FIBER_IS_EXITED(state)            ((state) == X_FIBER_STATE_EXITED)
 #define X_FIBER_IS_SUSPEND(state)           ((state) & X_FIBER_STATE_SUSPEND)
 #define X_FIBER_IS_WAITING_SUSPEND(state)   ((state) >= X_FIBER_STATE_SUSPEND_AND_WAITING_EVENT)
 #define X_FIBER_IS_WAITING(state)           (((state) & 0xFF) >= X_FIBER_STATE_WAITING_EVENT)
+#define X_FIBER_WAITING_KIND(state)         ((state) & 0xFF)
 
 
 struct XFiberObject;
@@ -145,6 +329,9 @@ typedef enum
     X_FIBER_OBJTYPE_SEMAPHORE,
     X_FIBER_OBJTYPE_MAILBOX,
     X_FIBER_OBJTYPE_POOL,
+    X_FIBER_OBJTYPE_RWLOCK,
+    X_FIBER_OBJTYPE_COND,
+    X_FIBER_OBJTYPE_RING,
     X_FIBER_OBJTYPE_END,
 } XFiberObjectType;
 
@@ -157,7 +344,13 @@ typedef enum
 
 #define X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS \
     X_DECLAER_FIBER_OBJECT_COMMON_MEMBERS;         \
-    XIntrusiveList      m_pending_tasks
+    XIntrusiveList      m_pending_tasks;           \
+    XIntrusiveList      m_selectors;               \
+    XMode               m_wait_mode
+
+
+struct X__Worker;
+struct X__SelectWaiter;
 
 
 struct XFiber
@@ -166,6 +359,7 @@ struct XFiber
     X_DECLAER_FIBER_OBJECT_COMMON_MEMBERS;
     size_t              m_stack_size;
     int                 m_priority;
+    int                 m_base_priority;
     XFiberFunc          m_func;
     void*               m_arg;
     uint8_t*            m_stack;
@@ -185,16 +379,89 @@ struct XFiber
     const void*         m_pending_send_src;
     void*               m_pending_recv_dst;
     size_t              m_channel_item_size;
+    void*               m_zero_copy_ptr;
+
+    /* 優先度継承のために、獲得中のミューテックスと獲得待ちのミューテックスを
+     * 保持する
+     */
+    XIntrusiveList      m_held_mutexes;
+    struct XFiberMutex* m_waiting_mutex;
+
+    /* 待ち状態の間に優先度が変わった時に、待ちリスト内の位置を更新する */
+    XIntrusiveList*     m_wait_list;
+    XMode               m_wait_mode;
+
+    /* xfiber_select()で待っているオブジェクトごとの待ちノードと、待ちを解除し
+     * たオブジェクトのインデックス
+     */
+    struct X__SelectWaiter* m_select_waiters;
+    int                 m_select_num;
+    int                 m_select_index;
+
+#if X_CONF_FIBER_LOCAL_STORAGE_SIZE > 0
+    void*               m_local[X_CONF_FIBER_LOCAL_STORAGE_SIZE];
+#endif
+
+    /* 合流可能なタスクの終了ステータスと、合流を待っているタスク */
+    int                 m_exit_status;
+    bool                m_detached;
+    bool                m_joining;
+    XIntrusiveList      m_joiners;
+
+    /* xfiber_arena_create()で生成したアリーナ。管理領域の直後にメモリを配置し
+     * ている
+     */
+    XStackAllocator*    m_arena;
+
+#if X_CONF_FIBER_USE_EPOLL
+    /* epollに登録中のファイルディスクリプタ(未登録なら-1)と、準備のできたイ
+     * ベント
+     */
+    int                 m_io_fd;
+    XMode               m_io_events;
+#endif
+
+#if X__TRACK_FIBERS
+    XIntrusiveNode      m_fiber_node;
+#endif
+#if X_CONF_FIBER_USE_STATS
+    XFiberStats         m_stats;
+
+    /* ディスパッチされた時刻、または待ち状態に入った時刻 */
+    XTicks              m_stats_timepoint;
+
+    /* 待ち状態に入った時の待ち要因。待ち状態でなければ-1 */
+    int                 m_stats_wait_kind;
+#endif
+
+#if X_CONF_FIBER_USE_SMP
+    /* レディキューを所有するワーカー。スティールされると移動する */
+    struct X__Worker*   m_worker;
+
+    /* コンテキストの退避が完了するまでは別のワーカーで再開してはならない */
+    bool                m_on_cpu;
+#endif
 };
 
 
 struct XFiberWaitObject
 {
-    X_DECLAER_FIBER_OBJECT_COMMON_MEMBERS;
-    XIntrusiveList      m_pending_tasks;
+    X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
 };
 
 
+/* xfiber_select()の待ちノードです。待ち対象のオブジェクトのm_selectorsにつな
+ * がります。
+ */
+typedef struct X__SelectWaiter
+{
+    XIntrusiveNode      m_node;
+    XFiber*             m_fiber;
+    int                 m_index;
+    XFiberSelectItem    m_item;
+} X__SelectWaiter;
+
+
 struct XFiberEvent
 {
     X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
@@ -207,6 +474,12 @@ struct XFiberQueue
     X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
     XCircularBuffer     m_buffer;
     size_t              m_item_size;
+
+    /* 末尾の要素を確保中、または先頭の要素を参照中であることを示す。確保中は他
+     * の送信を、参照中は他の受信を待たせる。
+     */
+    bool                m_reserving;
+    bool                m_peeking;
 };
 
 
@@ -215,6 +488,11 @@ struct XFiberChannel
     X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
     XMessageBuffer      m_buffer;
     size_t              m_max_item_size;
+
+    /* 確保中のメッセージ領域と、先頭のメッセージを参照中であることを示す */
+    uint8_t*            m_reserved;
+    size_t              m_reserved_size;
+    bool                m_peeking;
 };
 
 
@@ -222,6 +500,22 @@ struct XFiberMutex
 {
     X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
     XFiber*             m_holder;
+    XIntrusiveNode      m_held_node;
+};
+
+
+struct XFiberRwLock
+{
+    X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
+    XFiber*             m_writer;
+    int                 m_num_readers;
+    bool                m_prefer_writer;
+};
+
+
+struct XFiberCond
+{
+    X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
 };
 
 
@@ -246,48 +540,216 @@ struct XFiberPool
 };
 
 
-typedef struct X__Kernel
+/* m_headは送信側(割込みハンドラ)だけが、m_tailは受信側だけが書き換える。どち
+ * らも単調増加させ、m_maskで要素位置に変換する。
+ */
+struct XFiberRing
+{
+    X_DECLAER_FIBER_WAIT_OBJECT_COMMON_MEMBERS;
+    XIntrusiveNode      m_ring_node;
+    uint8_t*            m_data;
+    size_t              m_item_size;
+    size_t              m_mask;
+    volatile size_t     m_head;
+    volatile size_t     m_tail;
+};
+
+
+/* エグゼキューターの投入キューの要素です。m_funcがNULLのジョブはワーカーへの
+ * 終了要求です。
+ */
+typedef struct X__ExecutorJob
+{
+    XFiberJobFunc       m_func;
+    void*               m_arg;
+    XFiberFuture*       m_future;
+} X__ExecutorJob;
+
+
+struct XFiberExecutor
+{
+    XFiberQueue*        m_jobs;
+    XFiber**            m_workers;
+    int                 m_num_workers;
+};
+
+
+/* スケジューラの実行単位です。
+ * SMPモードではOSスレッドごとに1つ割り当てられ、それぞれがレディキューを持ちま
+ * す。非SMPモードではワーカーは1つだけです。
+ */
+typedef struct X__Worker
 {
     XFiber*             m_cur_task;
-    uint_fast8_t        m_priority_map;
+    X__PriorityMap      m_priority_map;
     XIntrusiveList      m_ready_queue[X_FIBER_PRIORITY_MAX];
+    XFiberContext       m_return_ctx;
+#if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
+    uint8_t*            m_machine_stack_begin;
+#endif
+#if X_CONF_FIBER_USE_SMP || X_CONF_FIBER_STACK_GUARD
+    XFiber*             m_zombie;
+#endif
+#if X_CONF_FIBER_USE_SMP
+    XFiber*             m_prev_task;
+    pthread_t           m_thread;
+    int                 m_id;
+
+    /* 実行可能なファイバーがない間は、他のワーカーから通知されるまでm_wakeup
+     * で休止する */
+    pthread_cond_t      m_wakeup;
+    bool                m_sleeping;
+
+    /* カーネルロックの解放後にm_wakeupへ通知する */
+    volatile int        m_wake_pending;
+#endif
+} X__Worker;
+
+
+typedef struct X__Kernel
+{
+    X__Worker           m_workers[X__MAX_WORKERS];
     XIntrusiveList      m_delay_queue;
-    XPicoAllocator      m_alloc;
+    X__HeapAllocator    m_alloc;
     XFiberIdleHook      m_idlehook;
-    XFiberContext       m_return_ctx;
     XTicks              m_timepoint;
     XVTimer             m_vtimer;
     int                 m_num_objects[X_FIBER_OBJTYPE_END];
-#if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
-    uint8_t*            m_machine_stack_begin;
+    XIntrusiveList      m_rings;
+    volatile int        m_ring_pushed;
+#if X_CONF_FIBER_USE_EPOLL
+    int                 m_epoll_fd;
+    XIntrusiveList      m_io_waiters;
+    XTicks              m_io_timepoint;
+#endif
+#if X__TRACK_FIBERS
+    XIntrusiveList      m_fibers;
+#endif
+#if X_CONF_FIBER_USE_STATS
+    uint16_t            m_next_fiber_id;
+#if X_CONF_FIBER_TRACE_SIZE > 0
+    XFiberTraceRecord   m_trace[X_CONF_FIBER_TRACE_SIZE];
+    size_t              m_trace_head;
+    size_t              m_trace_count;
+#endif
+#endif
+#if X_CONF_FIBER_USE_SMP
+    int                 m_num_workers;
+    volatile bool       m_end_request;
+    volatile int        m_wake_pending;
+    pthread_mutex_t     m_lock;
+    pthread_mutex_t     m_alloc_lock;
+    pthread_key_t       m_worker_key;
 #endif
 } X__Kernel;
 
 
+static XError X__CreateFiber(XFiber** o_fiber, int priority, const char* name, size_t stack_size, XFiberFunc func, void* arg, bool detached);
 static void X__PushToReadyQueue(XFiber* fiber);
-static XFiber* X__PopFromReadyQueue(void);
+static XFiber* X__PopFromReadyQueue(X__Worker* w);
+static XFiber* X__WaitForReadyTask(X__Worker* w);
+static void X__UpdateTimer(void);
 static void X__Schedule(void);
 static void X__ReleaseWaiting(XFiber* fiber, XError result);
+#if X_CONF_FIBER_USE_STATS
+static void X__Trace(const XFiber* fiber, XFiberTraceEvent event, int arg);
+static int X__WaitKind(XFiberState state);
+static void X__StatsSwitchOut(XFiber* fiber);
+static void X__StatsSwitchIn(XFiber* fiber, const XFiber* prev);
+#endif
 static void* X__Malloc(size_t size);
 static void X__Free(void* ptr);
+static XFiber* X__AllocFiber(size_t stack_size);
+static void X__FreeFiber(XFiber* fiber);
+#if X_CONF_FIBER_STACK_GUARD
+static void X__ReleaseStack(XFiber* fiber);
+static void X__ReleaseAllStacks(void);
+#endif
+#if X_CONF_FIBER_USE_SMP || X_CONF_FIBER_STACK_GUARD
+static void X__FreeZombie(X__Worker* w);
+#endif
+#if X_CONF_FIBER_STACK_PAINT && (X_CONF_FIBER_IMPL_TYPE != X_FIBER_IMPL_TYPE_COPY_STACK)
+static void X__CheckStack(const XFiber* fiber);
+#endif
 static void X__FiberMain(XFiber* fiber);
 static bool X__TestEvent(XFiberEvent* event, XMode mode, XBits wait_pattern, XBits* result);
 static void X__TimeoutHandler(XFiber* fiber);
 static void X__AddTimerEvent(XFiber* fiber, XFiberTimeEventHandler handler, XTicks time);
-static void X__TransitionIntoWaitState(XIntrusiveList* list, XFiber* fiber, XFiberState state, XTicks timeout);
-static void X__StartSchedule(void);
+static void X__TransitionIntoWaitState(XIntrusiveList* list, XMode wait_mode, XFiber* fiber, XFiberState state, XTicks timeout);
+static void X__InsertPendingTask(XIntrusiveList* list, XMode wait_mode, XFiber* fiber);
+static void X__StartSchedule(X__Worker* w);
 static void X__EndSchedule();
 static void X__MakeContext(XFiber* fiber, XFiberFunc func, void* arg, void* stack, size_t stack_size);
 static void X__SwapContext(XFiber* from, XFiber* to);
 static void X__SetContext(XFiber* to);
 static void* X__ResolvePtr(const XFiber* fiber, const void* ptr);
-static void X__DestroyFiber(XFiber* fiber);
+static void X__UnlinkFiber(XFiber* fiber);
+static bool X__ReleaseJoiners(XFiber* fiber, XError result);
+static void X__ReleaseFiber(XFiber* fiber);
 static void X__PargePendingTasks(XIntrusiveList* list);
+static void X__PargeSelectors(XIntrusiveList* list);
+static bool X__SelectReady(const XFiberSelectItem* item);
+static bool X__NotifySelectors(XIntrusiveList* list);
+static void X__UnlinkSelectWaiters(XFiber* fiber);
+static XFiber* X__PendingReceiver(XIntrusiveList* list, XFiberState state);
+static void* X__QueueReserve(XFiberQueue* queue);
+static void* X__QueuePeek(XFiberQueue* queue);
+static bool X__ServiceQueue(XFiberQueue* queue);
+static size_t X__QueueSendN(XFiberQueue* queue, const uint8_t* src, size_t n, bool* o_released);
+static size_t X__QueueReceiveN(XFiberQueue* queue, uint8_t* dst, size_t n, bool* o_released);
+static uint8_t* X__ChannelPrepare(XFiberChannel* channel, size_t size);
+static void X__ChannelPush(XFiberChannel* channel, uint8_t* msg, const void* src, size_t size);
+static void* X__ChannelPeek(XFiberChannel* channel, size_t* o_size);
+static bool X__ServiceChannel(XFiberChannel* channel);
+static size_t X__ChannelSendN(XFiberChannel* channel, const uint8_t* src, const size_t* sizes, size_t n, bool* o_released);
+static size_t X__ChannelReceiveN(XFiberChannel* channel, uint8_t* dst, size_t dst_size, size_t* o_sizes, size_t n, bool* o_released);
+static bool X__RingPop(XFiberRing* ring, void* dst);
+static void X__ServiceRings(void);
+#if X_CONF_FIBER_USE_EPOLL
+static bool X__PollIo(int timeout_ms);
+static void X__ServiceIo(void);
+#if !X_CONF_FIBER_USE_SMP
+static int X__IoTimeout(XTicks timeout);
+#endif
+#endif
+#if !defined(__GNUC__)
+static int X__AtomicExchange(volatile int* ptr, int value);
+#endif
+static void X__ExecutorWorker(void* arg);
+static void X__CompleteFuture(XFiberFuture* future, void* result);
+static void X__SetPriority(XFiber* fiber, int priority);
+static void X__UpdateInheritedPriority(XFiber* fiber);
+static void X__AcquireMutex(XFiberMutex* mutex, XFiber* fiber);
+static XFiber* X__ReleaseMutex(XFiberMutex* mutex);
+static bool X__ServiceRwLock(XFiberRwLock* rwlock);
+
+#if X_CONF_FIBER_USE_SMP
+static void* X__WorkerThread(void* arg);
+static void X__RunWorker(X__Worker* w);
+static XFiber* X__StealTask(X__Worker* w);
+static void X__FinishSwitch(void);
+static XFiber* X__FindStealable(const X__Worker* w);
+static void X__SleepWorker(X__Worker* w, XTicks timeout);
+static void X__NotifyWorker(X__Worker* owner, bool steal);
+static void X__WakeAllWorkers(void);
+static void X__WakeWorker(X__Worker* w);
+static void X__FlushWakeups(void);
+#endif
 
 #if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
 static void X__GetStackPtr(uint8_t** volatile dst);
 static void X__RestoreStack(XFiber* fiber, uint8_t* addr_in_prev_frame);
 static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end);
+
+/* 復帰先のスタック領域の外側までスタックポインタを進めるための領域を確保する。
+ * 固定長の領域で再帰すると、スタックが深いほど再帰呼び出しの回数が増えてしま
+ * うので、C99であれば可変長配列で一度に進める。
+ */
+#if X_COMPILER_C99
+    #define X__RESTORE_STACK_PADDING(distance)  uint8_t padding[(distance) + 64]
+#else
+    #define X__RESTORE_STACK_PADDING(distance)  uint8_t padding[64]
+#endif
 #endif
 
 
@@ -303,42 +765,223 @@ static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end);
 #endif
 
 
+#if X_CONF_FIBER_USE_STATS
+    #define X__TRACE(fiber, event, arg)         X__Trace(fiber, event, arg)
+    #define X__STATS_SWITCH_OUT(fiber)          X__StatsSwitchOut(fiber)
+    #define X__STATS_SWITCH_IN(fiber, prev)     X__StatsSwitchIn(fiber, prev)
+    #define X__STATS_STACK_USAGE(fiber, usage)                      \
+        do                                                          \
+        {                                                           \
+            if ((usage) > (fiber)->m_stats.max_stack_usage)         \
+                (fiber)->m_stats.max_stack_usage = (usage);         \
+        } while (0)
+#else
+    #define X__TRACE(fiber, event, arg)         (void)0
+    #define X__STATS_SWITCH_OUT(fiber)          (void)0
+    #define X__STATS_SWITCH_IN(fiber, prev)     (void)0
+    #define X__STATS_STACK_USAGE(fiber, usage)  (void)0
+#endif
+
+
+#if X_CONF_FIBER_STACK_PAINT
+    #define X__STACK_PAINT_BYTE     (0xA5)
+    #define X__STACK_CANARY_SIZE    (16)
+#endif
+
+#if X_CONF_FIBER_STACK_PAINT && (X_CONF_FIBER_IMPL_TYPE != X_FIBER_IMPL_TYPE_COPY_STACK)
+    #define X__CHECK_STACK(fiber)   X__CheckStack(fiber)
+#else
+    #define X__CHECK_STACK(fiber)   (void)0
+#endif
+
+
 X__Kernel        x_g_fiber_kernel;
 #define priv    (&x_g_fiber_kernel)
 
 
+#if X_CONF_FIBER_USE_SMP
+
+/* ファイバーはワーカー間を移動するので、TLS変数のアドレスをコンパイラにキャッ
+ * シュさせないように毎回関数呼び出しで取得する。
+ */
+static X__Worker* X__CurWorker(void)
+{
+    X__Worker* const w = pthread_getspecific(priv->m_worker_key);
+    return w ? w : &priv->m_workers[0];
+}
+
+#define X__FIBER_WORKER(fiber)  ((fiber)->m_worker)
+
+#else
+
+X_INLINE X__Worker* X__CurWorker(void)
+{
+    return &priv->m_workers[0];
+}
+
+#define X__FIBER_WORKER(fiber)  (&priv->m_workers[0])
+
+#endif
+
+
 XError xfiber_kernel_init(void* heap, size_t heapsize, XFiberIdleHook idlehook)
 {
     int i;
+    int j;
+
+    for (i = 0; i < X__MAX_WORKERS; ++i)
+    {
+        X__Worker* const w = &priv->m_workers[i];
+        for (j = 0; j < X_FIBER_PRIORITY_MAX; ++j)
+            xilist_init(&w->m_ready_queue[j]);
+        w->m_priority_map = 0;
+        w->m_cur_task = NULL;
+#if X_CONF_FIBER_USE_SMP || X_CONF_FIBER_STACK_GUARD
+        w->m_zombie = NULL;
+#endif
+#if X_CONF_FIBER_USE_SMP
+        w->m_prev_task = NULL;
+        w->m_id = i;
+        w->m_sleeping = false;
+        w->m_wake_pending = 0;
+#endif
+    }
 
-    for (i = 0; i < X_FIBER_PRIORITY_MAX; ++i)
-        xilist_init(&priv->m_ready_queue[i]);
+#if X_CONF_FIBER_USE_SMP
+    {
+        static bool initialized = false;
+        if (!initialized)
+        {
+            pthread_condattr_t attr;
+
+            pthread_mutex_init(&priv->m_lock, NULL);
+            pthread_mutex_init(&priv->m_alloc_lock, NULL);
+            pthread_key_create(&priv->m_worker_key, NULL);
+
+            /* 休止時間はタイマと同じく時刻の変更に影響されないようにする */
+            pthread_condattr_init(&attr);
+            pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+            for (i = 0; i < X__MAX_WORKERS; ++i)
+                pthread_cond_init(&priv->m_workers[i].m_wakeup, &attr);
+            pthread_condattr_destroy(&attr);
+            initialized = true;
+        }
+        priv->m_num_workers = 1;
+        priv->m_end_request = false;
+        priv->m_wake_pending = 0;
+    }
+#endif
 
     xilist_init(&priv->m_delay_queue);
-    xpalloc_init(&priv->m_alloc, heap, heapsize, X_ALIGN_OF(XMaxAlign));
+    X__HEAP_INIT(&priv->m_alloc, heap, heapsize);
     xvtimer_init(&priv->m_vtimer);
     priv->m_idlehook = idlehook;
-    priv->m_priority_map = 0;
     memset(priv->m_num_objects, 0, sizeof(priv->m_num_objects));
+    xilist_init(&priv->m_rings);
+    priv->m_ring_pushed = 0;
+#if X_CONF_FIBER_USE_EPOLL
+    {
+        /* 前回のスケジューラ終了時に待っていたファイバーの登録ごと破棄する */
+        static bool opened = false;
+        if (opened)
+            close(priv->m_epoll_fd);
+        priv->m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        opened = (priv->m_epoll_fd >= 0);
+        if (!opened)
+            return X_ERR_IO;
+        xilist_init(&priv->m_io_waiters);
+        priv->m_io_timepoint = priv->m_timepoint;
+    }
+#endif
+#if X__TRACK_FIBERS
+    xilist_init(&priv->m_fibers);
+#endif
+#if X_CONF_FIBER_USE_STATS
+    priv->m_next_fiber_id = 1;
+    xfiber_trace_clear();
+#endif
 
     return X_ERR_NONE;
 }
 
 
+#if X_CONF_FIBER_USE_SMP
+
+
+XError xfiber_kernel_start_scheduler(void)
+{
+    return xfiber_kernel_start_scheduler_smp(1);
+}
+
+
+XError xfiber_kernel_start_scheduler_smp(int num_workers)
+{
+    XError err = X_ERR_NONE;
+    int i;
+
+    if ((num_workers < 1) || (num_workers > X__MAX_WORKERS))
+        return X_ERR_INVALID;
+
+    X__LOG((X__TAG, "start schedule with %d workers", num_workers));
+
+    priv->m_num_workers = num_workers;
+    priv->m_end_request = false;
+    priv->m_timepoint = X__TICKS_NOW();
+
+    for (i = 1; i < num_workers; ++i)
+    {
+        X__Worker* const w = &priv->m_workers[i];
+        if (pthread_create(&w->m_thread, NULL, X__WorkerThread, w) != 0)
+        {
+            err = X_ERR_OTHER;
+            X__ENTER_CRITICAL();
+            priv->m_end_request = true;
+            X__WakeAllWorkers();
+            X__EXIT_CRITICAL();
+            break;
+        }
+    }
+
+    if (err == X_ERR_NONE)
+        X__RunWorker(&priv->m_workers[0]);
+
+    while (--i > 0)
+        pthread_join(priv->m_workers[i].m_thread, NULL);
+
+    pthread_setspecific(priv->m_worker_key, NULL);
+#if X_CONF_FIBER_STACK_GUARD
+    X__ReleaseAllStacks();
+#endif
+
+    X__LOG((X__TAG, "end schedule"));
+
+    return err;
+}
+
+
+#else
+
+
 XError xfiber_kernel_start_scheduler(void)
 {
+    X__Worker* const w = X__CurWorker();
     X__LOG((X__TAG, "start schedule"));
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        XFiber* fiber = X__PopFromReadyQueue();
+        XFiber* fiber = X__PopFromReadyQueue(w);
         fiber->m_state = X_FIBER_STATE_RUNNING;
-        priv->m_cur_task = fiber;
+        w->m_cur_task = fiber;
+        X__STATS_SWITCH_IN(fiber, NULL);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
-    priv->m_timepoint = x_ticks_now();
-    X__StartSchedule();
+    priv->m_timepoint = X__TICKS_NOW();
+    X__StartSchedule(w);
+#if X_CONF_FIBER_STACK_GUARD
+    X__FreeZombie(w);
+    X__ReleaseAllStacks();
+#endif
 
     X__LOG((X__TAG, "end schedule"));
 
@@ -346,77 +989,426 @@ XError xfiber_kernel_start_scheduler(void)
 }
 
 
+#endif
+
+
 void xfiber_kernel_end_scheduler(void)
 {
+#if X_CONF_FIBER_USE_SMP
+    X__ENTER_CRITICAL();
+    priv->m_end_request = true;
+    X__WakeAllWorkers();
+    X__EXIT_CRITICAL();
+#endif
     X__EndSchedule();
 }
 
 
 XFiber* xfiber_self(void)
 {
-    return priv->m_cur_task;
+    return X__CurWorker()->m_cur_task;
 }
 
 
-void xfiber_yield()
+#if X_CONF_FIBER_LOCAL_STORAGE_SIZE > 0
+
+
+void xfiber_set_local(XFiber* fiber, int index, void* value)
 {
-    X__Schedule();
+    X_ASSERT((index >= 0) && (index < X_CONF_FIBER_LOCAL_STORAGE_SIZE));
+
+    if (!fiber)
+        fiber = X__CurWorker()->m_cur_task;
+    fiber->m_local[index] = value;
 }
 
 
-XError xfiber_create(XFiber** o_fiber,
-                     int priority,
-                     const char* name,
-                     size_t stack_size,
-                     XFiberFunc func,
-                     void* arg)
+void* xfiber_get_local(const XFiber* fiber, int index)
 {
-    XError err = X_ERR_NONE;
-    uint8_t* stack;
-    XFiber* fiber = X__Malloc(x_roundup_multiple(
-                sizeof(XFiber), X_ALIGN_OF(XMaxAlign)) + stack_size);
+    X_ASSERT((index >= 0) && (index < X_CONF_FIBER_LOCAL_STORAGE_SIZE));
 
     if (!fiber)
-    {
-        err = X_ERR_NO_MEMORY;
-        goto x__exit;
-    }
+        fiber = X__CurWorker()->m_cur_task;
+    return fiber->m_local[index];
+}
 
-    stack = ((uint8_t*)fiber) + x_roundup_multiple(
-            sizeof(XFiber), X_ALIGN_OF(XMaxAlign));
 
-    if (name)
-        x_strlcpy(fiber->m_name, name, sizeof(fiber->m_name));
-    else
-        fiber->m_name[0] = '\0';
+#endif
 
-    fiber->m_func = func;
-    fiber->m_arg = arg;
-    fiber->m_stack = stack;
-    fiber->m_stack_size = stack_size;
-    fiber->m_priority = priority;
-    fiber->m_type = X_FIBER_OBJTYPE_TASK;
+
+XError xfiber_arena_create(size_t size)
+{
+    XFiber* const fiber = X__CurWorker()->m_cur_task;
+    const size_t offset = x_roundup_multiple(sizeof(XStackAllocator), X_ALIGN_OF(XMaxAlign));
+    XStackAllocator* arena;
+
+    X_ASSERT(fiber);
+    X_ASSERT(size > 0);
+
+    if (fiber->m_arena)
+        return X_ERR_EXIST;
+
+    arena = X__Malloc(offset + size);
+    if (!arena)
+        return X_ERR_NO_MEMORY;
+
+    xsalloc_init(arena, (uint8_t*)arena + offset, size, X_ALIGN_OF(XMaxAlign));
+    fiber->m_arena = arena;
+
+    return X_ERR_NONE;
+}
+
+
+void* xfiber_arena_alloc(size_t size)
+{
+    XFiber* const fiber = X__CurWorker()->m_cur_task;
+
+    if (!fiber->m_arena || (size == 0))
+        return NULL;
+
+    if (x_roundup_multiple(size, X_ALIGN_OF(XMaxAlign)) > xsalloc_reserve(fiber->m_arena))
+        return NULL;
+
+    return xsalloc_allocate(fiber->m_arena, size);
+}
+
+
+void xfiber_arena_clear(void)
+{
+    XFiber* const fiber = X__CurWorker()->m_cur_task;
+
+    if (fiber->m_arena)
+        xsalloc_clear(fiber->m_arena);
+}
+
+
+size_t xfiber_arena_reserve(void)
+{
+    const XFiber* const fiber = X__CurWorker()->m_cur_task;
+
+    if (!fiber->m_arena)
+        return 0;
+
+    return xsalloc_reserve(fiber->m_arena);
+}
+
+
+void xfiber_yield()
+{
+    X__Schedule();
+}
+
+
+XError xfiber_create(XFiber** o_fiber,
+                     int priority,
+                     const char* name,
+                     size_t stack_size,
+                     XFiberFunc func,
+                     void* arg)
+{
+    return X__CreateFiber(o_fiber, priority, name, stack_size, func, arg, true);
+}
+
+
+XError xfiber_create_joinable(XFiber** o_fiber,
+                              int priority,
+                              const char* name,
+                              size_t stack_size,
+                              XFiberFunc func,
+                              void* arg)
+{
+    return X__CreateFiber(o_fiber, priority, name, stack_size, func, arg, false);
+}
+
+
+static XError X__CreateFiber(XFiber** o_fiber,
+                             int priority,
+                             const char* name,
+                             size_t stack_size,
+                             XFiberFunc func,
+                             void* arg,
+                             bool detached)
+{
+    XError err = X_ERR_NONE;
+    uint8_t* stack;
+    XFiber* fiber;
+
+    X_ASSERT((priority >= 0) && (priority < X_FIBER_PRIORITY_MAX));
+
+    fiber = X__AllocFiber(stack_size);
+    if (!fiber)
+    {
+        err = X_ERR_NO_MEMORY;
+        goto x__exit;
+    }
+
+    stack = fiber->m_stack;
+    stack_size = fiber->m_stack_size;
+
+    if (name)
+        x_strlcpy(fiber->m_name, name, sizeof(fiber->m_name));
+    else
+        fiber->m_name[0] = '\0';
+
+    fiber->m_func = func;
+    fiber->m_arg = arg;
+    fiber->m_priority = priority;
+    fiber->m_base_priority = priority;
+    fiber->m_type = X_FIBER_OBJTYPE_TASK;
     fiber->m_wait_sigs = 0;
     fiber->m_recv_sigs = 0;
+    fiber->m_waiting_mutex = NULL;
+    fiber->m_wait_list = NULL;
+    fiber->m_select_waiters = NULL;
+    fiber->m_select_num = 0;
+    fiber->m_exit_status = 0;
+    fiber->m_detached = detached;
+    fiber->m_joining = false;
+    xilist_init(&fiber->m_joiners);
+    xilist_init(&fiber->m_held_mutexes);
+#if X_CONF_FIBER_LOCAL_STORAGE_SIZE > 0
+    memset(fiber->m_local, 0, sizeof(fiber->m_local));
+#endif
+    fiber->m_arena = NULL;
+#if X_CONF_FIBER_USE_EPOLL
+    fiber->m_io_fd = -1;
+#endif
+#if X_CONF_FIBER_USE_STATS
+    memset(&fiber->m_stats, 0, sizeof(fiber->m_stats));
+    fiber->m_stats_timepoint = X_CONF_FIBER_STATS_CLOCK();
+    fiber->m_stats_wait_kind = -1;
+#endif
 
     xvtimer_init_request(&fiber->m_timer_request);
+#if X_CONF_FIBER_USE_SMP
+    fiber->m_worker = X__CurWorker();
+    fiber->m_on_cpu = false;
+#endif
 
     X__MakeContext(fiber, func, arg, stack, stack_size);
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         X__PushToReadyQueue(fiber);
         priv->m_num_objects[X_FIBER_OBJTYPE_TASK]++;
+#if X__TRACK_FIBERS
+        xilist_push_back(&priv->m_fibers, &fiber->m_fiber_node);
+#endif
+#if X_CONF_FIBER_USE_STATS
+        fiber->m_stats.id = priv->m_next_fiber_id++;
+        X__TRACE(fiber, X_FIBER_TRACE_CREATE, 0);
+#endif
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     X_ASSIGN_NOT_NULL(o_fiber, fiber);
     fiber = NULL;
     stack = NULL;
 
 x__exit:
-    X__Free(fiber);
+    X__FreeFiber(fiber);
+
+    return err;
+}
+
+
+void xfiber_exit(int status)
+{
+    X__Worker* const w = X__CurWorker();
+    XFiber* const fiber = w->m_cur_task;
+
+    X__LOG((X__TAG, "end '%s' %p", fiber->m_name, fiber));
+
+    /* アリーナはスタック上にはないので、すぐに解放できる */
+    X__Free(fiber->m_arena);
+    fiber->m_arena = NULL;
+
+    X__ENTER_CRITICAL();
+    {
+        X__TRACE(fiber, X_FIBER_TRACE_EXIT, 0);
+        fiber->m_exit_status = status;
+
+        if (fiber->m_detached)
+        {
+            X__ReleaseFiber(fiber);
+            w->m_cur_task = NULL;
+        }
+        else
+        {
+            /* 合流されるまでTCBとスタックを残す。自身のスタックから抜けるまで
+             * は解放されないように、通常のコンテキストスイッチで離れる。
+             */
+            fiber->m_state = X_FIBER_STATE_EXITED;
+            X__ReleaseJoiners(fiber, X_ERR_NONE);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    X__Schedule();
+
+    /* 終了したタスクが再開されることはない */
+    X_ABORT("exited fiber resumed");
+}
+
+
+XError xfiber_timed_join(XFiber* fiber, int* o_status, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X_ASSERT(fiber);
+
+    X__ENTER_CRITICAL();
+    {
+        if ((fiber == cur_task) || fiber->m_detached)
+        {
+            err = X_ERR_INVALID;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        if (fiber->m_joining)
+        {
+            err = X_ERR_BUSY;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        if (X_FIBER_IS_EXITED(fiber->m_state))
+        {
+            X_ASSIGN_NOT_NULL(o_status, fiber->m_exit_status);
+            fiber->m_detached = true;
+            X__ReleaseFiber(fiber);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            fiber->m_joining = true;
+            X__TransitionIntoWaitState(&fiber->m_joiners, X_FIBER_WAIT_FIFO, cur_task,
+                                       X_FIBER_STATE_WAITING_JOIN, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+
+        /* X_ERR_CANCELEDの場合、fiberは既に解放されている */
+        X__ENTER_CRITICAL();
+        if (err == X_ERR_NONE)
+        {
+            X_ASSIGN_NOT_NULL(o_status, fiber->m_exit_status);
+            fiber->m_detached = true;
+            X__ReleaseFiber(fiber);
+        }
+        else if (err == X_ERR_TIMED_OUT)
+        {
+            fiber->m_joining = false;
+        }
+        X__EXIT_CRITICAL();
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_join(XFiber* fiber, int* o_status)
+{
+    return xfiber_timed_join(fiber, o_status, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_try_join(XFiber* fiber, int* o_status)
+{
+    return xfiber_timed_join(fiber, o_status, 0);
+}
+
+
+XError xfiber_detach(XFiber* fiber)
+{
+    XError err = X_ERR_NONE;
+
+    X_ASSERT(fiber);
+
+    X__ENTER_CRITICAL();
+    {
+        if (fiber->m_detached)
+            err = X_ERR_INVALID;
+        else if (fiber->m_joining)
+            err = X_ERR_BUSY;
+        else
+        {
+            fiber->m_detached = true;
+            if (X_FIBER_IS_EXITED(fiber->m_state))
+                X__ReleaseFiber(fiber);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    return err;
+}
+
+
+XError xfiber_destroy(XFiber* fiber)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X_ASSERT(fiber);
+
+    if (fiber == X__CurWorker()->m_cur_task)
+        return X_ERR_INVALID;
+
+    X__ENTER_CRITICAL();
+    {
+        /* 合流待ちのタスクが起床してから解放するまでの間は破棄させない */
+        if (fiber->m_joining && xilist_empty(&fiber->m_joiners))
+        {
+            err = X_ERR_BUSY;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        if (!X_FIBER_IS_EXITED(fiber->m_state))
+        {
+#if X_CONF_FIBER_USE_SMP
+            if (fiber->m_on_cpu)
+            {
+                err = X_ERR_BUSY;
+                X__EXIT_CRITICAL();
+                goto x__exit;
+            }
+#endif
+
+            /* 獲得中のミューテックスを待っているタスクが永久に待ち続けてしまう */
+            if (!xilist_empty(&fiber->m_held_mutexes))
+            {
+                err = X_ERR_BUSY;
+                X__EXIT_CRITICAL();
+                goto x__exit;
+            }
+
+            X__UnlinkFiber(fiber);
+            X__TRACE(fiber, X_FIBER_TRACE_EXIT, 0);
+            scheduling_request = X__ReleaseJoiners(fiber, X_ERR_CANCELED);
+            X__Free(fiber->m_arena);
+            fiber->m_arena = NULL;
+        }
+
+        fiber->m_detached = true;
+        X__ReleaseFiber(fiber);
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
 
+x__exit:
     return err;
 }
 
@@ -424,11 +1416,52 @@ x__exit:
 const char* xfiber_name(const XFiber* fiber)
 {
     if (!fiber)
-        fiber = priv->m_cur_task;
+        fiber = X__CurWorker()->m_cur_task;
     return fiber->m_name;
 }
 
 
+#if X_CONF_FIBER_STACK_PAINT || X_CONF_FIBER_STACK_GUARD
+
+
+size_t xfiber_stack_high_water(const XFiber* fiber)
+{
+    const uint8_t* p;
+    const uint8_t* end;
+
+    if (!fiber)
+        fiber = X__CurWorker()->m_cur_task;
+    end = fiber->m_stack + fiber->m_stack_size;
+
+#if X_CONF_FIBER_STACK_PAINT
+    for (p = fiber->m_stack; p < end; ++p)
+    {
+        if (*p != X__STACK_PAINT_BYTE)
+            break;
+    }
+#else
+    /* 塗りつぶしでページを割り当ててしまわないように、割り当て済みのページ
+     * を調べる。
+     */
+    {
+        const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+        unsigned char resident;
+
+        for (p = fiber->m_stack; p < end; p += page_size)
+        {
+            if ((mincore((void*)p, page_size, &resident) == 0) && (resident & 1))
+                break;
+        }
+    }
+#endif
+
+    return (size_t)(end - p);
+}
+
+
+#endif
+
+
 XError xfiber_event_create(XFiberEvent** o_event)
 {
     XError err = X_ERR_NONE;
@@ -441,7 +1474,9 @@ XError xfiber_event_create(XFiberEvent** o_event)
 
     event->m_pattern = 0;
     xilist_init(&event->m_pending_tasks);
+    xilist_init(&event->m_selectors);
     event->m_type = X_FIBER_OBJTYPE_EVENT;
+    event->m_wait_mode = X_FIBER_WAIT_FIFO;
     *o_event = event;
 
 x__exit:
@@ -452,12 +1487,13 @@ x__exit:
 
 void xfiber_event_destroy(XFiberEvent* event)
 {
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         X__PargePendingTasks(&event->m_pending_tasks);
+        X__PargeSelectors(&event->m_selectors);
         X__Free(event);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 }
 
 
@@ -479,18 +1515,18 @@ XError xfiber_event_timed_wait(XFiberEvent* event, XMode mode, XBits wait_patter
     XFiber* const fiber = xfiber_self();
 
     X_ASSIGN_NOT_NULL(result, 0);
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         if (X__TestEvent(event, mode, wait_pattern, result))
         {
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
         if (timeout == 0)
         {
             err = X_ERR_TIMED_OUT;
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
@@ -502,7 +1538,7 @@ XError xfiber_event_timed_wait(XFiberEvent* event, XMode mode, XBits wait_patter
         if (timeout > 0)
             X__AddTimerEvent(fiber, X__TimeoutHandler, timeout);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     X__Schedule();
     err = fiber->m_result_waiting;
@@ -537,6 +1573,7 @@ XError xfiber_event_set_isr(XFiberEvent* event, XBits pattern)
         }
         ite = next;
     }
+    X__NotifySelectors(&event->m_selectors);
 
     return err;
 }
@@ -547,7 +1584,7 @@ XError xfiber_event_set(XFiberEvent* event, XBits pattern)
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         event->m_pattern |= pattern;
         XIntrusiveNode* ite = xilist_front(&event->m_pending_tasks);
@@ -570,8 +1607,11 @@ XError xfiber_event_set(XFiberEvent* event, XBits pattern)
             }
             ite = next;
         }
+
+        if (X__NotifySelectors(&event->m_selectors))
+            scheduling_request = true;
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
@@ -583,12 +1623,12 @@ XError xfiber_event_set(XFiberEvent* event, XBits pattern)
 XBits xfiber_event_clear(XFiberEvent* event, XBits pattern)
 {
     XBits prev;
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         prev = event->m_pattern;
         event->m_pattern &= ~pattern;
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     return prev;
 }
@@ -605,11 +1645,11 @@ XBits xfiber_event_clear_isr(XFiberEvent* event, XBits pattern)
 XBits xfiber_event_get(XFiberEvent* event)
 {
     XBits cur;
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         cur = event->m_pattern;
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     return cur;
 }
@@ -646,20 +1686,20 @@ XError xfiber_signal_timed_wait(XBits sigs, XBits* result, XTicks timeout)
     }
 
     fiber = xfiber_self();
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         *result = sigs & fiber->m_recv_sigs;
         if (*result)
         {
             fiber->m_recv_sigs &= ~(*result);
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
         if (timeout == 0)
         {
             err = X_ERR_TIMED_OUT;
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
@@ -670,7 +1710,7 @@ XError xfiber_signal_timed_wait(XBits sigs, XBits* result, XTicks timeout)
         if (timeout > 0)
             X__AddTimerEvent(fiber, X__TimeoutHandler, timeout);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     X__Schedule();
 
@@ -678,13 +1718,13 @@ XError xfiber_signal_timed_wait(XBits sigs, XBits* result, XTicks timeout)
 
     if (err == X_ERR_NONE)
     {
-        X_FIBER_ENTER_CRITICAL();
+        X__ENTER_CRITICAL();
         {
             *result = sigs & fiber->m_recv_sigs;
             X_ASSERT(*result);
             fiber->m_recv_sigs &= ~(*result);
         }
-        X_FIBER_EXIT_CRITICAL();
+        X__EXIT_CRITICAL();
     }
 
 x__exit:
@@ -697,7 +1737,7 @@ XError xfiber_signal_raise(XFiber* fiber, XBits sigs)
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         fiber->m_recv_sigs |= sigs;
         if (fiber->m_wait_sigs & sigs)
@@ -707,7 +1747,7 @@ XError xfiber_signal_raise(XFiber* fiber, XBits sigs)
             scheduling_request = true;
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
@@ -734,11 +1774,11 @@ XError xfiber_signal_raise_isr(XFiber* fiber, XBits sigs)
 XBits xfiber_signal_get(XFiber* fiber)
 {
     XBits ret;
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         ret = fiber->m_recv_sigs;
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     return ret;
 }
@@ -756,14 +1796,14 @@ void xfiber_delay(XTicks time)
     if (time == 0)
         return;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        XFiber* const self = priv->m_cur_task;
+        XFiber* const self = X__CurWorker()->m_cur_task;
         self->m_state= X_FIBER_STATE_WAITING_DELAY;
         xilist_push_back(&priv->m_delay_queue, &self->m_node);
         X__AddTimerEvent(self, X__TimeoutHandler, time);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     X__Schedule();
 }
@@ -775,13 +1815,20 @@ XError xfiber_suspend(XFiber* fiber)
     bool scheduling_request = false;
 
     if (!fiber)
-        fiber = priv->m_cur_task;
+        fiber = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
+        if (X_FIBER_IS_EXITED(fiber->m_state))
+        {
+            err = X_ERR_INVALID;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
         if (X_FIBER_IS_SUSPEND(fiber->m_state))
         {
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
@@ -793,10 +1840,10 @@ XError xfiber_suspend(XFiber* fiber)
         {
             fiber->m_state =  X_FIBER_STATE_SUSPEND;
             xilist_push_back(&priv->m_delay_queue, &fiber->m_node);
-            scheduling_request = (fiber == priv->m_cur_task);
+            scheduling_request = (fiber == X__CurWorker()->m_cur_task);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
@@ -811,11 +1858,11 @@ XError xfiber_resume(XFiber* fiber)
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         if (!X_FIBER_IS_SUSPEND(fiber->m_state))
         {
-            X_FIBER_EXIT_CRITICAL();
+            X__EXIT_CRITICAL();
             goto x__exit;
         }
 
@@ -830,7 +1877,7 @@ XError xfiber_resume(XFiber* fiber)
             scheduling_request = true;
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
@@ -842,6 +1889,14 @@ x__exit:
 
 XError xfiber_queue_create(XFiberQueue** o_queue, size_t queue_len, size_t item_size)
 {
+    return xfiber_queue_create_ex(o_queue, queue_len, item_size, X_FIBER_WAIT_FIFO);
+}
+
+
+XError xfiber_queue_create_ex(XFiberQueue** o_queue, size_t queue_len, size_t item_size, XMode wait_mode)
+{
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
     if (queue_len == 0)
         return X_ERR_INVALID;
     if (item_size == 0)
@@ -849,14 +1904,20 @@ XError xfiber_queue_create(XFiberQueue** o_queue, size_t queue_len, size_t item_
     if (!o_queue)
         return X_ERR_INVALID;
 
-    XFiberQueue* queue = X__Malloc(sizeof(XFiberQueue) + queue_len * item_size);
+    /* 要素を直接参照できるように、バッファはアライメントを揃えて配置する */
+    const size_t header_size = x_roundup_multiple(sizeof(XFiberQueue), X_ALIGN_OF(XMaxAlign));
+    XFiberQueue* queue = X__Malloc(header_size + queue_len * item_size);
     if (!queue)
         return X_ERR_NO_MEMORY;
 
-    xcbuf_init(&queue->m_buffer, (uint8_t*)queue + sizeof(XFiberQueue), queue_len * item_size);
+    xcbuf_init(&queue->m_buffer, (uint8_t*)queue + header_size, queue_len * item_size);
     xilist_init(&queue->m_pending_tasks);
+    xilist_init(&queue->m_selectors);
     queue->m_type = X_FIBER_OBJTYPE_QUEUE;
+    queue->m_wait_mode = wait_mode;
     queue->m_item_size = item_size;
+    queue->m_reserving = false;
+    queue->m_peeking = false;
     *o_queue = queue;
 
     return X_ERR_NONE;
@@ -865,12 +1926,13 @@ XError xfiber_queue_create(XFiberQueue** o_queue, size_t queue_len, size_t item_
 
 void xfiber_queue_destroy(XFiberQueue* queue)
 {
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
         X__PargePendingTasks(&queue->m_pending_tasks);
+        X__PargeSelectors(&queue->m_selectors);
         X__Free(queue);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 }
 
 
@@ -890,31 +1952,35 @@ XError xfiber_queue_timed_send_back(XFiberQueue* queue, const void* src, XTicks
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xcbuf_empty(&queue->m_buffer) && (!xilist_empty(&queue->m_pending_tasks)))
+        XFiber* const pend_task = (xcbuf_empty(&queue->m_buffer) && !queue->m_reserving) ?
+            X__PendingReceiver(&queue->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_QUEUE) : NULL;
+
+        if (pend_task)
         {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&queue->m_pending_tasks));
             memcpy(pend_task->m_pending_recv_dst, src, queue->m_item_size);
             X__ReleaseWaiting(pend_task, X_ERR_NONE);
             scheduling_request = true;
         }
-        else if (xcbuf_reserve(&queue->m_buffer) >= queue->m_item_size)
+        else if (X__QUEUE_CAN_SEND(queue))
         {
             xcbuf_push_back_n(&queue->m_buffer, src, queue->m_item_size);
+            if (X__HAS_WAITERS(queue))
+                scheduling_request = X__ServiceQueue(queue);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
             cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
-            X__TransitionIntoWaitState(&queue->m_pending_tasks, cur_task,
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
                                        X_FIBER_STATE_WAITING_SEND_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
@@ -931,15 +1997,19 @@ XError xfiber_queue_send_back_isr(XFiberQueue* queue, const void* src)
 {
     XError err = X_ERR_NONE;
 
-    if (xcbuf_empty(&queue->m_buffer) && (!xilist_empty(&queue->m_pending_tasks)))
+    XFiber* const pend_task = (xcbuf_empty(&queue->m_buffer) && !queue->m_reserving) ?
+        X__PendingReceiver(&queue->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_QUEUE) : NULL;
+
+    if (pend_task)
     {
-        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&queue->m_pending_tasks));
         memcpy(pend_task->m_pending_recv_dst, src, queue->m_item_size);
         X__ReleaseWaiting(pend_task, X_ERR_NONE);
     }
-    else if (xcbuf_reserve(&queue->m_buffer) >= queue->m_item_size)
+    else if (X__QUEUE_CAN_SEND(queue))
     {
         xcbuf_push_back_n(&queue->m_buffer, src, queue->m_item_size);
+        if (X__HAS_WAITERS(queue))
+            X__ServiceQueue(queue);
     }
     else
     {
@@ -966,31 +2036,35 @@ XError xfiber_queue_timed_send_front(XFiberQueue* queue, const void* src, XTicks
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* cur_task = priv->m_cur_task;
+    XFiber* cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xcbuf_empty(&queue->m_buffer) && (!xilist_empty(&queue->m_pending_tasks)))
+        XFiber* const pend_task = (xcbuf_empty(&queue->m_buffer) && !queue->m_reserving) ?
+            X__PendingReceiver(&queue->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_QUEUE) : NULL;
+
+        if (pend_task)
         {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&queue->m_pending_tasks));
             memcpy(pend_task->m_pending_recv_dst, src, queue->m_item_size);
             X__ReleaseWaiting(pend_task, X_ERR_NONE);
             scheduling_request = true;
         }
-        else if (xcbuf_reserve(&queue->m_buffer) >= queue->m_item_size)
+        else if (X__QUEUE_CAN_SEND(queue) && !queue->m_peeking)
         {
             xcbuf_push_front_n(&queue->m_buffer, src, queue->m_item_size);
+            if (X__HAS_WAITERS(queue))
+                scheduling_request = X__ServiceQueue(queue);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
             cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
-            X__TransitionIntoWaitState(&queue->m_pending_tasks, cur_task,
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
                                        X_FIBER_STATE_WAITING_SEND_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
@@ -1007,15 +2081,19 @@ XError xfiber_queue_send_front_isr(XFiberQueue* queue, const void* src)
 {
     XError err = X_ERR_NONE;
 
-    if (xcbuf_empty(&queue->m_buffer) && (!xilist_empty(&queue->m_pending_tasks)))
+    XFiber* const pend_task = (xcbuf_empty(&queue->m_buffer) && !queue->m_reserving) ?
+        X__PendingReceiver(&queue->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_QUEUE) : NULL;
+
+    if (pend_task)
     {
-        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&queue->m_pending_tasks));
         memcpy(pend_task->m_pending_recv_dst, src, queue->m_item_size);
         X__ReleaseWaiting(pend_task, X_ERR_NONE);
     }
-    else if (xcbuf_reserve(&queue->m_buffer) >= queue->m_item_size)
+    else if (X__QUEUE_CAN_SEND(queue) && !queue->m_peeking)
     {
         xcbuf_push_front_n(&queue->m_buffer, src, queue->m_item_size);
+        if (X__HAS_WAITERS(queue))
+            X__ServiceQueue(queue);
     }
     else
     {
@@ -1042,39 +2120,28 @@ XError xfiber_queue_timed_receive(XFiberQueue* queue, void* dst, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xcbuf_size(&queue->m_buffer) >= queue->m_item_size)
+        if (X__QUEUE_CAN_RECEIVE(queue))
         {
             xcbuf_pop_front_n(&queue->m_buffer, dst, queue->m_item_size);
 
             /* 送信待ちのタスクがあれば、バッファに格納して待ちを解除する */
-            if (!xilist_empty(&queue->m_pending_tasks))
-            {
-                XFiber* const pend_task = xnode_entry(
-                        xilist_pop_front(&queue->m_pending_tasks),
-                        XFiber, m_node);
-
-                xcbuf_push_back_n(&queue->m_buffer,
-                                  pend_task->m_pending_send_src,
-                                  queue->m_item_size);
-
-                X__ReleaseWaiting(pend_task, X_ERR_NONE);
-                scheduling_request = true;
-            }
+            if (X__HAS_WAITERS(queue))
+                scheduling_request = X__ServiceQueue(queue);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
             cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, dst);
-            X__TransitionIntoWaitState(&queue->m_pending_tasks, cur_task,
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
                                        X_FIBER_STATE_WAITING_RECV_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
@@ -1091,20 +2158,12 @@ XError xfiber_queue_receive_isr(XFiberQueue* queue, void* dst)
 {
     XError err = X_ERR_NONE;
 
-    if (xcbuf_size(&queue->m_buffer) >= queue->m_item_size)
+    if (X__QUEUE_CAN_RECEIVE(queue))
     {
         xcbuf_pop_front_n(&queue->m_buffer, dst, queue->m_item_size);
 
-        if (!xilist_empty(&queue->m_pending_tasks))
-        {
-            XFiber* const pend_task = X__NODE_TO_FIBER(
-                    xilist_pop_front(&queue->m_pending_tasks));
-
-            xcbuf_push_back_n(&queue->m_buffer,
-                              pend_task->m_pending_send_src,
-                              queue->m_item_size);
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-        }
+        if (X__HAS_WAITERS(queue))
+            X__ServiceQueue(queue);
     }
     else
     {
@@ -1115,171 +2174,167 @@ XError xfiber_queue_receive_isr(XFiberQueue* queue, void* dst)
 }
 
 
-XError xfiber_channel_create(XFiberChannel** o_channel, size_t capacity, size_t max_item_size)
+XError xfiber_queue_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num)
 {
-    if (!o_channel)
-        return X_ERR_INVALID;
+    return xfiber_queue_timed_send_back_n(queue, src, n, o_num, X_TICKS_FOREVER);
+}
 
-    XFiberChannel* channel = X__Malloc(sizeof(XFiberChannel) + capacity);
-    if (!channel)
-        return X_ERR_NO_MEMORY;
 
-    xmsgbuf_init(&channel->m_buffer, (uint8_t*)channel + sizeof(XFiberChannel), capacity);
-    xilist_init(&channel->m_pending_tasks);
-    channel->m_type = X_FIBER_OBJTYPE_CHANNEL;
-    channel->m_max_item_size = max_item_size;
-    *o_channel = channel;
+XError xfiber_queue_try_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num)
+{
+    return xfiber_queue_timed_send_back_n(queue, src, n, o_num, 0);
+}
 
-    return X_ERR_NONE;
-}
 
-
-void xfiber_channel_destroy(XFiberChannel* channel)
+XError xfiber_queue_timed_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num, XTicks timeout)
 {
-    X_FIBER_ENTER_CRITICAL();
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    bool waiting = false;
+    size_t num = 0;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    if ((!src) || (n == 0))
+        return X_ERR_INVALID;
+
+    X__ENTER_CRITICAL();
     {
-        X__PargePendingTasks(&channel->m_pending_tasks);
-        X__Free(channel);
+        num = X__QueueSendN(queue, src, n, &scheduling_request);
+        if (num == 0)
+        {
+            X__CHECK_POLL(timeout);
+            waiting = true;
+            cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEND_QUEUE, timeout);
+        }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
+
+    /* 1要素目の送信を待った場合は、残りは待たずに送れるだけ送る */
+    if (waiting)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+        {
+            num = 1;
+            X__ENTER_CRITICAL();
+            num += X__QueueSendN(queue, (const uint8_t*)src + queue->m_item_size, n - 1, &scheduling_request);
+            X__EXIT_CRITICAL();
+        }
+    }
+
+    if (scheduling_request)
+        X__Schedule();
+
+x__exit:
+    *o_num = num;
+    return err;
 }
 
 
-XError xfiber_channel_send(XFiberChannel* channel, const void* src, size_t size)
+XError xfiber_queue_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num)
 {
-    return xfiber_channel_timed_send(channel, src, size, X_TICKS_FOREVER);
+    return xfiber_queue_timed_receive_n(queue, dst, n, o_num, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_channel_try_send(XFiberChannel* channel, const void* src, size_t size)
+XError xfiber_queue_try_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num)
 {
-    return xfiber_channel_timed_send(channel, src, size, 0);
+    return xfiber_queue_timed_receive_n(queue, dst, n, o_num, 0);
 }
 
 
-XError xfiber_channel_timed_send(XFiberChannel* channel, const void* src, size_t size, XTicks timeout)
+XError xfiber_queue_timed_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    bool waiting = false;
+    size_t num = 0;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    if ((!dst) || (n == 0))
+        return X_ERR_INVALID;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xmsgbuf_empty(&channel->m_buffer) && (!xilist_empty(&channel->m_pending_tasks)))
-        {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&channel->m_pending_tasks));
-            memcpy(pend_task->m_pending_recv_dst, src, size);
-            pend_task->m_channel_item_size = size;
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            scheduling_request = true;
-        }
-        else if (xmsgbuf_reserve(&channel->m_buffer) >= size + sizeof(XMessageHeader))
-        {
-            xmsgbuf_push(&channel->m_buffer, src, size);
-        }
-        else
+        num = X__QueueReceiveN(queue, dst, n, &scheduling_request);
+        if (num == 0)
         {
             X__CHECK_POLL(timeout);
-            scheduling_request = true;
-            cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
-            cur_task->m_channel_item_size = size;
-            X__TransitionIntoWaitState(&channel->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_SEND_CHANNEL, timeout);
+            waiting = true;
+            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, dst);
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
-    if (scheduling_request)
+    /* 1要素目の受信を待った場合は、残りは待たずに受け取れるだけ受け取る */
+    if (waiting)
     {
         X__Schedule();
         err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+        {
+            num = 1;
+            X__ENTER_CRITICAL();
+            num += X__QueueReceiveN(queue, (uint8_t*)dst + queue->m_item_size, n - 1, &scheduling_request);
+            X__EXIT_CRITICAL();
+        }
     }
 
-x__exit:
-    return err;
-}
-
-
-XError xfiber_channel_send_isr(XFiberChannel* channel, const void* src, size_t size)
-{
-    XError err = X_ERR_NONE;
-
-    if (xmsgbuf_empty(&channel->m_buffer) && (!xilist_empty(&channel->m_pending_tasks)))
-    {
-        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&channel->m_pending_tasks));
-        memcpy(pend_task->m_pending_recv_dst, src, size);
-        pend_task->m_channel_item_size = size;
-        X__ReleaseWaiting(pend_task, X_ERR_NONE);
-    }
-    else if (xmsgbuf_reserve(&channel->m_buffer) >= size + sizeof(XMessageHeader))
-    {
-        xmsgbuf_push(&channel->m_buffer, src, size);
-    }
-    else
-    {
-        err = X_ERR_TIMED_OUT;
-    }
+    if (scheduling_request)
+        X__Schedule();
 
+x__exit:
+    *o_num = num;
     return err;
 }
 
 
-
-XError xfiber_channel_receive(XFiberChannel* channel, void* dst, size_t* o_size)
+XError xfiber_queue_reserve_back(XFiberQueue* queue, void** o_ptr)
 {
-    return xfiber_channel_timed_receive(channel, dst, o_size, X_TICKS_FOREVER);
+    return xfiber_queue_timed_reserve_back(queue, o_ptr, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_channel_try_receive(XFiberChannel* channel, void* dst, size_t* o_size)
+XError xfiber_queue_try_reserve_back(XFiberQueue* queue, void** o_ptr)
 {
-    return xfiber_channel_timed_receive(channel, dst, o_size, 0);
+    return xfiber_queue_timed_reserve_back(queue, o_ptr, 0);
 }
 
 
-XError xfiber_channel_timed_receive(XFiberChannel* channel, void* dst, size_t* o_size, XTicks timeout)
+XError xfiber_queue_timed_reserve_back(XFiberQueue* queue, void** o_ptr, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (!xmsgbuf_empty(&channel->m_buffer))
+        if (X__QUEUE_CAN_SEND(queue))
         {
-            *o_size = xmsgbuf_pull(&channel->m_buffer, dst);
-            if (!xilist_empty(&channel->m_pending_tasks))
-            {
-                XFiber* const pend_task = X__NODE_TO_FIBER(xilist_front(&channel->m_pending_tasks));
-                if (xmsgbuf_reserve(&channel->m_buffer) >=
-                                    pend_task->m_channel_item_size + sizeof(XMessageHeader))
-                {
-                    xilist_pop_front(&channel->m_pending_tasks);
-                    xmsgbuf_push(&channel->m_buffer,
-                                 pend_task->m_pending_send_src,
-                                 pend_task->m_channel_item_size);
-                    X__ReleaseWaiting(pend_task, X_ERR_NONE);
-                    scheduling_request = true;
-                }
-
-            }
+            *o_ptr = X__QueueReserve(queue);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
-            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, dst);
-            X__TransitionIntoWaitState(&channel->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_RECV_CHANNEL, timeout);
+            cur_task->m_pending_send_src = NULL;
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEND_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
         X__Schedule();
         err = cur_task->m_result_waiting;
-        *o_size = cur_task->m_channel_item_size;
+        if (err == X_ERR_NONE)
+            *o_ptr = cur_task->m_zero_copy_ptr;
     }
 
 x__exit:
@@ -1287,105 +2342,66 @@ x__exit:
 }
 
 
-XError xfiber_channel_receive_isr(XFiberChannel* channel, void* dst, size_t* o_size)
+void xfiber_queue_commit_back(XFiberQueue* queue)
 {
-    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
 
-    if (!xmsgbuf_empty(&channel->m_buffer))
-    {
-        *o_size = xmsgbuf_pull(&channel->m_buffer, dst);
-        if (!xilist_empty(&channel->m_pending_tasks))
-        {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_front(&channel->m_pending_tasks));
-            if (xmsgbuf_reserve(&channel->m_buffer) >=
-                                pend_task->m_channel_item_size + sizeof(XMessageHeader))
-            {
-                xilist_pop_front(&channel->m_pending_tasks);
-                xmsgbuf_push(&channel->m_buffer,
-                             pend_task->m_pending_send_src,
-                             pend_task->m_channel_item_size);
-                X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            }
-        }
-    }
-    else
+    X__ENTER_CRITICAL();
     {
-        err = X_ERR_TIMED_OUT;
-        goto x__exit;
+        X_ASSERT(queue->m_reserving);
+        queue->m_reserving = false;
+        xcbuf_commit_back_n(&queue->m_buffer, queue->m_item_size);
+        if (X__HAS_WAITERS(queue))
+            scheduling_request = X__ServiceQueue(queue);
     }
+    X__EXIT_CRITICAL();
 
-x__exit:
-    return err;
-}
-
-
-XError xfiber_mutex_create(XFiberMutex** o_mutex)
-{
-    if (!o_mutex)
-        return X_ERR_INVALID;
-
-    XFiberMutex* mutex = X__Malloc(sizeof(XFiberMutex));
-    if (!mutex)
-        return X_ERR_NO_MEMORY;
-
-    xilist_init(&mutex->m_pending_tasks);
-    mutex->m_type = X_FIBER_OBJTYPE_MUTEX;
-    mutex->m_holder = NULL;
-    *o_mutex = mutex;
-
-    return X_ERR_NONE;
-}
-
-
-void xfiber_mutex_destroy(XFiberMutex* mutex)
-{
-    X_FIBER_ENTER_CRITICAL();
-    {
-        X__PargePendingTasks(&mutex->m_pending_tasks);
-        X__Free(mutex);
-    }
-    X_FIBER_EXIT_CRITICAL();
+    if (scheduling_request)
+        X__Schedule();
 }
 
 
-XError xfiber_mutex_lock(XFiberMutex* mutex)
+XError xfiber_queue_peek(XFiberQueue* queue, void** o_ptr)
 {
-    return xfiber_mutex_timed_lock(mutex, X_TICKS_FOREVER);
+    return xfiber_queue_timed_peek(queue, o_ptr, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_mutex_try_lock(XFiberMutex* mutex)
+XError xfiber_queue_try_peek(XFiberQueue* queue, void** o_ptr)
 {
-    return xfiber_mutex_timed_lock(mutex, 0);
+    return xfiber_queue_timed_peek(queue, o_ptr, 0);
 }
 
 
-XError xfiber_mutex_timed_lock(XFiberMutex* mutex, XTicks timeout)
+XError xfiber_queue_timed_peek(XFiberQueue* queue, void** o_ptr, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (!mutex->m_holder)
+        if (X__QUEUE_CAN_RECEIVE(queue))
         {
-            mutex->m_holder = cur_task;
+            *o_ptr = X__QueuePeek(queue);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
-            X__TransitionIntoWaitState(&mutex->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_MUTEX, timeout);
+            cur_task->m_pending_recv_dst = NULL;
+            X__TransitionIntoWaitState(&queue->m_pending_tasks, queue->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_QUEUE, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
         X__Schedule();
         err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+            *o_ptr = cur_task->m_zero_copy_ptr;
     }
 
 x__exit:
@@ -1393,124 +2409,117 @@ x__exit:
 }
 
 
-XError xfiber_mutex_unlock(XFiberMutex* mutex)
+void xfiber_queue_consume(XFiberQueue* queue)
 {
-    XError err = X_ERR_NONE;
     bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (!mutex->m_holder)
-        {
-            /* ロックされていない */
-            err = X_ERR_PROTOCOL;
-            X_FIBER_EXIT_CRITICAL();
-            goto x__exit;
-        }
-        else
-        {
-            mutex->m_holder = NULL;
-            if (xilist_empty(&mutex->m_pending_tasks))
-                goto x__exit;
-
-            XFiber* const pend_task = X__NODE_TO_FIBER(
-                    xilist_pop_front(&mutex->m_pending_tasks));
-            mutex->m_holder = pend_task;
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            scheduling_request = true;
-        }
+        X_ASSERT(queue->m_peeking);
+        queue->m_peeking = false;
+        xcbuf_pop_front_n(&queue->m_buffer, NULL, queue->m_item_size);
+        if (X__HAS_WAITERS(queue))
+            scheduling_request = X__ServiceQueue(queue);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
-
-x__exit:
-    return err;
 }
 
 
-XError xfiber_mutex_unlock_isr(XFiberMutex* mutex)
+XError xfiber_channel_create(XFiberChannel** o_channel, size_t capacity, size_t max_item_size)
 {
-    XError err = X_ERR_NONE;
-    if (!mutex->m_holder)
-        return X_ERR_PROTOCOL;
-
-    mutex->m_holder = NULL;
-    if (xilist_empty(&mutex->m_pending_tasks))
-        return X_ERR_NONE;
-
-    XFiber* const pend_task = X__NODE_TO_FIBER(
-            xilist_pop_front(&mutex->m_pending_tasks));
-    mutex->m_holder = pend_task;
-    X__ReleaseWaiting(pend_task, X_ERR_NONE);
-
-    return err;
+    return xfiber_channel_create_ex(o_channel, capacity, max_item_size, X_FIBER_WAIT_FIFO);
 }
 
 
-XError xfiber_semaphore_create(XFiberSemaphore** o_semaphore, int initial_count)
+XError xfiber_channel_create_ex(XFiberChannel** o_channel, size_t capacity, size_t max_item_size, XMode wait_mode)
 {
-    if (!o_semaphore)
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+    if (!o_channel)
         return X_ERR_INVALID;
 
-    XFiberSemaphore* semaphore = X__Malloc(sizeof(XFiberSemaphore));
-    if (!semaphore)
+    XFiberChannel* channel = X__Malloc(sizeof(XFiberChannel) + capacity);
+    if (!channel)
         return X_ERR_NO_MEMORY;
 
-    xilist_init(&semaphore->m_pending_tasks);
-    semaphore->m_type = X_FIBER_OBJTYPE_SEMAPHORE;
-    semaphore->m_count = initial_count;
-    *o_semaphore = semaphore;
+    xmsgbuf_init(&channel->m_buffer, (uint8_t*)channel + sizeof(XFiberChannel), capacity);
+    xilist_init(&channel->m_pending_tasks);
+    xilist_init(&channel->m_selectors);
+    channel->m_type = X_FIBER_OBJTYPE_CHANNEL;
+    channel->m_wait_mode = wait_mode;
+    channel->m_max_item_size = max_item_size;
+    channel->m_reserved = NULL;
+    channel->m_reserved_size = 0;
+    channel->m_peeking = false;
+    *o_channel = channel;
 
     return X_ERR_NONE;
 }
 
 
-void xfiber_semaphore_destroy(XFiberSemaphore* semaphore)
+void xfiber_channel_destroy(XFiberChannel* channel)
 {
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        X__PargePendingTasks(&semaphore->m_pending_tasks);
-        X__Free(semaphore);
+        X__PargePendingTasks(&channel->m_pending_tasks);
+        X__PargeSelectors(&channel->m_selectors);
+        X__Free(channel);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 }
 
 
-XError xfiber_semaphore_take(XFiberSemaphore* semaphore)
+XError xfiber_channel_send(XFiberChannel* channel, const void* src, size_t size)
 {
-    return xfiber_semaphore_timed_take(semaphore, X_TICKS_FOREVER);
+    return xfiber_channel_timed_send(channel, src, size, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_semaphore_try_take(XFiberSemaphore* semaphore)
+XError xfiber_channel_try_send(XFiberChannel* channel, const void* src, size_t size)
 {
-    return xfiber_semaphore_timed_take(semaphore, 0);
+    return xfiber_channel_timed_send(channel, src, size, 0);
 }
 
 
-XError xfiber_semaphore_timed_take(XFiberSemaphore* semaphore, XTicks timeout)
+XError xfiber_channel_timed_send(XFiberChannel* channel, const void* src, size_t size, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* const cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (semaphore->m_count > 0)
+        XFiber* const pend_task = (xmsgbuf_empty(&channel->m_buffer) && !channel->m_reserved) ?
+            X__PendingReceiver(&channel->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_CHANNEL) : NULL;
+        uint8_t* msg;
+
+        if (pend_task)
         {
-            semaphore->m_count--;
+            memcpy(pend_task->m_pending_recv_dst, src, size);
+            pend_task->m_channel_item_size = size;
+            X__ReleaseWaiting(pend_task, X_ERR_NONE);
+            scheduling_request = true;
+        }
+        else if ((msg = X__ChannelPrepare(channel, size)) != NULL)
+        {
+            X__ChannelPush(channel, msg, src, size);
+            if (X__HAS_WAITERS(channel))
+                scheduling_request = X__ServiceChannel(channel);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
-            X__TransitionIntoWaitState(&semaphore->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_SEMAPHORE, timeout);
+            cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
+            cur_task->m_channel_item_size = size;
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEND_CHANNEL, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
@@ -1523,166 +2532,279 @@ x__exit:
 }
 
 
-XError xfiber_semaphore_give(XFiberSemaphore* semaphore)
+XError xfiber_channel_send_isr(XFiberChannel* channel, const void* src, size_t size)
 {
     XError err = X_ERR_NONE;
-    bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    XFiber* const pend_task = (xmsgbuf_empty(&channel->m_buffer) && !channel->m_reserved) ?
+        X__PendingReceiver(&channel->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_CHANNEL) : NULL;
+    uint8_t* msg;
+
+    if (pend_task)
     {
-        if (xilist_empty(&semaphore->m_pending_tasks))
-        {
-            semaphore->m_count++;
-        }
-        else
-        {
-            XFiber* const pend_task = X__NODE_TO_FIBER(
-                    xilist_pop_front(&semaphore->m_pending_tasks));
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            scheduling_request = true;
-        }
+        memcpy(pend_task->m_pending_recv_dst, src, size);
+        pend_task->m_channel_item_size = size;
+        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+    }
+    else if ((msg = X__ChannelPrepare(channel, size)) != NULL)
+    {
+        X__ChannelPush(channel, msg, src, size);
+        if (X__HAS_WAITERS(channel))
+            X__ServiceChannel(channel);
+    }
+    else
+    {
+        err = X_ERR_TIMED_OUT;
     }
-    X_FIBER_EXIT_CRITICAL();
-
-    if (scheduling_request)
-        X__Schedule();
 
     return err;
 }
 
 
-XError xfiber_semaphore_give_isr(XFiberSemaphore* semaphore)
+
+XError xfiber_channel_receive(XFiberChannel* channel, void* dst, size_t* o_size)
 {
-    XError err = X_ERR_NONE;
+    return xfiber_channel_timed_receive(channel, dst, o_size, X_TICKS_FOREVER);
+}
 
-    if (xilist_empty(&semaphore->m_pending_tasks))
-    {
-        semaphore->m_count++;
+
+XError xfiber_channel_try_receive(XFiberChannel* channel, void* dst, size_t* o_size)
+{
+    return xfiber_channel_timed_receive(channel, dst, o_size, 0);
+}
+
+
+XError xfiber_channel_timed_receive(XFiberChannel* channel, void* dst, size_t* o_size, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (X__CHANNEL_CAN_RECEIVE(channel))
+        {
+            cur_task->m_channel_item_size = xmsgbuf_pull(&channel->m_buffer, dst);
+            if (X__HAS_WAITERS(channel))
+                scheduling_request = X__ServiceChannel(channel);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, dst);
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_CHANNEL, timeout);
+        }
     }
-    else
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
     {
-        XFiber* const pend_task = X__NODE_TO_FIBER(
-                xilist_pop_front(&semaphore->m_pending_tasks));
-        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+        X__Schedule();
+        err = cur_task->m_result_waiting;
     }
+    *o_size = cur_task->m_channel_item_size;
 
+x__exit:
     return err;
 }
 
 
-XError xfiber_mailbox_create(XFiberMailbox** o_mailbox)
+XError xfiber_channel_receive_isr(XFiberChannel* channel, void* dst, size_t* o_size)
 {
     XError err = X_ERR_NONE;
-    XFiberMailbox* mailbox = X__Malloc(sizeof(*mailbox));
-    if (!mailbox)
-        return X_ERR_NO_MEMORY;
 
-    xilist_init(&mailbox->m_pending_tasks);
-    xilist_init(&mailbox->m_messages);
-    mailbox->m_type = X_FIBER_OBJTYPE_MAILBOX;
-    *o_mailbox = mailbox;
+    if (X__CHANNEL_CAN_RECEIVE(channel))
+    {
+        *o_size = xmsgbuf_pull(&channel->m_buffer, dst);
+        if (X__HAS_WAITERS(channel))
+            X__ServiceChannel(channel);
+    }
+    else
+    {
+        err = X_ERR_TIMED_OUT;
+        goto x__exit;
+    }
 
+x__exit:
     return err;
 }
 
 
-void xfiber_mailbox_destroy(XFiberMailbox* mailbox)
+XError xfiber_channel_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num)
 {
-    X_FIBER_ENTER_CRITICAL();
-    {
-        X__PargePendingTasks(&mailbox->m_pending_tasks);
-        X__Free(mailbox);
-    }
-    X_FIBER_EXIT_CRITICAL();
+    return xfiber_channel_timed_send_n(channel, src, sizes, n, o_num, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_mailbox_send(XFiberMailbox* mailbox, XFiberMessage* message)
+XError xfiber_channel_try_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num)
+{
+    return xfiber_channel_timed_send_n(channel, src, sizes, n, o_num, 0);
+}
+
+
+XError xfiber_channel_timed_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
+    bool waiting = false;
+    size_t num = 0;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    if ((!src) || (!sizes) || (n == 0))
+        return X_ERR_INVALID;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xilist_empty(&mailbox->m_messages) && !xilist_empty(&mailbox->m_pending_tasks))
+        num = X__ChannelSendN(channel, src, sizes, n, &scheduling_request);
+        if (num == 0)
         {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&mailbox->m_pending_tasks));
-            *((XFiberMessage**)(pend_task->m_pending_recv_dst)) = message;
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            scheduling_request = true;
+            X__CHECK_POLL(timeout);
+            waiting = true;
+            cur_task->m_pending_send_src = X__ResolvePtr(cur_task, src);
+            cur_task->m_channel_item_size = sizes[0];
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEND_CHANNEL, timeout);
         }
-        else
+    }
+    X__EXIT_CRITICAL();
+
+    /* 1要素目の送信を待った場合は、残りは待たずに送れるだけ送る */
+    if (waiting)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
         {
-            xilist_push_back(&mailbox->m_messages, message);
+            num = 1;
+            X__ENTER_CRITICAL();
+            num += X__ChannelSendN(channel, (const uint8_t*)src + sizes[0], sizes + 1, n - 1, &scheduling_request);
+            X__EXIT_CRITICAL();
         }
     }
-    X_FIBER_EXIT_CRITICAL();
 
     if (scheduling_request)
         X__Schedule();
 
+x__exit:
+    *o_num = num;
     return err;
 }
 
 
-XError xfiber_mailbox_send_isr(XFiberMailbox* mailbox, XFiberMessage* message)
+XError xfiber_channel_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num)
+{
+    return xfiber_channel_timed_receive_n(channel, dst, dst_size, o_sizes, n, o_num, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_channel_try_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num)
+{
+    return xfiber_channel_timed_receive_n(channel, dst, dst_size, o_sizes, n, o_num, 0);
+}
+
+
+XError xfiber_channel_timed_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num, XTicks timeout)
 {
     XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    bool waiting = false;
+    size_t num = 0;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    if (xilist_empty(&mailbox->m_messages) && !xilist_empty(&mailbox->m_pending_tasks))
+    if ((!dst) || (!o_sizes) || (n == 0) || (dst_size < channel->m_max_item_size))
+        return X_ERR_INVALID;
+
+    X__ENTER_CRITICAL();
     {
-        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&mailbox->m_pending_tasks));
-        *((XFiberMessage**)(pend_task->m_pending_recv_dst)) = message;
-        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+        num = X__ChannelReceiveN(channel, dst, dst_size, o_sizes, n, &scheduling_request);
+        if (num == 0)
+        {
+            X__CHECK_POLL(timeout);
+            waiting = true;
+            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, dst);
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_CHANNEL, timeout);
+        }
     }
-    else
+    X__EXIT_CRITICAL();
+
+    /* 1要素目の受信を待った場合は、残りは待たずに受け取れるだけ受け取る */
+    if (waiting)
     {
-        xilist_push_back(&mailbox->m_messages, message);
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+        {
+            const size_t size = cur_task->m_channel_item_size;
+
+            o_sizes[0] = size;
+            num = 1;
+            X__ENTER_CRITICAL();
+            num += X__ChannelReceiveN(channel, (uint8_t*)dst + size, dst_size - size,
+                                      o_sizes + 1, n - 1, &scheduling_request);
+            X__EXIT_CRITICAL();
+        }
     }
 
+    if (scheduling_request)
+        X__Schedule();
+
+x__exit:
+    *o_num = num;
     return err;
 }
 
 
-XError xfiber_mailbox_receive(XFiberMailbox* mailbox, XFiberMessage** o_message)
+XError xfiber_channel_reserve(XFiberChannel* channel, size_t size, void** o_ptr)
 {
-    return xfiber_mailbox_timed_receive(mailbox, o_message, X_TICKS_FOREVER);
+    return xfiber_channel_timed_reserve(channel, size, o_ptr, X_TICKS_FOREVER);
 }
 
 
-XError xfiber_mailbox_try_receive(XFiberMailbox* mailbox, XFiberMessage** o_message)
+XError xfiber_channel_try_reserve(XFiberChannel* channel, size_t size, void** o_ptr)
 {
-    return xfiber_mailbox_timed_receive(mailbox, o_message, 0);
+    return xfiber_channel_timed_reserve(channel, size, o_ptr, 0);
 }
 
 
-XError xfiber_mailbox_timed_receive(XFiberMailbox* mailbox, XFiberMessage** o_message, XTicks timeout)
+XError xfiber_channel_timed_reserve(XFiberChannel* channel, size_t size, void** o_ptr, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+    uint8_t* msg;
+
+    if ((size == 0) || (size > channel->m_max_item_size))
+        return X_ERR_INVALID;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (!xilist_empty(&mailbox->m_messages))
+        if ((msg = X__ChannelPrepare(channel, size)) != NULL)
         {
-            *o_message = xilist_pop_front(&mailbox->m_messages);
+            channel->m_reserved = msg;
+            channel->m_reserved_size = size;
+            *o_ptr = msg;
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
-            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, (void*)o_message);
-            X__TransitionIntoWaitState(&mailbox->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_RECV_MAILBOX, timeout);
+            cur_task->m_pending_send_src = NULL;
+            cur_task->m_channel_item_size = size;
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEND_CHANNEL, timeout);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
         X__Schedule();
         err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+            *o_ptr = cur_task->m_zero_copy_ptr;
     }
 
 x__exit:
@@ -1690,85 +2812,181 @@ x__exit:
 }
 
 
-XError xfiber_mailbox_receive_isr(XFiberMailbox* mailbox, XFiberMessage** o_message)
+void xfiber_channel_commit(XFiberChannel* channel, size_t size)
 {
-    if (!xilist_empty(&mailbox->m_messages))
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
     {
-        *o_message = xilist_pop_front(&mailbox->m_messages);
-        return X_ERR_NONE;
+        X_ASSERT(channel->m_reserved);
+        X_ASSERT(size <= channel->m_reserved_size);
+
+        if (size > 0)
+            xmsgbuf_commit(&channel->m_buffer, channel->m_reserved, size);
+        channel->m_reserved = NULL;
+        if (X__HAS_WAITERS(channel))
+            scheduling_request = X__ServiceChannel(channel);
     }
+    X__EXIT_CRITICAL();
 
-    return X_ERR_TIMED_OUT;
+    if (scheduling_request)
+        X__Schedule();
 }
 
 
-XError xfiber_pool_create(XFiberPool** o_pool, size_t block_size, size_t num_blocks)
+XError xfiber_channel_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size)
+{
+    return xfiber_channel_timed_peek(channel, o_ptr, o_size, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_channel_try_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size)
+{
+    return xfiber_channel_timed_peek(channel, o_ptr, o_size, 0);
+}
+
+
+XError xfiber_channel_timed_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size, XTicks timeout)
 {
     XError err = X_ERR_NONE;
-    XFiberPool* pool = X__Malloc(x_roundup_multiple(
-                sizeof(*pool), X_ALIGN_OF(XMaxAlign)) +
-                block_size * num_blocks);
-    if (!pool)
-        return X_ERR_NO_MEMORY;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    xilist_init(&pool->m_pending_tasks);
-    xfalloc_init(&pool->m_allocator,
-                 (uint8_t*)pool + x_roundup_multiple(sizeof(*pool), X_ALIGN_OF(XMaxAlign)),
-                 block_size * num_blocks,
-                 block_size);
+    X__ENTER_CRITICAL();
+    {
+        if (X__CHANNEL_CAN_RECEIVE(channel))
+        {
+            *o_ptr = X__ChannelPeek(channel, o_size);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            cur_task->m_pending_recv_dst = NULL;
+            X__TransitionIntoWaitState(&channel->m_pending_tasks, channel->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_CHANNEL, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
 
-    pool->m_type = X_FIBER_OBJTYPE_POOL;
-    *o_pool = pool;
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+        {
+            *o_ptr = cur_task->m_zero_copy_ptr;
+            *o_size = cur_task->m_channel_item_size;
+        }
+    }
 
+x__exit:
     return err;
 }
 
 
-void xfiber_pool_destroy(XFiberPool* pool)
+void xfiber_channel_consume(XFiberChannel* channel)
 {
-    X_FIBER_ENTER_CRITICAL();
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
     {
-        X__PargePendingTasks(&pool->m_pending_tasks);
-        X__Free(pool);
+        X_ASSERT(channel->m_peeking);
+        channel->m_peeking = false;
+        xmsgbuf_skip(&channel->m_buffer);
+        if (X__HAS_WAITERS(channel))
+            scheduling_request = X__ServiceChannel(channel);
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
 }
 
 
-XError xfiber_pool_get(XFiberPool* pool, void** o_mem)
+XError xfiber_mutex_create(XFiberMutex** o_mutex)
 {
-    return xfiber_pool_timed_get(pool, o_mem, X_TICKS_FOREVER);
+    return xfiber_mutex_create_ex(o_mutex, X_FIBER_WAIT_FIFO);
 }
 
 
-XError xfiber_pool_try_get(XFiberPool* pool, void** o_mem)
+XError xfiber_mutex_create_ex(XFiberMutex** o_mutex, XMode wait_mode)
 {
-    return xfiber_pool_timed_get(pool, o_mem, 0);
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+    if (!o_mutex)
+        return X_ERR_INVALID;
+
+    XFiberMutex* mutex = X__Malloc(sizeof(XFiberMutex));
+    if (!mutex)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&mutex->m_pending_tasks);
+    xilist_init(&mutex->m_selectors);
+    mutex->m_type = X_FIBER_OBJTYPE_MUTEX;
+    mutex->m_wait_mode = wait_mode;
+    mutex->m_holder = NULL;
+    *o_mutex = mutex;
+
+    return X_ERR_NONE;
 }
 
 
-XError xfiber_pool_timed_get(XFiberPool* pool, void** o_mem, XTicks timeout)
+void xfiber_mutex_destroy(XFiberMutex* mutex)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&mutex->m_pending_tasks);
+        if (mutex->m_holder)
+        {
+            XFiber* const holder = mutex->m_holder;
+            mutex->m_holder = NULL;
+            xnode_unlink(&mutex->m_held_node);
+            X__UpdateInheritedPriority(holder);
+        }
+        X__Free(mutex);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_mutex_lock(XFiberMutex* mutex)
+{
+    return xfiber_mutex_timed_lock(mutex, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_mutex_try_lock(XFiberMutex* mutex)
+{
+    return xfiber_mutex_timed_lock(mutex, 0);
+}
+
+
+XError xfiber_mutex_timed_lock(XFiberMutex* mutex, XTicks timeout)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
-    XFiber* cur_task = priv->m_cur_task;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (xfalloc_remain_blocks(&pool->m_allocator) > 0)
+        if (!mutex->m_holder)
         {
-            *o_mem = xfalloc_allocate(&pool->m_allocator);
+            X__AcquireMutex(mutex, cur_task);
         }
         else
         {
             X__CHECK_POLL(timeout);
             scheduling_request = true;
-            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, (void*)o_mem);
-            X__TransitionIntoWaitState(&pool->m_pending_tasks, cur_task,
-                                       X_FIBER_STATE_WAITING_POOL, timeout);
+            X__TransitionIntoWaitState(&mutex->m_pending_tasks, mutex->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_MUTEX, timeout);
+
+            /* 獲得待ちの間は、ロック中のファイバーに自分の優先度を継承させる */
+            cur_task->m_waiting_mutex = mutex;
+            X__UpdateInheritedPriority(mutex->m_holder);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
 
     if (scheduling_request)
     {
@@ -1781,293 +2999,3215 @@ x__exit:
 }
 
 
-XError xfiber_pool_get_isr(XFiberPool* pool, void** o_mem)
-{
-    if (xfalloc_remain_blocks(&pool->m_allocator) > 0)
-    {
-        *o_mem = xfalloc_allocate(&pool->m_allocator);
-        return X_ERR_NONE;
-    }
-
-    return X_ERR_TIMED_OUT;
-}
-
-
-XError xfiber_pool_release(XFiberPool* pool, void* mem)
+XError xfiber_mutex_unlock(XFiberMutex* mutex)
 {
     XError err = X_ERR_NONE;
     bool scheduling_request = false;
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if ((xfalloc_remain_blocks(&pool->m_allocator) == 0) && !xilist_empty(&pool->m_pending_tasks))
+        if (!mutex->m_holder)
         {
-            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&pool->m_pending_tasks));
-            *((void**)(pend_task->m_pending_recv_dst)) = mem;
-            X__ReleaseWaiting(pend_task, X_ERR_NONE);
-            scheduling_request = true;
+            /* ロックされていない */
+            err = X_ERR_PROTOCOL;
+            X__EXIT_CRITICAL();
+            goto x__exit;
         }
         else
         {
-            xfalloc_deallocate(&pool->m_allocator, mem);
+            XFiber* const holder = mutex->m_holder;
+            const int priority = holder->m_priority;
+
+            /* 継承していた優先度が下がった場合も再スケジューリングが必要 */
+            scheduling_request = (X__ReleaseMutex(mutex) != NULL) ||
+                                 (holder->m_priority != priority);
         }
     }
-    X_FIBER_EXIT_CRITICAL();
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_mutex_unlock_isr(XFiberMutex* mutex)
+{
+    XError err = X_ERR_NONE;
+    if (!mutex->m_holder)
+        return X_ERR_PROTOCOL;
+
+    X__ReleaseMutex(mutex);
+
+    return err;
+}
+
+
+XError xfiber_rwlock_create(XFiberRwLock** o_rwlock)
+{
+    return xfiber_rwlock_create_ex(o_rwlock, X_FIBER_WAIT_FIFO, false);
+}
+
+
+XError xfiber_rwlock_create_ex(XFiberRwLock** o_rwlock, XMode wait_mode, bool prefer_writer)
+{
+    XFiberRwLock* rwlock;
+
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+    if (!o_rwlock)
+        return X_ERR_INVALID;
+
+    rwlock = X__Malloc(sizeof(*rwlock));
+    if (!rwlock)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&rwlock->m_pending_tasks);
+    xilist_init(&rwlock->m_selectors);
+    rwlock->m_type = X_FIBER_OBJTYPE_RWLOCK;
+    rwlock->m_wait_mode = wait_mode;
+    rwlock->m_writer = NULL;
+    rwlock->m_num_readers = 0;
+    rwlock->m_prefer_writer = prefer_writer;
+    *o_rwlock = rwlock;
+
+    return X_ERR_NONE;
+}
+
+
+void xfiber_rwlock_destroy(XFiberRwLock* rwlock)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&rwlock->m_pending_tasks);
+        X__Free(rwlock);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_rwlock_read_lock(XFiberRwLock* rwlock)
+{
+    return xfiber_rwlock_timed_read_lock(rwlock, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_rwlock_try_read_lock(XFiberRwLock* rwlock)
+{
+    return xfiber_rwlock_timed_read_lock(rwlock, 0);
+}
+
+
+XError xfiber_rwlock_timed_read_lock(XFiberRwLock* rwlock, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        /* 書き込み優先の場合は、待ちファイバーを追い越さない */
+        if (!rwlock->m_writer &&
+            (!rwlock->m_prefer_writer || xilist_empty(&rwlock->m_pending_tasks)))
+        {
+            rwlock->m_num_readers++;
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            X__TransitionIntoWaitState(&rwlock->m_pending_tasks, rwlock->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_READ_LOCK, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_rwlock_read_unlock(XFiberRwLock* rwlock)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if (rwlock->m_num_readers == 0)
+        {
+            err = X_ERR_PROTOCOL;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        rwlock->m_num_readers--;
+        scheduling_request = X__ServiceRwLock(rwlock);
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_rwlock_write_lock(XFiberRwLock* rwlock)
+{
+    return xfiber_rwlock_timed_write_lock(rwlock, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_rwlock_try_write_lock(XFiberRwLock* rwlock)
+{
+    return xfiber_rwlock_timed_write_lock(rwlock, 0);
+}
+
+
+XError xfiber_rwlock_timed_write_lock(XFiberRwLock* rwlock, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (!rwlock->m_writer && (rwlock->m_num_readers == 0))
+        {
+            rwlock->m_writer = cur_task;
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            X__TransitionIntoWaitState(&rwlock->m_pending_tasks, rwlock->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_WRITE_LOCK, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+
+        /* 書き込み優先の場合、自分の後ろで止められていた読み込み待ちを流す */
+        if (err == X_ERR_TIMED_OUT)
+        {
+            X__ENTER_CRITICAL();
+            scheduling_request = X__ServiceRwLock(rwlock);
+            X__EXIT_CRITICAL();
+
+            if (scheduling_request)
+                X__Schedule();
+        }
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_rwlock_write_unlock(XFiberRwLock* rwlock)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if (rwlock->m_writer != X__CurWorker()->m_cur_task)
+        {
+            err = X_ERR_PROTOCOL;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        rwlock->m_writer = NULL;
+        scheduling_request = X__ServiceRwLock(rwlock);
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_cond_create(XFiberCond** o_cond)
+{
+    return xfiber_cond_create_ex(o_cond, X_FIBER_WAIT_FIFO);
+}
+
+
+XError xfiber_cond_create_ex(XFiberCond** o_cond, XMode wait_mode)
+{
+    XFiberCond* cond;
+
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+    if (!o_cond)
+        return X_ERR_INVALID;
+
+    cond = X__Malloc(sizeof(*cond));
+    if (!cond)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&cond->m_pending_tasks);
+    xilist_init(&cond->m_selectors);
+    cond->m_type = X_FIBER_OBJTYPE_COND;
+    cond->m_wait_mode = wait_mode;
+    *o_cond = cond;
+
+    return X_ERR_NONE;
+}
+
+
+void xfiber_cond_destroy(XFiberCond* cond)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&cond->m_pending_tasks);
+        X__Free(cond);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_cond_wait(XFiberCond* cond, XFiberMutex* mutex)
+{
+    return xfiber_cond_timed_wait(cond, mutex, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_cond_timed_wait(XFiberCond* cond, XFiberMutex* mutex, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    XError lock_err;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (mutex->m_holder != cur_task)
+        {
+            err = X_ERR_PROTOCOL;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        /* ロック解除と待ちへの遷移の間に通知が割り込まないよう、同じクリティカ
+         * ルセクションで行う。
+         */
+        X__ReleaseMutex(mutex);
+        if (timeout == 0)
+        {
+            err = X_ERR_TIMED_OUT;
+        }
+        else
+        {
+            X__TransitionIntoWaitState(&cond->m_pending_tasks, cond->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_COND, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    X__Schedule();
+    if (timeout != 0)
+        err = cur_task->m_result_waiting;
+
+    lock_err = xfiber_mutex_lock(mutex);
+    if (err == X_ERR_NONE)
+        err = lock_err;
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_cond_signal(XFiberCond* cond)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if (!xilist_empty(&cond->m_pending_tasks))
+        {
+            X__ReleaseWaiting(X__NODE_TO_FIBER(xilist_front(&cond->m_pending_tasks)), X_ERR_NONE);
+            scheduling_request = true;
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+    return err;
+}
+
+
+XError xfiber_cond_broadcast(XFiberCond* cond)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        while (!xilist_empty(&cond->m_pending_tasks))
+        {
+            X__ReleaseWaiting(X__NODE_TO_FIBER(xilist_front(&cond->m_pending_tasks)), X_ERR_NONE);
+            scheduling_request = true;
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+    return err;
+}
+
+
+XError xfiber_semaphore_create(XFiberSemaphore** o_semaphore, int initial_count)
+{
+    return xfiber_semaphore_create_ex(o_semaphore, initial_count, X_FIBER_WAIT_FIFO);
+}
+
+
+XError xfiber_semaphore_create_ex(XFiberSemaphore** o_semaphore, int initial_count, XMode wait_mode)
+{
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+    if (!o_semaphore)
+        return X_ERR_INVALID;
+
+    XFiberSemaphore* semaphore = X__Malloc(sizeof(XFiberSemaphore));
+    if (!semaphore)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&semaphore->m_pending_tasks);
+    xilist_init(&semaphore->m_selectors);
+    semaphore->m_type = X_FIBER_OBJTYPE_SEMAPHORE;
+    semaphore->m_wait_mode = wait_mode;
+    semaphore->m_count = initial_count;
+    *o_semaphore = semaphore;
+
+    return X_ERR_NONE;
+}
+
+
+void xfiber_semaphore_destroy(XFiberSemaphore* semaphore)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&semaphore->m_pending_tasks);
+        X__PargeSelectors(&semaphore->m_selectors);
+        X__Free(semaphore);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_semaphore_take(XFiberSemaphore* semaphore)
+{
+    return xfiber_semaphore_timed_take(semaphore, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_semaphore_try_take(XFiberSemaphore* semaphore)
+{
+    return xfiber_semaphore_timed_take(semaphore, 0);
+}
+
+
+XError xfiber_semaphore_timed_take(XFiberSemaphore* semaphore, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (semaphore->m_count > 0)
+        {
+            semaphore->m_count--;
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            X__TransitionIntoWaitState(&semaphore->m_pending_tasks, semaphore->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_SEMAPHORE, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_semaphore_give(XFiberSemaphore* semaphore)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if (xilist_empty(&semaphore->m_pending_tasks))
+        {
+            semaphore->m_count++;
+            scheduling_request = X__NotifySelectors(&semaphore->m_selectors);
+        }
+        else
+        {
+            XFiber* const pend_task = X__NODE_TO_FIBER(
+                    xilist_pop_front(&semaphore->m_pending_tasks));
+            X__ReleaseWaiting(pend_task, X_ERR_NONE);
+            scheduling_request = true;
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+    return err;
+}
+
+
+XError xfiber_semaphore_give_isr(XFiberSemaphore* semaphore)
+{
+    XError err = X_ERR_NONE;
+
+    if (xilist_empty(&semaphore->m_pending_tasks))
+    {
+        semaphore->m_count++;
+        X__NotifySelectors(&semaphore->m_selectors);
+    }
+    else
+    {
+        XFiber* const pend_task = X__NODE_TO_FIBER(
+                xilist_pop_front(&semaphore->m_pending_tasks));
+        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+    }
+
+    return err;
+}
+
+
+XError xfiber_mailbox_create(XFiberMailbox** o_mailbox)
+{
+    return xfiber_mailbox_create_ex(o_mailbox, X_FIBER_WAIT_FIFO);
+}
+
+
+XError xfiber_mailbox_create_ex(XFiberMailbox** o_mailbox, XMode wait_mode)
+{
+    XError err = X_ERR_NONE;
+    XFiberMailbox* mailbox;
+
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+
+    mailbox = X__Malloc(sizeof(*mailbox));
+    if (!mailbox)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&mailbox->m_pending_tasks);
+    xilist_init(&mailbox->m_selectors);
+    xilist_init(&mailbox->m_messages);
+    mailbox->m_type = X_FIBER_OBJTYPE_MAILBOX;
+    mailbox->m_wait_mode = wait_mode;
+    *o_mailbox = mailbox;
+
+    return err;
+}
+
+
+void xfiber_mailbox_destroy(XFiberMailbox* mailbox)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&mailbox->m_pending_tasks);
+        X__PargeSelectors(&mailbox->m_selectors);
+        X__Free(mailbox);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_mailbox_send(XFiberMailbox* mailbox, XFiberMessage* message)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if (xilist_empty(&mailbox->m_messages) && !xilist_empty(&mailbox->m_pending_tasks))
+        {
+            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&mailbox->m_pending_tasks));
+            *((XFiberMessage**)(pend_task->m_pending_recv_dst)) = message;
+            X__ReleaseWaiting(pend_task, X_ERR_NONE);
+            scheduling_request = true;
+        }
+        else
+        {
+            xilist_push_back(&mailbox->m_messages, message);
+            scheduling_request = X__NotifySelectors(&mailbox->m_selectors);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+    return err;
+}
+
+
+XError xfiber_mailbox_send_isr(XFiberMailbox* mailbox, XFiberMessage* message)
+{
+    XError err = X_ERR_NONE;
+
+    if (xilist_empty(&mailbox->m_messages) && !xilist_empty(&mailbox->m_pending_tasks))
+    {
+        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&mailbox->m_pending_tasks));
+        *((XFiberMessage**)(pend_task->m_pending_recv_dst)) = message;
+        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+    }
+    else
+    {
+        xilist_push_back(&mailbox->m_messages, message);
+        X__NotifySelectors(&mailbox->m_selectors);
+    }
+
+    return err;
+}
+
+
+XError xfiber_mailbox_receive(XFiberMailbox* mailbox, XFiberMessage** o_message)
+{
+    return xfiber_mailbox_timed_receive(mailbox, o_message, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_mailbox_try_receive(XFiberMailbox* mailbox, XFiberMessage** o_message)
+{
+    return xfiber_mailbox_timed_receive(mailbox, o_message, 0);
+}
+
+
+XError xfiber_mailbox_timed_receive(XFiberMailbox* mailbox, XFiberMessage** o_message, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (!xilist_empty(&mailbox->m_messages))
+        {
+            *o_message = xilist_pop_front(&mailbox->m_messages);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, (void*)o_message);
+            X__TransitionIntoWaitState(&mailbox->m_pending_tasks, mailbox->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_MAILBOX, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_mailbox_receive_isr(XFiberMailbox* mailbox, XFiberMessage** o_message)
+{
+    if (!xilist_empty(&mailbox->m_messages))
+    {
+        *o_message = xilist_pop_front(&mailbox->m_messages);
+        return X_ERR_NONE;
+    }
+
+    return X_ERR_TIMED_OUT;
+}
+
+
+XError xfiber_pool_create(XFiberPool** o_pool, size_t block_size, size_t num_blocks)
+{
+    return xfiber_pool_create_ex(o_pool, block_size, num_blocks, X_FIBER_WAIT_FIFO);
+}
+
+
+XError xfiber_pool_create_ex(XFiberPool** o_pool, size_t block_size, size_t num_blocks, XMode wait_mode)
+{
+    XError err = X_ERR_NONE;
+    XFiberPool* pool;
+
+    if (!X__IS_VALID_WAIT_MODE(wait_mode))
+        return X_ERR_INVALID;
+
+    pool = X__Malloc(x_roundup_multiple(
+                sizeof(*pool), X_ALIGN_OF(XMaxAlign)) +
+                block_size * num_blocks);
+    if (!pool)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&pool->m_pending_tasks);
+    xilist_init(&pool->m_selectors);
+    xfalloc_init(&pool->m_allocator,
+                 (uint8_t*)pool + x_roundup_multiple(sizeof(*pool), X_ALIGN_OF(XMaxAlign)),
+                 block_size * num_blocks,
+                 block_size);
+
+    pool->m_type = X_FIBER_OBJTYPE_POOL;
+    pool->m_wait_mode = wait_mode;
+    *o_pool = pool;
+
+    return err;
+}
+
+
+void xfiber_pool_destroy(XFiberPool* pool)
+{
+    X__ENTER_CRITICAL();
+    {
+        X__PargePendingTasks(&pool->m_pending_tasks);
+        X__PargeSelectors(&pool->m_selectors);
+        X__Free(pool);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_pool_get(XFiberPool* pool, void** o_mem)
+{
+    return xfiber_pool_timed_get(pool, o_mem, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_pool_try_get(XFiberPool* pool, void** o_mem)
+{
+    return xfiber_pool_timed_get(pool, o_mem, 0);
+}
+
+
+XError xfiber_pool_timed_get(XFiberPool* pool, void** o_mem, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (xfalloc_remain_blocks(&pool->m_allocator) > 0)
+        {
+            *o_mem = xfalloc_allocate(&pool->m_allocator);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            cur_task->m_pending_recv_dst = X__ResolvePtr(cur_task, (void*)o_mem);
+            X__TransitionIntoWaitState(&pool->m_pending_tasks, pool->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_POOL, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_pool_get_isr(XFiberPool* pool, void** o_mem)
+{
+    if (xfalloc_remain_blocks(&pool->m_allocator) > 0)
+    {
+        *o_mem = xfalloc_allocate(&pool->m_allocator);
+        return X_ERR_NONE;
+    }
+
+    return X_ERR_TIMED_OUT;
+}
+
+
+XError xfiber_pool_release(XFiberPool* pool, void* mem)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+
+    X__ENTER_CRITICAL();
+    {
+        if ((xfalloc_remain_blocks(&pool->m_allocator) == 0) && !xilist_empty(&pool->m_pending_tasks))
+        {
+            XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&pool->m_pending_tasks));
+            *((void**)(pend_task->m_pending_recv_dst)) = mem;
+            X__ReleaseWaiting(pend_task, X_ERR_NONE);
+            scheduling_request = true;
+        }
+        else
+        {
+            xfalloc_deallocate(&pool->m_allocator, mem);
+            scheduling_request = X__NotifySelectors(&pool->m_selectors);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+        X__Schedule();
+
+    return err;
+}
+
+
+XError xfiber_pool_release_isr(XFiberPool* pool, void* mem)
+{
+    if ((xfalloc_remain_blocks(&pool->m_allocator) == 0) && !xilist_empty(&pool->m_pending_tasks))
+    {
+        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&pool->m_pending_tasks));
+        *((void**)(pend_task->m_pending_recv_dst)) = mem;
+        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+    }
+    else
+    {
+        xfalloc_deallocate(&pool->m_allocator, mem);
+        X__NotifySelectors(&pool->m_selectors);
+    }
+
+    return X_ERR_NONE;
+}
+
+
+XError xfiber_ring_create(XFiberRing** o_ring, size_t ring_len, size_t item_size)
+{
+    const size_t header_size = x_roundup_multiple(sizeof(XFiberRing), X_ALIGN_OF(XMaxAlign));
+    XFiberRing* ring;
+
+    if ((!o_ring) || (ring_len == 0) || (item_size == 0))
+        return X_ERR_INVALID;
+
+    ring_len = x_roundup_power_of_two(ring_len);
+    ring = X__Malloc(header_size + ring_len * item_size);
+    if (!ring)
+        return X_ERR_NO_MEMORY;
+
+    xilist_init(&ring->m_pending_tasks);
+    xilist_init(&ring->m_selectors);
+    ring->m_type = X_FIBER_OBJTYPE_RING;
+    ring->m_wait_mode = X_FIBER_WAIT_FIFO;
+    ring->m_data = (uint8_t*)ring + header_size;
+    ring->m_item_size = item_size;
+    ring->m_mask = ring_len - 1;
+    ring->m_head = 0;
+    ring->m_tail = 0;
+
+    X__ENTER_CRITICAL();
+    xilist_push_back(&priv->m_rings, &ring->m_ring_node);
+    X__EXIT_CRITICAL();
+
+    *o_ring = ring;
+
+    return X_ERR_NONE;
+}
+
+
+void xfiber_ring_destroy(XFiberRing* ring)
+{
+    X__ENTER_CRITICAL();
+    {
+        xnode_unlink(&ring->m_ring_node);
+        X__PargePendingTasks(&ring->m_pending_tasks);
+        X__PargeSelectors(&ring->m_selectors);
+        X__Free(ring);
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+XError xfiber_ring_push_isr(XFiberRing* ring, const void* src)
+{
+    const size_t head = ring->m_head;
+
+    if (head - X__ATOMIC_LOAD(&ring->m_tail) > ring->m_mask)
+        return X_ERR_TIMED_OUT;
+
+    memcpy(ring->m_data + (head & ring->m_mask) * ring->m_item_size, src, ring->m_item_size);
+
+    /* 要素の書き込みが完了してから公開し、次回のスケジューリングで通知させる */
+    X__ATOMIC_STORE(&ring->m_head, head + 1);
+    X__ATOMIC_STORE(&priv->m_ring_pushed, 1);
+
+    return X_ERR_NONE;
+}
+
+
+XError xfiber_ring_receive(XFiberRing* ring, void* dst)
+{
+    return xfiber_ring_timed_receive(ring, dst, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_ring_try_receive(XFiberRing* ring, void* dst)
+{
+    return xfiber_ring_timed_receive(ring, dst, 0);
+}
+
+
+XError xfiber_ring_timed_receive(XFiberRing* ring, void* dst, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    while (!X__RingPop(ring, dst))
+    {
+        X__ENTER_CRITICAL();
+        {
+            /* 空と判定してから待ちに入るまでの間に追加された要素は、ここで拾う
+             * 。待ちに入った後の追加は、この後のスケジューリングで通知される。
+             */
+            if (xfiber_ring_count(ring) > 0)
+            {
+                X__EXIT_CRITICAL();
+                continue;
+            }
+
+            X__CHECK_POLL(timeout);
+            X__TransitionIntoWaitState(&ring->m_pending_tasks, ring->m_wait_mode, cur_task,
+                                       X_FIBER_STATE_WAITING_RECV_RING, timeout);
+        }
+        X__EXIT_CRITICAL();
+
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err != X_ERR_NONE)
+            break;
+    }
+
+x__exit:
+    return err;
+}
+
+
+size_t xfiber_ring_count(const XFiberRing* ring)
+{
+    return X__ATOMIC_LOAD(&ring->m_head) - X__ATOMIC_LOAD(&ring->m_tail);
+}
+
+
+XError xfiber_select(const XFiberSelectItem* items, int num, int* o_index)
+{
+    return xfiber_timed_select(items, num, o_index, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_try_select(const XFiberSelectItem* items, int num, int* o_index)
+{
+    return xfiber_timed_select(items, num, o_index, 0);
+}
+
+
+XError xfiber_timed_select(const XFiberSelectItem* items, int num, int* o_index, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+    X__SelectWaiter* waiters = NULL;
+    int index = -1;
+    int i;
+
+    if ((!items) || (num <= 0))
+        return X_ERR_INVALID;
+
+    for (i = 0; i < num; i++)
+    {
+        const struct XFiberWaitObject* const object = items[i].object;
+        if ((!object) ||
+            (object->m_type == X_FIBER_OBJTYPE_TASK) ||
+            (object->m_type == X_FIBER_OBJTYPE_MUTEX) ||
+            (object->m_type == X_FIBER_OBJTYPE_RWLOCK) ||
+            (object->m_type == X_FIBER_OBJTYPE_COND) ||
+            (object->m_type >= X_FIBER_OBJTYPE_END))
+            return X_ERR_INVALID;
+    }
+
+    /* 待ちに入る場合に備えて、先に待ちノードを確保しておく */
+    if (timeout != 0)
+    {
+        waiters = X__Malloc(sizeof(*waiters) * num);
+        if (!waiters)
+            return X_ERR_NO_MEMORY;
+    }
+
+    X__ENTER_CRITICAL();
+    {
+        for (i = 0; i < num; i++)
+        {
+            if (X__SelectReady(&items[i]))
+            {
+                index = i;
+                break;
+            }
+        }
+
+        if (index >= 0)
+        {
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        X__CHECK_POLL(timeout);
+
+        for (i = 0; i < num; i++)
+        {
+            struct XFiberWaitObject* const object = items[i].object;
+            waiters[i].m_fiber = cur_task;
+            waiters[i].m_index = i;
+            waiters[i].m_item = items[i];
+            xilist_push_back(&object->m_selectors, &waiters[i].m_node);
+        }
+
+        /* 待ちリストはオブジェクトの数だけあるので、ファイバー自身はシグナル待
+         * ちと同様に遅延キューにつないでおく
+         */
+        cur_task->m_select_waiters = waiters;
+        cur_task->m_select_num = num;
+        cur_task->m_select_index = -1;
+        xilist_push_back(&priv->m_delay_queue, &cur_task->m_node);
+        cur_task->m_state = X_FIBER_STATE_WAITING_SELECT;
+
+        if (timeout > 0)
+            X__AddTimerEvent(cur_task, X__TimeoutHandler, timeout);
+    }
+    X__EXIT_CRITICAL();
+
+    X__Schedule();
+    err = cur_task->m_result_waiting;
+    index = cur_task->m_select_index;
+
+x__exit:
+    if (err == X_ERR_NONE)
+        X_ASSIGN_NOT_NULL(o_index, index);
+    X__Free(waiters);
+
+    return err;
+}
+
+
+void xfiber_future_init(XFiberFuture* future, XFiberFutureCallback callback, void* callback_arg)
+{
+    X_ASSERT(future);
+
+    xilist_init(&future->m_waiters);
+    future->m_callback = callback;
+    future->m_callback_arg = callback_arg;
+    future->m_result = NULL;
+    future->m_done = false;
+}
+
+
+bool xfiber_future_is_done(const XFiberFuture* future)
+{
+    bool done;
+
+    X__ENTER_CRITICAL();
+    done = future->m_done;
+    X__EXIT_CRITICAL();
+
+    return done;
+}
+
+
+XError xfiber_future_wait(XFiberFuture* future, void** o_result)
+{
+    return xfiber_future_timed_wait(future, o_result, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_future_try_wait(XFiberFuture* future, void** o_result)
+{
+    return xfiber_future_timed_wait(future, o_result, 0);
+}
+
+
+XError xfiber_future_timed_wait(XFiberFuture* future, void** o_result, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    bool scheduling_request = false;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        if (future->m_done)
+        {
+            X_ASSIGN_NOT_NULL(o_result, future->m_result);
+        }
+        else
+        {
+            X__CHECK_POLL(timeout);
+            scheduling_request = true;
+            X__TransitionIntoWaitState(&future->m_waiters, X_FIBER_WAIT_FIFO, cur_task,
+                                       X_FIBER_STATE_WAITING_FUTURE, timeout);
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (scheduling_request)
+    {
+        X__Schedule();
+        err = cur_task->m_result_waiting;
+        if (err == X_ERR_NONE)
+            X_ASSIGN_NOT_NULL(o_result, future->m_result);
+    }
+
+x__exit:
+    return err;
+}
+
+
+XError xfiber_executor_create(XFiberExecutor** o_executor, int num_workers, size_t queue_len,
+                              int priority, size_t stack_size)
+{
+    XError err = X_ERR_NONE;
+    XFiberExecutor* executor;
+    int i;
+
+    if ((!o_executor) || (num_workers <= 0) || (queue_len == 0))
+        return X_ERR_INVALID;
+
+    executor = X__Malloc(sizeof(*executor) + sizeof(XFiber*) * num_workers);
+    if (!executor)
+        return X_ERR_NO_MEMORY;
+
+    executor->m_workers = (XFiber**)(executor + 1);
+    executor->m_num_workers = 0;
+
+    err = xfiber_queue_create(&executor->m_jobs, queue_len, sizeof(X__ExecutorJob));
+    if (err != X_ERR_NONE)
+    {
+        X__Free(executor);
+        goto x__exit;
+    }
+
+    for (i = 0; i < num_workers; i++)
+    {
+        err = xfiber_create_joinable(&executor->m_workers[i], priority, "executor",
+                                     stack_size, X__ExecutorWorker, executor);
+        if (err != X_ERR_NONE)
+            break;
+        executor->m_num_workers++;
+    }
+
+    /* まだ一度も実行されていないので、強制的に破棄して構わない */
+    if (err != X_ERR_NONE)
+    {
+        for (i = 0; i < executor->m_num_workers; i++)
+            xfiber_destroy(executor->m_workers[i]);
+        xfiber_queue_destroy(executor->m_jobs);
+        X__Free(executor);
+        goto x__exit;
+    }
+
+    *o_executor = executor;
+
+x__exit:
+    return err;
+}
+
+
+void xfiber_executor_destroy(XFiberExecutor* executor)
+{
+    const X__ExecutorJob stop = { NULL, NULL, NULL };
+    int i;
+
+    /* 終了要求はキューの末尾に入るので、投入済みのジョブは全て実行される */
+    for (i = 0; i < executor->m_num_workers; i++)
+        xfiber_queue_send_back(executor->m_jobs, &stop);
+
+    for (i = 0; i < executor->m_num_workers; i++)
+        xfiber_join(executor->m_workers[i], NULL);
+
+    xfiber_queue_destroy(executor->m_jobs);
+    X__Free(executor);
+}
+
+
+XError xfiber_executor_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                              XFiberFuture* future)
+{
+    return xfiber_executor_timed_submit(executor, func, arg, future, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_executor_try_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                                  XFiberFuture* future)
+{
+    return xfiber_executor_timed_submit(executor, func, arg, future, 0);
+}
+
+
+XError xfiber_executor_timed_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                                    XFiberFuture* future, XTicks timeout)
+{
+    X__ExecutorJob job;
+
+    if (!func)
+        return X_ERR_INVALID;
+
+    if (future)
+    {
+        X__ENTER_CRITICAL();
+        X_ASSERT(xilist_empty(&future->m_waiters));
+        future->m_result = NULL;
+        future->m_done = false;
+        X__EXIT_CRITICAL();
+    }
+
+    job.m_func = func;
+    job.m_arg = arg;
+    job.m_future = future;
+
+    return xfiber_queue_timed_send_back(executor->m_jobs, &job, timeout);
+}
+
+
+#if X_CONF_FIBER_USE_EPOLL
+
+
+XError xfiber_io_wait(int fd, XMode events, XMode* o_events)
+{
+    return xfiber_io_timed_wait(fd, events, o_events, X_TICKS_FOREVER);
+}
+
+
+XError xfiber_io_try_wait(int fd, XMode events, XMode* o_events)
+{
+    return xfiber_io_timed_wait(fd, events, o_events, 0);
+}
+
+
+XError xfiber_io_timed_wait(int fd, XMode events, XMode* o_events, XTicks timeout)
+{
+    XError err = X_ERR_NONE;
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+    struct pollfd pfd;
+    struct epoll_event ev;
+    XMode result = 0;
+
+    if ((fd < 0) || ((events & (X_FIBER_IO_READ | X_FIBER_IO_WRITE)) == 0))
+        return X_ERR_INVALID;
+
+    /* 既に準備ができていれば、epollへの登録と削除を省略できる */
+    pfd.fd = fd;
+    pfd.events = ((events & X_FIBER_IO_READ) ? POLLIN : 0) | ((events & X_FIBER_IO_WRITE) ? POLLOUT : 0);
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) < 0)
+        return X_ERR_INVALID;
+    if (pfd.revents & POLLNVAL)
+        return X_ERR_INVALID;
+
+    result = ((pfd.revents & POLLIN) ? X_FIBER_IO_READ : 0) |
+             ((pfd.revents & POLLOUT) ? X_FIBER_IO_WRITE : 0) |
+             ((pfd.revents & (POLLERR | POLLHUP)) ? X_FIBER_IO_ERROR : 0);
+    if (result)
+        goto x__exit;
+
+    X__ENTER_CRITICAL();
+    {
+        X__CHECK_POLL(timeout);
+
+        /* EPOLLONESHOTで、1回通知されたら起床させるまで再通知させない */
+        ev.events = ((events & X_FIBER_IO_READ) ? EPOLLIN : 0) |
+                    ((events & X_FIBER_IO_WRITE) ? EPOLLOUT : 0) | EPOLLONESHOT;
+        ev.data.ptr = cur_task;
+        if (epoll_ctl(priv->m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            err = (errno == EEXIST) ? X_ERR_BUSY : X_ERR_INVALID;
+            X__EXIT_CRITICAL();
+            goto x__exit;
+        }
+
+        cur_task->m_io_fd = fd;
+        cur_task->m_io_events = 0;
+        X__TransitionIntoWaitState(&priv->m_io_waiters, X_FIBER_WAIT_FIFO, cur_task,
+                                   X_FIBER_STATE_WAITING_IO, timeout);
+    }
+    X__EXIT_CRITICAL();
+
+    X__Schedule();
+
+    /* 起床後に他のワーカーから通知されないように、カーネルロック内で削除する */
+    X__ENTER_CRITICAL();
+    {
+        epoll_ctl(priv->m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        cur_task->m_io_fd = -1;
+        err = cur_task->m_result_waiting;
+        result = cur_task->m_io_events;
+    }
+    X__EXIT_CRITICAL();
+
+x__exit:
+    X_ASSIGN_NOT_NULL(o_events, result);
+    return err;
+}
+
+
+#endif /* if X_CONF_FIBER_USE_EPOLL */
+
+
+#if X_CONF_FIBER_USE_STATS
+
+
+XError xfiber_get_stats(const XFiber* fiber, XFiberStats* o_stats)
+{
+    XFiber* const cur_task = X__CurWorker()->m_cur_task;
+
+    if (!o_stats)
+        return X_ERR_INVALID;
+    if (!fiber)
+        fiber = cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        *o_stats = fiber->m_stats;
+
+        /* 実行中であれば、現在時刻までの実行時間を含める */
+        if (fiber == cur_task)
+            o_stats->run_time += (uint32_t)X_CONF_FIBER_STATS_CLOCK() - (uint32_t)fiber->m_stats_timepoint;
+    }
+    X__EXIT_CRITICAL();
+
+    return X_ERR_NONE;
+}
+
+
+void xfiber_reset_stats(XFiber* fiber)
+{
+    if (!fiber)
+        fiber = X__CurWorker()->m_cur_task;
+
+    X__ENTER_CRITICAL();
+    {
+        const uint16_t id = fiber->m_stats.id;
+        memset(&fiber->m_stats, 0, sizeof(fiber->m_stats));
+        fiber->m_stats.id = id;
+        fiber->m_stats_timepoint = X_CONF_FIBER_STATS_CLOCK();
+    }
+    X__EXIT_CRITICAL();
+}
+
+
+typedef struct
+{
+    XFiberStats stats;
+    char        name[sizeof(((XFiber*)0)->m_name)];
+} X__StatsSnapshot;
+
+
+XError xfiber_dump_stats(XStream* stream)
+{
+    static const char* const wait_names[X_FIBER_WAIT_KIND_END] = {
+        "event", "delay", "signal", "queue", "channel", "mutex", "rwlock",
+        "cond", "semaphore", "mailbox", "pool", "ring", "select", "join",
+        "future", "io", "suspend",
+    };
+    XError err = X_ERR_NONE;
+    X__StatsSnapshot* snapshots = NULL;
+    XIntrusiveNode* ite;
+    size_t num = 0;
+    size_t n;
+    size_t j;
+    int i;
+
+    /* ストリームへの出力はカーネルロックの外で行う。ロック中に数えたファイバ
+     * ー分の領域を確保し、再度ロックして統計を写し取る。間に生成されたファイ
+     * バーは出力対象外とする。
+     */
+    X__ENTER_CRITICAL();
+    {
+        xilist_foreach(&priv->m_fibers, ite)
+            num++;
+    }
+    X__EXIT_CRITICAL();
+
+    snapshots = X__Malloc(sizeof(*snapshots) * num);
+    if (!snapshots)
+        return X_ERR_NO_MEMORY;
+
+    n = 0;
+    X__ENTER_CRITICAL();
+    {
+        xilist_foreach(&priv->m_fibers, ite)
+        {
+            const XFiber* const fiber = xnode_entry(ite, XFiber, m_fiber_node);
+
+            if (n == num)
+                break;
+            snapshots[n].stats = fiber->m_stats;
+            memcpy(snapshots[n].name, fiber->m_name, sizeof(snapshots[n].name));
+            n++;
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    if (xstream_printf(stream, "   id name             switches       run_time  max_stack\n") < 0)
+    {
+        err = X_ERR_IO;
+        goto x__exit;
+    }
+
+    for (j = 0; j < n; j++)
+    {
+        const XFiberStats* const stats = &snapshots[j].stats;
+
+        xstream_printf(stream, "%5u %-16s %8lu %14lu %10lu\n",
+                       (unsigned)stats->id, snapshots[j].name,
+                       (unsigned long)stats->num_switches,
+                       (unsigned long)stats->run_time,
+                       (unsigned long)stats->max_stack_usage);
+
+        for (i = 0; i < X_FIBER_WAIT_KIND_END; i++)
+        {
+            if (stats->wait_time[i])
+                xstream_printf(stream, "      wait %-10s %14lu\n",
+                               wait_names[i], (unsigned long)stats->wait_time[i]);
+        }
+    }
+
+    if (xstream_error(stream))
+        err = X_ERR_IO;
+
+x__exit:
+    X__Free(snapshots);
+
+    return err;
+}
+
+
+size_t xfiber_trace_read(XFiberTraceRecord* dst, size_t n)
+{
+#if X_CONF_FIBER_TRACE_SIZE > 0
+    size_t num;
+    size_t pos;
+    size_t i;
+
+    X__ENTER_CRITICAL();
+    {
+        num = X_MIN(n, priv->m_trace_count);
+        pos = (priv->m_trace_head + X_CONF_FIBER_TRACE_SIZE - priv->m_trace_count) % X_CONF_FIBER_TRACE_SIZE;
+        for (i = 0; i < num; i++)
+        {
+            dst[i] = priv->m_trace[pos];
+            pos = (pos + 1) % X_CONF_FIBER_TRACE_SIZE;
+        }
+    }
+    X__EXIT_CRITICAL();
+
+    return num;
+#else
+    X_UNUSED(dst);
+    X_UNUSED(n);
+    return 0;
+#endif
+}
+
+
+XError xfiber_trace_dump(XStream* stream)
+{
+    XError err = X_ERR_NONE;
+#if X_CONF_FIBER_TRACE_SIZE > 0
+    XFiberTraceRecord* records;
+    size_t num;
+    size_t nwritten;
+
+    /* ストリームへの出力はカーネルロックの外で行うので、先に写し取っておく */
+    records = X__Malloc(sizeof(*records) * X_CONF_FIBER_TRACE_SIZE);
+    if (!records)
+        return X_ERR_NO_MEMORY;
+
+    num = xfiber_trace_read(records, X_CONF_FIBER_TRACE_SIZE);
+    if (xstream_write(stream, records, sizeof(*records) * num, &nwritten) != 0)
+        err = X_ERR_IO;
+
+    X__Free(records);
+#else
+    X_UNUSED(stream);
+#endif
+
+    return err;
+}
+
+
+void xfiber_trace_clear(void)
+{
+#if X_CONF_FIBER_TRACE_SIZE > 0
+    X__ENTER_CRITICAL();
+    {
+        priv->m_trace_head = 0;
+        priv->m_trace_count = 0;
+    }
+    X__EXIT_CRITICAL();
+#endif
+}
+
+
+#endif /* if X_CONF_FIBER_USE_STATS */
+
+
+
+static void X__TransitionIntoWaitState(XIntrusiveList* list, XMode wait_mode, XFiber* fiber, XFiberState state, XTicks timeout)
+{
+    X__InsertPendingTask(list, wait_mode, fiber);
+    fiber->m_wait_list = list;
+    fiber->m_wait_mode = wait_mode;
+    fiber->m_state = state;
+    if (timeout > 0)
+        X__AddTimerEvent(fiber, X__TimeoutHandler, timeout);
+}
+
+
+/* X_FIBER_WAIT_PRIORITYの場合は、優先度の高い順かつ同じ優先度の中では到着順に
+ * 並ぶように挿入する
+ */
+static void X__InsertPendingTask(XIntrusiveList* list, XMode wait_mode, XFiber* fiber)
+{
+    XIntrusiveNode* ite;
+    XIntrusiveNode* const end = xilist_end(list);
+
+    if (wait_mode != X_FIBER_WAIT_PRIORITY)
+    {
+        xilist_push_back(list, &fiber->m_node);
+        return;
+    }
+
+    for (ite = xilist_back(list); ite != end; ite = ite->prev)
+    {
+        if (X__NODE_TO_FIBER(ite)->m_priority >= fiber->m_priority)
+            break;
+    }
+    xnode_insert_next(ite, &fiber->m_node);
+}
+
+
+static void X__AddTimerEvent(XFiber* fiber, XFiberTimeEventHandler handler, XTicks time)
+{
+    const XTicks now = X__TICKS_NOW();
+    const XTicks cur_step = now - priv->m_timepoint;
+    time += cur_step;
+    xvtimer_add_request(&priv->m_vtimer,
+                        &fiber->m_timer_request,
+                        (XVTimerCallBack)handler,
+                        fiber,
+                        0,
+                        time,
+                        true,
+                        NULL);
+}
+
+
+static void X__ReleaseWaiting(XFiber* fiber, XError result)
+{
+    XFiberMutex* const mutex = fiber->m_waiting_mutex;
+
+    if (X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_SELECT)
+        X__UnlinkSelectWaiters(fiber);
+
+    xnode_unlink(&fiber->m_node);
+    xvtimer_remove_requst(&priv->m_vtimer, &fiber->m_timer_request);
+    fiber->m_result_waiting = result;
+    fiber->m_wait_list = NULL;
+    X__TRACE(fiber, X_FIBER_TRACE_WAKE, result);
+
+    if (mutex)
+    {
+        /* タイムアウトや破棄で獲得待ちをやめた場合は、継承させていた優先度を
+         * 取り消す
+         */
+        fiber->m_waiting_mutex = NULL;
+        if (mutex->m_holder && (mutex->m_holder != fiber))
+            X__UpdateInheritedPriority(mutex->m_holder);
+    }
+
+    if (X_FIBER_IS_WAITING_SUSPEND(fiber->m_state))
+    {
+        fiber->m_state = X_FIBER_STATE_SUSPEND;
+        xilist_push_back(&priv->m_delay_queue, &fiber->m_node);
+    }
+    else
+    {
+        X__PushToReadyQueue(fiber);
+    }
+}
+
+
+static void X__TimeoutHandler(XFiber* fiber)
+{
+    X__ReleaseWaiting(fiber, X_ERR_TIMED_OUT);
+}
+
+
+static void X__PushToReadyQueue(XFiber* fiber)
+{
+    /* priority */
+    X__Worker* const w = X__FIBER_WORKER(fiber);
+    const int priority = fiber->m_priority;
+    XIntrusiveList* const ready_queue = &w->m_ready_queue[priority];
+#if X_CONF_FIBER_USE_SMP
+    /* 実行中のファイバーが自分のキューに戻るだけなら、そのまま再開できる */
+    const bool steal = (w->m_priority_map != 0) || (fiber != X__CurWorker()->m_cur_task);
+#endif
+
+    fiber->m_state = X_FIBER_STATE_READY;
+    xilist_push_back(ready_queue, &fiber->m_node);
+    w->m_priority_map |= X__PRIORITY_BIT(priority);
+
+#if X_CONF_FIBER_USE_SMP
+    X__NotifyWorker(w, steal);
+#endif
+}
+
+
+static XFiber* X__PopFromReadyQueue(X__Worker* w)
+{
+    /* Check dead lock */
+    X_ASSERT(w->m_priority_map);
+
+    const int priority = X__FIND_HIGHEST_PRIORITY(w->m_priority_map);
+    XIntrusiveList* const ready_queue = &w->m_ready_queue[priority];
+    XIntrusiveNode* const next = xilist_pop_front(ready_queue);
+    XFiber* const fiber = xnode_entry(next, XFiber, m_node);
+
+    if (xilist_empty(ready_queue))
+        w->m_priority_map &= ~X__PRIORITY_BIT(priority);
+
+    return fiber;
+}
+
+
+static void X__UpdateTimer(void)
+{
+    const XTicks now = X__TICKS_NOW();
+    const XTicks step = now - priv->m_timepoint;
+
+    priv->m_timepoint = now;
+    xvtimer_schedule(&priv->m_vtimer, step);
+}
+
+
+/* 実行可能なファイバーが見つかるまでアイドルフックを呼び出しながら待つ。
+ * クリティカルセクション内で呼び出すこと。スケジューラの終了が要求された場合は
+ * NULLを返す。
+ */
+static XFiber* X__WaitForReadyTask(X__Worker* w)
+{
+    XTicks timeout;
+    bool idle = false;
+
+    for (;;)
+    {
+#if X_CONF_FIBER_USE_SMP
+        XFiber* stolen;
+        XTicks sleep_time;
+        if (priv->m_end_request)
+            return NULL;
+#endif
+
+        if (w->m_priority_map)
+            return X__PopFromReadyQueue(w);
+
+#if X_CONF_FIBER_USE_SMP
+        stolen = X__StealTask(w);
+        if (stolen)
+            return stolen;
+#endif
+
+        if (!idle)
+        {
+            X__TRACE(NULL, X_FIBER_TRACE_IDLE, 0);
+            idle = true;
+        }
+
+        timeout = xvtimer_next_timeout(&priv->m_vtimer);
+#if X_CONF_FIBER_VIRTUAL_TICKS
+        if (timeout != X_TICKS_FOREVER)
+        {
+            /* 待たずに次のタイマーの期限まで時刻を進める */
+            priv->m_timepoint += timeout;
+            xvtimer_schedule(&priv->m_vtimer, timeout);
+            continue;
+        }
+#endif
+#if X_CONF_FIBER_USE_EPOLL
+        if (!xilist_empty(&priv->m_io_waiters))
+        {
+#if X_CONF_FIBER_USE_SMP
+            /* 他のワーカーがファイバーを起床させることがあるので、カーネルロッ
+             * クを保持したままポーリングだけ行う
+             */
+            X__PollIo(0);
+#else
+            /* アイドルフックの代わりに次のタイマーの期限までepoll_wait()で待つ */
+            X__PollIo(X__IoTimeout(timeout));
+            timeout = 0;
+#endif
+        }
+#endif
+#if X_CONF_FIBER_USE_SMP
+        /* 他のワーカーによる起床やI/Oの完了はフックに伝わらないので、フックで
+         * は休止させずに、ワーカー自身が通知を待って休止する。I/O待ちのファイ
+         * バーがいる間は、次のポーリングまでの1ティックだけ休止する。
+         */
+        sleep_time = timeout;
+#if X_CONF_FIBER_USE_EPOLL
+        if (!xilist_empty(&priv->m_io_waiters))
+            sleep_time = X_MIN(sleep_time, 1);
+#endif
+        timeout = 0;
+#endif
+        X__EXIT_CRITICAL();
+
+        if (priv->m_idlehook)
+        {
+            const int ret = priv->m_idlehook(timeout);
+            if (ret != 0)
+            {
+                X__ENTER_CRITICAL();
+#if X_CONF_FIBER_USE_SMP
+                priv->m_end_request = true;
+                X__WakeAllWorkers();
+#endif
+                return NULL;
+            }
+        }
+
+        X__ENTER_CRITICAL();
+#if X_CONF_FIBER_USE_SMP
+        X__SleepWorker(w, sleep_time);
+#endif
+        X__UpdateTimer();
+        X__ServiceRings();
+    }
+}
+
+
+static void X__Schedule(void)
+{
+    X__Worker* const w = X__CurWorker();
+    XFiber* const prev = w->m_cur_task;
+    XFiber* next = NULL;
+
+    X__ENTER_CRITICAL();
+    {
+        if (prev)
+        {
+            X__CHECK_STACK(prev);
+            X__STATS_SWITCH_OUT(prev);
+        }
+
+        if (prev && (prev->m_state == X_FIBER_STATE_RUNNING))
+        {
+            /* 待ちに入らずに呼び出された場合、呼び出し元は前回の待ちの結果を読ま
+             * ないようにする。
+             */
+            prev->m_result_waiting = X_ERR_NONE;
+            X__PushToReadyQueue(prev);
+        }
+
+        X__UpdateTimer();
+        X__ServiceRings();
+#if X_CONF_FIBER_USE_EPOLL
+        X__ServiceIo();
+#endif
+
+        next = X__WaitForReadyTask(w);
+        if (!next)
+        {
+            X__EXIT_CRITICAL();
+            X__EndSchedule();
+        }
+
+        next->m_state = X_FIBER_STATE_RUNNING;
+        w->m_cur_task = next;
+        X__STATS_SWITCH_IN(next, prev);
+#if X_CONF_FIBER_USE_SMP
+        /* カーネルロックはスイッチ先のX__FinishSwitch()で解放する */
+        next->m_on_cpu = true;
+        w->m_prev_task = prev;
+    }
+#else
+    }
+    X__EXIT_CRITICAL();
+#endif
+
+    if (prev == next)
+    {
+        /* 同じファイバーが再開する場合はコンテキストを切り替えない。コピースタ
+         * ック方式ではスタックの退避と復帰を丸ごと省略できる。
+         */
+    }
+    else if (prev)
+    {
+        X__LOG((X__TAG, "swap context from %s to %s\n", prev->m_name, next->m_name));
+        X__SwapContext(prev, next);
+    }
+    else
+    {
+        X__LOG((X__TAG, "set context to %s\n", next->m_name));
+        X__SetContext(next);
+    }
+
+#if X_CONF_FIBER_USE_SMP
+    X__FinishSwitch();
+#elif X_CONF_FIBER_STACK_GUARD
+    X__FreeZombie(w);
+#endif
+}
+
+
+#if X_CONF_FIBER_USE_SMP
+
+
+static void* X__WorkerThread(void* arg)
+{
+    X__RunWorker(arg);
+    return NULL;
+}
+
+
+static void X__RunWorker(X__Worker* w)
+{
+    XFiber* fiber;
+
+    pthread_setspecific(priv->m_worker_key, w);
+
+    X__ENTER_CRITICAL();
+    fiber = X__WaitForReadyTask(w);
+    if (!fiber)
+    {
+        X__EXIT_CRITICAL();
+        return;
+    }
+
+    fiber->m_state = X_FIBER_STATE_RUNNING;
+    fiber->m_on_cpu = true;
+    w->m_cur_task = fiber;
+    w->m_prev_task = NULL;
+    X__STATS_SWITCH_IN(fiber, NULL);
+    X__StartSchedule(w);
+
+    /* スケジューラ終了時点で破棄待ちのファイバーがあれば、ここで解放する */
+    X__ENTER_CRITICAL();
+    X__FreeZombie(w);
+    X__EXIT_CRITICAL();
+}
+
+
+/* 他のワーカーのレディキューから、実行中でないファイバーを優先度の高い順に探
+ * す。
+ */
+static XFiber* X__FindStealable(const X__Worker* w)
+{
+    int i;
+    int priority;
+
+    for (i = 0; i < priv->m_num_workers; ++i)
+    {
+        const X__Worker* const victim = &priv->m_workers[i];
+        X__PriorityMap map = victim->m_priority_map;
+
+        if (victim == w)
+            continue;
+
+        while (map)
+        {
+            const XIntrusiveList* ready_queue;
+            XIntrusiveNode* ite;
+            XIntrusiveNode* end;
+
+            priority = X__FIND_HIGHEST_PRIORITY(map);
+            map &= ~X__PRIORITY_BIT(priority);
+            ready_queue = &victim->m_ready_queue[priority];
+            end = xilist_end(ready_queue);
+
+            for (ite = xilist_front(ready_queue); ite != end; ite = ite->next)
+            {
+                XFiber* const fiber = X__NODE_TO_FIBER(ite);
+                if (!fiber->m_on_cpu)
+                    return fiber;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+/* 他のワーカーのレディキューから、実行中でないファイバーを優先度の高い順に奪
+ * う。
+ */
+static XFiber* X__StealTask(X__Worker* w)
+{
+    XFiber* const fiber = X__FindStealable(w);
+    X__Worker* victim;
+    XIntrusiveList* ready_queue;
+
+    if (!fiber)
+        return NULL;
+
+    victim = fiber->m_worker;
+    ready_queue = &victim->m_ready_queue[fiber->m_priority];
+    xnode_unlink(&fiber->m_node);
+    if (xilist_empty(ready_queue))
+        victim->m_priority_map &= ~X__PRIORITY_BIT(fiber->m_priority);
+    fiber->m_worker = w;
+
+    return fiber;
+}
+
+
+/* スイッチ先で呼び出され、スイッチ元のコンテキストの退避完了を他のワーカーに公
+ * 開してからカーネルロックを解放する。
+ */
+static void X__FinishSwitch(void)
+{
+    X__Worker* const w = X__CurWorker();
+    XFiber* const prev = w->m_prev_task;
+
+    if (prev && (prev != w->m_cur_task))
+    {
+        prev->m_on_cpu = false;
+
+        /* スイッチ中に合流または切り離しが済んだ終了済みのファイバー */
+        if (X_FIBER_IS_EXITED(prev->m_state) && prev->m_detached)
+            X__FreeFiber(prev);
+    }
+    w->m_prev_task = NULL;
+    X__FreeZombie(w);
+
+    X__EXIT_CRITICAL();
+}
+
+
+/* 他のワーカーから通知されるか、timeoutが経過するまでワーカーを休止させる。
+ * カーネルロックを保持した状態で呼び出すこと。
+ */
+static void X__SleepWorker(X__Worker* w, XTicks timeout)
+{
+    struct timespec deadline;
+    uint64_t nsec;
+
+    /* アイドルフックの呼び出し中に起床したファイバーは通知を取りこぼしている */
+    if (priv->m_end_request || w->m_priority_map || X__FindStealable(w))
+        return;
+
+    /* ロックを保持したまま休止するので、ここまでに溜まった通知を先に送る */
+    X__FlushWakeups();
+
+    w->m_sleeping = true;
+    if (timeout == X_TICKS_FOREVER)
+    {
+        pthread_cond_wait(&w->m_wakeup, &priv->m_lock);
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        nsec = (uint64_t)deadline.tv_nsec + (uint64_t)timeout * 1000000000u / X_TICKS_PER_SEC;
+        deadline.tv_sec += (time_t)(nsec / 1000000000u);
+        deadline.tv_nsec = (long)(nsec % 1000000000u);
+        pthread_cond_timedwait(&w->m_wakeup, &priv->m_lock, &deadline);
+    }
+    w->m_sleeping = false;
+}
+
+
+/* ownerのレディキューにファイバーを追加したことを通知する。
+ *
+ * ownerが休止中であればownerを起こす。ownerが他のファイバーを実行中でstealが
+ * 真であれば、休止中の他のワーカーを1つ起こしてスティールさせる。
+ */
+static void X__NotifyWorker(X__Worker* owner, bool steal)
+{
+    int i;
+
+    if (owner->m_sleeping)
+    {
+        X__WakeWorker(owner);
+        return;
+    }
+
+    if (!steal)
+        return;
+
+    for (i = 0; i < priv->m_num_workers; ++i)
+    {
+        X__Worker* const w = &priv->m_workers[i];
+        if (w->m_sleeping)
+        {
+            X__WakeWorker(w);
+            return;
+        }
+    }
+}
+
+
+static void X__WakeAllWorkers(void)
+{
+    int i;
+
+    for (i = 0; i < priv->m_num_workers; ++i)
+        X__WakeWorker(&priv->m_workers[i]);
+}
+
+
+/* 休止中のワーカーを起こす。カーネルロックを保持した状態で呼び出すこと。
+ *
+ * ロックを保持したまま通知すると、起きたワーカーがすぐにロックの獲得で待たされ
+ * るので、通知はX__EXIT_CRITICAL()でロックを解放した後に行う。
+ */
+static void X__WakeWorker(X__Worker* w)
+{
+    /* 続けて通知する場合に、別のワーカーを起こせるように先に落とす */
+    w->m_sleeping = false;
+    X__ATOMIC_STORE(&w->m_wake_pending, 1);
+    X__ATOMIC_STORE(&priv->m_wake_pending, 1);
+}
+
+
+/* 溜まっている通知を送る。カーネルロックの有無に関わらず呼び出せる */
+static void X__FlushWakeups(void)
+{
+    int i;
+
+    if (!X__ATOMIC_LOAD(&priv->m_wake_pending) || !X__ATOMIC_EXCHANGE(&priv->m_wake_pending, 0))
+        return;
+
+    for (i = 0; i < X__MAX_WORKERS; ++i)
+    {
+        X__Worker* const w = &priv->m_workers[i];
+        if (X__ATOMIC_EXCHANGE(&w->m_wake_pending, 0))
+            pthread_cond_signal(&w->m_wakeup);
+    }
+}
+
+
+#endif /* if X_CONF_FIBER_USE_SMP */
+
+
+#if X_CONF_FIBER_USE_STATS
+
+
+static void X__Trace(const XFiber* fiber, XFiberTraceEvent event, int arg)
+{
+#if X_CONF_FIBER_TRACE_SIZE > 0
+    XFiberTraceRecord* const record = &priv->m_trace[priv->m_trace_head];
+
+    record->time = (uint32_t)X_CONF_FIBER_STATS_CLOCK();
+    record->fiber_id = fiber ? fiber->m_stats.id : 0;
+    record->event = (uint8_t)event;
+    record->arg = (uint8_t)arg;
+
+    priv->m_trace_head = (priv->m_trace_head + 1) % X_CONF_FIBER_TRACE_SIZE;
+    if (priv->m_trace_count < X_CONF_FIBER_TRACE_SIZE)
+        priv->m_trace_count++;
+#else
+    X_UNUSED(fiber);
+    X_UNUSED(event);
+    X_UNUSED(arg);
+#endif
+}
+
+
+static int X__WaitKind(XFiberState state)
+{
+    switch (X_FIBER_WAITING_KIND(state))
+    {
+        case X_FIBER_STATE_WAITING_EVENT:           return X_FIBER_WAIT_KIND_EVENT;
+        case X_FIBER_STATE_WAITING_DELAY:           return X_FIBER_WAIT_KIND_DELAY;
+        case X_FIBER_STATE_WAITING_SIGNAL:          return X_FIBER_WAIT_KIND_SIGNAL;
+        case X_FIBER_STATE_WAITING_SEND_QUEUE:
+        case X_FIBER_STATE_WAITING_RECV_QUEUE:      return X_FIBER_WAIT_KIND_QUEUE;
+        case X_FIBER_STATE_WAITING_SEND_CHANNEL:
+        case X_FIBER_STATE_WAITING_RECV_CHANNEL:    return X_FIBER_WAIT_KIND_CHANNEL;
+        case X_FIBER_STATE_WAITING_MUTEX:           return X_FIBER_WAIT_KIND_MUTEX;
+        case X_FIBER_STATE_WAITING_READ_LOCK:
+        case X_FIBER_STATE_WAITING_WRITE_LOCK:      return X_FIBER_WAIT_KIND_RWLOCK;
+        case X_FIBER_STATE_WAITING_COND:            return X_FIBER_WAIT_KIND_COND;
+        case X_FIBER_STATE_WAITING_SEMAPHORE:       return X_FIBER_WAIT_KIND_SEMAPHORE;
+        case X_FIBER_STATE_WAITING_RECV_MAILBOX:    return X_FIBER_WAIT_KIND_MAILBOX;
+        case X_FIBER_STATE_WAITING_POOL:            return X_FIBER_WAIT_KIND_POOL;
+        case X_FIBER_STATE_WAITING_RECV_RING:       return X_FIBER_WAIT_KIND_RING;
+        case X_FIBER_STATE_WAITING_SELECT:          return X_FIBER_WAIT_KIND_SELECT;
+        case X_FIBER_STATE_WAITING_JOIN:            return X_FIBER_WAIT_KIND_JOIN;
+        case X_FIBER_STATE_WAITING_FUTURE:          return X_FIBER_WAIT_KIND_FUTURE;
+        case X_FIBER_STATE_WAITING_IO:              return X_FIBER_WAIT_KIND_IO;
+        default:                                    break;
+    }
+
+    return X_FIBER_IS_SUSPEND(state) ? X_FIBER_WAIT_KIND_SUSPEND : -1;
+}
+
+
+/* X__Schedule()の先頭で、実行を終えるファイバーに対して呼び出す。クロックは周
+ * 回してもいいように、符号なしで差分をとる。
+ */
+static void X__StatsSwitchOut(XFiber* fiber)
+{
+    const XTicks now = X_CONF_FIBER_STATS_CLOCK();
+
+#if X_CONF_FIBER_IMPL_TYPE != X_FIBER_IMPL_TYPE_COPY_STACK
+    /* ファイバー専用のスタック上で実行中なので、ローカル変数の位置から使用量
+     * が分かる。コピースタック方式ではX__SaveStack()で記録する。
+     */
+    const uint8_t* const sp = (const uint8_t*)&now;
+    if (x_is_within_ptr(sp, fiber->m_stack, fiber->m_stack + fiber->m_stack_size))
+        X__STATS_STACK_USAGE(fiber, (size_t)(fiber->m_stack + fiber->m_stack_size - sp));
+#endif
+
+    fiber->m_stats.run_time += (uint32_t)now - (uint32_t)fiber->m_stats_timepoint;
+    fiber->m_stats_timepoint = now;
+    fiber->m_stats_wait_kind = X__WaitKind(fiber->m_state);
+    if (fiber->m_stats_wait_kind >= 0)
+        X__Trace(fiber, X_FIBER_TRACE_BLOCK, fiber->m_stats_wait_kind);
+}
+
+
+static void X__StatsSwitchIn(XFiber* fiber, const XFiber* prev)
+{
+    const XTicks now = X_CONF_FIBER_STATS_CLOCK();
+
+    if (fiber->m_stats_wait_kind >= 0)
+    {
+        fiber->m_stats.wait_time[fiber->m_stats_wait_kind] +=
+            (uint32_t)now - (uint32_t)fiber->m_stats_timepoint;
+        fiber->m_stats_wait_kind = -1;
+    }
+    fiber->m_stats_timepoint = now;
+
+    if (fiber != prev)
+    {
+        fiber->m_stats.num_switches++;
+        X__Trace(fiber, X_FIBER_TRACE_DISPATCH, 0);
+    }
+}
+
+
+#endif /* if X_CONF_FIBER_USE_STATS */
+
+
+static bool X__TestEvent(XFiberEvent* event, XMode mode, XBits wait_pattern, XBits* result)
+{
+    bool ok = false;
+    const XBits pattern = event->m_pattern;
+
+    if ((mode & X_FIBER_EVENT_WAIT_MASK) == X_FIBER_EVENT_WAIT_OR)
+        ok = (pattern & wait_pattern) != 0;
+    else
+        ok = (pattern & wait_pattern) == wait_pattern;
+
+    if (ok)
+    {
+        *result = pattern;
+        if (mode & X_FIBER_EVENT_CLEAR_ON_EXIT)
+            event->m_pattern = 0;
+    }
+
+    return ok;
+}
+
+
+static void* X__Malloc(size_t size)
+{
+#if X_CONF_FIBER_USE_SMP
+    void* ptr;
+    pthread_mutex_lock(&priv->m_alloc_lock);
+    ptr = X__HEAP_ALLOCATE(&priv->m_alloc, size);
+    pthread_mutex_unlock(&priv->m_alloc_lock);
+    return ptr;
+#else
+    return X__HEAP_ALLOCATE(&priv->m_alloc, size);
+#endif
+}
+
+
+static void X__Free(void* ptr)
+{
+#if X_CONF_FIBER_USE_SMP
+    pthread_mutex_lock(&priv->m_alloc_lock);
+    X__HEAP_DEALLOCATE(&priv->m_alloc, ptr);
+    pthread_mutex_unlock(&priv->m_alloc_lock);
+#else
+    X__HEAP_DEALLOCATE(&priv->m_alloc, ptr);
+#endif
+}
+
+
+/* ファイバーとスタックを確保し、m_stackとm_stack_sizeを設定して返す。
+ * X_CONF_FIBER_STACK_GUARDが無効であれば、ファイバーの直後にスタックを配置し
+ * て1回の確保で済ませる。
+ */
+static XFiber* X__AllocFiber(size_t stack_size)
+{
+    XFiber* fiber;
+
+#if X_CONF_FIBER_STACK_GUARD
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    uint8_t* base;
+
+    fiber = X__Malloc(sizeof(XFiber));
+    if (!fiber)
+        return NULL;
+
+    /* 下位アドレス側の1ページをガードページにする */
+    stack_size = x_roundup_multiple(stack_size, page_size);
+    base = mmap(NULL, stack_size + page_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        X__Free(fiber);
+        return NULL;
+    }
+
+    if (mprotect(base, page_size, PROT_NONE) != 0)
+    {
+        munmap(base, stack_size + page_size);
+        X__Free(fiber);
+        return NULL;
+    }
+
+    fiber->m_stack = base + page_size;
+#else
+    fiber = X__Malloc(x_roundup_multiple(
+                sizeof(XFiber), X_ALIGN_OF(XMaxAlign)) + stack_size);
+    if (!fiber)
+        return NULL;
+
+    fiber->m_stack = ((uint8_t*)fiber) + x_roundup_multiple(
+            sizeof(XFiber), X_ALIGN_OF(XMaxAlign));
+#endif
+
+    fiber->m_stack_size = stack_size;
+#if X_CONF_FIBER_STACK_PAINT
+    memset(fiber->m_stack, X__STACK_PAINT_BYTE, stack_size);
+#endif
+
+    return fiber;
+}
+
+
+static void X__FreeFiber(XFiber* fiber)
+{
+    if (!fiber)
+        return;
+
+#if X_CONF_FIBER_STACK_GUARD
+    X__ReleaseStack(fiber);
+#endif
+    X__Free(fiber);
+}
+
+
+#if X_CONF_FIBER_STACK_GUARD
+
+
+static void X__ReleaseStack(XFiber* fiber)
+{
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    munmap(fiber->m_stack - page_size, fiber->m_stack_size + page_size);
+}
+
+
+/* スケジューラ終了時に生存していたファイバーのスタックを解放する。TCBはヒープ
+ * にあり、スケジューラが戻った後に呼び出し元が解放、再利用できるので、ここで
+ * 解放しておかなければ次のxfiber_kernel_init()からは辿れない。
+ */
+static void X__ReleaseAllStacks(void)
+{
+    while (!xilist_empty(&priv->m_fibers))
+    {
+        XFiber* const fiber = xnode_entry(xilist_front(&priv->m_fibers), XFiber, m_fiber_node);
+        xnode_unlink(&fiber->m_fiber_node);
+        X__ReleaseStack(fiber);
+    }
+}
+
+
+#endif
+
+
+#if X_CONF_FIBER_USE_SMP || X_CONF_FIBER_STACK_GUARD
+
+
+/* 破棄されたファイバーは自身のスタック上で破棄処理を行うので、解放はスイッチ
+ * 先のコンテキストで行う。
+ */
+static void X__FreeZombie(X__Worker* w)
+{
+    if (w->m_zombie)
+    {
+        X__FreeFiber(w->m_zombie);
+        w->m_zombie = NULL;
+    }
+}
+
+
+#endif
+
+
+#if X_CONF_FIBER_STACK_PAINT && (X_CONF_FIBER_IMPL_TYPE != X_FIBER_IMPL_TYPE_COPY_STACK)
+
+
+/* スタック末端のパターンが書き換えられていれば、既にオーバーフローしてファイ
+ * バーの外側を破壊している可能性があるので、実行を継続しない。
+ */
+static void X__CheckStack(const XFiber* fiber)
+{
+    size_t i;
+
+    for (i = 0; i < X__STACK_CANARY_SIZE; i++)
+    {
+        if (fiber->m_stack[i] != X__STACK_PAINT_BYTE)
+        {
+            X__LOG((X__TAG, "'%s' %p stack overflow", fiber->m_name, fiber));
+            X_ABORT("fiber stack overflow");
+        }
+    }
+}
+
+
+#endif
+
+
+static void X__FiberMain(XFiber* fiber)
+{
+#if X_CONF_FIBER_USE_SMP
+    X__FinishSwitch();
+#elif X_CONF_FIBER_STACK_GUARD
+    X__FreeZombie(X__CurWorker());
+#endif
+
+    X__LOG((X__TAG, "start '%s' %p", fiber->m_name, fiber));
+
+    fiber->m_func(fiber->m_arg);
+
+    /* @attention
+     * なんかこの辺のスタックの復帰処理がGCCのバージョンによって上手くいかない。
+     * m_func()の実行後、fierの値が変わっていたりするので、無理やり再代入してお
+     * く。
+     * かなり危険な実装だが、今のところこの部分以外のスタックは問題ない。
+     */
+    X_UNUSED(fiber);
+    xfiber_exit(0);
+}
+
+
+/* 実行中ではないファイバーを、レディキューや待ちリストから取り外す */
+static void X__UnlinkFiber(XFiber* fiber)
+{
+    XFiberMutex* const mutex = fiber->m_waiting_mutex;
+
+    if (X_FIBER_IS_READY(fiber->m_state))
+    {
+        X__Worker* const w = X__FIBER_WORKER(fiber);
+        XIntrusiveList* const ready_queue = &w->m_ready_queue[fiber->m_priority];
+
+        xnode_unlink(&fiber->m_node);
+        if (xilist_empty(ready_queue))
+            w->m_priority_map &= ~X__PRIORITY_BIT(fiber->m_priority);
+    }
+    else
+    {
+        /* 待ちリストまたはディレイキューにつながっている */
+        if (X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_SELECT)
+            X__UnlinkSelectWaiters(fiber);
+
+        /* 合流先が待ち手のいないまま合流中として残ると、合流も破棄もできなくな
+         * る */
+        if ((X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_JOIN) && fiber->m_wait_list)
+            xnode_entry(fiber->m_wait_list, XFiber, m_joiners)->m_joining = false;
+        xnode_unlink(&fiber->m_node);
+    }
+
+#if X_CONF_FIBER_USE_EPOLL
+    /* タイムアウトで起床した直後でも、登録が残っていれば解放後に通知されてしま
+     * う
+     */
+    if (fiber->m_io_fd >= 0)
+    {
+        epoll_ctl(priv->m_epoll_fd, EPOLL_CTL_DEL, fiber->m_io_fd, NULL);
+        fiber->m_io_fd = -1;
+    }
+#endif
+
+    xvtimer_remove_requst(&priv->m_vtimer, &fiber->m_timer_request);
+    fiber->m_wait_list = NULL;
+
+    if (mutex)
+    {
+        fiber->m_waiting_mutex = NULL;
+        if (mutex->m_holder)
+            X__UpdateInheritedPriority(mutex->m_holder);
+    }
+}
+
+
+static bool X__ReleaseJoiners(XFiber* fiber, XError result)
+{
+    bool released = false;
+
+    while (!xilist_empty(&fiber->m_joiners))
+    {
+        X__ReleaseWaiting(X__NODE_TO_FIBER(xilist_front(&fiber->m_joiners)), result);
+        released = true;
+    }
+
+    return released;
+}
+
+
+/* 切り離されたファイバーのTCBとスタックを解放する。実行中のファイバー自身の場
+ * 合は、自分のスタック上にいるので解放をスイッチ先に任せる。
+ */
+static void X__ReleaseFiber(XFiber* fiber)
+{
+    X__Worker* const w = X__CurWorker();
+
+#if X__TRACK_FIBERS
+    xnode_unlink(&fiber->m_fiber_node);
+#endif
+    priv->m_num_objects[X_FIBER_OBJTYPE_TASK]--;
+
+    if (fiber == w->m_cur_task)
+    {
+#if X_CONF_FIBER_USE_SMP || X_CONF_FIBER_STACK_GUARD
+        w->m_zombie = fiber;
+#else
+        X__FreeFiber(fiber);
+#endif
+    }
+#if X_CONF_FIBER_USE_SMP
+    else if (fiber->m_on_cpu)
+    {
+        /* 終了したファイバーが他のワーカーでまだスイッチ中なので、スイッチ先
+         * のX__FinishSwitch()で解放する
+         */
+    }
+#endif
+    else
+    {
+        X__FreeFiber(fiber);
+    }
+}
+
+
+static void X__PargePendingTasks(XIntrusiveList* list)
+{
+    XIntrusiveNode* ite = xilist_front(list);
+    XIntrusiveNode* const end = xilist_end(list);
+
+    while (ite != end)
+    {
+        XFiber* const fiber = X__NODE_TO_FIBER(ite);
+        XIntrusiveNode* const next = ite->next;
+        X__ReleaseWaiting(fiber, X_ERR_CANCELED);
+        ite = next;
+    }
+}
+
+
+static void X__PargeSelectors(XIntrusiveList* list)
+{
+    /* 待ちを解除すると同じファイバーの他の待ちノードも外れるので、常に先頭か
+     * ら取り出す
+     */
+    while (!xilist_empty(list))
+    {
+        X__SelectWaiter* const waiter = xnode_entry(xilist_front(list), X__SelectWaiter, m_node);
+        X__ReleaseWaiting(waiter->m_fiber, X_ERR_CANCELED);
+    }
+}
+
+
+static bool X__SelectReady(const XFiberSelectItem* item)
+{
+    struct XFiberWaitObject* const object = item->object;
+    XBits result;
+
+    switch (object->m_type)
+    {
+        case X_FIBER_OBJTYPE_EVENT:
+            return X__TestEvent(item->object, item->mode & X_FIBER_EVENT_WAIT_MASK, item->pattern, &result);
+        case X_FIBER_OBJTYPE_QUEUE:
+        {
+            XFiberQueue* const queue = item->object;
+            if (item->mode == X_FIBER_SELECT_WRITE)
+                return X__QUEUE_CAN_SEND(queue);
+            return X__QUEUE_CAN_RECEIVE(queue);
+        }
+        case X_FIBER_OBJTYPE_CHANNEL:
+        {
+            XFiberChannel* const channel = item->object;
+            if (item->mode == X_FIBER_SELECT_WRITE)
+                return X__ChannelPrepare(channel, channel->m_max_item_size) != NULL;
+            return X__CHANNEL_CAN_RECEIVE(channel);
+        }
+        case X_FIBER_OBJTYPE_SEMAPHORE:
+            return ((XFiberSemaphore*)item->object)->m_count > 0;
+        case X_FIBER_OBJTYPE_MAILBOX:
+            return !xilist_empty(&((XFiberMailbox*)item->object)->m_messages);
+        case X_FIBER_OBJTYPE_POOL:
+            return xfalloc_remain_blocks(&((XFiberPool*)item->object)->m_allocator) > 0;
+        case X_FIBER_OBJTYPE_RING:
+            return xfiber_ring_count(item->object) > 0;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+
+/* オブジェクトの状態が変化した時に呼び出し、条件が成立したxfiber_select()の待
+ * ちファイバーを全て解除する。待ちを解除したファイバーがあればtrueを返す。
+ */
+static bool X__NotifySelectors(XIntrusiveList* list)
+{
+    XIntrusiveNode* ite = xilist_front(list);
+    bool released = false;
+
+    while (ite != xilist_end(list))
+    {
+        X__SelectWaiter* const waiter = xnode_entry(ite, X__SelectWaiter, m_node);
+
+        if (!X__SelectReady(&waiter->m_item))
+        {
+            ite = ite->next;
+            continue;
+        }
+
+        /* 同じオブジェクトを複数指定されていると次のノードも外れるので、先頭か
+         * らやり直す
+         */
+        waiter->m_fiber->m_select_index = waiter->m_index;
+        X__ReleaseWaiting(waiter->m_fiber, X_ERR_NONE);
+        released = true;
+        ite = xilist_front(list);
+    }
+
+    return released;
+}
+
+
+static void X__UnlinkSelectWaiters(XFiber* fiber)
+{
+    int i;
+
+    for (i = 0; i < fiber->m_select_num; i++)
+        xnode_unlink(&fiber->m_select_waiters[i].m_node);
+
+    fiber->m_select_waiters = NULL;
+    fiber->m_select_num = 0;
+}
+
+
+/* 先頭の待ちファイバーがコピー先を指定した受信待ちであれば返す。データを直
+ * 接渡せる相手かどうかの判定に使用する。確保中の要素を追い越さないように、呼
+ * び出し側で確保中でないことを確認すること。
+ */
+static XFiber* X__PendingReceiver(XIntrusiveList* list, XFiberState state)
+{
+    XFiber* fiber;
+
+    if (xilist_empty(list))
+        return NULL;
+
+    fiber = X__NODE_TO_FIBER(xilist_front(list));
+    if ((X_FIBER_WAITING_KIND(fiber->m_state) != state) || (!fiber->m_pending_recv_dst))
+        return NULL;
+
+    return fiber;
+}
+
+
+/* キューの要素はitem_sizeの倍数の位置に並ぶので、1要素分の領域は必ず連続し
+ * ている
+ */
+static void* X__QueueReserve(XFiberQueue* queue)
+{
+    size_t space;
+    uint8_t* const ptr = xcbuf_back_space(&queue->m_buffer, &space);
+
+    X_ASSERT(space >= queue->m_item_size);
+    queue->m_reserving = true;
+
+    return ptr;
+}
+
+
+static void* X__QueuePeek(XFiberQueue* queue)
+{
+    size_t size;
+    const uint8_t* const ptr = xcbuf_array_one(&queue->m_buffer, &size);
+
+    X_ASSERT(size >= queue->m_item_size);
+    queue->m_peeking = true;
+
+    return (void*)ptr;
+}
+
+
+/* 要求を満たせるようになった待ちファイバーの待ちを解除する。確保中や参照中は
+ * 送信待ちと受信待ちが混在しうるので、リスト全体を走査する。待ちを解除したフ
+ * ァイバーがあればtrueを返す。
+ */
+static bool X__ServiceQueue(XFiberQueue* queue)
+{
+    XIntrusiveList* const list = &queue->m_pending_tasks;
+    XIntrusiveNode* ite;
+    XIntrusiveNode* next;
+    bool released = false;
+    bool progress = true;
+
+    while (progress)
+    {
+        progress = false;
+        for (ite = xilist_front(list); ite != xilist_end(list); ite = next)
+        {
+            XFiber* const fiber = X__NODE_TO_FIBER(ite);
+            next = ite->next;
+
+            if (X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_RECV_QUEUE)
+            {
+                if (!X__QUEUE_CAN_RECEIVE(queue))
+                    continue;
+
+                if (fiber->m_pending_recv_dst)
+                    xcbuf_pop_front_n(&queue->m_buffer, fiber->m_pending_recv_dst, queue->m_item_size);
+                else
+                    fiber->m_zero_copy_ptr = X__QueuePeek(queue);
+            }
+            else
+            {
+                if (!X__QUEUE_CAN_SEND(queue))
+                    continue;
+
+                if (fiber->m_pending_send_src)
+                    xcbuf_push_back_n(&queue->m_buffer, fiber->m_pending_send_src, queue->m_item_size);
+                else
+                    fiber->m_zero_copy_ptr = X__QueueReserve(queue);
+            }
+
+            X__ReleaseWaiting(fiber, X_ERR_NONE);
+            released = progress = true;
+        }
+    }
+
+    if (X__NotifySelectors(&queue->m_selectors))
+        released = true;
+
+    return released;
+}
+
+
+/* 待たずに送信できるだけ、最大n要素を送信して送信した要素数を返す。受信待ち
+ * のファイバーには先頭から順に直接渡す。
+ */
+static size_t X__QueueSendN(XFiberQueue* queue, const uint8_t* src, size_t n, bool* o_released)
+{
+    const size_t item_size = queue->m_item_size;
+    size_t num = 0;
+    size_t space;
+    XFiber* pend_task;
+
+    while ((num < n) && xcbuf_empty(&queue->m_buffer) && (!queue->m_reserving) &&
+           ((pend_task = X__PendingReceiver(&queue->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_QUEUE)) != NULL))
+    {
+        memcpy(pend_task->m_pending_recv_dst, src + num * item_size, item_size);
+        X__ReleaseWaiting(pend_task, X_ERR_NONE);
+        *o_released = true;
+        num++;
+    }
+
+    if (queue->m_reserving)
+        return num;
+
+    space = xcbuf_reserve(&queue->m_buffer) / item_size;
+    if (space > n - num)
+        space = n - num;
+
+    if (space > 0)
+    {
+        xcbuf_push_back_n(&queue->m_buffer, src + num * item_size, space * item_size);
+        num += space;
+        if (X__HAS_WAITERS(queue) && X__ServiceQueue(queue))
+            *o_released = true;
+    }
+
+    return num;
+}
+
+
+/* 待たずに受信できるだけ、最大n要素を受信して受信した要素数を返す。空いた分
+ * だけ送信待ちのファイバーを解放し、その要素も続けて受け取る。
+ */
+static size_t X__QueueReceiveN(XFiberQueue* queue, uint8_t* dst, size_t n, bool* o_released)
+{
+    const size_t item_size = queue->m_item_size;
+    size_t num = 0;
+    size_t avail;
+
+    while ((num < n) && X__QUEUE_CAN_RECEIVE(queue))
+    {
+        avail = xcbuf_size(&queue->m_buffer) / item_size;
+        if (avail > n - num)
+            avail = n - num;
+
+        xcbuf_pop_front_n(&queue->m_buffer, dst + num * item_size, avail * item_size);
+        num += avail;
+
+        if (!X__HAS_WAITERS(queue) || !X__ServiceQueue(queue))
+            break;
+        *o_released = true;
+    }
+
+    return num;
+}
+
+
+/* メッセージはバッファ内に連続して配置するので、受信側はそのまま参照できる */
+static uint8_t* X__ChannelPrepare(XFiberChannel* channel, size_t size)
+{
+    if (channel->m_reserved)
+        return NULL;
+
+    return xmsgbuf_prepare(&channel->m_buffer, size);
+}
+
+
+static void X__ChannelPush(XFiberChannel* channel, uint8_t* msg, const void* src, size_t size)
+{
+    memcpy(msg, src, size);
+    xmsgbuf_commit(&channel->m_buffer, msg, size);
+}
+
+
+static void* X__ChannelPeek(XFiberChannel* channel, size_t* o_size)
+{
+    uint8_t* const ptr = xmsgbuf_peek(&channel->m_buffer, o_size);
+
+    X_ASSERT(ptr);
+    channel->m_peeking = true;
+
+    return ptr;
+}
+
+
+/* X__ServiceQueue()のチャンネル版。メッセージの順序を保つため、送信待ちは先
+ * 頭から順に、格納できなくなった時点で打ち切る。
+ */
+static bool X__ServiceChannel(XFiberChannel* channel)
+{
+    XIntrusiveList* const list = &channel->m_pending_tasks;
+    XIntrusiveNode* ite;
+    XIntrusiveNode* next;
+    bool released = false;
+    bool progress = true;
+
+    while (progress)
+    {
+        bool send_blocked = false;
+
+        progress = false;
+        for (ite = xilist_front(list); ite != xilist_end(list); ite = next)
+        {
+            XFiber* const fiber = X__NODE_TO_FIBER(ite);
+            next = ite->next;
+
+            if (X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_RECV_CHANNEL)
+            {
+                if (!X__CHANNEL_CAN_RECEIVE(channel))
+                    continue;
+
+                if (fiber->m_pending_recv_dst)
+                    fiber->m_channel_item_size = xmsgbuf_pull(&channel->m_buffer, fiber->m_pending_recv_dst);
+                else
+                    fiber->m_zero_copy_ptr = X__ChannelPeek(channel, &fiber->m_channel_item_size);
+            }
+            else
+            {
+                uint8_t* msg;
+
+                if (send_blocked)
+                    continue;
+
+                msg = X__ChannelPrepare(channel, fiber->m_channel_item_size);
+                if (!msg)
+                {
+                    send_blocked = true;
+                    continue;
+                }
+
+                if (fiber->m_pending_send_src)
+                {
+                    X__ChannelPush(channel, msg, fiber->m_pending_send_src, fiber->m_channel_item_size);
+                }
+                else
+                {
+                    channel->m_reserved = msg;
+                    channel->m_reserved_size = fiber->m_channel_item_size;
+                    fiber->m_zero_copy_ptr = msg;
+                }
+            }
+
+            X__ReleaseWaiting(fiber, X_ERR_NONE);
+            released = progress = true;
+        }
+    }
+
+    if (X__NotifySelectors(&channel->m_selectors))
+        released = true;
+
+    return released;
+}
+
+
+/* X__QueueSendN()のチャンネル版。srcにはsizesのバイト数のメッセージが詰めて
+ * 並んでいる。
+ */
+static size_t X__ChannelSendN(XFiberChannel* channel, const uint8_t* src, const size_t* sizes, size_t n, bool* o_released)
+{
+    size_t num = 0;
+    XFiber* pend_task;
+    uint8_t* msg;
+
+    while (num < n)
+    {
+        pend_task = (xmsgbuf_empty(&channel->m_buffer) && !channel->m_reserved) ?
+            X__PendingReceiver(&channel->m_pending_tasks, X_FIBER_STATE_WAITING_RECV_CHANNEL) : NULL;
+
+        if (pend_task)
+        {
+            memcpy(pend_task->m_pending_recv_dst, src, sizes[num]);
+            pend_task->m_channel_item_size = sizes[num];
+            X__ReleaseWaiting(pend_task, X_ERR_NONE);
+            *o_released = true;
+        }
+        else if ((msg = X__ChannelPrepare(channel, sizes[num])) != NULL)
+        {
+            X__ChannelPush(channel, msg, src, sizes[num]);
+        }
+        else
+        {
+            break;
+        }
+
+        src += sizes[num];
+        num++;
+    }
+
+    if ((num > 0) && X__HAS_WAITERS(channel) && X__ServiceChannel(channel))
+        *o_released = true;
+
+    return num;
+}
+
+
+/* X__QueueReceiveN()のチャンネル版。メッセージはdstに詰めて格納し、dst_size
+ * に収まらなくなった時点で打ち切る。
+ */
+static size_t X__ChannelReceiveN(XFiberChannel* channel, uint8_t* dst, size_t dst_size, size_t* o_sizes, size_t n, bool* o_released)
+{
+    size_t num = 0;
+    size_t size;
+
+    while ((num < n) && X__CHANNEL_CAN_RECEIVE(channel))
+    {
+        size = xmsgbuf_msg_size(&channel->m_buffer);
+        if (size > dst_size)
+            break;
+
+        o_sizes[num++] = xmsgbuf_pull(&channel->m_buffer, dst);
+        dst += size;
+        dst_size -= size;
+
+        if (X__HAS_WAITERS(channel) && X__ServiceChannel(channel))
+            *o_released = true;
+    }
 
-    if (scheduling_request)
-        X__Schedule();
+    return num;
+}
 
-    return err;
+
+static bool X__RingPop(XFiberRing* ring, void* dst)
+{
+    const size_t tail = ring->m_tail;
+
+    if (X__ATOMIC_LOAD(&ring->m_head) == tail)
+        return false;
+
+    memcpy(dst, ring->m_data + (tail & ring->m_mask) * ring->m_item_size, ring->m_item_size);
+    X__ATOMIC_STORE(&ring->m_tail, tail + 1);
+
+    return true;
 }
 
 
-XError xfiber_pool_release_isr(XFiberPool* pool, void* mem)
+/* 割込みハンドラがリングに追加した要素を、受信待ちのファイバーとセレクターに通
+ * 知する。リングへの追加がなければフラグを1つ読むだけで終わる。
+ */
+static void X__ServiceRings(void)
 {
-    if ((xfalloc_remain_blocks(&pool->m_allocator) == 0) && !xilist_empty(&pool->m_pending_tasks))
-    {
-        XFiber* const pend_task = X__NODE_TO_FIBER(xilist_pop_front(&pool->m_pending_tasks));
-        *((void**)(pend_task->m_pending_recv_dst)) = mem;
-        X__ReleaseWaiting(pend_task, X_ERR_NONE);
-    }
-    else
+    XIntrusiveNode* ite;
+
+    if (!X__ATOMIC_EXCHANGE(&priv->m_ring_pushed, 0))
+        return;
+
+    xilist_foreach(&priv->m_rings, ite)
     {
-        xfalloc_deallocate(&pool->m_allocator, mem);
-    }
+        XFiberRing* const ring = xnode_entry(ite, XFiberRing, m_ring_node);
 
-    return X_ERR_NONE;
+        if (xfiber_ring_count(ring) == 0)
+            continue;
+
+        if (!xilist_empty(&ring->m_pending_tasks))
+            X__ReleaseWaiting(X__NODE_TO_FIBER(xilist_front(&ring->m_pending_tasks)), X_ERR_NONE);
+        X__NotifySelectors(&ring->m_selectors);
+    }
 }
 
 
+#if !defined(__GNUC__)
 
-static void X__TransitionIntoWaitState(XIntrusiveList* list, XFiber* fiber, XFiberState state, XTicks timeout)
+
+/* クリティカルセクション内から呼び出されるので、読み出しと書き込みの間に割り込
+ * まれることはない。
+ */
+static int X__AtomicExchange(volatile int* ptr, int value)
 {
-    xilist_push_back(list, &fiber->m_node);
-    fiber->m_state = state;
-    if (timeout > 0)
-        X__AddTimerEvent(fiber, X__TimeoutHandler, timeout);
+    const int prev = *ptr;
+    *ptr = value;
+    return prev;
 }
 
 
-static void X__AddTimerEvent(XFiber* fiber, XFiberTimeEventHandler handler, XTicks time)
-{
-    const XTicks now = x_ticks_now();
-    const XTicks cur_step = now - priv->m_timepoint;
-    time += cur_step;
-    xvtimer_add_request(&priv->m_vtimer,
-                        &fiber->m_timer_request,
-                        (XVTimerCallBack)handler,
-                        fiber,
-                        0,
-                        time,
-                        true,
-                        NULL);
-}
+#endif
 
 
-static void X__ReleaseWaiting(XFiber* fiber, XError result)
+#if X_CONF_FIBER_USE_EPOLL
+
+
+/* 準備のできたファイルディスクリプタを待っているファイバーを起床させる。クリテ
+ * ィカルセクション内で呼び出すこと。timeout_msが0でなければ、待機する間はクリ
+ * ティカルセクションを抜ける。
+ */
+static bool X__PollIo(int timeout_ms)
 {
-    xnode_unlink(&fiber->m_node);
-    xvtimer_remove_requst(&priv->m_vtimer, &fiber->m_timer_request);
-    fiber->m_result_waiting = result;
+    struct epoll_event events[X__IO_MAX_EVENTS];
+    bool released = false;
+    int n;
+    int i;
 
-    if (X_FIBER_IS_WAITING_SUSPEND(fiber->m_state))
+    if (timeout_ms != 0)
     {
-        fiber->m_state = X_FIBER_STATE_SUSPEND;
-        xilist_push_back(&priv->m_delay_queue, &fiber->m_node);
+        X__EXIT_CRITICAL();
+        n = epoll_wait(priv->m_epoll_fd, events, X__IO_MAX_EVENTS, timeout_ms);
+        X__ENTER_CRITICAL();
     }
     else
     {
-        X__PushToReadyQueue(fiber);
+        n = epoll_wait(priv->m_epoll_fd, events, X__IO_MAX_EVENTS, 0);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        XFiber* const fiber = events[i].data.ptr;
+        const uint32_t revents = events[i].events;
+
+        /* タイムアウトで起床済みで、まだ登録を削除していないファイバー */
+        if (X_FIBER_WAITING_KIND(fiber->m_state) != X_FIBER_STATE_WAITING_IO)
+            continue;
+
+        fiber->m_io_events = ((revents & EPOLLIN) ? X_FIBER_IO_READ : 0) |
+                             ((revents & EPOLLOUT) ? X_FIBER_IO_WRITE : 0) |
+                             ((revents & (EPOLLERR | EPOLLHUP)) ? X_FIBER_IO_ERROR : 0);
+        X__ReleaseWaiting(fiber, X_ERR_NONE);
+        released = true;
     }
+
+    priv->m_io_timepoint = priv->m_timepoint;
+
+    return released;
 }
 
 
-static void X__TimeoutHandler(XFiber* fiber)
+/* 実行可能なファイバーが途切れなくてもI/O待ちが放置されないように、スケジュー
+ * リングの度に呼び出して1チックに1回だけポーリングする。
+ */
+static void X__ServiceIo(void)
 {
-    X__ReleaseWaiting(fiber, X_ERR_TIMED_OUT);
+    if (xilist_empty(&priv->m_io_waiters) || (priv->m_io_timepoint == priv->m_timepoint))
+        return;
+
+    X__PollIo(0);
 }
 
 
-static void X__PushToReadyQueue(XFiber* fiber)
+#if !X_CONF_FIBER_USE_SMP
+
+
+/* タイマーの次の期限をepoll_wait()のタイムアウトに変換する。1ミリ秒未満は切り
+ * 上げないと、期限まで空回りしてしまう。
+ */
+static int X__IoTimeout(XTicks timeout)
 {
-    /* priority */
-    const int priority = fiber->m_priority;
-    XIntrusiveList* const ready_queue = &priv->m_ready_queue[priority];
+    XMSeconds msec;
 
-    fiber->m_state = X_FIBER_STATE_READY;
-    xilist_push_back(ready_queue, &fiber->m_node);
-    priv->m_priority_map |= 1 << priority;
+    if (timeout == X_TICKS_FOREVER)
+        return -1;
+
+    msec = x_ticks_to_msec(timeout);
+    if ((msec == 0) && (timeout > 0))
+        msec = 1;
 
+    return (int)msec;
 }
 
 
-static XFiber* X__PopFromReadyQueue(void)
+#endif /* if !X_CONF_FIBER_USE_SMP */
+
+
+#endif /* if X_CONF_FIBER_USE_EPOLL */
+
+
+static void X__ExecutorWorker(void* arg)
 {
-    /* Check dead lock */
-    X_ASSERT(priv->m_priority_map);
+    XFiberExecutor* const executor = arg;
+    X__ExecutorJob job;
+    void* result;
 
-    const int priority = x_find_msb_pos8(priv->m_priority_map);
-    XIntrusiveList* const ready_queue = &priv->m_ready_queue[priority];
-    XIntrusiveNode* const next = xilist_pop_front(ready_queue);
-    XFiber* const fiber = xnode_entry(next, XFiber, m_node);
+    for (;;)
+    {
+        xfiber_queue_receive(executor->m_jobs, &job);
 
-    if (xilist_empty(ready_queue))
-        priv->m_priority_map &= ~(1 << priority);
+        /* 関数が空のジョブは終了要求 */
+        if (!job.m_func)
+            break;
 
-    return fiber;
+        result = job.m_func(job.m_arg);
+        if (job.m_future)
+            X__CompleteFuture(job.m_future, result);
+    }
 }
 
 
-static void X__Schedule(void)
+static void X__CompleteFuture(XFiberFuture* future, void* result)
 {
-    XFiber* const prev = priv->m_cur_task;
-    XFiber* next = NULL;
+    bool scheduling_request = false;
 
-    XTicks now = x_ticks_now();
-    XTicks step = now - priv->m_timepoint;
-    priv->m_timepoint = now;
+    if (future->m_callback)
+        future->m_callback(result, future->m_callback_arg);
 
-    X_FIBER_ENTER_CRITICAL();
+    X__ENTER_CRITICAL();
     {
-        if (prev && (prev->m_state == X_FIBER_STATE_RUNNING))
-            X__PushToReadyQueue(prev);
-
-        xvtimer_schedule(&priv->m_vtimer, step);
-
-        while (!priv->m_priority_map)
+        future->m_result = result;
+        future->m_done = true;
+        while (!xilist_empty(&future->m_waiters))
         {
-            X_FIBER_EXIT_CRITICAL();
+            X__ReleaseWaiting(X__NODE_TO_FIBER(xilist_front(&future->m_waiters)), X_ERR_NONE);
+            scheduling_request = true;
+        }
+    }
+    X__EXIT_CRITICAL();
 
-            if (priv->m_idlehook)
-            {
-                const int ret = priv->m_idlehook();
-                if (ret != 0)
-                    X__EndSchedule();
-            }
+    if (scheduling_request)
+        X__Schedule();
+}
 
-            now = x_ticks_now();
-            step = now - priv->m_timepoint;
-            priv->m_timepoint = now;
 
-            X_FIBER_ENTER_CRITICAL();
-            xvtimer_schedule(&priv->m_vtimer, step);
-        }
+/* 実行可能状態のファイバーは、新しい優先度のレディキューに移し替える */
+static void X__SetPriority(XFiber* fiber, int priority)
+{
+    if (fiber->m_state == X_FIBER_STATE_READY)
+    {
+        X__Worker* const w = X__FIBER_WORKER(fiber);
+        XIntrusiveList* const ready_queue = &w->m_ready_queue[fiber->m_priority];
 
-        next = X__PopFromReadyQueue();
-        next->m_state = X_FIBER_STATE_RUNNING;
-        priv->m_cur_task = next;
-    }
-    X_FIBER_EXIT_CRITICAL();
+        xnode_unlink(&fiber->m_node);
+        if (xilist_empty(ready_queue))
+            w->m_priority_map &= ~X__PRIORITY_BIT(fiber->m_priority);
 
-    if (prev)
+        fiber->m_priority = priority;
+        X__PushToReadyQueue(fiber);
+    }
+    else if (fiber->m_wait_list && (fiber->m_wait_mode == X_FIBER_WAIT_PRIORITY))
     {
-        X__LOG((X__TAG, "swap context from %s to %s\n", prev->m_name, next->m_name));
-        X__SwapContext(prev, next);
+        xnode_unlink(&fiber->m_node);
+        fiber->m_priority = priority;
+        X__InsertPendingTask(fiber->m_wait_list, fiber->m_wait_mode, fiber);
     }
     else
     {
-        X__LOG((X__TAG, "set context to %s\n", next->m_name));
-        X__SetContext(next);
+        fiber->m_priority = priority;
     }
 }
 
 
-static bool X__TestEvent(XFiberEvent* event, XMode mode, XBits wait_pattern, XBits* result)
+/* fiberの優先度を、本来の優先度と獲得中のミューテックスを待っているファイバー
+ * の優先度のうち最も高いものに更新する。
+ * fiber自身が別のミューテックスを待っている場合は、その所有者にも連鎖的に反映
+ * させる。
+ */
+static void X__UpdateInheritedPriority(XFiber* fiber)
 {
-    bool ok = false;
-    const XBits pattern = event->m_pattern;
-
-    if ((mode & X_FIBER_EVENT_WAIT_MASK) == X_FIBER_EVENT_WAIT_OR)
-        ok = (pattern & wait_pattern) != 0;
-    else
-        ok = (pattern & wait_pattern) == wait_pattern;
-
-    if (ok)
+    while (fiber)
     {
-        *result = pattern;
-        if (mode & X_FIBER_EVENT_CLEAR_ON_EXIT)
-            event->m_pattern = 0;
-    }
+        int priority = fiber->m_base_priority;
+        XIntrusiveNode* ite;
+        XIntrusiveNode* const end = xilist_end(&fiber->m_held_mutexes);
 
-    return ok;
-}
+        for (ite = xilist_front(&fiber->m_held_mutexes); ite != end; ite = ite->next)
+        {
+            XFiberMutex* const mutex = xnode_entry(ite, XFiberMutex, m_held_node);
+            XIntrusiveNode* wite;
+            XIntrusiveNode* const wend = xilist_end(&mutex->m_pending_tasks);
+
+            for (wite = xilist_front(&mutex->m_pending_tasks); wite != wend; wite = wite->next)
+            {
+                const XFiber* const waiter = X__NODE_TO_FIBER(wite);
+                if (waiter->m_priority > priority)
+                    priority = waiter->m_priority;
+            }
+        }
 
+        if (priority == fiber->m_priority)
+            break;
 
-static void* X__Malloc(size_t size)
-{
-    return xpalloc_allocate(&priv->m_alloc, size);
+        X__SetPriority(fiber, priority);
+        fiber = fiber->m_waiting_mutex ? fiber->m_waiting_mutex->m_holder : NULL;
+    }
 }
 
 
-static void X__Free(void* ptr)
+static void X__AcquireMutex(XFiberMutex* mutex, XFiber* fiber)
 {
-    xpalloc_deallocate(&priv->m_alloc, ptr);
+    mutex->m_holder = fiber;
+    xilist_push_back(&fiber->m_held_mutexes, &mutex->m_held_node);
 }
 
 
-static void X__FiberMain(XFiber* fiber)
+/* ロックを解除し、待ちファイバーがいれば先頭のファイバーに所有権を渡して返す */
+static XFiber* X__ReleaseMutex(XFiberMutex* mutex)
 {
-    X__LOG((X__TAG, "start '%s' %p", fiber->m_name, fiber));
-
-    fiber->m_func(fiber->m_arg);
-
-    /* @attention
-     * なんかこの辺のスタックの復帰処理がGCCのバージョンによって上手くいかない。
-     * m_func()の実行後、fierの値が変わっていたりするので、無理やり再代入してお
-     * く。
-     * かなり危険な実装だが、今のところこの部分以外のスタックは問題ない。
-     */
-    fiber = priv->m_cur_task;
+    XFiber* const holder = mutex->m_holder;
+    XFiber* next;
 
-    X__LOG((X__TAG, "end '%s' %p", fiber->m_name, fiber));
+    mutex->m_holder = NULL;
+    xnode_unlink(&mutex->m_held_node);
+    X__UpdateInheritedPriority(holder);
 
-    X__DestroyFiber(fiber);
-    priv->m_cur_task = NULL;
-    X__Schedule();
-}
+    if (xilist_empty(&mutex->m_pending_tasks))
+        return NULL;
 
+    next = X__NODE_TO_FIBER(xilist_front(&mutex->m_pending_tasks));
+    X__AcquireMutex(mutex, next);
+    X__ReleaseWaiting(next, X_ERR_NONE);
+    X__UpdateInheritedPriority(next);
 
-static void X__DestroyFiber(XFiber* fiber)
-{
-    X_FIBER_ENTER_CRITICAL();
-    xvtimer_remove_requst(&priv->m_vtimer, &fiber->m_timer_request);
-    X__Free(fiber);
-    priv->m_num_objects[X_FIBER_OBJTYPE_TASK]--;
-    X_FIBER_EXIT_CRITICAL();
+    return next;
 }
 
 
-static void X__PargePendingTasks(XIntrusiveList* list)
+/* 待ち行列の先頭から順にロックを割り当てる。読み込み待ちは書き込みロック中でな
+ * ければまとめて起床させる。書き込み待ちはロックが空くまで止まるが、読み込み優
+ * 先の場合は後ろの読み込み待ちの追い越しを許す。
+ */
+static bool X__ServiceRwLock(XFiberRwLock* rwlock)
 {
-    XIntrusiveNode* ite = xilist_front(list);
-    XIntrusiveNode* const end = xilist_end(list);
+    XIntrusiveList* const list = &rwlock->m_pending_tasks;
+    XIntrusiveNode* ite;
+    XIntrusiveNode* next;
+    bool released = false;
 
-    while (ite != end)
+    for (ite = xilist_front(list); ite != xilist_end(list); ite = next)
     {
         XFiber* const fiber = X__NODE_TO_FIBER(ite);
-        XIntrusiveNode* const next = ite->next;
-        X__ReleaseWaiting(fiber, X_ERR_CANCELED);
-        ite = next;
+        next = ite->next;
+
+        if (rwlock->m_writer)
+            break;
+
+        if (X_FIBER_WAITING_KIND(fiber->m_state) == X_FIBER_STATE_WAITING_WRITE_LOCK)
+        {
+            if (rwlock->m_num_readers > 0)
+            {
+                if (rwlock->m_prefer_writer)
+                    break;
+                continue;
+            }
+
+            rwlock->m_writer = fiber;
+        }
+        else
+        {
+            rwlock->m_num_readers++;
+        }
+
+        X__ReleaseWaiting(fiber, X_ERR_NONE);
+        released = true;
     }
+
+    return released;
 }
 
 
 #if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
 
-static void X__StartSchedule(void)
+static void X__StartSchedule(X__Worker* w)
 {
-    X__GetStackPtr(&priv->m_machine_stack_begin);
+    X__GetStackPtr(&w->m_machine_stack_begin);
 
-    setjmp(priv->m_return_ctx.m_jmpbuf);
-    if (priv->m_cur_task)
-        X__FiberMain(priv->m_cur_task);
+    setjmp(w->m_return_ctx.m_jmpbuf);
+    if (w->m_cur_task)
+        X__FiberMain(w->m_cur_task);
 }
 
 
 static void X__EndSchedule()
 {
-    priv->m_cur_task = NULL;
-    longjmp(priv->m_return_ctx.m_jmpbuf, 1);
+    X__CurWorker()->m_cur_task = NULL;
+    longjmp(X__CurWorker()->m_return_ctx.m_jmpbuf, 1);
 }
 
 
@@ -2114,9 +6254,9 @@ static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end)
     bool stackoverflow = false;
     size_t size;
 
-    if (priv->m_machine_stack_begin > stack_end)
+    if (X__CurWorker()->m_machine_stack_begin > stack_end)
     {
-        size = priv->m_machine_stack_begin - stack_end;
+        size = X__CurWorker()->m_machine_stack_begin - stack_end;
         if (size > fiber->m_stack_size)
             stackoverflow = true;
         else
@@ -2124,6 +6264,7 @@ static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end)
             memcpy(fiber->m_stack + fiber->m_stack_size - size,
                    stack_end,
                    size);
+            X__STATS_STACK_USAGE(fiber, size);
             X__HEXDUMP((
                 X__TAG, stack_end, size, 16,
                 "%s saved stack %d[Bytes]", fiber->m_name, size));
@@ -2131,11 +6272,16 @@ static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end)
     }
     else
     {
-        size = stack_end - priv->m_machine_stack_begin;
+        size = stack_end - X__CurWorker()->m_machine_stack_begin;
         if (size > fiber->m_stack_size)
+        {
             stackoverflow = true;
+        }
         else
-            memcpy(fiber->m_stack, priv->m_machine_stack_begin, size);
+        {
+            memcpy(fiber->m_stack, X__CurWorker()->m_machine_stack_begin, size);
+            X__STATS_STACK_USAGE(fiber, size);
+        }
     }
 
     if (stackoverflow)
@@ -2151,48 +6297,48 @@ static void X__SaveStack(XFiber* fiber, const uint8_t* stack_end)
 
 static void X__RestoreStack(XFiber* fiber, uint8_t* addr_in_prev_frame)
 {
-    uint8_t padding[64];
-
     /* 初回の呼び出し時は、X__StartSchedule()まで戻って、X__FiberMain()で
      * ファイバーのメイン関数を呼び出す。
      */
     if (fiber->m_context.m_machine_stack_end == NULL)
     {
-        longjmp(priv->m_return_ctx.m_jmpbuf, 1);
+        longjmp(X__CurWorker()->m_return_ctx.m_jmpbuf, 1);
     }
 
     /* スタックはアドレスの大きい方から小さい方へ伸長する(下方伸長)か? */
-    if (priv->m_machine_stack_begin > fiber->m_context.m_machine_stack_end)
+    if (X__CurWorker()->m_machine_stack_begin > fiber->m_context.m_machine_stack_end)
     {
         if (addr_in_prev_frame > fiber->m_context.m_machine_stack_end)
         {
+            X__RESTORE_STACK_PADDING(addr_in_prev_frame - fiber->m_context.m_machine_stack_end);
             X__RestoreStack(fiber, &padding[0]);
         }
         memcpy(fiber->m_context.m_machine_stack_end,
                (fiber->m_stack + fiber->m_stack_size) -
-               (priv->m_machine_stack_begin - fiber->m_context.m_machine_stack_end),
-               (priv->m_machine_stack_begin - fiber->m_context.m_machine_stack_end));
+               (X__CurWorker()->m_machine_stack_begin - fiber->m_context.m_machine_stack_end),
+               (X__CurWorker()->m_machine_stack_begin - fiber->m_context.m_machine_stack_end));
 
         X__HEXDUMP((
                 X__TAG,
                 fiber->m_context.m_machine_stack_end,
-                priv->m_machine_stack_begin - fiber->m_context.m_machine_stack_end,
+                X__CurWorker()->m_machine_stack_begin - fiber->m_context.m_machine_stack_end,
                 16,
                 "%s restore stack %d[Bytes]", fiber->m_name,
-                priv->m_machine_stack_begin - fiber->m_context.m_machine_stack_end));
+                X__CurWorker()->m_machine_stack_begin - fiber->m_context.m_machine_stack_end));
     }
     else
     {
         if (addr_in_prev_frame < (
-                priv->m_machine_stack_begin + (
-                fiber->m_context.m_machine_stack_end - priv->m_machine_stack_begin)))
+                X__CurWorker()->m_machine_stack_begin + (
+                fiber->m_context.m_machine_stack_end - X__CurWorker()->m_machine_stack_begin)))
         {
+            X__RESTORE_STACK_PADDING(fiber->m_context.m_machine_stack_end - addr_in_prev_frame);
             X__RestoreStack(fiber, &padding[sizeof(padding) - 1]);
         }
 
-        memcpy(priv->m_machine_stack_begin,
+        memcpy(X__CurWorker()->m_machine_stack_begin,
                fiber->m_stack,
-               fiber->m_context.m_machine_stack_end- priv->m_machine_stack_begin);
+               fiber->m_context.m_machine_stack_end- X__CurWorker()->m_machine_stack_begin);
     }
 
     /* 前回の実行位置に戻る */
@@ -2207,14 +6353,14 @@ static void* X__ResolvePtr(const XFiber* fiber, const void* ptr)
     const void* ret = ptr;
 
     X__GetStackPtr(&stack_cur);
-    if (stack_cur < priv->m_machine_stack_begin)
+    if (stack_cur < X__CurWorker()->m_machine_stack_begin)
     {
         is_stack = x_is_within_ptr(ptr,
-                                   priv->m_machine_stack_begin - fiber->m_stack_size,
-                                   priv->m_machine_stack_begin);
+                                   X__CurWorker()->m_machine_stack_begin - fiber->m_stack_size,
+                                   X__CurWorker()->m_machine_stack_begin);
         if (is_stack)
         {
-            ptrdiff_t offset = priv->m_machine_stack_begin - (const uint8_t*)ptr;
+            ptrdiff_t offset = X__CurWorker()->m_machine_stack_begin - (const uint8_t*)ptr;
             ret = fiber->m_stack + fiber->m_stack_size - offset;
         }
     }
@@ -2230,16 +6376,22 @@ static void* X__ResolvePtr(const XFiber* fiber, const void* ptr)
 #elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_UCONTEXT
 
 
-static void X__StartSchedule(void)
+#if (X_SIZEOF_INTPTR > X_SIZEOF_INT)
+
+/* makecontext()の可変長引数はint型なので、ポインタを分割して受け取り復元する */
+static void X__FiberMainTrampoline(int lo, int hi)
 {
-    static bool first = true;
-    getcontext(&priv->m_return_ctx);
-    if (first)
-    {
-        first = false;
-        setcontext(&priv->m_cur_task->m_context);
-    }
-    first = true;
+    const uintptr_t addr = ((uintptr_t)(unsigned)hi << (8 * X_SIZEOF_INT)) |
+                           (uintptr_t)(unsigned)lo;
+    X__FiberMain((XFiber*)addr);
+}
+
+#endif
+
+
+static void X__StartSchedule(X__Worker* w)
+{
+    swapcontext(&w->m_return_ctx, &w->m_cur_task->m_context);
 }
 
 
@@ -2254,7 +6406,7 @@ static void X__MakeContext(XFiber* fiber, XFiberFunc func, void* arg, void* stac
     fiber->m_context.uc_stack.ss_size = stack_size;
 
 #if (X_SIZEOF_INTPTR > X_SIZEOF_INT)
-    makecontext(&fiber->m_context, (void(*)(void))X__FiberMain, 2,
+    makecontext(&fiber->m_context, (void(*)(void))X__FiberMainTrampoline, 2,
                 (int)(uintptr_t)fiber,
                 (int)((uintptr_t)fiber >> (8 * X_SIZEOF_INT)));
 #else
@@ -2277,19 +6429,206 @@ static void X__SetContext(XFiber* to)
 
 static void X__EndSchedule()
 {
-    setcontext(&priv->m_return_ctx);
+    setcontext(&X__CurWorker()->m_return_ctx);
 }
 
 
 static void* X__ResolvePtr(const XFiber* fiber, const void* ptr)
 {
     X_UNUSED(fiber);
-    return ptr;
+    return (void*)ptr;
 }
 
 
 #elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_PLATFORM_DEPEND
-    #error not implemented yet
+
+
+/* 呼び出し先保存レジスタをスタックに積み、*save_spに現在のスタックポインタを格
+ * 納してから、load_spのスタックに切り替えて退避済みのレジスタを復帰する。
+ * 呼び出し規約上、呼び出し元保存レジスタはコンパイラが退避するので、関数呼び出
+ * し1回分のコストでコンテキストスイッチが完了する。
+ */
+void x__fiber_switch(void** save_sp, void* load_sp);
+
+
+/* 生成直後のファイバーに初めてスイッチした時の戻り先。
+ * X__MakeContext()で積んだレジスタからfiberとX__FiberMain()を取り出して呼び出
+ * す。X__FiberMain()から戻ることはない。
+ */
+void x__fiber_entry(void);
+
+
+#if defined(__x86_64__)
+
+/* [スタックフレーム(下位アドレスから)]
+ * mxcsr(4) + x87 control word(2) + padding(2), r15, r14, r13, r12, rbx, rbp,
+ * 戻りアドレス
+ */
+#define X__NUM_SAVED_REGS   (8)
+
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl x__fiber_switch\n"
+    ".hidden x__fiber_switch\n"
+    ".type x__fiber_switch, @function\n"
+    "x__fiber_switch:\n"
+    "    pushq   %rbp\n"
+    "    pushq   %rbx\n"
+    "    pushq   %r12\n"
+    "    pushq   %r13\n"
+    "    pushq   %r14\n"
+    "    pushq   %r15\n"
+    "    subq    $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw  4(%rsp)\n"
+    "    movq    %rsp, (%rdi)\n"
+    "    movq    %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw   4(%rsp)\n"
+    "    addq    $8, %rsp\n"
+    "    popq    %r15\n"
+    "    popq    %r14\n"
+    "    popq    %r13\n"
+    "    popq    %r12\n"
+    "    popq    %rbx\n"
+    "    popq    %rbp\n"
+    "    retq\n"
+    ".size x__fiber_switch, .-x__fiber_switch\n"
+    "\n"
+    ".p2align 4\n"
+    ".globl x__fiber_entry\n"
+    ".hidden x__fiber_entry\n"
+    ".type x__fiber_entry, @function\n"
+    "x__fiber_entry:\n"
+    "    movq    %r12, %rdi\n"
+    "    callq   *%r13\n"
+    "    ud2\n"
+    ".size x__fiber_entry, .-x__fiber_entry\n"
+);
+
+#elif defined(__aarch64__)
+
+/* [スタックフレーム(下位アドレスから)]
+ * x19 ~ x28, x29(fp), x30(lr), d8 ~ d15
+ */
+#define X__NUM_SAVED_REGS   (20)
+
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    ".globl x__fiber_switch\n"
+    ".hidden x__fiber_switch\n"
+    ".type x__fiber_switch, %function\n"
+    "x__fiber_switch:\n"
+    "    sub     sp, sp, #160\n"
+    "    stp     x19, x20, [sp, #0]\n"
+    "    stp     x21, x22, [sp, #16]\n"
+    "    stp     x23, x24, [sp, #32]\n"
+    "    stp     x25, x26, [sp, #48]\n"
+    "    stp     x27, x28, [sp, #64]\n"
+    "    stp     x29, x30, [sp, #80]\n"
+    "    stp     d8,  d9,  [sp, #96]\n"
+    "    stp     d10, d11, [sp, #112]\n"
+    "    stp     d12, d13, [sp, #128]\n"
+    "    stp     d14, d15, [sp, #144]\n"
+    "    mov     x9, sp\n"
+    "    str     x9, [x0]\n"
+    "    mov     sp, x1\n"
+    "    ldp     x19, x20, [sp, #0]\n"
+    "    ldp     x21, x22, [sp, #16]\n"
+    "    ldp     x23, x24, [sp, #32]\n"
+    "    ldp     x25, x26, [sp, #48]\n"
+    "    ldp     x27, x28, [sp, #64]\n"
+    "    ldp     x29, x30, [sp, #80]\n"
+    "    ldp     d8,  d9,  [sp, #96]\n"
+    "    ldp     d10, d11, [sp, #112]\n"
+    "    ldp     d12, d13, [sp, #128]\n"
+    "    ldp     d14, d15, [sp, #144]\n"
+    "    add     sp, sp, #160\n"
+    "    ret\n"
+    ".size x__fiber_switch, .-x__fiber_switch\n"
+    "\n"
+    ".p2align 4\n"
+    ".globl x__fiber_entry\n"
+    ".hidden x__fiber_entry\n"
+    ".type x__fiber_entry, %function\n"
+    "x__fiber_entry:\n"
+    "    mov     x0, x19\n"
+    "    blr     x20\n"
+    "    brk     #0\n"
+    ".size x__fiber_entry, .-x__fiber_entry\n"
+);
+
+#endif
+
+
+static void X__StartSchedule(X__Worker* w)
+{
+    x__fiber_switch(&w->m_return_ctx.m_sp, w->m_cur_task->m_context.m_sp);
+}
+
+
+static void X__EndSchedule()
+{
+    void* discard;
+    x__fiber_switch(&discard, X__CurWorker()->m_return_ctx.m_sp);
+}
+
+
+static void X__MakeContext(XFiber* fiber, XFiberFunc func, void* arg, void* stack, size_t stack_size)
+{
+    uintptr_t* sp;
+    X_UNUSED(func);
+    X_UNUSED(arg);
+
+    /* どちらのABIもスタックポインタは16バイトアラインが要求される */
+    sp = x_rounddown_alignment_ptr((uint8_t*)stack + stack_size, 16);
+    X_ASSERT((uint8_t*)sp - (uint8_t*)stack >= (ptrdiff_t)(sizeof(uintptr_t) * X__NUM_SAVED_REGS));
+    sp -= X__NUM_SAVED_REGS;
+    memset(sp, 0, sizeof(uintptr_t) * X__NUM_SAVED_REGS);
+
+#if defined(__x86_64__)
+    /* ret直後のrspが16バイト境界になるように、戻りアドレスは最上位に置く */
+    sp[0] = ((uintptr_t)0x037F << 32) | 0x1F80;  /* x87 control word | mxcsr */
+    sp[4] = (uintptr_t)fiber;                    /* r12 */
+    sp[3] = (uintptr_t)X__FiberMain;             /* r13 */
+    sp[7] = (uintptr_t)x__fiber_entry;           /* 戻りアドレス */
+#elif defined(__aarch64__)
+    sp[0] = (uintptr_t)fiber;                    /* x19 */
+    sp[1] = (uintptr_t)X__FiberMain;             /* x20 */
+    sp[11] = (uintptr_t)x__fiber_entry;          /* x30 */
+#endif
+
+    fiber->m_context.m_sp = sp;
+}
+
+
+static void X__SwapContext(XFiber* from, XFiber* to)
+{
+    /* 待ち解除された自分自身に戻る場合はスイッチ不要。
+     * load_spは値渡しなので、そのまま呼ぶと古いコンテキストに戻ってしまう。
+     */
+    if (from == to)
+        return;
+    x__fiber_switch(&from->m_context.m_sp, to->m_context.m_sp);
+}
+
+
+static void X__SetContext(XFiber* to)
+{
+    void* discard;
+    x__fiber_switch(&discard, to->m_context.m_sp);
+}
+
+
+static void* X__ResolvePtr(const XFiber* fiber, const void* ptr)
+{
+    X_UNUSED(fiber);
+    return (void*)ptr;
+}
+
+
 #else
     #error invalid configuration
 #endif /* if X_CONF_FIBER_IMPL_TYPE */
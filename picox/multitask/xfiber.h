@@ -93,6 +93,8 @@
  *      `X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK`である場合、コン
  *      テキストスイッチの度に使用中のスタックのコピーが行われます。
  *      これは非力なCPUでは致命的なオーバーヘッドになる可能性があります。
+ *      x86-64とAArch64では`X_FIBER_IMPL_TYPE_PLATFORM_DEPEND`を選択すること
+ *      で、レジスタの退避と復帰だけの軽量なスイッチを使用できます。
  *
  *  + C++の例外との共存不可<br>
  *      これは巷のRTOSでも同じですが、コンテキストスイッチと例外スタックの整合性
@@ -118,9 +120,11 @@ extern "C" {
 #endif /* __cplusplus */
 
 
-/** @brief タスク優先度の最大値です(0 ~ 7の8段階)
+/** @brief タスク優先度の段階数です(0 ~ X_FIBER_PRIORITY_MAX - 1)
+ *
+ *  @see X_CONF_FIBER_PRIORITY_MAX
  */
-#define X_FIBER_PRIORITY_MAX       (8)
+#define X_FIBER_PRIORITY_MAX       X_CONF_FIBER_PRIORITY_MAX
 
 
 /** @brief @see X_CONF_FIBER_ENTER_CRITICAL
@@ -141,11 +145,26 @@ typedef void (*XFiberFunc)(void*);
 
 
 /** @brief アイドル時に呼び出されるフック関数のポインタ型です
+ *
+ *  @param timeout 次のタイマ(xfiber_delay()やタイムアウト付きの待ち)が満了する
+ *                 までのティック数です。タイマがない場合はX_TICKS_FOREVERです。
+ *
+ *  実行可能なファイバーがない間、繰り返し呼び出されます。timeoutの間はタイマに
+ *  よるファイバーの起床は発生しないので、nanosleep()やWFI命令などでCPUを休止さ
+ *  せることができます(ティックレスアイドル)。割込みでファイバーを起床させる場合
+ *  は、割込み発生時に休止から復帰するようにしてください。
  *
  *  0以外を返すと、スケジューリングは終了し、xfiber_kernel_start_scheduler()の呼
  *  び出し直後の地点までジャンプします。
+ *
+ *  X_CONF_FIBER_USE_SMPが有効な場合は、実行可能なファイバーがなくなったワーカー
+ *  ごとに並行して呼び出されます。他のワーカーによる起床やI/Oの完了はフックに通
+ *  知されないので、timeoutは常に0です。フック内で休止してはいけません。ワーカー
+ *  はフックから戻った後、他のワーカーから通知されるか次のタイマーの期限まで自ら
+ *  休止し、復帰する度にフックを呼び出します。0以外を返すと全てのワーカーが終了
+ *  します。
  */
-typedef int(*XFiberIdleHook)(void);
+typedef int(*XFiberIdleHook)(XTicks timeout);
 
 
 /** @name fiber_event_mode
@@ -166,6 +185,23 @@ typedef int(*XFiberIdleHook)(void);
  */
 
 
+/** @name fiber_wait_mode
+ *  @brief xfiber_xxx_create_ex()のwait_mode引数に指定可能な値です
+ *
+ *  待ちファイバーを解放する順番を指定します。
+ *  @{
+ */
+
+/** @brief 到着順に解放します(xfiber_xxx_create()のデフォルト) */
+#define X_FIBER_WAIT_FIFO           (0)
+
+/** @brief 優先度の高い順に解放します。同じ優先度の中では到着順です */
+#define X_FIBER_WAIT_PRIORITY       (1)
+
+/** @} end of name fiber_wait_mode
+ */
+
+
 /* 前方宣言
  * fiberオブジェクトはスタックに確保することはできず、xfiber_xxx_create()系の生
  * 成関数を呼び出す必要があります。
@@ -186,6 +222,10 @@ typedef struct XFiberChannel XFiberChannel;
 typedef struct XFiberMailbox XFiberMailbox;
 typedef struct XFiberSemaphore XFiberSemaphore;
 typedef struct XFiberMutex XFiberMutex;
+typedef struct XFiberRwLock XFiberRwLock;
+typedef struct XFiberCond XFiberCond;
+typedef struct XFiberRing XFiberRing;
+typedef struct XFiberExecutor XFiberExecutor;
 typedef XIntrusiveNode XFiberMessage;
 
 
@@ -210,6 +250,23 @@ XError xfiber_kernel_init(void* heap, size_t heapsize, XFiberIdleHook idlehook);
 XError xfiber_kernel_start_scheduler(void);
 
 
+#if X_CONF_FIBER_USE_SMP
+
+
+/** @brief num_workers個のワーカースレッドでスケジューリングを開始します
+ *
+ *  呼び出し元のスレッドも1つ目のワーカーとして動作し、全てのワーカーが終了する
+ *  まで戻りません。ファイバーの優先度は各ワーカーのレディキュー内で有効です。
+ *
+ *  @pre
+ *  + 1 <= num_workers <= X_CONF_FIBER_SMP_MAX_WORKERS
+ */
+XError xfiber_kernel_start_scheduler_smp(int num_workers);
+
+
+#endif
+
+
 /** @brief スケジューリングを終了します
  *
  *  呼び出し後はxfiber_kernel_start_scheduler()の呼び出し直後の位置までジャンプ
@@ -230,7 +287,7 @@ void   xfiber_kernel_end_scheduler(void);
 /** @brief タスクを生成します
  *
  *  @param o_fiber      生成したタスクのアドレスの格納先
- *  @param priority     タスク優先度
+ *  @param priority     タスク優先度(0 ~ X_FIBER_PRIORITY_MAX - 1)
  *  @param name         タスク名
  *  @param stack_size   スタックのバイト数
  *  @param func         メイン関数
@@ -239,6 +296,69 @@ void   xfiber_kernel_end_scheduler(void);
 XError xfiber_create(XFiber** o_fiber, int priority, const char* name, size_t stack_size, XFiberFunc func, void* arg);
 
 
+/** @brief 合流可能なタスクを生成します
+ *
+ *  xfiber_create()で生成したタスクは終了と同時に解放されますが、このタスクは終
+ *  了後もxfiber_join()で合流するか、xfiber_detach()で切り離すまでTCBとスタック
+ *  が保持されます。引数はxfiber_create()と同じです。
+ */
+XError xfiber_create_joinable(XFiber** o_fiber, int priority, const char* name, size_t stack_size, XFiberFunc func, void* arg);
+
+
+/** @brief 実行中のタスクを終了します
+ *
+ *  statusはxfiber_join()で合流したタスクに返されます。メイン関数からreturnした
+ *  場合は、xfiber_exit(0)を呼び出したのと同じです。この関数からは戻りません。
+ */
+void xfiber_exit(int status);
+
+
+/** @brief タスクの終了をタイムアウト付きで待ち、終了ステータスを取得します
+ *
+ *  合流したタスクのTCBとスタックは解放され、以降fiberは使用できなくなります。1
+ *  つのタスクに同時に合流できるのは1つのタスクだけです。
+ *
+ *  @retval X_ERR_NONE      合流した
+ *  @retval X_ERR_TIMED_OUT タイムアウトした
+ *  @retval X_ERR_CANCELED  待っている間にxfiber_destroy()で破棄された
+ *  @retval X_ERR_INVALID   合流可能なタスクではないか、自分自身を指定した
+ *  @retval X_ERR_BUSY      他のタスクが合流を待っている
+ */
+XError xfiber_timed_join(XFiber* fiber, int* o_status, XTicks timeout);
+
+
+/** @brief タスクの終了を待ち、終了ステータスを取得します
+ */
+XError xfiber_join(XFiber* fiber, int* o_status);
+
+
+/** @brief 終了済みのタスクに合流します
+ */
+XError xfiber_try_join(XFiber* fiber, int* o_status);
+
+
+/** @brief 合流可能なタスクを切り離します
+ *
+ *  切り離されたタスクは、終了と同時に解放されます。既に終了しているタスクは即
+ *  座に解放されます。
+ *
+ *  @retval X_ERR_INVALID   合流可能なタスクではない
+ *  @retval X_ERR_BUSY      他のタスクが合流を待っている
+ */
+XError xfiber_detach(XFiber* fiber);
+
+
+/** @brief 自分以外のタスクを強制的に終了させ、TCBとスタックを解放します
+ *
+ *  待ち状態やサスペンド状態のタスクも破棄できます。合流を待っているタスクには
+ *  X_ERR_CANCELEDが返されます。
+ *
+ *  @retval X_ERR_INVALID   自分自身を指定した
+ *  @retval X_ERR_BUSY      ミューテックスを獲得中か、他のワーカーで実行中
+ */
+XError xfiber_destroy(XFiber* fiber);
+
+
 /** @brief タスクの実行を指定時間遅延します
  */
 void xfiber_delay(XTicks time);
@@ -275,10 +395,99 @@ XFiber* xfiber_self();
 const char* xfiber_name(const XFiber* fiber);
 
 
+#if X_CONF_FIBER_STACK_PAINT || X_CONF_FIBER_STACK_GUARD
+
+
+/** @brief タスクのスタック使用量のピークをバイト単位で返します
+ *
+ *  fiberにNULLを指定した場合は、実行中のタスクが対象です。スタックは下位アドレ
+ *  スに向かって伸びるものとして計算します。
+ *
+ *  X_CONF_FIBER_STACK_PAINTが有効な場合は塗りつぶしたパターンが書き換えられた
+ *  範囲を、そうでなければmincore()で物理メモリが割り当て済のページ範囲を返しま
+ *  す。後者はページサイズ単位の値になります。
+ *
+ *  X_FIBER_IMPL_TYPE_COPY_STACKの場合は、コンテキストスイッチ時に退避された
+ *  スタックサイズのピークです。
+ */
+size_t xfiber_stack_high_water(const XFiber* fiber);
+
+
+#endif
+
+
 /** @} end of name fiber_task_control
  */
 
 
+/** @name fiber_local
+ *  @brief タスク固有のデータやメモリ領域を保持したい場合に使用します
+ *  @{
+ */
+
+
+#if X_CONF_FIBER_LOCAL_STORAGE_SIZE > 0
+
+
+/** @brief タスクのローカルストレージのindex番目のスロットに値を設定します
+ *
+ *  fiberにNULLを指定した場合は、実行中のタスクが対象です。スロットはタスク生成
+ *  時にNULLで初期化されます。
+ *
+ *  @param fiber    対象のタスク
+ *  @param index    スロット番号(0 ~ X_CONF_FIBER_LOCAL_STORAGE_SIZE - 1)
+ *  @param value    設定する値
+ */
+void xfiber_set_local(XFiber* fiber, int index, void* value);
+
+
+/** @brief タスクのローカルストレージのindex番目のスロットの値を返します
+ */
+void* xfiber_get_local(const XFiber* fiber, int index);
+
+
+#endif
+
+
+/** @brief 実行中のタスク専用のアリーナを生成します
+ *
+ *  カーネルのヒープからsizeバイトを確保し、xfiber_arena_alloc()で先頭から順に
+ *  切り出します。個別の解放はできませんが、xfiber_arena_clear()で一括して解放
+ *  でき、アリーナ自体はタスクの終了時に自動的に解放されます。
+ *
+ *  短命なメモリの確保をカーネルのヒープから切り離すことで、ヒープの探索と断片
+ *  化を避けることができます。アリーナは生成したタスク専用なので、他のタスクか
+ *  ら使用することはできません。
+ *
+ *  @retval X_ERR_NONE      正常終了
+ *  @retval X_ERR_EXIST     既にアリーナを生成している
+ *  @retval X_ERR_NO_MEMORY メモリ不足
+ */
+XError xfiber_arena_create(size_t size);
+
+
+/** @brief 実行中のタスクのアリーナからsizeバイトを確保します
+ *
+ *  アリーナが生成されていないか、空き容量が不足している場合はNULLを返します。
+ *  返されるアドレスはX_ALIGN_OF(XMaxAlign)の倍数です。
+ */
+void* xfiber_arena_alloc(size_t size);
+
+
+/** @brief 実行中のタスクのアリーナから確保した全てのメモリを解放します
+ */
+void xfiber_arena_clear(void);
+
+
+/** @brief 実行中のタスクのアリーナの空き容量を返します
+ */
+size_t xfiber_arena_reserve(void);
+
+
+/** @} end of name fiber_local
+ */
+
+
 /** @name fiber_event
  *  @brief ビットフラグによるイベント待ちを行いたい場合に使用します
  *  @{
@@ -412,6 +621,12 @@ XBits xfiber_signal_get_isr(XFiber* fiber);
  *
  *  固定長のメッセージの受け渡しに使用します。リングバッファで実装されており、デ
  *  ータはバッファにコピーされます。
+ *
+ *  xfiber_queue_reserve_back()とxfiber_queue_peek()を使用すると、コピーを行わず
+ *  にバッファ内の要素を直接読み書きできます。
+ *  + 確保から確定までの間、他の送信はバッファが満杯の時と同様に待たされます
+ *  + 参照から消費までの間、他の受信は待たされます。また先頭への送信も待たされま
+ *    す
  *  @{
  */
 
@@ -427,6 +642,13 @@ XBits xfiber_signal_get_isr(XFiber* fiber);
 XError xfiber_queue_create(XFiberQueue** o_queue, size_t queue_len, size_t item_size);
 
 
+/** @brief 待ちファイバーの解放順を指定してキューを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_queue_create_ex(XFiberQueue** o_queue, size_t queue_len, size_t item_size, XMode wait_mode);
+
+
 /** @brief キューを破棄します
  *
  *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
@@ -494,6 +716,99 @@ XError xfiber_queue_try_receive(XFiberQueue* queue, void* dst);
 XError xfiber_queue_receive_isr(XFiberQueue* queue, void* dst);
 
 
+/** @brief キューの末尾へ最大n要素の転送をタイムアウト付きで試みます
+ *
+ *  @param src      n要素が並んだ配列
+ *  @param o_num    転送した要素数の格納先
+ *
+ *  1要素も転送できない間はタイムアウトまで待ちます。1要素以上転送できた時点で、
+ *  残りは待たずに転送できるだけ転送して戻ります。
+ */
+XError xfiber_queue_timed_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num, XTicks timeout);
+
+
+/** @brief キューの末尾へ最大n要素の転送を試みます
+ */
+XError xfiber_queue_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num);
+
+
+/** @brief キューの末尾へ最大n要素の転送をポーリングで試みます
+ */
+XError xfiber_queue_try_send_back_n(XFiberQueue* queue, const void* src, size_t n, size_t* o_num);
+
+
+/** @brief キューの先頭から最大n要素の受信をタイムアウト付きで試みます
+ *
+ *  @param dst      n要素分の格納先
+ *  @param o_num    受信した要素数の格納先
+ *
+ *  1要素も受信できない間はタイムアウトまで待ちます。1要素以上受信できた時点で、
+ *  残りは待たずに受信できるだけ受信して戻ります。空きができて送信待ちが解除さ
+ *  れたファイバーの要素も、続けて受信します。
+ */
+XError xfiber_queue_timed_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num, XTicks timeout);
+
+
+/** @brief キューの先頭から最大n要素の受信を試みます
+ */
+XError xfiber_queue_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num);
+
+
+/** @brief キューの先頭から最大n要素の受信をポーリングで試みます
+ */
+XError xfiber_queue_try_receive_n(XFiberQueue* queue, void* dst, size_t n, size_t* o_num);
+
+
+/** @brief キューの末尾に1要素分の領域をタイムアウト付きで確保します
+ *
+ *  @param o_ptr    確保した領域のアドレスの格納先
+ *
+ *  o_ptrが指すitem_sizeバイトの領域にデータを書き込み、
+ *  xfiber_queue_commit_back()で送信を確定してください。
+ */
+XError xfiber_queue_timed_reserve_back(XFiberQueue* queue, void** o_ptr, XTicks timeout);
+
+
+/** @brief キューの末尾に1要素分の領域を確保します
+ */
+XError xfiber_queue_reserve_back(XFiberQueue* queue, void** o_ptr);
+
+
+/** @brief キューの末尾に1要素分の領域をポーリングで確保します
+ */
+XError xfiber_queue_try_reserve_back(XFiberQueue* queue, void** o_ptr);
+
+
+/** @brief xfiber_queue_reserve_back()で確保した要素の送信を確定します
+ */
+void xfiber_queue_commit_back(XFiberQueue* queue);
+
+
+/** @brief キューの先頭の要素をタイムアウト付きで参照します
+ *
+ *  @param o_ptr    先頭の要素のアドレスの格納先
+ *
+ *  要素はキューから取り除かれません。参照を終えたらxfiber_queue_consume()で要素
+ *  を取り除いてください。
+ */
+XError xfiber_queue_timed_peek(XFiberQueue* queue, void** o_ptr, XTicks timeout);
+
+
+/** @brief キューの先頭の要素を参照します
+ */
+XError xfiber_queue_peek(XFiberQueue* queue, void** o_ptr);
+
+
+/** @brief キューの先頭の要素をポーリングで参照します
+ */
+XError xfiber_queue_try_peek(XFiberQueue* queue, void** o_ptr);
+
+
+/** @brief xfiber_queue_peek()で参照中の要素をキューから取り除きます
+ */
+void xfiber_queue_consume(XFiberQueue* queue);
+
+
 /** @} end of name fiber_queue
  */
 
@@ -506,6 +821,14 @@ XError xfiber_queue_receive_isr(XFiberQueue* queue, void* dst);
  *  queueとの違いは以下の通りです
  *  + 可変長のため、要素ごとにsizeof(size_t)バイトの管理領域が必要
  *  + 先頭への送信は不可
+ *
+ *  メッセージはバッファの終端で折り返さずに連続して格納されるため、
+ *  xfiber_channel_reserve()とxfiber_channel_peek()でバッファ内のメッセージを直
+ *  接読み書きできます。ただし、メッセージのアドレスのアライメントは保証されませ
+ *  ん。確保中と参照中の制約はqueueと同じです。
+ *
+ *  終端の余りは詰め物として読み飛ばされるため、空き容量がメッセージのバイト数+
+ *  管理領域以上あっても、送信が待たされる場合があります。
  *  @{
  */
 
@@ -524,6 +847,13 @@ XError xfiber_queue_receive_isr(XFiberQueue* queue, void* dst);
 XError xfiber_channel_create(XFiberChannel** o_channel, size_t capacity, size_t max_item_size);
 
 
+/** @brief 待ちファイバーの解放順を指定してチャンネルを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_channel_create_ex(XFiberChannel** o_channel, size_t capacity, size_t max_item_size, XMode wait_mode);
+
+
 /** チャンネル破棄します
  *
  *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
@@ -571,6 +901,105 @@ XError xfiber_channel_try_receive(XFiberChannel* channel, void* dst, size_t* o_s
 XError xfiber_channel_receive_isr(XFiberChannel* channel, void* dst, size_t* o_size);
 
 
+/** @brief チャンネルの末尾へ最大n個のメッセージの転送をタイムアウト付きで試みます
+ *
+ *  @param src      メッセージを詰めて並べた領域
+ *  @param sizes    各メッセージのバイト数の配列
+ *  @param o_num    転送したメッセージ数の格納先
+ *
+ *  待ち合わせの動作はxfiber_queue_timed_send_back_n()と同じです。
+ */
+XError xfiber_channel_timed_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num, XTicks timeout);
+
+
+/** @brief チャンネルの末尾へ最大n個のメッセージの転送を試みます
+ */
+XError xfiber_channel_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num);
+
+
+/** @brief チャンネルの末尾へ最大n個のメッセージの転送をポーリングで試みます
+ */
+XError xfiber_channel_try_send_n(XFiberChannel* channel, const void* src, const size_t* sizes, size_t n, size_t* o_num);
+
+
+/** @brief チャンネル先頭から最大n個のメッセージの受信をタイムアウト付きで試みます
+ *
+ *  @param dst      メッセージの格納先
+ *  @param dst_size dstのバイト数(max_item_size以上)
+ *  @param o_sizes  受信した各メッセージのバイト数の格納先(n要素)
+ *  @param o_num    受信したメッセージ数の格納先
+ *
+ *  メッセージはdstに詰めて格納され、dst_sizeに収まらなくなった時点で受信を終え
+ *  ます。待ち合わせの動作はxfiber_queue_timed_receive_n()と同じです。
+ */
+XError xfiber_channel_timed_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num, XTicks timeout);
+
+
+/** @brief チャンネル先頭から最大n個のメッセージの受信を試みます
+ */
+XError xfiber_channel_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num);
+
+
+/** @brief チャンネル先頭から最大n個のメッセージの受信をポーリングで試みます
+ */
+XError xfiber_channel_try_receive_n(XFiberChannel* channel, void* dst, size_t dst_size, size_t* o_sizes, size_t n, size_t* o_num);
+
+
+/** @brief チャンネルの末尾にsizeバイトのメッセージ領域をタイムアウト付きで確保します
+ *
+ *  @param size     確保するバイト数(1 ~ max_item_size)
+ *  @param o_ptr    確保した領域のアドレスの格納先
+ *
+ *  領域にメッセージを書き込み、xfiber_channel_commit()で送信を確定してくださ
+ *  い。
+ */
+XError xfiber_channel_timed_reserve(XFiberChannel* channel, size_t size, void** o_ptr, XTicks timeout);
+
+
+/** @brief チャンネルの末尾にsizeバイトのメッセージ領域を確保します
+ */
+XError xfiber_channel_reserve(XFiberChannel* channel, size_t size, void** o_ptr);
+
+
+/** @brief チャンネルの末尾にsizeバイトのメッセージ領域をポーリングで確保します
+ */
+XError xfiber_channel_try_reserve(XFiberChannel* channel, size_t size, void** o_ptr);
+
+
+/** @brief 確保した領域の先頭sizeバイトをメッセージとして送信を確定します
+ *
+ *  sizeは確保したバイト数以下である必要があります。0を指定した場合は送信を取り
+ *  やめます。
+ */
+void xfiber_channel_commit(XFiberChannel* channel, size_t size);
+
+
+/** @brief チャンネル先頭のメッセージをタイムアウト付きで参照します
+ *
+ *  @param o_ptr    メッセージのアドレスの格納先
+ *  @param o_size   メッセージのバイト数の格納先
+ *
+ *  メッセージはチャンネルから取り除かれません。参照を終えたら
+ *  xfiber_channel_consume()でメッセージを取り除いてください。
+ */
+XError xfiber_channel_timed_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size, XTicks timeout);
+
+
+/** @brief チャンネル先頭のメッセージを参照します
+ */
+XError xfiber_channel_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size);
+
+
+/** @brief チャンネル先頭のメッセージをポーリングで参照します
+ */
+XError xfiber_channel_try_peek(XFiberChannel* channel, void** o_ptr, size_t* o_size);
+
+
+/** @brief xfiber_channel_peek()で参照中のメッセージをチャンネルから取り除きます
+ */
+void xfiber_channel_consume(XFiberChannel* channel);
+
+
 /** @} end of name fiber_channel
  */
 
@@ -592,6 +1021,13 @@ XError xfiber_channel_receive_isr(XFiberChannel* channel, void* dst, size_t* o_s
 XError xfiber_semaphore_create(XFiberSemaphore** o_semaphore, int initial_count);
 
 
+/** @brief 待ちファイバーの解放順を指定してセマフォを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_semaphore_create_ex(XFiberSemaphore** o_semaphore, int initial_count, XMode wait_mode);
+
+
 /** @brief セマフォを破棄します
  *
  *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
@@ -634,8 +1070,14 @@ XError xfiber_semaphore_give_isr(XFiberSemaphore* semaphore);
  *  セマフォとの違いはロックされたままタスクが終了すると、自動的にロック解除を行
  *  う点と、優先度逆転防止機構を持つことです。
  *
+ *  優先度逆転防止には優先度継承方式を使用しています。ロック中のファイバーは、獲
+ *  得待ちのファイバーのうち最も高い優先度を一時的に継承し、ロック解除やタイムア
+ *  ウトで待ちファイバーがいなくなると本来の優先度に戻ります。ロック中のファイバ
+ *  ーが別のミューテックスを待っている場合は、その所有者にも連鎖的に継承されま
+ *  す。
+ *
  *  @attention
- *  自動ロック解除と、優先度逆転防止機構はまだ未実装です
+ *  自動ロック解除はまだ未実装です
  *  @{
  */
 
@@ -645,6 +1087,13 @@ XError xfiber_semaphore_give_isr(XFiberSemaphore* semaphore);
 XError xfiber_mutex_create(XFiberMutex** o_mutex);
 
 
+/** @brief 待ちファイバーの解放順を指定してミューテックスを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_mutex_create_ex(XFiberMutex** o_mutex, XMode wait_mode);
+
+
 /** @brief ミューテックスを破棄します
  */
 void xfiber_mutex_destroy(XFiberMutex* mutex);
@@ -679,83 +1128,249 @@ XError xfiber_mutex_unlock_isr(XFiberMutex* mutex);
  */
 
 
-/** @name fiber_mailbox
+/** @name fiber_rwlock
+ *  @brief 読み込みが大半を占める共有資源の排他制御に使用します
  *
- *  大きなデータの受け渡しに使用する通信機能です。リンクリストで実装しているので
- *  、データのコピーが行われません。また、送信待ちが絶対に発生しないのも大きな特
- *  徴です。
+ *  読み込みロックは複数のファイバーが同時に獲得でき、書き込みロックは1つのファ
+ *  イバーだけが獲得できます。
  *
- *  ただし、スタック上のデータを送信することができないという制限があり、データの
- *  寿命管理にも気をつける必要があります。
+ *  デフォルトでは読み込みを優先し、書き込みロックの獲得待ちがいても、書き込み
+ *  ロック中でなければ読み込みロックを獲得できます。書き込み優先を指定すると、
+ *  待ちファイバーがいる間は新たな読み込みロックを待たせるので、読み込みが途切
+ *  れなくても書き込みが待たされ続けることはありません。
+ *
+ *  ミューテックスと異なり、優先度継承は行いません。
  *  @{
  */
 
 
-/** @brief メールボックスを生成します
+/** @brief 読み込み優先のRWロックを生成します
  */
-XError xfiber_mailbox_create(XFiberMailbox** o_mailbox);
+XError xfiber_rwlock_create(XFiberRwLock** o_rwlock);
 
 
-/** @brief メールボックスを生成します
+/** @brief 待ちファイバーの解放順と優先方針を指定してRWロックを生成します
+ *
+ *  @param wait_mode        @see fiber_wait_mode
+ *  @param prefer_writer    書き込みを優先するかどうか
+ */
+XError xfiber_rwlock_create_ex(XFiberRwLock** o_rwlock, XMode wait_mode, bool prefer_writer);
+
+
+/** @brief RWロックを破棄します
  *
  *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
  */
-void xfiber_mailbox_destroy(XFiberMailbox* mailbox);
+void xfiber_rwlock_destroy(XFiberRwLock* rwlock);
 
 
-/** @brief メールボックス末尾にメッセージを追加します
+/** @brief 読み込みロックの獲得をタイムアウト付きで試みます
  */
-XError xfiber_mailbox_send(XFiberMailbox* mailbox, XFiberMessage* message);
+XError xfiber_rwlock_timed_read_lock(XFiberRwLock* rwlock, XTicks timeout);
 
 
-/** @brief 割込みハンドラから呼び出し可能なxfiber_mailbox_send()です
+/** @brief 読み込みロックの獲得を試みます
  */
-XError xfiber_mailbox_send_isr(XFiberMailbox* mailbox, XFiberMessage* message);
+XError xfiber_rwlock_read_lock(XFiberRwLock* rwlock);
 
 
-/** @brief メールボックス先頭からメッセージの受信をタイムアウト付きで試みます
+/** @brief 読み込みロックの獲得をポーリングで試みます
  */
-XError xfiber_mailbox_timed_receive(XFiberMailbox* mailbox, XFiberMessage** o_message, XTicks timeout);
+XError xfiber_rwlock_try_read_lock(XFiberRwLock* rwlock);
 
 
-/** @brief メールボックス先頭からメッセージの受信を試みます
+/** @brief 読み込みロックを解除します
+ *
+ *  @retval X_ERR_PROTOCOL  読み込みロックされていない
  */
-XError xfiber_mailbox_receive(XFiberMailbox* mailbox, XFiberMessage** o_message);
+XError xfiber_rwlock_read_unlock(XFiberRwLock* rwlock);
 
 
-/** @brief メールボックス先頭からメッセージの受信をポーリングで試みます
+/** @brief 書き込みロックの獲得をタイムアウト付きで試みます
  */
-XError xfiber_mailbox_try_receive(XFiberMailbox* mailbox, XFiberMessage** o_message);
+XError xfiber_rwlock_timed_write_lock(XFiberRwLock* rwlock, XTicks timeout);
 
 
-/** @brief 割込みハンドラから呼び出し可能なxfiber_mailbox_try_receive()です
+/** @brief 書き込みロックの獲得を試みます
  */
-XError xfiber_mailbox_receive_isr(XFiberMailbox* mailbox, XFiberMessage** o_message);
+XError xfiber_rwlock_write_lock(XFiberRwLock* rwlock);
 
 
-/** @} end of name fiber_mailbox
+/** @brief 書き込みロックの獲得をポーリングで試みます
  */
+XError xfiber_rwlock_try_write_lock(XFiberRwLock* rwlock);
 
 
-/** @name fiber_pool
+/** @brief 書き込みロックを解除します
  *
- *  @brief 固定長のメモリブロックを確保と解放を行えます
- *
- *  メールボックスのメッセージのメモリ確保と相性がいいです。固定長なので、確保と
- *  解放は超高速です。
- *  @{
+ *  @retval X_ERR_PROTOCOL  自分が書き込みロックしていない
  */
+XError xfiber_rwlock_write_unlock(XFiberRwLock* rwlock);
 
 
-/** @brief プールを生成します
- *
- *  @param o_pool       生成したプールのアドレスの格納先
+/** @} end of name fiber_rwlock
+ */
+
+
+/** @name fiber_cond
+ *  @brief ミューテックスで保護された条件が成立するまで待ちます
+ *
+ *  pthreadの条件変数と同じく、待ちに入る時にミューテックスのロックを解除し、起
+ *  床後に再びロックしてから戻ります。ロックの解除と待ちへの遷移は不可分に行わ
+ *  れるので、通知を取りこぼすことはありません。起床後は条件を再確認してくださ
+ *  い。
+ *
+ *  @code
+ *  xfiber_mutex_lock(mutex);
+ *  while (!ready)
+ *      xfiber_cond_wait(cond, mutex);
+ *  xfiber_mutex_unlock(mutex);
+ *  @endcode
+ *  @{
+ */
+
+
+/** @brief 条件変数を生成します
+ */
+XError xfiber_cond_create(XFiberCond** o_cond);
+
+
+/** @brief 待ちファイバーの解放順を指定して条件変数を生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_cond_create_ex(XFiberCond** o_cond, XMode wait_mode);
+
+
+/** @brief 条件変数を破棄します
+ *
+ *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
+ */
+void xfiber_cond_destroy(XFiberCond* cond);
+
+
+/** @brief 条件変数への通知をタイムアウト付きで待ちます
+ *
+ *  @param mutex    呼び出し元がロックしているミューテックス
+ *
+ *  タイムアウトやキャンセルの場合も、ミューテックスをロックし直してから戻りま
+ *  す。
+ *
+ *  @retval X_ERR_PROTOCOL  mutexをロックしていない
+ */
+XError xfiber_cond_timed_wait(XFiberCond* cond, XFiberMutex* mutex, XTicks timeout);
+
+
+/** @brief 条件変数への通知を待ちます
+ */
+XError xfiber_cond_wait(XFiberCond* cond, XFiberMutex* mutex);
+
+
+/** @brief 待ちファイバーを1つ起床させます
+ */
+XError xfiber_cond_signal(XFiberCond* cond);
+
+
+/** @brief 全ての待ちファイバーを起床させます
+ */
+XError xfiber_cond_broadcast(XFiberCond* cond);
+
+
+/** @} end of name fiber_cond
+ */
+
+
+/** @name fiber_mailbox
+ *
+ *  大きなデータの受け渡しに使用する通信機能です。リンクリストで実装しているので
+ *  、データのコピーが行われません。また、送信待ちが絶対に発生しないのも大きな特
+ *  徴です。
+ *
+ *  ただし、スタック上のデータを送信することができないという制限があり、データの
+ *  寿命管理にも気をつける必要があります。
+ *  @{
+ */
+
+
+/** @brief メールボックスを生成します
+ */
+XError xfiber_mailbox_create(XFiberMailbox** o_mailbox);
+
+
+/** @brief 待ちファイバーの解放順を指定してメールボックスを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_mailbox_create_ex(XFiberMailbox** o_mailbox, XMode wait_mode);
+
+
+/** @brief メールボックスを生成します
+ *
+ *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
+ */
+void xfiber_mailbox_destroy(XFiberMailbox* mailbox);
+
+
+/** @brief メールボックス末尾にメッセージを追加します
+ */
+XError xfiber_mailbox_send(XFiberMailbox* mailbox, XFiberMessage* message);
+
+
+/** @brief 割込みハンドラから呼び出し可能なxfiber_mailbox_send()です
+ */
+XError xfiber_mailbox_send_isr(XFiberMailbox* mailbox, XFiberMessage* message);
+
+
+/** @brief メールボックス先頭からメッセージの受信をタイムアウト付きで試みます
+ */
+XError xfiber_mailbox_timed_receive(XFiberMailbox* mailbox, XFiberMessage** o_message, XTicks timeout);
+
+
+/** @brief メールボックス先頭からメッセージの受信を試みます
+ */
+XError xfiber_mailbox_receive(XFiberMailbox* mailbox, XFiberMessage** o_message);
+
+
+/** @brief メールボックス先頭からメッセージの受信をポーリングで試みます
+ */
+XError xfiber_mailbox_try_receive(XFiberMailbox* mailbox, XFiberMessage** o_message);
+
+
+/** @brief 割込みハンドラから呼び出し可能なxfiber_mailbox_try_receive()です
+ */
+XError xfiber_mailbox_receive_isr(XFiberMailbox* mailbox, XFiberMessage** o_message);
+
+
+/** @} end of name fiber_mailbox
+ */
+
+
+/** @name fiber_pool
+ *
+ *  @brief 固定長のメモリブロックを確保と解放を行えます
+ *
+ *  メールボックスのメッセージのメモリ確保と相性がいいです。固定長なので、確保と
+ *  解放は超高速です。
+ *  @{
+ */
+
+
+/** @brief プールを生成します
+ *
+ *  @param o_pool       生成したプールのアドレスの格納先
  *  @param block_size   1ブロックのサイズ
  *  @param num_blocks   ブロック数
  */
 XError xfiber_pool_create(XFiberPool** o_pool, size_t block_size, size_t num_blocks);
 
 
+/** @brief 待ちファイバーの解放順を指定してプールを生成します
+ *
+ *  @param wait_mode    @see fiber_wait_mode
+ */
+XError xfiber_pool_create_ex(XFiberPool** o_pool, size_t block_size, size_t num_blocks, XMode wait_mode);
+
+
 /** @brief プールを解放します
  *
  *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります
@@ -797,6 +1412,535 @@ XError xfiber_pool_release_isr(XFiberPool* pool, void* mem);
  */
 
 
+/** @name fiber_ring
+ *
+ *  @brief 割込みハンドラからファイバーへ、クリティカルセクションなしでデータを
+ *  受け渡します
+ *
+ *  xfiber_queue_send_back_isr()などの割込み用APIは、データのコピーを含む処理全
+ *  体をX_CONF_FIBER_ENTER_CRITICAL()の中で行います。リングは送信側と受信側が
+ *  1つずつに限定される代わりに、送信側は読み書き位置のアトミックな更新だけで完
+ *  結するので、割込みを禁止しません。
+ *
+ *  受信待ちのファイバーの起床は、割込みハンドラではなく次回のスケジューリング
+ *  時にカーネルが行います。アイドル中は、アイドルフック(XFiberIdleHook)から戻
+ *  った時点で起床させるので、アイドルフックは割込みで待機を抜けるようにしてく
+ *  ださい。
+ *
+ *  xfiber_select()ではX_FIBER_SELECT_READを指定して受信可能になるのを待てま
+ *  す。
+ *  @{
+ */
+
+
+/** @brief リングを生成します
+ *
+ *  @param o_ring       生成したリングのアドレスの格納先
+ *  @param ring_len     格納できる要素数。2のべき乗に切り上げられます
+ *  @param item_size    1要素のサイズ
+ */
+XError xfiber_ring_create(XFiberRing** o_ring, size_t ring_len, size_t item_size);
+
+
+/** @brief リングを解放します
+ *
+ *  全ての待ちタスクの待ちは解除され、待ちタスクにはX_ERR_CANCELEDが返ります。
+ *  割込みハンドラからの送信が行われないことを保証してから呼び出してください。
+ */
+void xfiber_ring_destroy(XFiberRing* ring);
+
+
+/** @brief リング末尾に要素を追加します
+ *
+ *  割込みハンドラから呼び出せます。割込みは禁止しません。1つのリングに対して
+ *  送信するのは、常に同じ割込みハンドラ(またはファイバー)にしてください。
+ *
+ *  @retval X_ERR_TIMED_OUT リングが満杯
+ */
+XError xfiber_ring_push_isr(XFiberRing* ring, const void* src);
+
+
+/** @brief リング先頭からの要素の受信をタイムアウト付きで試みます
+ *
+ *  1つのリングから受信するのは、常に同じファイバーにしてください。
+ */
+XError xfiber_ring_timed_receive(XFiberRing* ring, void* dst, XTicks timeout);
+
+
+/** @brief リング先頭からの要素の受信を試みます
+ */
+XError xfiber_ring_receive(XFiberRing* ring, void* dst);
+
+
+/** @brief リング先頭からの要素の受信をポーリングで試みます
+ */
+XError xfiber_ring_try_receive(XFiberRing* ring, void* dst);
+
+
+/** @brief リングに格納されている要素数を返します
+ */
+size_t xfiber_ring_count(const XFiberRing* ring);
+
+
+/** @} end of name fiber_ring
+ */
+
+
+/** @name fiber_select
+ *
+ *  @brief 複数の待ちオブジェクトのいずれかが使用可能になるまで待ちます
+ *
+ *  キュー、チャンネル、イベント、セマフォ、メールボックス、プール、リングを混
+ *  在させて指定できます。select()やpoll()と同じく、使用可能になったことを通知
+ *  するだけでオブジェクトの操作は行いません。通知を受けたら、xfiber_queue_try_receive()
+ *  などのポーリング版の関数で操作してください。他のファイバーに先を越されると
+ *  ポーリングは失敗するので、その場合は再度待ち合わせてください。
+ *
+ *  @code
+ *  XFiberSelectItem items[2] = {
+ *      { queue, X_FIBER_SELECT_READ, 0 },
+ *      { event, X_FIBER_EVENT_WAIT_OR, 0x01 },
+ *  };
+ *  int index;
+ *
+ *  if (xfiber_select(items, 2, &index) == X_ERR_NONE)
+ *  {
+ *      if (index == 0)
+ *          xfiber_queue_try_receive(queue, &item);
+ *  }
+ *  @endcode
+ *  @{
+ */
+
+
+/** @brief キュー、チャンネル、リングが受信可能になるのを待ちます */
+#define X_FIBER_SELECT_READ         (0)
+
+/** @brief キューとチャンネルが送信可能になるのを待ちます
+ *
+ *  チャンネルの場合は、最大サイズのメッセージを格納できるようになるまで待ちま
+ *  す。
+ */
+#define X_FIBER_SELECT_WRITE        (1)
+
+
+/** @brief xfiber_select()で待つオブジェクトと条件です
+ */
+typedef struct XFiberSelectItem
+{
+    /** @brief 待ち対象のオブジェクト(XFiberQueue*など)です
+     *
+     *  ミューテックス、RWロック、条件変数は指定できません。
+     */
+    void*   object;
+
+    /** @brief 待ち条件です
+     *
+     *  キューとチャンネルではX_FIBER_SELECT_READかX_FIBER_SELECT_WRITEを、イベ
+     *  ントではX_FIBER_EVENT_WAIT_ORかX_FIBER_EVENT_WAIT_ANDを指定します。その
+     *  他のオブジェクトでは無視されます。
+     */
+    XMode   mode;
+
+    /** @brief イベントの待ちパターンです。イベント以外では無視されます */
+    XBits   pattern;
+} XFiberSelectItem;
+
+
+/** @brief itemsのいずれかが使用可能になるまでタイムアウト付きで待ちます
+ *
+ *  @param items    待ち対象の配列
+ *  @param num      itemsの要素数
+ *  @param o_index  使用可能になったitemsのインデックスの格納先
+ *
+ *  複数が使用可能な場合は、インデックスの小さい方が優先されます。待ち対象のオブ
+ *  ジェクトが破棄された場合はX_ERR_CANCELEDが返ります。
+ *
+ *  待ちに入る場合は、待ちノードの領域をカーネルのワークバッファから一時的に確保
+ *  します。確保できなければX_ERR_NO_MEMORYを返します。
+ */
+XError xfiber_timed_select(const XFiberSelectItem* items, int num, int* o_index, XTicks timeout);
+
+
+/** @brief itemsのいずれかが使用可能になるまで待ちます
+ */
+XError xfiber_select(const XFiberSelectItem* items, int num, int* o_index);
+
+
+/** @brief itemsのいずれかが使用可能かをポーリングで調べます
+ */
+XError xfiber_try_select(const XFiberSelectItem* items, int num, int* o_index);
+
+
+/** @} end of name fiber_select
+ */
+
+
+/** @name fiber_executor
+ *
+ *  @brief 固定数のワーカーファイバーでジョブを実行します
+ *
+ *  ジョブごとにファイバーを生成すると、その度にTCBとスタックの確保が発生します
+ *  。エグゼキューターは生成時に起動したワーカーファイバーで、投入されたジョブを
+ *  順に実行します。同時実行数はワーカー数で、未実行のジョブ数は投入キューの長
+ *  さで制限され、キューが満杯の間は投入側が待たされます。
+ *
+ *  ジョブの完了は、投入時に指定したXFiberFutureで待ち合わせるか、フューチャー
+ *  に登録したコールバックで受け取ります。
+ *
+ *  @code
+ *  static XFiberFuture future;
+ *  XFiberExecutor* executor;
+ *  void* result;
+ *
+ *  xfiber_executor_create(&executor, 4, 16, priority, stack_size);
+ *  xfiber_future_init(&future, NULL, NULL);
+ *  xfiber_executor_submit(executor, Job, arg, &future);
+ *  xfiber_future_wait(&future, &result);
+ *  @endcode
+ *  @{
+ */
+
+
+/** @brief ジョブの関数です。戻り値はフューチャーに格納されます
+ */
+typedef void* (*XFiberJobFunc)(void* arg);
+
+
+/** @brief ジョブの完了時にワーカーファイバーから呼び出されるコールバックです
+ *
+ *  フューチャーを待っているファイバーが起床する前に呼び出されます。
+ */
+typedef void (*XFiberFutureCallback)(void* result, void* callback_arg);
+
+
+/** @brief ジョブの完了を待ち合わせるためのオブジェクトです
+ *
+ *  メモリは呼び出し側で用意します。完了するまでは解放しないでください。メール
+ *  ボックスのメッセージと同じく、スタック上に置くことはできません。
+ */
+typedef struct XFiberFuture
+{
+/// privatesection
+    XIntrusiveList          m_waiters;
+    XFiberFutureCallback    m_callback;
+    void*                   m_callback_arg;
+    void*                   m_result;
+    bool                    m_done;
+} XFiberFuture;
+
+
+/** @brief フューチャーを初期化します
+ *
+ *  @param callback     完了時のコールバック。不要であればNULL
+ *  @param callback_arg コールバックに渡す引数
+ */
+void xfiber_future_init(XFiberFuture* future, XFiberFutureCallback callback, void* callback_arg);
+
+
+/** @brief 関連付けられたジョブが完了しているかどうかを返します
+ */
+bool xfiber_future_is_done(const XFiberFuture* future);
+
+
+/** @brief 関連付けられたジョブの完了をタイムアウト付きで待ちます
+ *
+ *  @param o_result ジョブの戻り値の格納先。不要であればNULL
+ *
+ *  複数のファイバーから待つこともできます。
+ */
+XError xfiber_future_timed_wait(XFiberFuture* future, void** o_result, XTicks timeout);
+
+
+/** @brief 関連付けられたジョブの完了を待ちます
+ */
+XError xfiber_future_wait(XFiberFuture* future, void** o_result);
+
+
+/** @brief 関連付けられたジョブの完了をポーリングで調べます
+ */
+XError xfiber_future_try_wait(XFiberFuture* future, void** o_result);
+
+
+/** @brief エグゼキューターを生成します
+ *
+ *  @param o_executor   生成したエグゼキューターのアドレスの格納先
+ *  @param num_workers  ワーカーファイバー数
+ *  @param queue_len    未実行のジョブを保持できる数
+ *  @param priority     ワーカーファイバーの優先度
+ *  @param stack_size   ワーカーファイバーのスタックサイズ
+ *
+ *  スケジューラの起動前でも呼び出せます。
+ */
+XError xfiber_executor_create(XFiberExecutor** o_executor, int num_workers, size_t queue_len,
+                              int priority, size_t stack_size);
+
+
+/** @brief 投入済みの全てのジョブの完了を待ってから、エグゼキューターを解放します
+ *
+ *  ワーカーファイバー以外のファイバーから呼び出してください。
+ */
+void xfiber_executor_destroy(XFiberExecutor* executor);
+
+
+/** @brief ジョブの投入をタイムアウト付きで試みます
+ *
+ *  @param func     ジョブの関数
+ *  @param arg      funcに渡す引数
+ *  @param future   完了を待ち合わせるフューチャー。不要であればNULL
+ *
+ *  投入キューに空きがなければ、空くまで待ちます。futureは未完了の状態に戻され
+ *  るので、完了済みのフューチャーは再利用できます。
+ */
+XError xfiber_executor_timed_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                                    XFiberFuture* future, XTicks timeout);
+
+
+/** @brief ジョブを投入します
+ */
+XError xfiber_executor_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                              XFiberFuture* future);
+
+
+/** @brief ジョブの投入をポーリングで試みます
+ */
+XError xfiber_executor_try_submit(XFiberExecutor* executor, XFiberJobFunc func, void* arg,
+                                  XFiberFuture* future);
+
+
+/** @} end of name fiber_executor
+ */
+
+
+#if X_CONF_FIBER_USE_EPOLL
+
+
+/** @name fiber_io
+ *
+ *  @brief ファイルディスクリプタが読み書き可能になるまで待ちます
+ *
+ *  待っている間は他のファイバーが実行されます。待ちの登録にはepollを使用し、カ
+ *  ーネルは1チックに1回のスケジューリング時と、アイドル時に準備のできたファイ
+ *  ルディスクリプタを調べて待ちファイバーを起床させます。
+ *
+ *  アイドル時はアイドルフックより先にepoll_wait()で次のタイマーの期限まで待機
+ *  し、その後アイドルフックをtimeout=0で呼び出します。この待機中はxfiber_ring_push_isr()
+ *  による起床も遅れるので、リングと併用する場合は注意してください。
+ *
+ *  ファイルディスクリプタはノンブロッキングモードにしておき、読み書きが
+ *  EAGAINで失敗したら待つようにしてください。
+ *
+ *  @code
+ *  while ((n = read(fd, buf, size)) < 0 && errno == EAGAIN)
+ *      xfiber_io_wait(fd, X_FIBER_IO_READ, NULL);
+ *  @endcode
+ *  @{
+ */
+
+/** @brief 読み込み可能になるのを待ちます */
+#define X_FIBER_IO_READ     (1 << 0)
+
+/** @brief 書き込み可能になるのを待ちます */
+#define X_FIBER_IO_WRITE    (1 << 1)
+
+/** @brief エラーまたは切断が発生しました(o_eventsにのみ格納されます) */
+#define X_FIBER_IO_ERROR    (1 << 2)
+
+
+/** @brief ファイルディスクリプタの準備ができるまでタイムアウト付きで待ちます
+ *
+ *  @param fd       待ち対象のファイルディスクリプタ
+ *  @param events   X_FIBER_IO_READとX_FIBER_IO_WRITEの組み合わせ
+ *  @param o_events 準備のできたイベントの格納先。NULL可
+ *  @param timeout  タイムアウト
+ *
+ *  @retval X_ERR_BUSY      他のファイバーが同じファイルディスクリプタを待って
+ *                          いる
+ *  @retval X_ERR_INVALID   fdがepollで待てないファイルディスクリプタ
+ */
+XError xfiber_io_timed_wait(int fd, XMode events, XMode* o_events, XTicks timeout);
+
+
+/** @brief ファイルディスクリプタの準備ができるまで待ちます
+ */
+XError xfiber_io_wait(int fd, XMode events, XMode* o_events);
+
+
+/** @brief ファイルディスクリプタの準備ができているかをポーリングで調べます
+ */
+XError xfiber_io_try_wait(int fd, XMode events, XMode* o_events);
+
+
+/** @} end of name fiber_io
+ */
+
+
+#endif /* if X_CONF_FIBER_USE_EPOLL */
+
+
+#if X_CONF_FIBER_USE_STATS
+
+
+/** @name fiber_stats
+ *
+ *  @brief ファイバーの実行統計とスケジューリングトレースです
+ *
+ *  X_CONF_FIBER_USE_STATSが有効な場合のみ使用できます。時間の単位は
+ *  X_CONF_FIBER_STATS_CLOCK()に依存します。
+ *  @{
+ */
+
+
+/** @brief 待ち要因の種類です。XFiberStats::wait_timeのインデックスです
+ */
+typedef enum
+{
+    X_FIBER_WAIT_KIND_EVENT,
+    X_FIBER_WAIT_KIND_DELAY,
+    X_FIBER_WAIT_KIND_SIGNAL,
+    X_FIBER_WAIT_KIND_QUEUE,
+    X_FIBER_WAIT_KIND_CHANNEL,
+    X_FIBER_WAIT_KIND_MUTEX,
+    X_FIBER_WAIT_KIND_RWLOCK,
+    X_FIBER_WAIT_KIND_COND,
+    X_FIBER_WAIT_KIND_SEMAPHORE,
+    X_FIBER_WAIT_KIND_MAILBOX,
+    X_FIBER_WAIT_KIND_POOL,
+    X_FIBER_WAIT_KIND_RING,
+    X_FIBER_WAIT_KIND_SELECT,
+    X_FIBER_WAIT_KIND_JOIN,
+    X_FIBER_WAIT_KIND_FUTURE,
+    X_FIBER_WAIT_KIND_IO,
+    X_FIBER_WAIT_KIND_SUSPEND,
+    X_FIBER_WAIT_KIND_END,
+} XFiberWaitKind;
+
+
+/** @brief ファイバーごとの実行統計です
+ */
+typedef struct XFiberStats
+{
+    /** @brief トレースの記録に使用するファイバーの識別番号です */
+    uint16_t    id;
+
+    /** @brief ディスパッチされた回数です */
+    uint32_t    num_switches;
+
+    /** @brief 実行状態だった時間の累計です */
+    uint64_t    run_time;
+
+    /** @brief 待ち状態に入ってから再びディスパッチされるまでの時間の累計です
+     *
+     *  待ち要因ごとに集計されます。待ち解除後にレディキューで待っていた時間も
+     *  含みます。
+     */
+    uint64_t    wait_time[X_FIBER_WAIT_KIND_END];
+
+    /** @brief スタック使用量のピークです
+     *
+     *  コンテキストスイッチ時点の使用量から求めるので、スイッチの合間に一時的
+     *  に使用された領域は含まれません。
+     */
+    size_t      max_stack_usage;
+} XFiberStats;
+
+
+/** @brief トレースのイベントの種類です
+ */
+typedef enum
+{
+    /** @brief ファイバーが生成された */
+    X_FIBER_TRACE_CREATE,
+
+    /** @brief ファイバーがディスパッチされた */
+    X_FIBER_TRACE_DISPATCH,
+
+    /** @brief ファイバーが待ち状態に入った。argはXFiberWaitKindです */
+    X_FIBER_TRACE_BLOCK,
+
+    /** @brief ファイバーの待ちが解除された。argは待ちの結果のXErrorです */
+    X_FIBER_TRACE_WAKE,
+
+    /** @brief ファイバーが終了した */
+    X_FIBER_TRACE_EXIT,
+
+    /** @brief 実行可能なファイバーがなくなった。fiber_idは0です */
+    X_FIBER_TRACE_IDLE,
+} XFiberTraceEvent;
+
+
+/** @brief トレースの1レコードです
+ *
+ *  xfiber_trace_dump()はこの構造体をそのままのバイト列で出力します。
+ */
+typedef struct XFiberTraceRecord
+{
+    /** @brief X_CONF_FIBER_STATS_CLOCK()で取得した時刻です */
+    uint32_t    time;
+
+    /** @brief XFiberStats::idです */
+    uint16_t    fiber_id;
+
+    /** @brief XFiberTraceEventです */
+    uint8_t     event;
+
+    /** @brief イベントごとの付加情報です */
+    uint8_t     arg;
+} XFiberTraceRecord;
+
+
+/** @brief ファイバーの実行統計を取得します
+ *
+ *  fiberにNULLを指定した場合は、実行中のファイバーが対象です。実行中のファイバ
+ *  ーの実行時間には、今回ディスパッチされてからの時間も含まれます。
+ */
+XError xfiber_get_stats(const XFiber* fiber, XFiberStats* o_stats);
+
+
+/** @brief ファイバーの実行統計をクリアします
+ *
+ *  fiberにNULLを指定した場合は、実行中のファイバーが対象です。
+ */
+void xfiber_reset_stats(XFiber* fiber);
+
+
+/** @brief 生存中の全てのファイバーの実行統計をテキストで出力します
+ *
+ *  統計はカーネルのヒープに写し取ってから出力するので、streamへの書き込み中に
+ *  他のファイバーを止めることはありません。領域を確保できない場合は
+ *  X_ERR_NO_MEMORYを返します。
+ */
+XError xfiber_dump_stats(XStream* stream);
+
+
+/** @brief トレースバッファの内容を古い順に最大n個、dstにコピーします
+ *
+ *  @return コピーしたレコード数
+ */
+size_t xfiber_trace_read(XFiberTraceRecord* dst, size_t n);
+
+
+/** @brief トレースバッファの内容を古い順にXFiberTraceRecordのバイト列で出力し
+ *         ます
+ *
+ *  レコードはカーネルのヒープに写し取ってから出力します。領域を確保できない場合
+ *  はX_ERR_NO_MEMORYを返します。
+ */
+XError xfiber_trace_dump(XStream* stream);
+
+
+/** @brief トレースバッファを空にします
+ */
+void xfiber_trace_clear(void);
+
+
+/** @} end of name fiber_stats
+ */
+
+
+#endif /* if X_CONF_FIBER_USE_STATS */
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
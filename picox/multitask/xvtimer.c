@@ -41,14 +41,19 @@
 #include <picox/multitask/xvtimer.h>
 
 
+static XTicks X__Add(XTicks a, XTicks b);
+static XTicks X__Diff(XTicks a, XTicks b);
+static XVTimerRequest* X__Meld(XVTimerRequest* a, XVTimerRequest* b);
+static XVTimerRequest* X__MergePairs(XVTimerRequest* first);
+static void X__Insert(XVTimer* self, XVTimerRequest* request);
+static void X__Detach(XVTimer* self, XVTimerRequest* request);
+static XVTimerRequest* X__PopMin(XVTimer* self);
 static void X__RemoveRequest(XVTimerRequest* request);
-static void X__RemoveAll(XIntrusiveList* requests);
 
 
 void xvtimer_init(XVTimer* self)
 {
-    xilist_init(&self->m_requests);
-    xilist_init(&self->m_pending_requests);
+    self->m_root = NULL;
     self->m_tick_count = 0;
     self->m_in_scheduling = false;
 }
@@ -60,24 +65,29 @@ void xvtimer_init_request(XVTimerRequest* request)
     request->arg = NULL;
     request->delay = 0;
     request->interval = 0;
-    request->m_node.next = NULL;
-    request->m_node.prev = NULL;
-    request->m_count = 0;
+    request->m_child = NULL;
+    request->m_sibling = NULL;
+    request->m_prev = NULL;
+    request->m_deadline = 0;
     request->m_holder = NULL;
-    request->m_pending = false;
-    request->m_is_delayed = false;
+    request->m_has_marked_for_deletion = false;
+    request->m_expired = false;
+    request->m_rearmed = false;
 }
 
 
 void xvtimer_deinit(XVTimer* self)
 {
+    XVTimerRequest* req;
+
     if (!self)
         return;
 
+    while ((req = X__PopMin(self)) != NULL)
+        X__RemoveRequest(req);
+
     self->m_tick_count = 0;
     self->m_in_scheduling = false;
-    X__RemoveAll(&self->m_requests);
-    X__RemoveAll(&self->m_pending_requests);
 }
 
 
@@ -100,17 +110,22 @@ void xvtimer_add_request(XVTimer* self,
     request->delay = delay;
     request->interval = interval;
     request->deleter = (!deleter) ? x_null_deleter : deleter;
-    request->m_count = 0;
+    request->m_deadline = X__Add(self->m_tick_count, X__Add(delay, interval));
     request->m_has_marked_for_deletion = false;
-    request->m_pending = (self->m_in_scheduling);
-    request->m_is_delayed = (request->delay != 0);
     request->m_once = once;
 
-    if (!request->m_holder)
+    if (request->m_expired)
     {
-        request->m_holder = self;
-        xilist_push_back(&self->m_requests, &request->m_node);
+        /* xvtimer_schedule()の処理待ちなので、処理の順番が来た時に再登録する */
+        request->m_rearmed = true;
+        return;
     }
+
+    if (request->m_holder)
+        X__Detach(self, request);
+
+    request->m_holder = self;
+    X__Insert(self, request);
 }
 
 
@@ -123,106 +138,253 @@ void xvtimer_remove_requst(XVTimer* self, XVTimerRequest* request)
         return;
 
     X_ASSERT(request->m_holder == self);
-    if (self->m_in_scheduling)
+    if (request->m_expired)
+    {
+        /* xvtimer_schedule()の処理待ちリストに繋がっているので除去は任せる */
         request->m_has_marked_for_deletion = true;
+        request->m_rearmed = false;
+    }
     else
+    {
+        X__Detach(self, request);
         X__RemoveRequest(request);
+    }
 }
 
 
 void xvtimer_schedule(XVTimer* self, XTicks step)
 {
+    XVTimerRequest* expired = NULL;
+    XVTimerRequest** tail = &expired;
+    XVTimerRequest* req;
+
     if (step == 0)
         return;
 
-    self->m_tick_count += step;
+    self->m_tick_count = X__Add(self->m_tick_count, step);
     self->m_in_scheduling = true;
 
-    XIntrusiveNode* ite = xilist_front(&self->m_requests);
-    XIntrusiveNode* const end = xilist_end(&self->m_requests);
-    while (ite != end)
+    /* 先に期限切れのリクエストを全て取り出しておく。コールバック中に追加された
+     * リクエストや、再登録された周期リクエストは次回以降の呼び出しで処理される。
+     */
+    while (self->m_root && X__Diff(self->m_tick_count, self->m_root->m_deadline) >= 0)
     {
-        XVTimerRequest* const req = xnode_entry(ite, XVTimerRequest, m_node);
-        XIntrusiveNode* next = ite->next;
+        req = X__PopMin(self);
+        req->m_expired = true;
+        req->m_sibling = NULL;
+        *tail = req;
+        tail = &req->m_sibling;
+    }
+
+    while (expired)
+    {
+        req = expired;
+        expired = req->m_sibling;
+        req->m_sibling = NULL;
+        req->m_expired = false;
 
         if (req->m_has_marked_for_deletion)
         {
             X__RemoveRequest(req);
-            goto x__next;
+            continue;
         }
 
-        if (req->m_pending)
-            goto x__next;
+        if (req->m_rearmed)
+        {
+            req->m_rearmed = false;
+            X__Insert(self, req);
+            continue;
+        }
 
-        if (req->m_is_delayed)
+        if (req->m_once)
         {
-            req->m_count += step;
-            if (req->m_count >= req->delay)
-            {
-                req->m_count = 0;
-                req->m_is_delayed = false;
-            }
+            const XVTimerCallBack callback = req->callback;
+            void* const arg = req->arg;
+            X__RemoveRequest(req);
+            callback(arg);
         }
         else
         {
-            req->m_count += step;
-            if (req->m_count >= req->interval)
+            /* コールバック中の除去と再登録に備えて処理待ちの状態にしておく */
+            req->m_expired = true;
+            req->callback(req->arg);
+            req->m_expired = false;
+
+            if (req->m_has_marked_for_deletion)
+                X__RemoveRequest(req);
+            else
             {
-                req->m_count = 0;
-                if (req->m_once)
-                    X__RemoveRequest(req);
-                req->callback(req->arg);
+                if (!req->m_rearmed)
+                    req->m_deadline = X__Add(self->m_tick_count, req->interval);
+                req->m_rearmed = false;
+                X__Insert(self, req);
             }
         }
+    }
+
+    self->m_in_scheduling = false;
+}
+
+
+XTicks xvtimer_now(const XVTimer* self)
+{
+    return self->m_tick_count;
+}
+
+
+XTicks xvtimer_next_timeout(const XVTimer* self)
+{
+    XTicks timeout;
+
+    if (!self->m_root)
+        return X_TICKS_FOREVER;
+
+    timeout = X__Diff(self->m_root->m_deadline, self->m_tick_count);
+    return (timeout < 0) ? 0 : timeout;
+}
+
+
+/* 期限は絶対時刻なので、XTicksのオーバーフローは折り返しとして扱う */
+static XTicks X__Add(XTicks a, XTicks b)
+{
+    return (XTicks)((uint32_t)a + (uint32_t)b);
+}
+
+
+/* XTicksのオーバーフローを考慮した時刻の差(a - b)を返す */
+static XTicks X__Diff(XTicks a, XTicks b)
+{
+    return (XTicks)((uint32_t)a - (uint32_t)b);
+}
+
 
-x__next:
-        ite = next;
+/* 2つのヒープを併合し、期限の早い方を根にして返す */
+static XVTimerRequest* X__Meld(XVTimerRequest* a, XVTimerRequest* b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (X__Diff(b->m_deadline, a->m_deadline) < 0)
+    {
+        XVTimerRequest* const tmp = a;
+        a = b;
+        b = tmp;
     }
 
-    ite = xilist_front(&self->m_requests);
-    while (ite != end)
+    /* bをaの先頭の子にする */
+    b->m_prev = a;
+    b->m_sibling = a->m_child;
+    if (a->m_child)
+        a->m_child->m_prev = b;
+    a->m_child = b;
+    a->m_sibling = NULL;
+    a->m_prev = NULL;
+
+    return a;
+}
+
+
+/* 兄弟リストを先頭から2つずつ併合し、その結果を末尾から順に併合する */
+static XVTimerRequest* X__MergePairs(XVTimerRequest* first)
+{
+    XVTimerRequest* pairs = NULL;
+    XVTimerRequest* result = NULL;
+
+    while (first)
     {
-        XVTimerRequest* const req = xnode_entry(ite, XVTimerRequest, m_node);
-        XIntrusiveNode* next = ite->next;
+        XVTimerRequest* const a = first;
+        XVTimerRequest* const b = a->m_sibling;
+        XVTimerRequest* merged;
 
-        if (req->m_has_marked_for_deletion)
-            X__RemoveRequest(req);
+        if (b)
+        {
+            first = b->m_sibling;
+            b->m_sibling = NULL;
+            b->m_prev = NULL;
+        }
         else
-            req->m_pending = false;
-        ite = next;
+        {
+            first = NULL;
+        }
+        a->m_sibling = NULL;
+        a->m_prev = NULL;
+
+        /* 併合結果はm_prevを使ってスタックに積んでおく */
+        merged = X__Meld(a, b);
+        merged->m_prev = pairs;
+        pairs = merged;
     }
 
-    self->m_in_scheduling = false;
+    while (pairs)
+    {
+        XVTimerRequest* const next = pairs->m_prev;
+        pairs->m_prev = NULL;
+        result = X__Meld(result, pairs);
+        pairs = next;
+    }
+
+    return result;
 }
 
 
-XTicks xvtimer_now(const XVTimer* self)
+static void X__Insert(XVTimer* self, XVTimerRequest* request)
 {
-    return self->m_tick_count;
+    request->m_child = NULL;
+    request->m_sibling = NULL;
+    request->m_prev = NULL;
+    self->m_root = X__Meld(self->m_root, request);
 }
 
 
-static void X__RemoveRequest(XVTimerRequest* request)
+static void X__Detach(XVTimer* self, XVTimerRequest* request)
 {
-    request->m_holder = NULL;
-    request->m_has_marked_for_deletion = false;
-    request->m_pending = false;
-    xnode_unlink(&request->m_node);
-    request->deleter(request);
+    XVTimerRequest* children;
+
+    if (request == self->m_root)
+    {
+        X__PopMin(self);
+        return;
+    }
+
+    /* 親または兄から切り離す */
+    if (request->m_prev->m_child == request)
+        request->m_prev->m_child = request->m_sibling;
+    else
+        request->m_prev->m_sibling = request->m_sibling;
+    if (request->m_sibling)
+        request->m_sibling->m_prev = request->m_prev;
+
+    children = X__MergePairs(request->m_child);
+    request->m_child = NULL;
+    request->m_sibling = NULL;
+    request->m_prev = NULL;
+    self->m_root = X__Meld(self->m_root, children);
 }
 
 
-static void X__RemoveAll(XIntrusiveList* requests)
+static XVTimerRequest* X__PopMin(XVTimer* self)
 {
-    XIntrusiveNode* ite = xilist_front(requests);
-    XIntrusiveNode* const end = xilist_end(requests);
+    XVTimerRequest* const root = self->m_root;
 
-    while (ite != end)
-    {
-        XVTimerRequest* const req = xnode_entry(ite, XVTimerRequest, m_node);
-        XIntrusiveNode* next = ite->next;
-        req->deleter(req);
-        ite = next;
-    }
-    xilist_init(requests);
+    if (!root)
+        return NULL;
+
+    self->m_root = X__MergePairs(root->m_child);
+    root->m_child = NULL;
+    root->m_sibling = NULL;
+    root->m_prev = NULL;
+
+    return root;
+}
+
+
+static void X__RemoveRequest(XVTimerRequest* request)
+{
+    request->m_holder = NULL;
+    request->m_has_marked_for_deletion = false;
+    request->m_expired = false;
+    request->m_rearmed = false;
+    request->deleter(request);
 }
@@ -43,7 +43,6 @@
 
 
 #include <picox/core/xcore.h>
-#include <picox/container/xintrusive_list.h>
 
 
 /** @addtogroup multitask
@@ -88,23 +87,29 @@ struct XVTimerRequest
     XDeleter            deleter;
 
     /** @privatesection */
-    XIntrusiveNode      m_node;
-    XTicks              m_count;
+    XVTimerRequest*     m_child;
+    XVTimerRequest*     m_sibling;
+    XVTimerRequest*     m_prev;
+    XTicks              m_deadline;
     XVTimer*            m_holder;
     unsigned            m_has_marked_for_deletion : 1;
-    unsigned            m_pending                 : 1;
-    unsigned            m_is_delayed              : 1;
+    unsigned            m_expired                 : 1;
+    unsigned            m_rearmed                 : 1;
     unsigned            m_once                    : 1;
 };
 
 
 /** @brief 仮想タイマー構造体です
+ *
+ *  リクエストは絶対時刻の期限をキーとしたペアリングヒープで管理しているので、リ
+ *  クエストの追加はO(1)、除去と期限切れの取り出しは償却O(log n)です。
+ *  xvtimer_schedule()の処理量はリクエストの総数ではなく、期限切れになったリクエ
+ *  ストの数に比例します。
  */
 struct XVTimer
 {
 /** @privatesection */
-    XIntrusiveList      m_requests;
-    XIntrusiveList      m_pending_requests;
+    XVTimerRequest*     m_root;
     XTicks              m_tick_count;
     bool                m_in_scheduling;
 };
@@ -166,6 +171,16 @@ void xvtimer_schedule(XVTimer* self, XTicks step);
 XTicks xvtimer_now(const XVTimer* self);
 
 
+/** @brief 次のコールバック呼び出しまでの時間を返します
+ *
+ *  リクエストがない場合はX_TICKS_FOREVERを返します。期限切れのリクエストが残っ
+ *  ている場合は0を返します。
+ *  タイマ割り込みを止めてスリープする時間の計算(ティックレスアイドル)に使用でき
+ *  ます。
+ */
+XTicks xvtimer_next_timeout(const XVTimer* self);
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
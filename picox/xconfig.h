@@ -92,20 +92,41 @@ extern "C" {
 #endif
 
 
+/** @def   X_CONF_USE_XTALLOC_MALLOC
+ *  @brief x_malloc(), x_free()のバックエンドをXTlsfAllocatorにします
+ *
+ *  @details
+ *  X_CONF_MALLOC, X_CONF_FREEが未指定の場合に、malloc(), free()の代わりに
+ *  xtalloc_init_global()で初期化したヒープを使用します。標準ライブラリのmalloc()
+ *  の最悪実行時間が見積もれない環境向けです。
+ */
+#ifndef X_CONF_USE_XTALLOC_MALLOC
+#define X_CONF_USE_XTALLOC_MALLOC   (0)
+#endif
+
+
 /** @def   X_CONF_MALLOC
  *  @brief 動的メモリ確保関数を設定します。未指定時はmalloc()が使用されます。
  */
 #ifndef X_CONF_MALLOC
+#if X_CONF_USE_XTALLOC_MALLOC
+#define X_CONF_MALLOC(size)       xtalloc_global_allocate(size)
+#else
 #define X_CONF_MALLOC(size)       malloc(size)
 #endif
+#endif
 
 
 /** @def   X_CONF_FREE
  *  @brief メモリ解放関数を設定します。未指定時はfree()が使用されます。
  */
 #ifndef X_CONF_FREE
+#if X_CONF_USE_XTALLOC_MALLOC
+#define X_CONF_FREE(ptr)         xtalloc_global_deallocate(ptr)
+#else
 #define X_CONF_FREE(ptr)         free(ptr)
 #endif
+#endif
 
 
 /** @def   X_CONF_USE_DETECT_MALLOC_NULL
@@ -121,6 +142,95 @@ extern "C" {
 #endif
 
 
+/** @def   X_CONF_XPALLOC_MAX_SIZE_CLASSES
+ *  @brief XPicoAllocatorで使用できるサイズクラスの最大数を設定します
+ *
+ *  @details
+ *  xpalloc_set_size_classes()で有効にすると、この数までの小さいサイズのメモリ
+ *  ブロックを、空きリストを走査せずにO(1)で確保、解放できるようになります。0
+ *  の場合はサイズクラスを使用できず、XPicoAllocatorのサイズも増えません。最大
+ *  値は32です。
+ */
+#ifndef X_CONF_XPALLOC_MAX_SIZE_CLASSES
+#define X_CONF_XPALLOC_MAX_SIZE_CLASSES   (0)
+#endif
+
+
+/** @def   X_CONF_XTALLOC_FL_COUNT
+ *  @brief XTlsfAllocatorの第1レベルの分割数を設定します
+ *
+ *  @details
+ *  管理できる最大のブロックサイズは2^(X_CONF_XTALLOC_FL_COUNT +
+ *  log2(alignment) + 3)未満になります。XTlsfAllocatorのサイズはこの値に比例し
+ *  て、1あたりポインタ16個分増えます。最大値は32です。
+ */
+#ifndef X_CONF_XTALLOC_FL_COUNT
+#define X_CONF_XTALLOC_FL_COUNT   (24)
+#endif
+
+
+/** @def   X_CONF_XMTALLOC_NUM_CLASSES
+ *  @brief XMtAllocatorがスレッドごとにキャッシュするサイズクラスの数を設定しま
+ *         す
+ *
+ *  @details
+ *  アリーナの最小のブロックからalignment刻みで、この数のサイズクラスの確保が
+ *  キャッシュの対象になります。
+ */
+#ifndef X_CONF_XMTALLOC_NUM_CLASSES
+#define X_CONF_XMTALLOC_NUM_CLASSES   (16)
+#endif
+
+
+/** @def   X_CONF_XMTALLOC_BATCH_SIZE
+ *  @brief XMtAllocatorのキャッシュとアリーナの間で、一度にやり取りするブロッ
+ *         ク数を設定します
+ *
+ *  @details
+ *  大きくするほどロックを取る回数は減りますが、スレッドごとに保持するメモリが
+ *  増えます。
+ */
+#ifndef X_CONF_XMTALLOC_BATCH_SIZE
+#define X_CONF_XMTALLOC_BATCH_SIZE   (16)
+#endif
+
+
+/** @def   X_CONF_XPOOLALLOC_MAX_CLASSES
+ *  @brief XPoolAllocatorで使用できるサイズクラスの最大数を設定します
+ *
+ *  @details
+ *  XPoolAllocatorはこの数のサイズクラスの管理領域を常に保持します。
+ */
+#ifndef X_CONF_XPOOLALLOC_MAX_CLASSES
+#define X_CONF_XPOOLALLOC_MAX_CLASSES   (8)
+#endif
+
+
+/** @def   X_CONF_USE_ALLOCATOR_STATS
+ *  @brief XPicoAllocator, XFixedAllocator, XStackAllocatorの統計情報の収集を有
+ *         効にします
+ *
+ *  @details
+ *  有効にすると、xxx_set_stats()でXAllocatorStatsを登録できるようになり、確保
+ *  関数は呼び出し元のファイル名と行番号を記録するマクロになります。統計情報を
+ *  登録していないアロケータのコストは、ポインタの判定1回分です。
+ */
+#ifndef X_CONF_USE_ALLOCATOR_STATS
+#define X_CONF_USE_ALLOCATOR_STATS   (0)
+#endif
+
+
+/** @def   X_CONF_ALLOCATOR_STATS_MAX_RECORDS
+ *  @brief XAllocatorStatsが確保位置を記録する使用中のブロック数を設定します
+ *
+ *  @details
+ *  解放時の記録の検索はこの数に比例した時間がかかります。
+ */
+#ifndef X_CONF_ALLOCATOR_STATS_MAX_RECORDS
+#define X_CONF_ALLOCATOR_STATS_MAX_RECORDS   (32)
+#endif
+
+
 #define X_BYTE_ORDER_LITTLE     (0)
 #define X_BYTE_ORDER_BIG        (1)
 #define X_BYTE_ORDER_UNKNOWN    (2)
@@ -563,7 +673,10 @@ extern "C" {
  *  + X_FIBER_IMPL_TYPE_PLATFORM_DEPEND <br />
  *      CPUやコンパイラに依存した、プラットフォームごとの専用の方法でコンテキス
  *      トスイッチを行います。非対応のプラットフォームの場合、コンパイルに失敗し
- *      ます。
+ *      ます。<br />
+ *      現在はGCC互換コンパイラのx86-64とAArch64に対応しています。ファイバーご
+ *      とに専用のスタックを持ち、呼び出し先保存レジスタの退避と復帰だけでスイッ
+ *      チするので、スタックのコピーもシステムコールも発生しません。
  */
 #ifndef X_CONF_FIBER_IMPL_TYPE
 #define X_CONF_FIBER_IMPL_TYPE   X_FIBER_IMPL_TYPE_COPY_STACK
@@ -591,6 +704,159 @@ extern "C" {
 #endif
 
 
+/** @def   X_CONF_FIBER_USE_SMP
+ *  @brief xfiberモジュールのマルチコア対応を有効にします
+ *
+ *  有効にすると、xfiber_kernel_start_scheduler_smp()で複数のワーカースレッド(
+ *  POSIXスレッド)がファイバーを並行して実行します。ワーカーはそれぞれレディキュ
+ *  ーを持ち、自分のキューが空になると他のワーカーからファイバーを奪って(ワーク
+ *  スティーリング)実行します。
+ *
+ *  ファイバーはワーカー間を移動するため、X_FIBER_IMPL_TYPE_COPY_STACKとは併用
+ *  できません。また、xfiber_xxx_isr()系の関数は使用できません。
+ */
+#ifndef X_CONF_FIBER_USE_SMP
+#define X_CONF_FIBER_USE_SMP   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_SMP_MAX_WORKERS
+ *  @brief X_CONF_FIBER_USE_SMP有効時のワーカー数の上限を設定します
+ */
+#ifndef X_CONF_FIBER_SMP_MAX_WORKERS
+#define X_CONF_FIBER_SMP_MAX_WORKERS   (8)
+#endif
+
+
+/** @def   X_CONF_FIBER_PRIORITY_MAX
+ *  @brief xfiberのタスク優先度の段階数を設定します(1 ~ 32)
+ *
+ *  8以下の場合、レディキューのビットマップは8bitで管理されます。8を超える場合は
+ *  32bitのビットマップを使用し、GCCではcount leading zeros命令で最高優先度を求め
+ *  ます。
+ */
+#ifndef X_CONF_FIBER_PRIORITY_MAX
+#define X_CONF_FIBER_PRIORITY_MAX   (8)
+#endif
+
+
+/** @def   X_CONF_FIBER_USE_STATS
+ *  @brief xfiberの実行統計とスケジューリングトレースを有効にします
+ *
+ *  ファイバーごとの実行時間、ディスパッチ回数、待ち要因ごとの待ち時間、スタッ
+ *  ク使用量のピークを記録し、xfiber_get_stats()で取得できるようになります。コ
+ *  ンテキストスイッチごとにX_CONF_FIBER_STATS_CLOCK()の呼び出しが2回増えます。
+ */
+#ifndef X_CONF_FIBER_USE_STATS
+#define X_CONF_FIBER_USE_STATS   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_STATS_CLOCK
+ *  @brief X_CONF_FIBER_USE_STATS有効時に時間の計測に使用する関数を指定します
+ *
+ *  XTicks型の値を返す必要があります。デフォルトはx_ticks_now()ですが、分解能が
+ *  不足する場合はCPUのサイクルカウンタなどを指定してください。値は32bitで周回
+ *  しても構いません。
+ */
+#ifndef X_CONF_FIBER_STATS_CLOCK
+#define X_CONF_FIBER_STATS_CLOCK()   x_ticks_now()
+#endif
+
+
+/** @def   X_CONF_FIBER_TRACE_SIZE
+ *  @brief X_CONF_FIBER_USE_STATS有効時のトレースバッファの要素数を設定します
+ *
+ *  スケジューリングイベントを固定長のリングバッファに記録し、古いものから上書
+ *  きします。0の場合はトレースを行いません。
+ */
+#ifndef X_CONF_FIBER_TRACE_SIZE
+#define X_CONF_FIBER_TRACE_SIZE   (256)
+#endif
+
+
+/** @def   X_CONF_FIBER_STACK_PAINT
+ *  @brief ファイバーのスタックを既知のパターンで塗りつぶすかどうかを設定します
+ *
+ *  有効にするとファイバー生成時にスタック全体をパターンで埋め、
+ *  xfiber_stack_high_water()でバイト単位のスタック使用量のピークを取得できるよ
+ *  うになります。スタック毎に実行する実装では、コンテキストスイッチ時にスタッ
+ *  ク末端のパターンを検査し、オーバーフローを検出したらX_ABORT()します。
+ */
+#ifndef X_CONF_FIBER_STACK_PAINT
+#define X_CONF_FIBER_STACK_PAINT   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_STACK_GUARD
+ *  @brief ファイバーのスタックをガードページ付きでmmap()するかどうかを設定します
+ *
+ *  POSIX環境かつX_FIBER_IMPL_TYPE_COPY_STACK以外の実装でのみ有効にできます。ス
+ *  タックはページサイズに切り上げて確保され、末端にアクセス不可のページを配置
+ *  するので、オーバーフローはヒープの破壊ではなくSIGSEGVとして検出されます。
+ *  スタックはヒープ(X_CONF_MALLOC)ではなくmmap()で確保され、触れたページにだ
+ *  け物理メモリが割り当てられます。
+ *
+ *  X_CONF_FIBER_STACK_PAINTが無効の場合、xfiber_stack_high_water()はmincore()
+ *  を使用してページ単位の使用量を返します。
+ */
+#ifndef X_CONF_FIBER_STACK_GUARD
+#define X_CONF_FIBER_STACK_GUARD   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_LOCAL_STORAGE_SIZE
+ *  @brief ファイバーごとのローカルストレージのスロット数を設定します
+ *
+ *  スロット1つにつき、ファイバー1つあたりポインタ1個分のメモリを消費します。0
+ *  の場合、xfiber_set_local()とxfiber_get_local()は使用できません。
+ */
+#ifndef X_CONF_FIBER_LOCAL_STORAGE_SIZE
+#define X_CONF_FIBER_LOCAL_STORAGE_SIZE   (4)
+#endif
+
+
+/** @def   X_CONF_FIBER_VIRTUAL_TICKS
+ *  @brief ファイバーのカーネルを仮想時刻で動作させるかどうかを設定します
+ *
+ *  有効にするとカーネルはx_ticks_now()を参照せず、実行可能なファイバーがなくな
+ *  った時点で次のタイマーの期限まで時刻を進めます。アイドルフックはタイマーが
+ *  1つもない時にだけtimeout=X_TICKS_FOREVERで呼び出されます。
+ *
+ *  実時間に依存せずに同じ順序でスケジューリングされるので、ベンチマークやシミ
+ *  ュレーションで結果を再現させる用途を想定しています。
+ */
+#ifndef X_CONF_FIBER_VIRTUAL_TICKS
+#define X_CONF_FIBER_VIRTUAL_TICKS   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_USE_EPOLL
+ *  @brief ファイバーがファイルディスクリプタの入出力を待てるようにするかどうか
+ *         を設定します
+ *
+ *  Linux環境でのみ有効にできます。有効にするとカーネルがepollインスタンスを1
+ *  つ保持し、xfiber_io_wait()で待っているファイバーをスケジューリング時とアイ
+ *  ドル時に起床させます。
+ */
+#ifndef X_CONF_FIBER_USE_EPOLL
+#define X_CONF_FIBER_USE_EPOLL   (0)
+#endif
+
+
+/** @def   X_CONF_FIBER_USE_TLSF_HEAP
+ *  @brief ファイバーのカーネルのヒープをXTlsfAllocatorで管理するかどうかを設定
+ *         します
+ *
+ *  無効の場合はXPicoAllocatorを使用します。ファイバーやカーネルオブジェクトの
+ *  生成と破棄を繰り返してヒープが断片化しても、生成にかかる時間を一定に保ちた
+ *  い場合に有効にしてください。
+ */
+#ifndef X_CONF_FIBER_USE_TLSF_HEAP
+#define X_CONF_FIBER_USE_TLSF_HEAP   (0)
+#endif
+
+
 /** @} end of addtogroup config
  */
 
@@ -0,0 +1,239 @@
+/* 可変長メモリアロケータのベンチマーク
+ *
+ * XPicoAllocator(サイズクラスあり、なし)とXTlsfAllocatorに、乱数で生成した同
+ * じ確保、解放の列を与えて、1回あたりの平均と最悪の実行時間、終了時の断片化率
+ * を比較します。乱数の種は固定なので、どのアロケータにも同じ列が与えられます。
+ * 確保に失敗した場合はそのスロットを空のままにしますが、乱数の消費量は変わらな
+ * いので、以降の要求の列も変わりません。
+ *
+ * 断片化率は 1 - (最大の空きブロック / 空き容量の合計) です。"mixed"はヒープ
+ * に収まらない量を要求するので、確保の失敗を含めて、空きが足りない状態での振
+ * る舞いを比較します。
+ */
+
+
+#include <picox/allocator/xpico_allocator.h>
+#include <picox/allocator/xtlsf_allocator.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define HEAP_SIZE           (1024 * 1024 * 4)
+#define NUM_SLOTS           (4096)
+#define NUM_OPS             (200000)
+
+
+typedef struct Allocator
+{
+    const char*     name;
+    void            (*init)(void* heap, size_t size);
+    void*           (*allocate)(size_t size);
+    void            (*deallocate)(void* ptr);
+    void            (*walk)(void (*walker)(const uint8_t*, size_t, void*), void* user);
+} Allocator;
+
+
+typedef struct Trace
+{
+    const char*     name;
+    size_t          min_size;
+    size_t          max_size;
+    bool            log_scale;
+
+    /* 1/keep_ratioの確率で確保したメモリを解放せずに残す */
+    unsigned        keep_ratio;
+} Trace;
+
+
+typedef struct FreeStats
+{
+    size_t          total;
+    size_t          largest;
+    size_t          num_chunks;
+} FreeStats;
+
+
+static uint8_t s_heap[HEAP_SIZE];
+static void* s_slots[NUM_SLOTS];
+static bool s_kept[NUM_SLOTS];
+static uint32_t s_random;
+static XPicoAllocator s_pico;
+static XTlsfAllocator s_tlsf;
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static uint32_t Random(void)
+{
+    /* xorshift32 */
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+
+static void PicoInit(void* heap, size_t size)
+{
+    xpalloc_init(&s_pico, heap, size, X_ALIGN_OF(XMaxAlign));
+}
+
+
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+static void PicoClassesInit(void* heap, size_t size)
+{
+    xpalloc_init(&s_pico, heap, size, X_ALIGN_OF(XMaxAlign));
+    xpalloc_set_size_classes(&s_pico, X_CONF_XPALLOC_MAX_SIZE_CLASSES);
+}
+#endif
+
+
+static void* PicoAllocate(size_t size) { return xpalloc_allocate(&s_pico, size); }
+static void PicoDeallocate(void* ptr) { xpalloc_deallocate(&s_pico, ptr); }
+static void PicoWalk(void (*walker)(const uint8_t*, size_t, void*), void* user)
+{
+    xpalloc_walk_heap(&s_pico, walker, user);
+}
+
+
+static void TlsfInit(void* heap, size_t size)
+{
+    xtalloc_init(&s_tlsf, heap, size, X_ALIGN_OF(XMaxAlign));
+}
+
+
+static void* TlsfAllocate(size_t size) { return xtalloc_allocate(&s_tlsf, size); }
+static void TlsfDeallocate(void* ptr) { xtalloc_deallocate(&s_tlsf, ptr); }
+static void TlsfWalk(void (*walker)(const uint8_t*, size_t, void*), void* user)
+{
+    xtalloc_walk_heap(&s_tlsf, walker, user);
+}
+
+
+static const Allocator s_allocators[] = {
+    { "pico", PicoInit, PicoAllocate, PicoDeallocate, PicoWalk },
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    { "pico+classes", PicoClassesInit, PicoAllocate, PicoDeallocate, PicoWalk },
+#endif
+    { "tlsf", TlsfInit, TlsfAllocate, TlsfDeallocate, TlsfWalk },
+};
+
+
+static const Trace s_traces[] = {
+    { "small",      8,   256, false,  0 },
+    { "mixed",      8, 16384, true,   0 },
+    { "long-lived", 8,  4096, true,   8 },
+};
+
+
+static size_t RandomSize(const Trace* trace)
+{
+    const uint32_t r = Random();
+
+    if (trace->log_scale)
+    {
+        /* 小さいサイズほど多く要求されるように、桁ごとに均等に選ぶ */
+        size_t size = trace->min_size << (r % x_find_msb_pos32((uint32_t)(trace->max_size / trace->min_size)));
+        return size + (Random() % size);
+    }
+
+    return trace->min_size + (r % (trace->max_size - trace->min_size + 1));
+}
+
+
+static void CollectFree(const uint8_t* chunk, size_t size, void* user)
+{
+    FreeStats* stats = user;
+    X_UNUSED(chunk);
+    stats->total += size;
+    stats->num_chunks++;
+    if (size > stats->largest)
+        stats->largest = size;
+}
+
+
+static void Run(const Allocator* allocator, const Trace* trace)
+{
+    uint64_t total_ns = 0;
+    uint64_t max_alloc_ns = 0;
+    uint64_t max_free_ns = 0;
+    size_t num_failed = 0;
+    FreeStats stats;
+    size_t i;
+
+    /* 最初に触れた時のページフォルトを最悪時間に含めないようにする */
+    memset(s_heap, 0, sizeof(s_heap));
+    allocator->init(s_heap, sizeof(s_heap));
+    memset(s_slots, 0, sizeof(s_slots));
+    memset(s_kept, 0, sizeof(s_kept));
+    s_random = 2463534242u;
+
+    for (i = 0; i < NUM_OPS; i++)
+    {
+        const size_t slot = Random() % NUM_SLOTS;
+        const size_t size = RandomSize(trace);
+        const bool keep = trace->keep_ratio && ((Random() % trace->keep_ratio) == 0);
+        uint64_t t0;
+        uint64_t ns;
+
+        if (s_kept[slot])
+            continue;
+
+        t0 = NowNSec();
+        if (s_slots[slot])
+        {
+            allocator->deallocate(s_slots[slot]);
+            ns = NowNSec() - t0;
+            s_slots[slot] = NULL;
+            if (ns > max_free_ns)
+                max_free_ns = ns;
+        }
+        else
+        {
+            s_slots[slot] = allocator->allocate(size);
+            ns = NowNSec() - t0;
+            if (!s_slots[slot])
+                num_failed++;
+            else if (keep)
+                s_kept[slot] = true;
+            if (ns > max_alloc_ns)
+                max_alloc_ns = ns;
+        }
+        total_ns += ns;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    allocator->walk(CollectFree, &stats);
+
+    printf("%-12s %-10s %8.1f ns/op  max alloc %7llu ns  max free %7llu ns  "
+           "free chunks %6zu  frag %5.1f%%  failed %zu\n",
+           allocator->name, trace->name,
+           (double)total_ns / NUM_OPS,
+           (unsigned long long)max_alloc_ns,
+           (unsigned long long)max_free_ns,
+           stats.num_chunks,
+           stats.total ? 100.0 * (1.0 - (double)stats.largest / stats.total) : 0.0,
+           num_failed);
+}
+
+
+int main(void)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < X_COUNT_OF(s_traces); i++)
+    {
+        for (j = 0; j < X_COUNT_OF(s_allocators); j++)
+            Run(&s_allocators[j], &s_traces[i]);
+    }
+
+    return 0;
+}
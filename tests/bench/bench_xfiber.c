@@ -0,0 +1,161 @@
+/* xfiberのベンチマーク
+ *
+ * X_CONF_FIBER_IMPL_TYPEごとにビルドして、実装間のコストを比較します。
+ */
+
+
+#include <picox/multitask/xfiber.h>
+#include <stdio.h>
+#include <time.h>
+
+
+#define KERNEL_WORK_SIZE    (1024 * 64)
+#define STACK_SIZE          (1024 * 8)
+#define PRIORITY            (4)
+#define NUM_YIELDS          (100000)
+#define DEEP_STACK_SIZE     (1024 * 24)
+#define FRAME_SIZE          (256)
+
+
+#if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
+    #define IMPL_NAME   "copy_stack"
+#elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_UCONTEXT
+    #define IMPL_NAME   "ucontext"
+#elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_PLATFORM_DEPEND
+    #define IMPL_NAME   "platform_depend"
+#endif
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/* 全てのタスクが終了したらスケジューラを抜ける */
+static int ExitOnIdle(XTicks timeout)
+{
+    X_UNUSED(timeout);
+    return 1;
+}
+
+
+static void YieldTask(void* arg)
+{
+    const int n = *(const int*)arg;
+    int i;
+
+    for (i = 0; i < n; i++)
+        xfiber_yield();
+}
+
+
+static void BenchSwitch(void)
+{
+    static int num_yields = NUM_YIELDS;
+    uint64_t start;
+    uint64_t elapsed;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, ExitOnIdle);
+    xfiber_create(NULL, PRIORITY, "ping", STACK_SIZE, YieldTask, &num_yields);
+    xfiber_create(NULL, PRIORITY, "pong", STACK_SIZE, YieldTask, &num_yields);
+
+    start = NowNSec();
+    xfiber_kernel_start_scheduler();
+    elapsed = NowNSec() - start;
+
+    printf("%-16s switch      %10d switches %10.1f ns/switch\n",
+           IMPL_NAME, 2 * num_yields, (double)elapsed / (2.0 * num_yields));
+}
+
+
+typedef struct DeepArg
+{
+    int     depth;
+    int     num_yields;
+} DeepArg;
+
+
+/* FRAME_SIZEバイトのフレームをdepth段積んだ状態でyieldを繰り返す */
+static int DeepYield(int depth, int num_yields)
+{
+    volatile uint8_t frame[FRAME_SIZE];
+    int i;
+
+    frame[0] = (uint8_t)depth;
+    if (depth > 0)
+        return DeepYield(depth - 1, num_yields) + frame[0];
+
+    for (i = 0; i < num_yields; i++)
+        xfiber_yield();
+
+    return frame[0];
+}
+
+
+static void DeepYieldTask(void* arg)
+{
+    const DeepArg* const deep = arg;
+    DeepYield(deep->depth, deep->num_yields);
+}
+
+
+/* コールスタックの深さに対するスイッチのコストを計測する。コピースタック方式
+ * ではスタックの退避と復帰のコピー量が深さに比例する。
+ */
+static void BenchStackDepth(int depth)
+{
+    static DeepArg arg;
+    uint64_t start;
+    uint64_t elapsed;
+
+    arg.depth = depth;
+    arg.num_yields = NUM_YIELDS / 10;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE * 2, ExitOnIdle);
+    xfiber_create(NULL, PRIORITY, "ping", DEEP_STACK_SIZE, DeepYieldTask, &arg);
+    xfiber_create(NULL, PRIORITY, "pong", DEEP_STACK_SIZE, DeepYieldTask, &arg);
+
+    start = NowNSec();
+    xfiber_kernel_start_scheduler();
+    elapsed = NowNSec() - start;
+
+    printf("%-16s depth %6d  %10d switches %10.1f ns/switch\n",
+           IMPL_NAME, depth * FRAME_SIZE, 2 * arg.num_yields,
+           (double)elapsed / (2.0 * arg.num_yields));
+}
+
+
+/* 1つのファイバーだけが実行可能な状態でyieldを繰り返す */
+static void BenchSelfYield(void)
+{
+    static int num_yields = NUM_YIELDS;
+    uint64_t start;
+    uint64_t elapsed;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, ExitOnIdle);
+    xfiber_create(NULL, PRIORITY, "self", STACK_SIZE, YieldTask, &num_yields);
+
+    start = NowNSec();
+    xfiber_kernel_start_scheduler();
+    elapsed = NowNSec() - start;
+
+    printf("%-16s self yield  %10d yields   %10.1f ns/yield\n",
+           IMPL_NAME, num_yields, (double)elapsed / num_yields);
+}
+
+
+int main(void)
+{
+    static const int depths[] = { 0, 4, 16, 64 };
+    size_t i;
+
+    BenchSwitch();
+    BenchSelfYield();
+    for (i = 0; i < X_COUNT_OF(depths); i++)
+        BenchStackDepth(depths[i]);
+
+    return 0;
+}
@@ -0,0 +1,385 @@
+/* xfiberのスケジューラベンチマーク
+ *
+ * X_CONF_FIBER_VIRTUAL_TICKSを有効にし、X_CONF_FIBER_IMPL_TYPEごとにビルドし
+ * ます。時刻は実時間ではなくタイマーの期限まで進むので、時間待ちを含む計測でも
+ * スケジューリングの順序は毎回同じになります。起床順から求めたチェックサムは実
+ * 装や実行環境によらず一致するはずなので、リリース間で値が変わったらスケジュー
+ * ラの振る舞いが変わっています。
+ */
+
+
+#include <picox/multitask/xfiber.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define HEAP_SIZE           (1024 * 1024 * 4)
+#define STACK_SIZE          (1024 * 2)
+#define PRIORITY            (4)
+#define NUM_SWITCHES        (100000)
+#define NUM_MESSAGES        (50000)
+#define NUM_SLEEPS          (64)
+#define NUM_BROADCASTS      (1000)
+#define MESSAGE_SIZE        (16)
+
+
+#if !X_CONF_FIBER_VIRTUAL_TICKS
+    #error bench_xfiber_sched requires X_CONF_FIBER_VIRTUAL_TICKS
+#endif
+
+#if X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK
+    #define IMPL_NAME   "copy_stack"
+#elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_UCONTEXT
+    #define IMPL_NAME   "ucontext"
+#elif X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_PLATFORM_DEPEND
+    #define IMPL_NAME   "platform_depend"
+#endif
+
+
+typedef struct Sleeper
+{
+    int         index;
+    XTicks      period;
+} Sleeper;
+
+
+static uint8_t s_heap[HEAP_SIZE];
+static XFiberQueue* s_queues[2];
+static XFiberChannel* s_channels[2];
+static XFiberSemaphore* s_semaphores[2];
+static XFiberEvent* s_event;
+static XFiberSemaphore* s_done;
+static Sleeper s_sleepers[1024];
+static uint32_t s_seq;
+static uint32_t s_checksum;
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/* 仮想時刻ではタイマーが残っている間は呼ばれないので、呼ばれたら全てのファイ
+ * バーが終了している
+ */
+static int ExitOnIdle(XTicks timeout)
+{
+    X_UNUSED(timeout);
+    return 1;
+}
+
+
+static void Check(XError err, const char* what)
+{
+    if (err != X_ERR_NONE)
+    {
+        printf("%s: %s failed (%d)\n", IMPL_NAME, what, (int)err);
+        exit(1);
+    }
+}
+
+
+/* 起床の順番を記録する。順序が1つでも入れ替わると値が変わる */
+static void Record(int index)
+{
+    s_seq++;
+    s_checksum = s_checksum * 31u + s_seq * (uint32_t)(index + 1);
+}
+
+
+static void InitKernel(void)
+{
+    xfiber_kernel_init(s_heap, sizeof(s_heap), ExitOnIdle);
+    s_seq = 0;
+    s_checksum = 0;
+}
+
+
+static uint64_t RunScheduler(void)
+{
+    const uint64_t start = NowNSec();
+    xfiber_kernel_start_scheduler();
+    return NowNSec() - start;
+}
+
+
+static void YieldTask(void* arg)
+{
+    int i;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_SWITCHES / 2; i++)
+        xfiber_yield();
+}
+
+
+static void BenchSwitch(void)
+{
+    uint64_t elapsed;
+
+    InitKernel();
+    Check(xfiber_create(NULL, PRIORITY, "ping", STACK_SIZE, YieldTask, NULL), "create");
+    Check(xfiber_create(NULL, PRIORITY, "pong", STACK_SIZE, YieldTask, NULL), "create");
+    elapsed = RunScheduler();
+
+    printf("%-16s switch          %10d ops %10.1f ns/op\n",
+           IMPL_NAME, NUM_SWITCHES, (double)elapsed / NUM_SWITCHES);
+}
+
+
+/* s_xxx[0]で受け取った値をs_xxx[1]で送り返す。往復ごとに2回切り替わる */
+static void QueuePingTask(void* arg)
+{
+    int i;
+    int value;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        Check(xfiber_queue_send_back(s_queues[0], &i), "queue send");
+        Check(xfiber_queue_receive(s_queues[1], &value), "queue receive");
+        if (value != i)
+            Check(X_ERR_PROTOCOL, "queue order");
+    }
+}
+
+
+static void QueuePongTask(void* arg)
+{
+    int i;
+    int value;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        Check(xfiber_queue_receive(s_queues[0], &value), "queue receive");
+        Check(xfiber_queue_send_back(s_queues[1], &value), "queue send");
+    }
+}
+
+
+static void BenchQueuePingPong(void)
+{
+    uint64_t elapsed;
+
+    InitKernel();
+    Check(xfiber_queue_create(&s_queues[0], 1, sizeof(int)), "queue create");
+    Check(xfiber_queue_create(&s_queues[1], 1, sizeof(int)), "queue create");
+    Check(xfiber_create(NULL, PRIORITY, "ping", STACK_SIZE, QueuePingTask, NULL), "create");
+    Check(xfiber_create(NULL, PRIORITY, "pong", STACK_SIZE, QueuePongTask, NULL), "create");
+    elapsed = RunScheduler();
+
+    printf("%-16s queue ping-pong %10d ops %10.1f ns/op\n",
+           IMPL_NAME, NUM_MESSAGES, (double)elapsed / NUM_MESSAGES);
+}
+
+
+static void ChannelPingTask(void* arg)
+{
+    uint8_t msg[MESSAGE_SIZE] = { 0 };
+    size_t size;
+    int i;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        msg[0] = (uint8_t)i;
+        Check(xfiber_channel_send(s_channels[0], msg, sizeof(msg)), "channel send");
+        Check(xfiber_channel_receive(s_channels[1], msg, &size), "channel receive");
+        if ((size != sizeof(msg)) || (msg[0] != (uint8_t)i))
+            Check(X_ERR_PROTOCOL, "channel order");
+    }
+}
+
+
+static void ChannelPongTask(void* arg)
+{
+    uint8_t msg[MESSAGE_SIZE];
+    size_t size;
+    int i;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        Check(xfiber_channel_receive(s_channels[0], msg, &size), "channel receive");
+        Check(xfiber_channel_send(s_channels[1], msg, size), "channel send");
+    }
+}
+
+
+static void BenchChannelPingPong(void)
+{
+    uint64_t elapsed;
+
+    InitKernel();
+    Check(xfiber_channel_create(&s_channels[0], 64, MESSAGE_SIZE), "channel create");
+    Check(xfiber_channel_create(&s_channels[1], 64, MESSAGE_SIZE), "channel create");
+    Check(xfiber_create(NULL, PRIORITY, "ping", STACK_SIZE, ChannelPingTask, NULL), "create");
+    Check(xfiber_create(NULL, PRIORITY, "pong", STACK_SIZE, ChannelPongTask, NULL), "create");
+    elapsed = RunScheduler();
+
+    printf("%-16s channel ping-pong %8d ops %10.1f ns/op\n",
+           IMPL_NAME, NUM_MESSAGES, (double)elapsed / NUM_MESSAGES);
+}
+
+
+/* 自分のセマフォを取得したら相手のセマフォを返却する */
+static void HandoffTask(void* arg)
+{
+    const int self = *(const int*)arg;
+    int i;
+
+    for (i = 0; i < NUM_MESSAGES; i++)
+    {
+        Check(xfiber_semaphore_take(s_semaphores[self]), "semaphore take");
+        Check(xfiber_semaphore_give(s_semaphores[!self]), "semaphore give");
+    }
+}
+
+
+static void BenchSemaphoreHandoff(void)
+{
+    static const int indices[2] = { 0, 1 };
+    uint64_t elapsed;
+
+    InitKernel();
+    Check(xfiber_semaphore_create(&s_semaphores[0], 1), "semaphore create");
+    Check(xfiber_semaphore_create(&s_semaphores[1], 0), "semaphore create");
+    Check(xfiber_create(NULL, PRIORITY, "a", STACK_SIZE, HandoffTask, (void*)&indices[0]), "create");
+    Check(xfiber_create(NULL, PRIORITY, "b", STACK_SIZE, HandoffTask, (void*)&indices[1]), "create");
+    elapsed = RunScheduler();
+
+    printf("%-16s semaphore handoff %8d ops %10.1f ns/op\n",
+           IMPL_NAME, 2 * NUM_MESSAGES, (double)elapsed / (2.0 * NUM_MESSAGES));
+}
+
+
+static void SleeperTask(void* arg)
+{
+    const Sleeper* const sleeper = arg;
+    int i;
+
+    for (i = 0; i < NUM_SLEEPS; i++)
+    {
+        xfiber_delay(sleeper->period);
+        Record(sleeper->index);
+    }
+}
+
+
+/* 周期の異なるnum_sleepers個のファイバーが時間待ちを繰り返す。タイマーの登録
+ * と期限切れの処理のコストが、待ちファイバー数に対してどう増えるかを見る。
+ */
+static void BenchSleepers(int num_sleepers)
+{
+    const int num_wakeups = num_sleepers * NUM_SLEEPS;
+    uint64_t elapsed;
+    int i;
+
+    InitKernel();
+    for (i = 0; i < num_sleepers; i++)
+    {
+        s_sleepers[i].index = i;
+        s_sleepers[i].period = 1 + (XTicks)((i * 7) % 13);
+        Check(xfiber_create(NULL, PRIORITY, "sleeper", STACK_SIZE, SleeperTask, &s_sleepers[i]), "create");
+    }
+    elapsed = RunScheduler();
+
+    if ((int)s_seq != num_wakeups)
+        Check(X_ERR_PROTOCOL, "sleeper wakeups");
+
+    printf("%-16s sleepers %5d   %10d ops %10.1f ns/op  checksum %08x\n",
+           IMPL_NAME, num_sleepers, num_wakeups, (double)elapsed / num_wakeups,
+           (unsigned)s_checksum);
+}
+
+
+/* ラウンドごとにビットを切り替えて待つので、前のラウンドのビットが残っていて
+ * も素通りしない
+ */
+static void WaiterTask(void* arg)
+{
+    const Sleeper* const waiter = arg;
+    XBits bits;
+    int r;
+
+    for (r = 0; r < NUM_BROADCASTS; r++)
+    {
+        Check(xfiber_event_wait(s_event, X_FIBER_EVENT_WAIT_OR, 1u << (r & 1), &bits), "event wait");
+        Record(waiter->index);
+        Check(xfiber_semaphore_give(s_done), "semaphore give");
+    }
+}
+
+
+static void BroadcastTask(void* arg)
+{
+    const int num_waiters = *(const int*)arg;
+    int r;
+    int i;
+
+    for (r = 0; r < NUM_BROADCASTS; r++)
+    {
+        xfiber_event_clear(s_event, 0x03);
+        Check(xfiber_event_set(s_event, 1u << (r & 1)), "event set");
+        for (i = 0; i < num_waiters; i++)
+            Check(xfiber_semaphore_take(s_done), "semaphore take");
+    }
+}
+
+
+/* 1回のイベントセットでnum_waiters個の待ちファイバーを起床させる */
+static void BenchEventFanOut(int num_waiters)
+{
+    static int arg;
+    const int num_wakeups = num_waiters * NUM_BROADCASTS;
+    uint64_t elapsed;
+    int i;
+
+    InitKernel();
+    arg = num_waiters;
+    Check(xfiber_event_create(&s_event), "event create");
+    Check(xfiber_semaphore_create(&s_done, 0), "semaphore create");
+    for (i = 0; i < num_waiters; i++)
+    {
+        s_sleepers[i].index = i;
+        Check(xfiber_create(NULL, PRIORITY, "waiter", STACK_SIZE, WaiterTask, &s_sleepers[i]), "create");
+    }
+    Check(xfiber_create(NULL, PRIORITY, "broadcast", STACK_SIZE, BroadcastTask, &arg), "create");
+    elapsed = RunScheduler();
+
+    if ((int)s_seq != num_wakeups)
+        Check(X_ERR_PROTOCOL, "event wakeups");
+
+    printf("%-16s fan-out %6d   %10d ops %10.1f ns/op  checksum %08x\n",
+           IMPL_NAME, num_waiters, num_wakeups, (double)elapsed / num_wakeups,
+           (unsigned)s_checksum);
+}
+
+
+int main(void)
+{
+    static const int num_sleepers[] = { 1, 16, 256, 1024 };
+    static const int num_waiters[] = { 1, 16, 256 };
+    size_t i;
+
+    BenchSwitch();
+    BenchQueuePingPong();
+    BenchChannelPingPong();
+    BenchSemaphoreHandoff();
+    for (i = 0; i < X_COUNT_OF(num_sleepers); i++)
+        BenchSleepers(num_sleepers[i]);
+    for (i = 0; i < X_COUNT_OF(num_waiters); i++)
+        BenchEventFanOut(num_waiters[i]);
+
+    return 0;
+}
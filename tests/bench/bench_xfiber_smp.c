@@ -0,0 +1,127 @@
+/* xfiberのSMPベンチマーク
+ *
+ * X_CONF_FIBER_USE_SMPを有効にしてビルドし、ワーカー数を変えながらキューを介し
+ * たファイバー間通信のスループットを計測します。ファイバーはワーカー間で移動す
+ * るので、受信値の合計を検証して取りこぼしがないことを確認します。
+ */
+
+
+#include <picox/multitask/xfiber.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define KERNEL_WORK_SIZE    (1024 * 256)
+#define STACK_SIZE          (1024 * 8)
+#define PRIORITY            (4)
+#define NUM_PAIRS           (8)
+#define NUM_ITEMS           (20000)
+#define QUEUE_LEN           (16)
+#define MAX_WORKERS         (4)
+
+
+typedef struct Pair
+{
+    XFiberQueue*    queue;
+    long            sum;
+} Pair;
+
+
+static Pair s_pairs[NUM_PAIRS];
+static int s_num_done;
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/* 他のワーカーが実行中の間は待ち続け、全ての受信が完了したら終了する */
+static int ExitOnDone(XTicks timeout)
+{
+    X_UNUSED(timeout);
+    return __atomic_load_n(&s_num_done, __ATOMIC_ACQUIRE) == NUM_PAIRS;
+}
+
+
+static void ProducerTask(void* arg)
+{
+    Pair* const pair = arg;
+    int i;
+
+    for (i = 1; i <= NUM_ITEMS; i++)
+        xfiber_queue_send_back(pair->queue, &i);
+}
+
+
+static void ConsumerTask(void* arg)
+{
+    Pair* const pair = arg;
+    int value;
+    int i;
+
+    for (i = 0; i < NUM_ITEMS; i++)
+    {
+        xfiber_queue_receive(pair->queue, &value);
+        pair->sum += value;
+    }
+
+    __atomic_add_fetch(&s_num_done, 1, __ATOMIC_RELEASE);
+}
+
+
+static void BenchQueue(int num_workers)
+{
+    const long expected = (long)NUM_ITEMS * (NUM_ITEMS + 1) / 2;
+    uint64_t start;
+    uint64_t elapsed;
+    int i;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, ExitOnDone);
+    s_num_done = 0;
+
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        s_pairs[i].sum = 0;
+        if ((xfiber_queue_create(&s_pairs[i].queue, QUEUE_LEN, sizeof(int)) != X_ERR_NONE) ||
+            (xfiber_create(NULL, PRIORITY, "producer", STACK_SIZE, ProducerTask, &s_pairs[i]) != X_ERR_NONE) ||
+            (xfiber_create(NULL, PRIORITY, "consumer", STACK_SIZE, ConsumerTask, &s_pairs[i]) != X_ERR_NONE))
+        {
+            printf("smp queue: out of kernel memory\n");
+            exit(1);
+        }
+    }
+
+    start = NowNSec();
+    xfiber_kernel_start_scheduler_smp(num_workers);
+    elapsed = NowNSec() - start;
+
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        if (s_pairs[i].sum != expected)
+        {
+            printf("smp queue: pair %d checksum mismatch %ld != %ld\n",
+                   i, s_pairs[i].sum, expected);
+            exit(1);
+        }
+    }
+
+    printf("smp queue   %d workers %10d items %10.1f ns/item\n",
+           num_workers, NUM_PAIRS * NUM_ITEMS,
+           (double)elapsed / (NUM_PAIRS * NUM_ITEMS));
+}
+
+
+int main(void)
+{
+    int i;
+
+    for (i = 1; i <= MAX_WORKERS; i++)
+        BenchQueue(i);
+
+    return 0;
+}
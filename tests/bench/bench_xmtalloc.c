@@ -0,0 +1,150 @@
+/* マルチスレッドでのメモリ確保、解放のスループットのベンチマーク
+ *
+ * 1つのミューテックスで保護したXPicoAllocatorと、スレッドごとのキャッシュを持
+ * つXMtAllocatorを、スレッド数を変えて比較します。各スレッドは自分のスロット
+ * に対して、乱数で選んだ小さいサイズの確保と解放を繰り返します。
+ */
+
+
+#include <picox/allocator/xmt_allocator.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define HEAP_SIZE           (1024 * 1024 * 16)
+#define MAX_THREADS         (8)
+#define NUM_SLOTS           (256)
+#define NUM_OPS             (1000000)
+#define MAX_SIZE            (256)
+
+
+typedef struct Worker
+{
+    pthread_t       thread;
+    unsigned        seed;
+    void*           slots[NUM_SLOTS];
+} Worker;
+
+
+static XPicoAllocator s_pico;
+static pthread_mutex_t s_pico_lock = PTHREAD_MUTEX_INITIALIZER;
+static XMtAllocator s_mt;
+static Worker s_workers[MAX_THREADS];
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static void* LockedAllocate(size_t size)
+{
+    void* ptr;
+    pthread_mutex_lock(&s_pico_lock);
+    ptr = xpalloc_allocate(&s_pico, size);
+    pthread_mutex_unlock(&s_pico_lock);
+    return ptr;
+}
+
+
+static void LockedDeallocate(void* ptr)
+{
+    pthread_mutex_lock(&s_pico_lock);
+    xpalloc_deallocate(&s_pico, ptr);
+    pthread_mutex_unlock(&s_pico_lock);
+}
+
+
+static void* MtAllocate(size_t size) { return xmtalloc_allocate(&s_mt, size); }
+static void MtDeallocate(void* ptr) { xmtalloc_deallocate(&s_mt, ptr); }
+
+
+static void* (*s_allocate)(size_t size);
+static void (*s_deallocate)(void* ptr);
+
+
+static void* WorkerMain(void* arg)
+{
+    Worker* const worker = arg;
+    size_t i;
+
+    for (i = 0; i < NUM_OPS; i++)
+    {
+        const size_t slot = rand_r(&worker->seed) % NUM_SLOTS;
+
+        if (worker->slots[slot])
+        {
+            s_deallocate(worker->slots[slot]);
+            worker->slots[slot] = NULL;
+        }
+        else
+        {
+            worker->slots[slot] = s_allocate((rand_r(&worker->seed) % MAX_SIZE) + 1);
+            if (!worker->slots[slot])
+            {
+                printf("out of memory\n");
+                exit(1);
+            }
+        }
+    }
+
+    for (i = 0; i < NUM_SLOTS; i++)
+    {
+        if (worker->slots[i])
+            s_deallocate(worker->slots[i]);
+    }
+
+    return NULL;
+}
+
+
+static void Run(const char* name, int num_threads)
+{
+    uint64_t t0;
+    uint64_t ns;
+    int i;
+
+    memset(s_workers, 0, sizeof(s_workers));
+
+    t0 = NowNSec();
+    for (i = 0; i < num_threads; i++)
+    {
+        s_workers[i].seed = (unsigned)i + 1;
+        pthread_create(&s_workers[i].thread, NULL, WorkerMain, &s_workers[i]);
+    }
+
+    for (i = 0; i < num_threads; i++)
+        pthread_join(s_workers[i].thread, NULL);
+    ns = NowNSec() - t0;
+
+    printf("%-14s threads %d  %8.2f Mops/s\n",
+           name, num_threads, (double)NUM_OPS * num_threads * 1000.0 / ns);
+}
+
+
+int main(void)
+{
+    static const int num_threads[] = { 1, 2, 4, 8 };
+    size_t i;
+
+    for (i = 0; i < X_COUNT_OF(num_threads); i++)
+    {
+        xpalloc_init(&s_pico, NULL, HEAP_SIZE, X_ALIGN_OF(XMaxAlign));
+        s_allocate = LockedAllocate;
+        s_deallocate = LockedDeallocate;
+        Run("pico+mutex", num_threads[i]);
+        xpalloc_deinit(&s_pico);
+
+        xmtalloc_init(&s_mt, NULL, HEAP_SIZE, X_ALIGN_OF(XMaxAlign));
+        s_allocate = MtAllocate;
+        s_deallocate = MtDeallocate;
+        Run("mt", num_threads[i]);
+        xmtalloc_deinit(&s_mt);
+    }
+
+    return 0;
+}
@@ -15,5 +15,28 @@
 #define X_CONF_MDELAY_IMPL_TYPE         X_MDELAY_IMPL_TYPE_POSIX_NANOSLEEP
 #define X_CONF_UDELAY_IMPL_TYPE         X_MDELAY_IMPL_TYPE_POSIX_NANOSLEEP
 
+#define X_CONF_FIBER_PRIORITY_MAX       (32)
+#define X_CONF_XPALLOC_MAX_SIZE_CLASSES (16)
+#define X_CONF_USE_ALLOCATOR_STATS      (1)
+
+#ifndef X_CONF_FIBER_USE_STATS
+#define X_CONF_FIBER_USE_STATS          (1)
+#endif
+
+/* スタック毎に実行する実装ではガードページ、コピースタック方式では塗りつぶし
+ * でスタック使用量を検査する。このファイルはX_FIBER_IMPL_TYPE_*の定義より前に
+ * 読み込まれるので、ここでは比較せず、使用される時点で評価される式にしておく。
+ */
+#ifndef X_CONF_FIBER_STACK_GUARD
+#define X_CONF_FIBER_STACK_GUARD    (X_CONF_FIBER_IMPL_TYPE != X_FIBER_IMPL_TYPE_COPY_STACK)
+#endif
+#ifndef X_CONF_FIBER_STACK_PAINT
+#define X_CONF_FIBER_STACK_PAINT    (X_CONF_FIBER_IMPL_TYPE == X_FIBER_IMPL_TYPE_COPY_STACK)
+#endif
+
+#if defined(__linux__) && !defined(X_CONF_FIBER_USE_EPOLL)
+#define X_CONF_FIBER_USE_EPOLL          (1)
+#endif
+
 
 #endif /* picox_config_h_ */
@@ -19,6 +19,10 @@ static void run_all_tests(void)
     RUN_TEST_GROUP(xutils);
     RUN_TEST_GROUP(xsalloc);
     RUN_TEST_GROUP(xfalloc);
+    RUN_TEST_GROUP(xtalloc);
+    RUN_TEST_GROUP(xmtalloc);
+    RUN_TEST_GROUP(xpoolalloc);
+    RUN_TEST_GROUP(xastats);
     RUN_TEST_GROUP(xstring);
     RUN_TEST_GROUP(xtokenizer);
     RUN_TEST_GROUP(xargparser);
@@ -45,6 +49,13 @@ static void run_all_tests(void)
     RUN_TEST_GROUP(xfiber_mailbox);
     RUN_TEST_GROUP(xfiber_channel);
     RUN_TEST_GROUP(xfiber_queue);
+    RUN_TEST_GROUP(xfiber_select);
+    RUN_TEST_GROUP(xfiber_executor);
+    RUN_TEST_GROUP(xfiber_rwlock);
+    RUN_TEST_GROUP(xfiber_cond);
+    RUN_TEST_GROUP(xfiber_ring);
+    RUN_TEST_GROUP(xfiber_io);
+    RUN_TEST_GROUP(xvtimer);
 }
 
 
@@ -20,6 +20,7 @@ DEFINES += UNITY_INCLUDE_DOUBLE
 #
 DEFINES += _POSIX_C_SOURCE=200809L
 QMAKE_CFLAGS += -std=c99 -O0 -Wall -Wextra -Wpedantic
+LIBS += -lpthread
 
 INCLUDEPATH += ./
 INCLUDEPATH += ./config
@@ -52,6 +53,10 @@ SOURCES += $$picox_dir/filesystem/xspiffs.c
 SOURCES += $$picox_dir/allocator/xstack_allocator.c
 SOURCES += $$picox_dir/allocator/xfixed_allocator.c
 SOURCES += $$picox_dir/allocator/xpico_allocator.c
+SOURCES += $$picox_dir/allocator/xtlsf_allocator.c
+SOURCES += $$picox_dir/allocator/xmt_allocator.c
+SOURCES += $$picox_dir/allocator/xpool_allocator.c
+SOURCES += $$picox_dir/allocator/xallocator_stats.c
 SOURCES += $$picox_dir/string/xdynamic_string.c
 SOURCES += $$picox_dir/misc/xtokenizer.c
 SOURCES += $$picox_dir/misc/xargparser.c
@@ -81,6 +86,10 @@ SOURCES += $$libfixmath_dir/uint32.c
 
 HEADERS += $$picox_dir/allocator/xfixed_allocator.h
 HEADERS += $$picox_dir/allocator/xpico_allocator.h
+HEADERS += $$picox_dir/allocator/xtlsf_allocator.h
+HEADERS += $$picox_dir/allocator/xmt_allocator.h
+HEADERS += $$picox_dir/allocator/xpool_allocator.h
+HEADERS += $$picox_dir/allocator/xallocator_stats.h
 HEADERS += $$picox_dir/allocator/xstack_allocator.h
 HEADERS += $$picox_dir/container/xbyte_array.h
 HEADERS += $$picox_dir/container/xfifo_buffer.h
@@ -123,6 +132,10 @@ SOURCES += ./Build/romfsimg.c
 SOURCES += ./test_xstack_allocator.c
 SOURCES += ./test_xpico_allocator.c
 SOURCES += ./test_xfixed_allocator.c
+SOURCES += ./test_xtlsf_allocator.c
+SOURCES += ./test_xmt_allocator.c
+SOURCES += ./test_xpool_allocator.c
+SOURCES += ./test_xallocator_stats.c
 SOURCES += ./test_xstring.c
 SOURCES += ./test_xtokenizer.c
 SOURCES += ./test_xargparser.c
@@ -0,0 +1,29 @@
+#include "testutils.h"
+
+
+static void run_all_tests(void)
+{
+    RUN_TEST_GROUP(xfiber_smp);
+}
+
+
+static void X__PostAssertionFailed(void)
+{
+    fflush(stdout);
+    while (1);
+}
+
+
+static int X__Putc(int c)
+{
+    return putc(c, stderr);
+}
+
+
+int main(int argc, const char* argv[])
+{
+    x_putc_stdout = (XCharPutFunc)X__Putc;
+    x_post_assertion_failed = (XAssertionFailedFunc)X__PostAssertionFailed;
+
+    return UnityMain(argc, argv, run_all_tests);
+}
@@ -0,0 +1,234 @@
+#include <picox/allocator/xpico_allocator.h>
+#include <picox/allocator/xfixed_allocator.h>
+#include <picox/allocator/xstack_allocator.h>
+#include <picox/core/xmemstream.h>
+#include <unity.h>
+#include <unity_fixture.h>
+#include "testutils.h"
+
+
+TEST_GROUP(xastats);
+
+
+#if X_CONF_USE_ALLOCATOR_STATS
+
+
+static XAllocatorStats stats;
+static uint8_t heap[1024];
+static char buf[1024];
+
+
+TEST_SETUP(xastats)
+{
+    xastats_init(&stats);
+}
+
+
+TEST_TEAR_DOWN(xastats)
+{
+}
+
+
+static void X__AssertRecord(const void* ptr, int line)
+{
+    size_t i;
+
+    for (i = 0; i < xastats_num_records(&stats); i++)
+    {
+        const XAllocatorStatsRecord* const record = xastats_record(&stats, i);
+        if (record->ptr == ptr)
+        {
+            TEST_ASSERT_NOT_NULL(strstr(record->file, "test_xallocator_stats.c"));
+            TEST_ASSERT_EQUAL(line, record->line);
+            return;
+        }
+    }
+    TEST_FAIL();
+}
+
+
+static const char* X__Dump(XError (*dump)(const void*, XStream*), const void* alloc)
+{
+    XMemStream mstream;
+    XStream* const stream = xmemstream_init(&mstream, buf, 0, sizeof(buf) - 1);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, dump(alloc, stream));
+    buf[mstream.size] = '\0';
+    return buf;
+}
+
+
+static XError X__DumpPico(const void* alloc, XStream* stream) { return xpalloc_dump_stats(alloc, stream); }
+static XError X__DumpFixed(const void* alloc, XStream* stream) { return xfalloc_dump_stats(alloc, stream); }
+static XError X__DumpStack(const void* alloc, XStream* stream) { return xsalloc_dump_stats(alloc, stream); }
+
+
+TEST(xastats, pico)
+{
+    XPicoAllocator alloc;
+    void* p1;
+    void* p2;
+    void* p3;
+    int line1;
+    int line2;
+
+    xpalloc_init(&alloc, heap, sizeof(heap), X_ALIGN_OF(XMaxAlign));
+    xpalloc_set_stats(&alloc, &stats);
+    TEST_ASSERT_EQUAL_PTR(&stats, xpalloc_stats(&alloc));
+
+    /* 確保位置が記録される */
+    p1 = xpalloc_allocate(&alloc, 10); line1 = __LINE__;
+    p2 = xpalloc_allocate(&alloc, 100); line2 = __LINE__;
+    p3 = xpalloc_allocate(&alloc, 10);
+    TEST_ASSERT_NULL(xpalloc_allocate(&alloc, sizeof(heap)));
+    TEST_ASSERT_EQUAL(3, stats.num_allocs);
+    TEST_ASSERT_EQUAL(1, stats.num_failures);
+    TEST_ASSERT_EQUAL(2, stats.histogram[3]);
+    TEST_ASSERT_EQUAL(1, stats.histogram[6]);
+    TEST_ASSERT_EQUAL(xpalloc_capacity(&alloc) - xpalloc_reserve(&alloc), stats.cur_bytes);
+    X__AssertRecord(p1, line1);
+    X__AssertRecord(p2, line2);
+
+    /* 再確保は解放と確保として記録され、コピーの間は新旧のブロックが両方使用中
+     * になる */
+    p2 = xpalloc_reallocate(&alloc, p2, 200); line2 = __LINE__;
+    X__AssertRecord(p2, line2);
+    TEST_ASSERT_EQUAL(3, stats.cur_count);
+    TEST_ASSERT_EQUAL(4, stats.max_count);
+    TEST_ASSERT_EQUAL(1, stats.num_frees);
+
+    /* 間の空きブロックが断片化として現れる */
+    xpalloc_deallocate(&alloc, p1);
+    xpalloc_deallocate(&alloc, p3);
+    TEST_ASSERT_EQUAL(1, stats.cur_count);
+    TEST_ASSERT_EQUAL(1, xastats_num_records(&stats));
+    TEST_ASSERT_TRUE(xpalloc_largest_free_block(&alloc) < xpalloc_reserve(&alloc));
+    TEST_ASSERT_TRUE(xastats_fragmentation(xpalloc_reserve(&alloc), xpalloc_largest_free_block(&alloc)) > 0);
+
+    /* 解放されていないブロックは確保位置とともに出力される */
+    TEST_ASSERT_NOT_NULL(strstr(X__Dump(X__DumpPico, &alloc), "leak"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "test_xallocator_stats.c"));
+
+    xpalloc_clear(&alloc);
+    TEST_ASSERT_EQUAL(0, stats.cur_count);
+    TEST_ASSERT_EQUAL(0, stats.cur_bytes);
+    TEST_ASSERT_EQUAL(0, xastats_num_records(&stats));
+    TEST_ASSERT_EQUAL(xpalloc_reserve(&alloc), xpalloc_largest_free_block(&alloc));
+    TEST_ASSERT_NULL(strstr(X__Dump(X__DumpPico, &alloc), "leak"));
+
+    xpalloc_deinit(&alloc);
+}
+
+
+TEST(xastats, fixed)
+{
+    XFixedAllocator alloc;
+    void* ptrs[4];
+    int line;
+    size_t i;
+
+    xfalloc_init(&alloc, heap, 32 * X_COUNT_OF(ptrs) + X_ALIGN_OF(XMaxAlign), 32);
+    xfalloc_set_stats(&alloc, &stats);
+
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+    {
+        ptrs[i] = xfalloc_allocate(&alloc); line = __LINE__;
+        X__AssertRecord(ptrs[i], line);
+    }
+    TEST_ASSERT_EQUAL(32 * X_COUNT_OF(ptrs), stats.cur_bytes);
+    TEST_ASSERT_EQUAL(X_COUNT_OF(ptrs), stats.histogram[5]);
+    TEST_ASSERT_EQUAL(xfalloc_remain_blocks(&alloc) ? 32 : 0, xfalloc_largest_free_block(&alloc));
+
+    xfalloc_deallocate(&alloc, ptrs[0]);
+    TEST_ASSERT_EQUAL(32, xfalloc_largest_free_block(&alloc));
+    TEST_ASSERT_EQUAL(X_COUNT_OF(ptrs) - 1, stats.cur_count);
+    TEST_ASSERT_NOT_NULL(strstr(X__Dump(X__DumpFixed, &alloc), "leak"));
+
+    xfalloc_clear(&alloc);
+    TEST_ASSERT_EQUAL(X_COUNT_OF(ptrs), stats.num_frees);
+    TEST_ASSERT_EQUAL(0, stats.cur_bytes);
+}
+
+
+TEST(xastats, stack)
+{
+    XStackAllocator alloc;
+    uint8_t* begin;
+    uint8_t* end;
+    void* p;
+    int line;
+
+    xsalloc_init(&alloc, heap, sizeof(heap), X_ALIGN_OF(XMaxAlign));
+    xsalloc_set_stats(&alloc, &stats);
+
+    p = xsalloc_allocate(&alloc, 16); line = __LINE__;
+    X__AssertRecord(p, line);
+    begin = xsalloc_bedin(&alloc);
+    end = xsalloc_end(&alloc);
+
+    /* 巻き戻した範囲のブロックが解放として記録される */
+    xsalloc_allocate(&alloc, 16);
+    xsalloc_set_growth_direction(&alloc, false);
+    xsalloc_allocate(&alloc, 16);
+    TEST_ASSERT_EQUAL(3, stats.cur_count);
+    xsalloc_rewind(&alloc, begin, end);
+    TEST_ASSERT_EQUAL(1, stats.cur_count);
+    TEST_ASSERT_EQUAL(2, stats.num_frees);
+    TEST_ASSERT_EQUAL(xsalloc_capacity(&alloc) - xsalloc_reserve(&alloc), stats.cur_bytes);
+    TEST_ASSERT_EQUAL(xsalloc_reserve(&alloc), xsalloc_largest_free_block(&alloc));
+    TEST_ASSERT_NOT_NULL(strstr(X__Dump(X__DumpStack, &alloc), "leak"));
+
+    xsalloc_clear(&alloc);
+    TEST_ASSERT_EQUAL(0, stats.cur_count);
+    TEST_ASSERT_EQUAL(0, stats.cur_bytes);
+}
+
+
+TEST(xastats, untracked)
+{
+    XPicoAllocator alloc;
+    void* ptrs[X_CONF_ALLOCATOR_STATS_MAX_RECORDS + 2];
+    size_t i;
+
+    xpalloc_init(&alloc, NULL, 8192, X_ALIGN_OF(XMaxAlign));
+    xpalloc_set_stats(&alloc, &stats);
+
+    /* 記録表から溢れたブロックは数だけが記録される */
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        ptrs[i] = xpalloc_allocate(&alloc, 8);
+    TEST_ASSERT_EQUAL(X_CONF_ALLOCATOR_STATS_MAX_RECORDS, xastats_num_records(&stats));
+    TEST_ASSERT_EQUAL(2, stats.num_untracked);
+
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        xpalloc_deallocate(&alloc, ptrs[i]);
+    TEST_ASSERT_EQUAL(0, stats.num_untracked);
+    TEST_ASSERT_EQUAL(0, stats.cur_count);
+    TEST_ASSERT_EQUAL(0, xastats_num_records(&stats));
+
+    /* 登録前に確保したブロックの解放は無視される */
+    xpalloc_set_stats(&alloc, NULL);
+    ptrs[0] = xpalloc_allocate(&alloc, 8);
+    xpalloc_set_stats(&alloc, &stats);
+    xpalloc_deallocate(&alloc, ptrs[0]);
+    TEST_ASSERT_EQUAL(X_COUNT_OF(ptrs), stats.num_frees);
+
+    TEST_ASSERT_EQUAL(0, xastats_fragmentation(0, 0));
+    TEST_ASSERT_EQUAL(0, xastats_fragmentation(100, 100));
+    TEST_ASSERT_EQUAL(75, xastats_fragmentation(100, 25));
+
+    xpalloc_deinit(&alloc);
+}
+
+
+#endif /* if X_CONF_USE_ALLOCATOR_STATS */
+
+
+TEST_GROUP_RUNNER(xastats)
+{
+#if X_CONF_USE_ALLOCATOR_STATS
+    RUN_TEST_CASE(xastats, pico);
+    RUN_TEST_CASE(xastats, fixed);
+    RUN_TEST_CASE(xastats, stack);
+    RUN_TEST_CASE(xastats, untracked);
+#endif
+}
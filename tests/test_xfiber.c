@@ -1,4 +1,5 @@
 #include <picox/multitask/xfiber.h>
+#include <picox/core/xmemstream.h>
 #include "testutils.h"
 
 
@@ -170,6 +171,404 @@ static void DelayMainTask(void* a)
 }
 
 
+static int num_idle_calls;
+static XTicks max_idle_timeout;
+
+
+static int RecordIdleHook(XTicks timeout)
+{
+    /* タイマがなくなったら全てのファイバーが終了している */
+    if (timeout == X_TICKS_FOREVER)
+        return 1;
+
+    num_idle_calls++;
+    if (timeout > max_idle_timeout)
+        max_idle_timeout = timeout;
+    return 0;
+}
+
+
+static void SleepTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_delay(x_msec_to_ticks(20));
+}
+
+
+static const int priority_order_input[] = { 3, 31, 8, 0, 17, 30, 9, 7 };
+static int priority_order_result[X_COUNT_OF(priority_order_input)];
+static int num_priority_order_result;
+
+
+static int ExitOnIdle(XTicks timeout)
+{
+    X_UNUSED(timeout);
+    return 1;
+}
+
+
+static void RecordPriorityTask(void* arg)
+{
+    priority_order_result[num_priority_order_result++] = *(const int*)arg;
+}
+
+
+#if X_CONF_FIBER_USE_STATS
+
+
+static XFiberSemaphore* stats_done;
+
+
+static void BusyTask(void* arg)
+{
+    const XTicks start = x_ticks_now();
+
+    X_UNUSED(arg);
+    while (x_ticks_now() - start < x_msec_to_ticks(20))
+        ;
+    xfiber_yield();
+    xfiber_semaphore_take(stats_done);
+}
+
+
+static void SleepyTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_delay(x_msec_to_ticks(30));
+    xfiber_semaphore_take(stats_done);
+}
+
+
+static bool HasTrace(const XFiberTraceRecord* records, size_t num, uint16_t id, int event, int arg)
+{
+    size_t i;
+
+    for (i = 0; i < num; i++)
+    {
+        if ((records[i].fiber_id == id) && (records[i].event == event) &&
+            ((arg < 0) || (records[i].arg == arg)))
+            return true;
+    }
+    return false;
+}
+
+
+static void StatsMainTask(void* a)
+{
+    const size_t buf_size = 4096;
+    XFiberTraceRecord* const records = x_malloc(sizeof(XFiberTraceRecord) * X_CONF_FIBER_TRACE_SIZE);
+    char* const buf = x_malloc(buf_size);
+    XFiber* busy;
+    XFiber* sleepy;
+    XFiberStats stats;
+    XMemStream mstream;
+    XStream* stream;
+    size_t num;
+
+    X_UNUSED(a);
+    TEST_ASSERT_NOT_NULL(records);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_create(&stats_done, 0));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&busy, PRIORITY, "busy", STACK_SIZE, BusyTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&sleepy, PRIORITY, "sleepy", STACK_SIZE, SleepyTask, NULL));
+
+    xfiber_delay(x_msec_to_ticks(80));
+
+    /* CPUを占有したファイバーは実行時間が、遅延したファイバーは待ち時間が長い */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_get_stats(busy, &stats));
+    TEST_ASSERT_TRUE(stats.run_time >= (uint64_t)x_msec_to_ticks(15));
+    TEST_ASSERT_TRUE(stats.num_switches >= 2);
+    TEST_ASSERT_TRUE(stats.max_stack_usage > 0);
+    TEST_ASSERT_TRUE(stats.max_stack_usage <= STACK_SIZE);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_get_stats(sleepy, &stats));
+    TEST_ASSERT_TRUE(stats.wait_time[X_FIBER_WAIT_KIND_DELAY] >= (uint64_t)x_msec_to_ticks(25));
+    TEST_ASSERT_EQUAL(0, stats.wait_time[X_FIBER_WAIT_KIND_SEMAPHORE]);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_get_stats(NULL, &stats));
+    TEST_ASSERT_TRUE(stats.wait_time[X_FIBER_WAIT_KIND_DELAY] >= (uint64_t)x_msec_to_ticks(75));
+    xfiber_reset_stats(NULL);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_get_stats(NULL, &stats));
+    TEST_ASSERT_EQUAL(0, stats.wait_time[X_FIBER_WAIT_KIND_DELAY]);
+    TEST_ASSERT_EQUAL(0, stats.num_switches);
+
+    /* スケジューリングイベントが記録されている */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_get_stats(sleepy, &stats));
+    num = xfiber_trace_read(records, X_CONF_FIBER_TRACE_SIZE);
+    TEST_ASSERT_TRUE(num > 0);
+    TEST_ASSERT_TRUE(HasTrace(records, num, stats.id, X_FIBER_TRACE_CREATE, -1));
+    TEST_ASSERT_TRUE(HasTrace(records, num, stats.id, X_FIBER_TRACE_DISPATCH, -1));
+    TEST_ASSERT_TRUE(HasTrace(records, num, stats.id, X_FIBER_TRACE_BLOCK, X_FIBER_WAIT_KIND_DELAY));
+    TEST_ASSERT_TRUE(HasTrace(records, num, stats.id, X_FIBER_TRACE_WAKE, X_ERR_TIMED_OUT));
+    TEST_ASSERT_TRUE(HasTrace(records, num, stats.id, X_FIBER_TRACE_BLOCK, X_FIBER_WAIT_KIND_SEMAPHORE));
+
+    /* トレースはレコードのバイト列で、統計はテキストで出力される */
+    stream = xmemstream_init(&mstream, buf, 0, buf_size);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_trace_dump(stream));
+    TEST_ASSERT_TRUE(mstream.size >= num * sizeof(XFiberTraceRecord));
+    TEST_ASSERT_EQUAL(0, mstream.size % sizeof(XFiberTraceRecord));
+
+    stream = xmemstream_init(&mstream, buf, 0, buf_size - 1);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_dump_stats(stream));
+    buf[mstream.size] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(buf, "busy"));
+    TEST_ASSERT_NOT_NULL(strstr(buf, "wait delay"));
+
+    xfiber_trace_clear();
+    TEST_ASSERT_EQUAL(0, xfiber_trace_read(records, X_CONF_FIBER_TRACE_SIZE));
+
+    xfiber_semaphore_destroy(stats_done);
+    x_free(records);
+    x_free(buf);
+    xfiber_kernel_end_scheduler();
+}
+
+
+#endif /* if X_CONF_FIBER_USE_STATS */
+
+
+static int num_local_done;
+
+
+/* 各タスクが自分のスロットとアリーナを使う */
+static void LocalTask(void* arg)
+{
+    uint8_t* p;
+    uint8_t* q;
+    size_t reserve;
+
+    TEST_ASSERT_NULL(xfiber_get_local(NULL, 0));
+    xfiber_set_local(NULL, 0, arg);
+    xfiber_set_local(NULL, X_CONF_FIBER_LOCAL_STORAGE_SIZE - 1, &num_local_done);
+
+    TEST_ASSERT_NULL(xfiber_arena_alloc(16));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_arena_create(256));
+    TEST_ASSERT_EQUAL(X_ERR_EXIST, xfiber_arena_create(256));
+    reserve = xfiber_arena_reserve();
+    TEST_ASSERT_TRUE(reserve > 0);
+
+    p = xfiber_arena_alloc(10);
+    q = xfiber_arena_alloc(10);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)q % X_ALIGN_OF(XMaxAlign));
+    TEST_ASSERT_TRUE(q >= p + 10);
+    memset(p, 0xAA, 10);
+
+    xfiber_yield();
+
+    /* 他のタスクの操作に影響されない */
+    TEST_ASSERT_EQUAL_PTR(arg, xfiber_get_local(NULL, 0));
+    TEST_ASSERT_EQUAL_PTR(&num_local_done, xfiber_get_local(xfiber_self(), X_CONF_FIBER_LOCAL_STORAGE_SIZE - 1));
+    TEST_ASSERT_EQUAL_HEX8(0xAA, p[9]);
+
+    /* 容量を超えたらNULLを返し、クリアすると全て解放される */
+    TEST_ASSERT_NULL(xfiber_arena_alloc(reserve));
+    xfiber_arena_clear();
+    TEST_ASSERT_EQUAL(reserve, xfiber_arena_reserve());
+    TEST_ASSERT_NOT_NULL(xfiber_arena_alloc(reserve));
+    TEST_ASSERT_EQUAL(0, xfiber_arena_reserve());
+
+    num_local_done++;
+}
+
+
+static void LocalMainTask(void* arg)
+{
+    static int values[2];
+    XFiber* fiber;
+
+    X_UNUSED(arg);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&fiber, PRIORITY, "local1", STACK_SIZE, LocalTask, &values[0]));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "local2", STACK_SIZE, LocalTask, &values[1]));
+
+    /* 他のタスクのスロットも参照できる */
+    xfiber_yield();
+    TEST_ASSERT_EQUAL_PTR(&values[0], xfiber_get_local(fiber, 0));
+
+    while (num_local_done < 2)
+        xfiber_yield();
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+static XFiberSemaphore* join_semaphore;
+static XFiberMutex* join_mutex;
+
+
+static void ExitStatusTask(void* arg)
+{
+    xfiber_exit((int)(intptr_t)arg);
+}
+
+
+static void WaitForeverTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_semaphore_take(join_semaphore);
+    TEST_FAIL();
+}
+
+
+static void HoldMutexTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_mutex_lock(join_mutex);
+    xfiber_semaphore_take(join_semaphore);
+    xfiber_mutex_unlock(join_mutex);
+}
+
+
+static void JoinDestroyTask(void* arg)
+{
+    XFiber* const target = arg;
+    int status = 0;
+
+    TEST_ASSERT_EQUAL(X_ERR_CANCELED, xfiber_join(target, &status));
+    xfiber_semaphore_give(join_semaphore);
+}
+
+
+static void JoinForeverTask(void* arg)
+{
+    xfiber_join(arg, NULL);
+    TEST_FAIL();
+}
+
+
+static void JoinMainTask(void* arg)
+{
+    XFiber* fiber;
+    XFiber* joiner;
+    int status = 0;
+
+    X_UNUSED(arg);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_create(&join_semaphore, 0));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_create(&join_mutex));
+
+    /* 終了を待ってから終了ステータスを受け取る */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create_joinable(&fiber, PRIORITY, "exit", STACK_SIZE, ExitStatusTask, (void*)(intptr_t)7));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_join(fiber, &status));
+    TEST_ASSERT_EQUAL(7, status);
+
+    /* 既に終了していればすぐに返る */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create_joinable(&fiber, PRIORITY + 1, "exit", STACK_SIZE, ExitStatusTask, (void*)(intptr_t)3));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_join(fiber, &status));
+    TEST_ASSERT_EQUAL(3, status);
+
+    /* 自分自身とデタッチ済みファイバーはjoinできない */
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_join(xfiber_self(), NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create_joinable(&fiber, PRIORITY, "wait", STACK_SIZE, WaitForeverTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_timed_join(fiber, &status, x_msec_to_ticks(5)));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_detach(fiber));
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_detach(fiber));
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_try_join(fiber, &status));
+
+    /* 待ち中のファイバーを破棄すると、joinしているファイバーはX_ERR_CANCELED */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_destroy(fiber));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create_joinable(&fiber, PRIORITY, "wait", STACK_SIZE, WaitForeverTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&joiner, PRIORITY, "joiner", STACK_SIZE, JoinDestroyTask, fiber));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_destroy(fiber));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_take(join_semaphore));
+
+    /* joinしているファイバーを破棄すれば、対象は再びjoinや破棄ができる */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create_joinable(&fiber, PRIORITY, "wait", STACK_SIZE, WaitForeverTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&joiner, PRIORITY, "joiner", STACK_SIZE, JoinForeverTask, fiber));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_BUSY, xfiber_try_join(fiber, &status));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_destroy(joiner));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_try_join(fiber, &status));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_destroy(fiber));
+
+    /* ミューテックスを保持しているファイバーは破棄できない */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&fiber, PRIORITY, "hold", STACK_SIZE, HoldMutexTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_BUSY, xfiber_destroy(fiber));
+    xfiber_semaphore_give(join_semaphore);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_lock(join_mutex));
+    xfiber_mutex_unlock(join_mutex);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+#if X_CONF_FIBER_STACK_PAINT || X_CONF_FIBER_STACK_GUARD
+
+
+#define DEEP_STACK_USAGE    (1024)
+
+
+static size_t deep_high_water;
+
+
+/* スタック上の配列を使用したままコンテキストを切り替える */
+static void DeepStackTask(void* arg)
+{
+    volatile uint8_t buf[DEEP_STACK_USAGE];
+    size_t i;
+
+    X_UNUSED(arg);
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = (uint8_t)i;
+    xfiber_yield();
+    deep_high_water = xfiber_stack_high_water(NULL);
+    TEST_ASSERT_EQUAL(0xFF, buf[sizeof(buf) - 1]);
+}
+
+
+static void ShallowStackTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_yield();
+}
+
+
+static void StackHighWaterMainTask(void* arg)
+{
+    XFiber* deep;
+    XFiber* shallow;
+    size_t deep_usage;
+
+    X_UNUSED(arg);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&deep, PRIORITY, "deep", STACK_SIZE, DeepStackTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&shallow, PRIORITY, "shallow", STACK_SIZE, ShallowStackTask, NULL));
+    xfiber_yield();
+
+    deep_usage = xfiber_stack_high_water(deep);
+    TEST_ASSERT_TRUE(deep_usage >= DEEP_STACK_USAGE);
+    TEST_ASSERT_TRUE(xfiber_stack_high_water(shallow) > 0);
+#if X_CONF_FIBER_STACK_PAINT
+    /* バイト単位で計測できるので、使用量の差が現れる */
+    TEST_ASSERT_TRUE(xfiber_stack_high_water(shallow) < DEEP_STACK_USAGE);
+    TEST_ASSERT_TRUE(deep_usage <= STACK_SIZE);
+#endif
+
+    /* ピーク値なので、減ることはない */
+    xfiber_yield();
+    TEST_ASSERT_TRUE(deep_high_water >= deep_usage);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber, stack_high_water)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, StackHighWaterMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+#endif /* if X_CONF_FIBER_STACK_PAINT || X_CONF_FIBER_STACK_GUARD */
+
+
 TEST(xfiber, create)
 {
     xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
@@ -186,8 +585,88 @@ TEST(xfiber, delay)
 }
 
 
+TEST(xfiber, idle_hook)
+{
+    num_idle_calls = 0;
+    max_idle_timeout = 0;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, RecordIdleHook);
+    xfiber_create(NULL, PRIORITY, "sleep", STACK_SIZE, SleepTask, NULL);
+    xfiber_kernel_start_scheduler();
+
+    TEST_ASSERT_TRUE(num_idle_calls > 0);
+    TEST_ASSERT_TRUE(max_idle_timeout > 0);
+    TEST_ASSERT_TRUE(max_idle_timeout <= x_msec_to_ticks(20));
+}
+
+
+TEST(xfiber, priority_order)
+{
+    const int num = X_COUNT_OF(priority_order_input);
+    int i;
+
+    num_priority_order_result = 0;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE * 2, ExitOnIdle);
+    for (i = 0; i < num; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE,
+                          xfiber_create(NULL, priority_order_input[i], "task", STACK_SIZE,
+                                        RecordPriorityTask, (void*)&priority_order_input[i]));
+    }
+    xfiber_kernel_start_scheduler();
+
+    /* 8段階を超える優先度でも、高い順に実行される */
+    TEST_ASSERT_EQUAL(num, num_priority_order_result);
+    for (i = 1; i < num; i++)
+        TEST_ASSERT_TRUE(priority_order_result[i - 1] > priority_order_result[i]);
+}
+
+
+TEST(xfiber, join)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, JoinMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber, local)
+{
+    num_local_done = 0;
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, LocalMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+#if X_CONF_FIBER_USE_STATS
+
+
+TEST(xfiber, stats)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, StatsMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+#endif
+
+
 TEST_GROUP_RUNNER(xfiber)
 {
     RUN_TEST_CASE(xfiber, create);
-    RUN_TEST_CASE(xfiber, delay)
+    RUN_TEST_CASE(xfiber, delay);
+    RUN_TEST_CASE(xfiber, idle_hook);
+    RUN_TEST_CASE(xfiber, priority_order);
+    RUN_TEST_CASE(xfiber, local);
+    RUN_TEST_CASE(xfiber, join);
+#if X_CONF_FIBER_USE_STATS
+    RUN_TEST_CASE(xfiber, stats);
+#endif
+#if X_CONF_FIBER_STACK_PAINT || X_CONF_FIBER_STACK_GUARD
+    RUN_TEST_CASE(xfiber, stack_high_water);
+#endif
 }
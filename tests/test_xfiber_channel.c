@@ -188,6 +188,147 @@ static void DestroyTaskMain(void* a)
 }
 
 
+#define NUM_ZERO_COPY_ITEMS     (40)
+#define ZERO_COPY_MAX_SIZE      (24)
+
+
+static size_t ZeroCopyItemSize(int index)
+{
+    return (size_t)(index % ZERO_COPY_MAX_SIZE) + 1;
+}
+
+
+static void ZeroCopySendTask(void* a)
+{
+    XFiberChannel* const channel = a;
+    void* ptr;
+    int i;
+
+    for (i = 0; i < NUM_ZERO_COPY_ITEMS; i++)
+    {
+        /* 最大サイズで確保して、実際のサイズで確定する */
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_reserve(channel, ZERO_COPY_MAX_SIZE, &ptr));
+        memset(ptr, i, ZeroCopyItemSize(i));
+        xfiber_channel_commit(channel, ZeroCopyItemSize(i));
+    }
+}
+
+
+static void ZeroCopyReceiveTaskMain(void* a)
+{
+    X_UNUSED(a);
+
+    XFiberChannel* channel;
+    uint8_t expected[ZERO_COPY_MAX_SIZE];
+    uint8_t buf[ZERO_COPY_MAX_SIZE];
+    void* ptr;
+    size_t size;
+    int i;
+
+    /* 終端の詰め物が頻繁に発生するように、容量を小さくする */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_create(&channel, 64, ZERO_COPY_MAX_SIZE));
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_channel_try_reserve(channel, ZERO_COPY_MAX_SIZE + 1, &ptr));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "sender", STACK_SIZE, ZeroCopySendTask, channel));
+
+    for (i = 0; i < NUM_ZERO_COPY_ITEMS; i++)
+    {
+        memset(expected, i, sizeof(expected));
+
+        if (i % 3 == 0)
+        {
+            TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_receive(channel, buf, &size));
+            TEST_ASSERT_EQUAL(ZeroCopyItemSize(i), size);
+            TEST_ASSERT_EQUAL_MEMORY(expected, buf, size);
+            continue;
+        }
+
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_peek(channel, &ptr, &size));
+        TEST_ASSERT_EQUAL(ZeroCopyItemSize(i), size);
+        TEST_ASSERT_EQUAL_MEMORY(expected, ptr, size);
+        xfiber_channel_consume(channel);
+    }
+
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_channel_try_peek(channel, &ptr, &size));
+    xfiber_channel_destroy(channel);
+    xfiber_kernel_end_scheduler();
+}
+
+
+#define NUM_BATCH_ITEMS     (60)
+#define BATCH_MAX_SIZE      (8)
+
+
+static size_t BatchItemSize(int index)
+{
+    return (size_t)(index % BATCH_MAX_SIZE) + 1;
+}
+
+
+static void BatchSendTask(void* a)
+{
+    XFiberChannel* const channel = a;
+    uint8_t buf[BATCH_MAX_SIZE * 10];
+    size_t sizes[10];
+    size_t num;
+    size_t i;
+    int sent = 0;
+
+    while (sent < NUM_BATCH_ITEMS)
+    {
+        uint8_t* p = buf;
+        const size_t n = X_MIN(X_COUNT_OF(sizes), (size_t)(NUM_BATCH_ITEMS - sent));
+
+        for (i = 0; i < n; i++)
+        {
+            sizes[i] = BatchItemSize(sent + i);
+            memset(p, sent + i, sizes[i]);
+            p += sizes[i];
+        }
+
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_send_n(channel, buf, sizes, n, &num));
+        TEST_ASSERT_TRUE((num >= 1) && (num <= n));
+        sent += num;
+    }
+}
+
+
+static void BatchReceiveTaskMain(void* a)
+{
+    X_UNUSED(a);
+
+    XFiberChannel* channel;
+    uint8_t buf[BATCH_MAX_SIZE * 4];
+    uint8_t expected[BATCH_MAX_SIZE];
+    size_t sizes[16];
+    size_t num;
+    size_t i;
+    int received = 0;
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_create(&channel, 64, BATCH_MAX_SIZE));
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_channel_try_receive_n(channel, buf, BATCH_MAX_SIZE - 1, sizes, 16, &num));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "sender", STACK_SIZE, BatchSendTask, channel));
+
+    while (received < NUM_BATCH_ITEMS)
+    {
+        const uint8_t* p = buf;
+
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_receive_n(channel, buf, sizeof(buf), sizes, 16, &num));
+        for (i = 0; i < num; i++)
+        {
+            TEST_ASSERT_EQUAL(BatchItemSize(received), sizes[i]);
+            memset(expected, received, sizes[i]);
+            TEST_ASSERT_EQUAL_MEMORY(expected, p, sizes[i]);
+            p += sizes[i];
+            received++;
+        }
+        TEST_ASSERT_TRUE(p <= buf + sizeof(buf));
+    }
+
+    xfiber_channel_destroy(channel);
+    xfiber_kernel_end_scheduler();
+}
+
+
 TEST(xfiber_channel, receive)
 {
     xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
@@ -212,9 +353,27 @@ TEST(xfiber_channel, destroy)
 }
 
 
+TEST(xfiber_channel, zero_copy)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, ZeroCopyReceiveTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_channel, batch)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, BatchReceiveTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
 TEST_GROUP_RUNNER(xfiber_channel)
 {
     RUN_TEST_CASE(xfiber_channel, receive);
     RUN_TEST_CASE(xfiber_channel, timed_receive);
     RUN_TEST_CASE(xfiber_channel, destroy);
+    RUN_TEST_CASE(xfiber_channel, zero_copy);
+    RUN_TEST_CASE(xfiber_channel, batch);
 }
@@ -0,0 +1,125 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#define KERNEL_WORK_SIZE    (1024 * 20)
+#define STACK_SIZE          (2048)
+#define PRIORITY            (4)
+#define NUM_WAITERS         (3)
+
+
+TEST_GROUP(xfiber_cond);
+
+
+static XFiberCond* cond;
+static XFiberMutex* mutex;
+static int num_items;
+static int num_woken;
+
+
+TEST_SETUP(xfiber_cond)
+{
+    num_items = 0;
+    num_woken = 0;
+}
+
+
+TEST_TEAR_DOWN(xfiber_cond)
+{
+}
+
+
+/* 条件が成立するまで待ち、起床時にはミューテックスを獲得していること */
+static void ConsumeTask(void* a)
+{
+    X_UNUSED(a);
+
+    xfiber_mutex_lock(mutex);
+    while (num_items == 0)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_cond_wait(cond, mutex));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_mutex_try_lock(mutex));
+    num_items--;
+    num_woken++;
+    xfiber_mutex_unlock(mutex);
+}
+
+
+static void CanceledTask(void* a)
+{
+    X_UNUSED(a);
+
+    xfiber_mutex_lock(mutex);
+    TEST_ASSERT_EQUAL(X_ERR_CANCELED, xfiber_cond_wait(cond, mutex));
+    num_woken++;
+    xfiber_mutex_unlock(mutex);
+}
+
+
+static void SignalTaskMain(void* a)
+{
+    int i;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_cond_create(&cond));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_create(&mutex));
+
+    /* ミューテックスをロックしていなければエラー */
+    TEST_ASSERT_EQUAL(X_ERR_PROTOCOL, xfiber_cond_wait(cond, mutex));
+
+    for (i = 0; i < NUM_WAITERS; i++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "consumer", STACK_SIZE, ConsumeTask, NULL));
+    xfiber_yield();
+
+    /* signalは1つだけ起床させる */
+    xfiber_mutex_lock(mutex);
+    num_items++;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_cond_signal(cond));
+    xfiber_mutex_unlock(mutex);
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(1, num_woken);
+
+    /* broadcastは全て起床させるが、条件が成立しなければ再び待つ */
+    xfiber_mutex_lock(mutex);
+    num_items++;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_cond_broadcast(cond));
+    xfiber_mutex_unlock(mutex);
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(2, num_woken);
+
+    xfiber_mutex_lock(mutex);
+    num_items++;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_cond_signal(cond));
+    xfiber_mutex_unlock(mutex);
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(3, num_woken);
+
+    /* タイムアウトしてもミューテックスを獲得し直して戻る */
+    xfiber_mutex_lock(mutex);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_cond_timed_wait(cond, mutex, x_msec_to_ticks(5)));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_unlock(mutex));
+
+    /* 破棄されたらX_ERR_CANCELED */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "canceled", STACK_SIZE, CanceledTask, NULL));
+    xfiber_yield();
+    xfiber_cond_destroy(cond);
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(4, num_woken);
+
+    xfiber_mutex_destroy(mutex);
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_cond, signal)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, SignalTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST_GROUP_RUNNER(xfiber_cond)
+{
+    RUN_TEST_CASE(xfiber_cond, signal);
+}
@@ -0,0 +1,164 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#define KERNEL_WORK_SIZE    (1024 * 40)
+#define STACK_SIZE          (2048)
+#define PRIORITY            (4)
+#define NUM_WORKERS         (3)
+#define QUEUE_LEN           (4)
+#define NUM_JOBS            (16)
+
+
+TEST_GROUP(xfiber_executor);
+
+
+static int num_running;
+static int max_running;
+static int num_callbacks;
+static XFiberSemaphore* gate;
+static XFiberFuture futures[NUM_JOBS];
+
+
+TEST_SETUP(xfiber_executor)
+{
+    num_running = 0;
+    max_running = 0;
+    num_callbacks = 0;
+}
+
+
+TEST_TEAR_DOWN(xfiber_executor)
+{
+}
+
+
+/* 途中で他のファイバーに切り替えながら、引数の2乗を返す */
+static void* SquareJob(void* arg)
+{
+    const intptr_t n = (intptr_t)arg;
+
+    if (++num_running > max_running)
+        max_running = num_running;
+    xfiber_delay(x_msec_to_ticks(1));
+    num_running--;
+
+    return (void*)(n * n);
+}
+
+
+static void* GateJob(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_semaphore_take(gate);
+    return NULL;
+}
+
+
+static void CountCallback(void* result, void* callback_arg)
+{
+    X_UNUSED(result);
+    TEST_ASSERT_EQUAL_PTR(&num_callbacks, callback_arg);
+    num_callbacks++;
+}
+
+
+static void SubmitMainTask(void* a)
+{
+    XFiberExecutor* executor;
+    void* result;
+    int i;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_executor_create(&executor, 0, QUEUE_LEN, PRIORITY, STACK_SIZE));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_create(&executor, NUM_WORKERS, QUEUE_LEN, PRIORITY, STACK_SIZE));
+
+    /* キューが満杯の間は投入側が待たされる */
+    for (i = 0; i < NUM_JOBS; i++)
+    {
+        xfiber_future_init(&futures[i], CountCallback, &num_callbacks);
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_submit(executor, SquareJob, (void*)(intptr_t)i, &futures[i]));
+    }
+
+    for (i = 0; i < NUM_JOBS; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_future_wait(&futures[i], &result));
+        TEST_ASSERT_EQUAL(i * i, (intptr_t)result);
+        TEST_ASSERT_TRUE(xfiber_future_is_done(&futures[i]));
+    }
+
+    /* 同時実行数はワーカー数で制限される */
+    TEST_ASSERT_EQUAL(NUM_WORKERS, max_running);
+    TEST_ASSERT_EQUAL(NUM_JOBS, num_callbacks);
+
+    /* 完了済みのフューチャーは再利用できる */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_submit(executor, SquareJob, (void*)(intptr_t)5, &futures[0]));
+    TEST_ASSERT_FALSE(xfiber_future_is_done(&futures[0]));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_future_wait(&futures[0], &result));
+    TEST_ASSERT_EQUAL(25, (intptr_t)result);
+
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_executor_submit(executor, NULL, NULL, NULL));
+
+    xfiber_executor_destroy(executor);
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void BackpressureMainTask(void* a)
+{
+    XFiberExecutor* executor;
+    XFiberFuture* const future = &futures[0];
+    int i;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_create(&gate, 0));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_create(&executor, 1, QUEUE_LEN, PRIORITY, STACK_SIZE));
+
+    /* ワーカーが止まっていれば、キューの長さを超えた投入はタイムアウトする */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_try_submit(executor, GateJob, NULL, NULL));
+    xfiber_yield();
+    for (i = 0; i < QUEUE_LEN; i++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_try_submit(executor, GateJob, NULL, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_executor_try_submit(executor, GateJob, NULL, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_executor_timed_submit(executor, GateJob, NULL, NULL, x_msec_to_ticks(5)));
+
+    xfiber_future_init(future, NULL, NULL);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_future_try_wait(future, NULL));
+
+    for (i = 0; i < QUEUE_LEN + 1; i++)
+        xfiber_semaphore_give(gate);
+
+    /* 破棄は投入済みのジョブの完了を待つ */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_executor_submit(executor, SquareJob, (void*)(intptr_t)3, future));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_future_try_wait(future, NULL));
+    xfiber_executor_destroy(executor);
+    TEST_ASSERT_TRUE(xfiber_future_is_done(future));
+
+    xfiber_semaphore_destroy(gate);
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_executor, submit)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, SubmitMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_executor, backpressure)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, BackpressureMainTask, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST_GROUP_RUNNER(xfiber_executor)
+{
+    RUN_TEST_CASE(xfiber_executor, submit);
+    RUN_TEST_CASE(xfiber_executor, backpressure);
+}
@@ -0,0 +1,169 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#if X_CONF_FIBER_USE_EPOLL
+
+
+#include <unistd.h>
+#include <fcntl.h>
+
+
+#define KERNEL_WORK_SIZE    (1024 * 40)
+#define STACK_SIZE          (4096)
+#define PRIORITY            (4)
+
+
+static int s_pipe[2];
+static volatile bool s_done;
+static int s_num_spins;
+
+
+#endif /* if X_CONF_FIBER_USE_EPOLL */
+
+
+TEST_GROUP(xfiber_io);
+
+
+TEST_SETUP(xfiber_io)
+{
+#if X_CONF_FIBER_USE_EPOLL
+    TEST_ASSERT_EQUAL(0, pipe(s_pipe));
+    fcntl(s_pipe[0], F_SETFL, fcntl(s_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(s_pipe[1], F_SETFL, fcntl(s_pipe[1], F_GETFL) | O_NONBLOCK);
+    s_done = false;
+    s_num_spins = 0;
+#endif
+}
+
+
+TEST_TEAR_DOWN(xfiber_io)
+{
+#if X_CONF_FIBER_USE_EPOLL
+    close(s_pipe[0]);
+    if (s_pipe[1] >= 0)
+        close(s_pipe[1]);
+#endif
+}
+
+
+#if X_CONF_FIBER_USE_EPOLL
+
+
+static void WriteTask(void* a)
+{
+    X_UNUSED(a);
+
+    xfiber_delay(x_msec_to_ticks(10));
+    TEST_ASSERT_EQUAL(5, write(s_pipe[1], "hello", 5));
+}
+
+
+/* 実行可能な状態のままになり、待ちファイバーがアイドル時以外にも起床すること
+ * を確かめる
+ */
+static void SpinTask(void* a)
+{
+    X_UNUSED(a);
+
+    while (!s_done)
+    {
+        s_num_spins++;
+        xfiber_yield();
+    }
+}
+
+
+static void WaitTaskMain(void* a)
+{
+    char buf[8];
+    XMode events = 0;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "write", STACK_SIZE, WriteTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "spin", STACK_SIZE, SpinTask, NULL));
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_io_wait(s_pipe[0], X_FIBER_IO_READ, &events));
+    TEST_ASSERT_EQUAL(X_FIBER_IO_READ, events);
+    TEST_ASSERT_EQUAL(5, read(s_pipe[0], buf, sizeof(buf)));
+    TEST_ASSERT_TRUE(s_num_spins > 0);
+    s_done = true;
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void BusyTask(void* a)
+{
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_io_timed_wait(s_pipe[0], X_FIBER_IO_READ, NULL, x_msec_to_ticks(20)));
+}
+
+
+static void TimeoutTaskMain(void* a)
+{
+    XMode events = 0;
+    XFiber* busy;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_io_try_wait(-1, X_FIBER_IO_READ, &events));
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_io_try_wait(s_pipe[0], 0, &events));
+
+    /* 空のパイプは書き込み可能だが読み込みはできない */
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_io_try_wait(s_pipe[0], X_FIBER_IO_READ, &events));
+    TEST_ASSERT_EQUAL(0, events);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_io_try_wait(s_pipe[1], X_FIBER_IO_WRITE, &events));
+    TEST_ASSERT_EQUAL(X_FIBER_IO_WRITE, events);
+
+    /* アイドル中はepoll_wait()でタイマーの期限まで待つ */
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_io_timed_wait(s_pipe[0], X_FIBER_IO_READ, &events, x_msec_to_ticks(10)));
+    TEST_ASSERT_EQUAL(0, events);
+
+    /* 同じファイルディスクリプタは1つのファイバーしか待てない */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(&busy, PRIORITY, "busy", STACK_SIZE, BusyTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_BUSY, xfiber_io_timed_wait(s_pipe[0], X_FIBER_IO_READ, &events, x_msec_to_ticks(10)));
+
+    /* 待ち中のファイバーを破棄すると、登録も削除される */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_destroy(busy));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_io_timed_wait(s_pipe[0], X_FIBER_IO_READ, &events, x_msec_to_ticks(5)));
+
+    /* 書き込み側が閉じられたらエラーが通知される */
+    close(s_pipe[1]);
+    s_pipe[1] = -1;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_io_try_wait(s_pipe[0], X_FIBER_IO_READ, &events));
+    TEST_ASSERT_TRUE(events & X_FIBER_IO_ERROR);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_io, wait)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, WaitTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_io, timeout)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, TimeoutTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+#endif /* if X_CONF_FIBER_USE_EPOLL */
+
+
+TEST_GROUP_RUNNER(xfiber_io)
+{
+#if X_CONF_FIBER_USE_EPOLL
+    RUN_TEST_CASE(xfiber_io, wait);
+    RUN_TEST_CASE(xfiber_io, timeout);
+#endif
+}
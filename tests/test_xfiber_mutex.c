@@ -151,7 +151,7 @@ static void LockTaskMain(void* a)
     TEST_ASSERT_EQUAL(X_ERR_NONE, err);
     TEST_ASSERT_TRUE(x_msec_to_ticks(30) >= x_ticks_now() - start);
 
-    xfiber_mutex_unlock(arg->mutex);
+    xfiber_mutex_unlock(mutex);
 
     xfiber_mutex_destroy(mutex);
     xfiber_kernel_end_scheduler();
@@ -182,7 +182,7 @@ static void TimedLockTaskMain(void* a)
     err = xfiber_mutex_lock(mutex);
     TEST_ASSERT_EQUAL(X_ERR_NONE, err);
 
-    xfiber_mutex_unlock(arg->mutex);
+    xfiber_mutex_unlock(mutex);
 
     xfiber_mutex_destroy(mutex);
     xfiber_kernel_end_scheduler();
@@ -211,7 +211,7 @@ static void TryLockTaskMain(void* a)
     err = xfiber_mutex_try_lock(mutex);
     TEST_ASSERT_EQUAL(X_ERR_NONE, err);
 
-    xfiber_mutex_unlock(arg->mutex);
+    xfiber_mutex_unlock(mutex);
     xfiber_mutex_destroy(mutex);
     xfiber_kernel_end_scheduler();
 }
@@ -241,6 +241,116 @@ static void DestroyTaskMain(void* a)
 }
 
 
+/* 優先度逆転のシナリオ
+ *
+ * 低優先度(L)がロック中に高優先度(H)が獲得待ちになり、中優先度(M)がCPUを占有
+ * し続ける。優先度継承がなければLは実行されず、Hは永久に待たされる。
+ */
+#define INVERSION_SPIN_LIMIT    (100000)
+
+
+typedef struct
+{
+    XFiberMutex*    mutex_a;
+    XFiberMutex*    mutex_b;
+    volatile bool   high_acquired;
+    bool            hog_gave_up;
+    int             seq;
+    int             hog_done_seq;
+    int             low_done_seq;
+} InversionContext;
+
+
+static InversionContext inversion;
+
+
+static int ExitOnIdle(XTicks timeout)
+{
+    return timeout == X_TICKS_FOREVER;
+}
+
+
+static void InversionLowTask(void* a)
+{
+    int i;
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_lock(inversion.mutex_a));
+    xfiber_delay(x_msec_to_ticks(20));
+
+    /* ロック中にCPUを必要とする処理 */
+    for (i = 0; i < 10; i++)
+        xfiber_yield();
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_unlock(inversion.mutex_a));
+    inversion.low_done_seq = ++inversion.seq;
+}
+
+
+static void InversionMiddleTask(void* a)
+{
+    X_UNUSED(a);
+
+    /* mutex_bをロックしたままmutex_aを待つ(継承の連鎖) */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_lock(inversion.mutex_b));
+    xfiber_delay(x_msec_to_ticks(5));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_lock(inversion.mutex_a));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_unlock(inversion.mutex_a));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_unlock(inversion.mutex_b));
+}
+
+
+static void InversionHighTask(void* a)
+{
+    XFiberMutex* const mutex = a;
+
+    xfiber_delay(x_msec_to_ticks(10));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_lock(mutex));
+    inversion.high_acquired = true;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_unlock(mutex));
+}
+
+
+static void InversionHogTask(void* a)
+{
+    int i;
+    X_UNUSED(a);
+
+    xfiber_delay(x_msec_to_ticks(15));
+    for (i = 0; !inversion.high_acquired; i++)
+    {
+        if (i >= INVERSION_SPIN_LIMIT)
+        {
+            inversion.hog_gave_up = true;
+            break;
+        }
+        xfiber_yield();
+    }
+    inversion.hog_done_seq = ++inversion.seq;
+}
+
+
+static void SetupInversion(void)
+{
+    memset(&inversion, 0, sizeof(inversion));
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, ExitOnIdle);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_create(&inversion.mutex_a));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_create(&inversion.mutex_b));
+}
+
+
+static void TearDownInversion(void)
+{
+    /* Hは逆転せずにロックを獲得でき、Lはロック解除で本来の優先度に戻る */
+    TEST_ASSERT_TRUE(inversion.high_acquired);
+    TEST_ASSERT_FALSE(inversion.hog_gave_up);
+    TEST_ASSERT_TRUE(inversion.hog_done_seq < inversion.low_done_seq);
+
+    xfiber_mutex_destroy(inversion.mutex_a);
+    xfiber_mutex_destroy(inversion.mutex_b);
+}
+
+
 TEST(xfiber_mutex, lock)
 {
     xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
@@ -273,10 +383,36 @@ TEST(xfiber_mutex, destroy)
 }
 
 
+TEST(xfiber_mutex, priority_inheritance)
+{
+    SetupInversion();
+    xfiber_create(NULL, 1, "low", STACK_SIZE, InversionLowTask, NULL);
+    xfiber_create(NULL, 2, "hog", STACK_SIZE, InversionHogTask, NULL);
+    xfiber_create(NULL, 3, "high", STACK_SIZE, InversionHighTask, inversion.mutex_a);
+    xfiber_kernel_start_scheduler();
+    TearDownInversion();
+}
+
+
+TEST(xfiber_mutex, priority_inheritance_chain)
+{
+    /* high -> mutex_b(middle) -> mutex_a(low) と継承される */
+    SetupInversion();
+    xfiber_create(NULL, 1, "low", STACK_SIZE, InversionLowTask, NULL);
+    xfiber_create(NULL, 2, "middle", STACK_SIZE, InversionMiddleTask, NULL);
+    xfiber_create(NULL, 3, "hog", STACK_SIZE, InversionHogTask, NULL);
+    xfiber_create(NULL, 4, "high", STACK_SIZE, InversionHighTask, inversion.mutex_b);
+    xfiber_kernel_start_scheduler();
+    TearDownInversion();
+}
+
+
 TEST_GROUP_RUNNER(xfiber_mutex)
 {
     RUN_TEST_CASE(xfiber_mutex, lock);
     RUN_TEST_CASE(xfiber_mutex, timed_lock);
     RUN_TEST_CASE(xfiber_mutex, try_lock);
     RUN_TEST_CASE(xfiber_mutex, destroy);
+    RUN_TEST_CASE(xfiber_mutex, priority_inheritance);
+    RUN_TEST_CASE(xfiber_mutex, priority_inheritance_chain);
 }
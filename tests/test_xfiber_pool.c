@@ -165,6 +165,68 @@ static void DestroyTaskMain(void* a)
 }
 
 
+#define NUM_ORDER_WAITERS   (4)
+
+
+static XFiberPool* order_pool;
+static int release_order[NUM_ORDER_WAITERS];
+static int num_released;
+
+
+static void OrderGetTask(void* a)
+{
+    void* ptr = NULL;
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_pool_get(order_pool, &ptr));
+    release_order[num_released++] = (int)(intptr_t)a;
+    xfiber_pool_release(order_pool, ptr);
+}
+
+
+static void WaitOrderTaskMain(void* a)
+{
+    /* 待ちファイバーの生成順と優先度 */
+    static const int priorities[NUM_ORDER_WAITERS] = { 1, 3, 2, 3 };
+    const XMode wait_mode = (XMode)(intptr_t)a;
+    void* ptr = NULL;
+    int i;
+
+    num_released = 0;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_pool_create_ex(&order_pool, 16, 1, wait_mode));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_pool_get(order_pool, &ptr));
+
+    for (i = 0; i < NUM_ORDER_WAITERS; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE,
+                xfiber_create(NULL, priorities[i], "waiter", STACK_SIZE,
+                              OrderGetTask, (void*)(intptr_t)i));
+
+        /* 生成順にブロックさせる */
+        xfiber_delay(x_msec_to_ticks(2));
+    }
+
+    xfiber_pool_release(order_pool, ptr);
+    xfiber_delay(x_msec_to_ticks(10));
+
+    TEST_ASSERT_EQUAL(NUM_ORDER_WAITERS, num_released);
+    if (wait_mode == X_FIBER_WAIT_PRIORITY)
+    {
+        TEST_ASSERT_EQUAL(1, release_order[0]);
+        TEST_ASSERT_EQUAL(3, release_order[1]);
+        TEST_ASSERT_EQUAL(2, release_order[2]);
+        TEST_ASSERT_EQUAL(0, release_order[3]);
+    }
+    else
+    {
+        for (i = 0; i < NUM_ORDER_WAITERS; i++)
+            TEST_ASSERT_EQUAL(i, release_order[i]);
+    }
+
+    xfiber_pool_destroy(order_pool);
+    xfiber_kernel_end_scheduler();
+}
+
+
 TEST(xfiber_pool, get)
 {
     xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
@@ -189,9 +251,24 @@ TEST(xfiber_pool, destroy)
 }
 
 
+TEST(xfiber_pool, wait_order)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, WaitOrderTaskMain,
+                  (void*)(intptr_t)X_FIBER_WAIT_FIFO);
+    xfiber_kernel_start_scheduler();
+
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, WaitOrderTaskMain,
+                  (void*)(intptr_t)X_FIBER_WAIT_PRIORITY);
+    xfiber_kernel_start_scheduler();
+}
+
+
 TEST_GROUP_RUNNER(xfiber_pool)
 {
     RUN_TEST_CASE(xfiber_pool, get);
     RUN_TEST_CASE(xfiber_pool, timed_get);
     RUN_TEST_CASE(xfiber_pool, destroy);
+    RUN_TEST_CASE(xfiber_pool, wait_order);
 }
@@ -182,6 +182,141 @@ static void DestroyTaskMain(void* a)
 }
 
 
+#define NUM_ZERO_COPY_ITEMS     (20)
+
+
+/* ファイバーのスタックは小さいので、sprintf()は使わない */
+static void MakeItemName(char* dst, int index)
+{
+    strcpy(dst, "item");
+    dst[4] = (char)('A' + index);
+    dst[5] = '\0';
+}
+
+
+static void ZeroCopySendTask(void* a)
+{
+    XFiberQueue* const queue = a;
+    Message message;
+    void* ptr;
+    int i;
+
+    for (i = 0; i < NUM_ZERO_COPY_ITEMS; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_reserve_back(queue, &ptr));
+
+        /* 確保中は他の送信は待たされる */
+        message.index = -1;
+        TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_queue_try_send_back(queue, &message));
+
+        ((Message*)ptr)->index = i;
+        MakeItemName(((Message*)ptr)->str, i);
+        xfiber_queue_commit_back(queue);
+    }
+}
+
+
+static void ZeroCopyReceiveTaskMain(void* a)
+{
+    X_UNUSED(a);
+
+    XFiberQueue* queue;
+    Message msg;
+    char expected[16];
+    void* ptr;
+    int i;
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_create(&queue, 4, sizeof(Message)));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_queue_try_peek(queue, &ptr));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "sender", STACK_SIZE, ZeroCopySendTask, queue));
+
+    for (i = 0; i < NUM_ZERO_COPY_ITEMS; i++)
+    {
+        MakeItemName(expected, i);
+
+        /* 参照とコピーによる受信を交互に行う */
+        if (i % 2)
+        {
+            TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_receive(queue, &msg));
+            TEST_ASSERT_EQUAL(i, msg.index);
+            TEST_ASSERT_EQUAL_STRING(expected, msg.str);
+            continue;
+        }
+
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_peek(queue, &ptr));
+        TEST_ASSERT_EQUAL(i, ((Message*)ptr)->index);
+        TEST_ASSERT_EQUAL_STRING(expected, ((Message*)ptr)->str);
+
+        /* 参照中は他の受信は待たされる */
+        TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_queue_try_receive(queue, &msg));
+        xfiber_queue_consume(queue);
+    }
+
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_queue_try_receive(queue, &msg));
+    xfiber_queue_destroy(queue);
+    xfiber_kernel_end_scheduler();
+}
+
+
+#define NUM_BATCH_ITEMS     (100)
+#define BATCH_QUEUE_LEN     (8)
+
+
+static void BatchSendTask(void* a)
+{
+    XFiberQueue* const queue = a;
+    int items[30];
+    size_t num;
+    int sent = 0;
+    int i;
+
+    while (sent < NUM_BATCH_ITEMS)
+    {
+        const int n = X_MIN((int)X_COUNT_OF(items), NUM_BATCH_ITEMS - sent);
+        for (i = 0; i < n; i++)
+            items[i] = sent + i;
+
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_send_back_n(queue, items, n, &num));
+        TEST_ASSERT_TRUE((num >= 1) && ((int)num <= n));
+        sent += num;
+    }
+}
+
+
+static void BatchReceiveTaskMain(void* a)
+{
+    X_UNUSED(a);
+
+    XFiberQueue* queue;
+    int items[16];
+    size_t num;
+    size_t max_num = 0;
+    int received = 0;
+    size_t i;
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_create(&queue, BATCH_QUEUE_LEN, sizeof(int)));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_queue_try_receive_n(queue, items, X_COUNT_OF(items), &num));
+    TEST_ASSERT_EQUAL(0, num);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "sender", STACK_SIZE, BatchSendTask, queue));
+
+    while (received < NUM_BATCH_ITEMS)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_receive_n(queue, items, X_COUNT_OF(items), &num));
+        for (i = 0; i < num; i++)
+            TEST_ASSERT_EQUAL(received + (int)i, items[i]);
+        received += num;
+        max_num = X_MAX(max_num, num);
+    }
+
+    /* 送信待ちのファイバーを解放しながら、キューの長さを超えて受信できる */
+    TEST_ASSERT_EQUAL(NUM_BATCH_ITEMS, received);
+    TEST_ASSERT_TRUE(max_num > BATCH_QUEUE_LEN);
+
+    xfiber_queue_destroy(queue);
+    xfiber_kernel_end_scheduler();
+}
+
+
 TEST(xfiber_queue, receive)
 {
     xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
@@ -206,9 +341,27 @@ TEST(xfiber_queue, destroy)
 }
 
 
+TEST(xfiber_queue, zero_copy)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, ZeroCopyReceiveTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_queue, batch)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, BatchReceiveTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
 TEST_GROUP_RUNNER(xfiber_queue)
 {
     RUN_TEST_CASE(xfiber_queue, receive);
     RUN_TEST_CASE(xfiber_queue, timed_receive);
     RUN_TEST_CASE(xfiber_queue, destroy);
+    RUN_TEST_CASE(xfiber_queue, zero_copy);
+    RUN_TEST_CASE(xfiber_queue, batch);
 }
@@ -0,0 +1,142 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#define KERNEL_WORK_SIZE    (1024 * 20)
+#define STACK_SIZE          (2048)
+#define PRIORITY            (4)
+#define NUM_ITEMS           (10)
+
+
+TEST_GROUP(xfiber_ring);
+
+
+static XFiberRing* ring;
+static int num_pushed;
+static int sum_received;
+
+
+TEST_SETUP(xfiber_ring)
+{
+    num_pushed = 0;
+    sum_received = 0;
+}
+
+
+TEST_TEAR_DOWN(xfiber_ring)
+{
+}
+
+
+/* アイドル中に割込みが発生したとみなして、リングに要素を追加する */
+static int PushOnIdle(XTicks timeout)
+{
+    X_UNUSED(timeout);
+
+    if (ring && (num_pushed < NUM_ITEMS))
+    {
+        num_pushed++;
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_push_isr(ring, &num_pushed));
+    }
+
+    return 0;
+}
+
+
+static void PushPopTaskMain(void* a)
+{
+    int value;
+    int i;
+
+    X_UNUSED(a);
+
+    /* 要素数は2のべき乗に切り上げられる */
+    TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_ring_create(&ring, 0, sizeof(int)));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_create(&ring, 3, sizeof(int)));
+    for (i = 0; i < 4; i++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_push_isr(ring, &i));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_ring_push_isr(ring, &i));
+    TEST_ASSERT_EQUAL(4, xfiber_ring_count(ring));
+
+    for (i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_try_receive(ring, &value));
+        TEST_ASSERT_EQUAL(i, value);
+    }
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_ring_try_receive(ring, &value));
+
+    /* 読み書き位置が一周しても順序は保たれる */
+    for (i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_push_isr(ring, &i));
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_receive(ring, &value));
+        TEST_ASSERT_EQUAL(i, value);
+    }
+
+    xfiber_ring_destroy(ring);
+    ring = NULL;
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void ReceiveTaskMain(void* a)
+{
+    XFiberSelectItem item;
+    int value;
+    int index;
+    int i;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_create(&ring, 4, sizeof(int)));
+
+    /* 受信待ちのファイバーは、アイドル中の追加で起床する */
+    for (i = 1; i <= NUM_ITEMS / 2; i++)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_receive(ring, &value));
+        TEST_ASSERT_EQUAL(i, value);
+        sum_received += value;
+    }
+
+    item.object = ring;
+    item.mode = X_FIBER_SELECT_READ;
+    item.pattern = 0;
+    while (sum_received < NUM_ITEMS * (NUM_ITEMS + 1) / 2)
+    {
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_select(&item, 1, &index));
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_ring_try_receive(ring, &value));
+        sum_received += value;
+    }
+
+    /* 追加されなければタイムアウトする */
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_ring_timed_receive(ring, &value, x_msec_to_ticks(5)));
+
+    xfiber_ring_destroy(ring);
+    ring = NULL;
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_ring, push_pop)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, PushPopTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_ring, receive)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, PushOnIdle);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, ReceiveTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+
+    TEST_ASSERT_EQUAL(NUM_ITEMS, num_pushed);
+}
+
+
+TEST_GROUP_RUNNER(xfiber_ring)
+{
+    RUN_TEST_CASE(xfiber_ring, push_pop);
+    RUN_TEST_CASE(xfiber_ring, receive);
+}
@@ -0,0 +1,166 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#define KERNEL_WORK_SIZE    (1024 * 20)
+#define STACK_SIZE          (2048)
+#define PRIORITY            (4)
+#define NUM_READERS         (3)
+
+
+TEST_GROUP(xfiber_rwlock);
+
+
+static XFiberRwLock* rwlock;
+static int num_reading;
+static int max_reading;
+static char order[8];
+static int num_order;
+
+
+TEST_SETUP(xfiber_rwlock)
+{
+    num_reading = 0;
+    max_reading = 0;
+    num_order = 0;
+    memset(order, 0, sizeof(order));
+}
+
+
+TEST_TEAR_DOWN(xfiber_rwlock)
+{
+}
+
+
+static void ReadTask(void* a)
+{
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_lock(rwlock));
+    order[num_order++] = 'r';
+    if (++num_reading > max_reading)
+        max_reading = num_reading;
+    xfiber_delay(x_msec_to_ticks(5));
+    num_reading--;
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_unlock(rwlock));
+}
+
+
+static void WriteTask(void* a)
+{
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_lock(rwlock));
+    order[num_order++] = 'w';
+    TEST_ASSERT_EQUAL(0, num_reading);
+    xfiber_delay(x_msec_to_ticks(5));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_unlock(rwlock));
+}
+
+
+static void ReaderWriterTaskMain(void* a)
+{
+    int i;
+
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_create(&rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_PROTOCOL, xfiber_rwlock_read_unlock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_PROTOCOL, xfiber_rwlock_write_unlock(rwlock));
+
+    /* 読み込みロックは同時に獲得でき、書き込みロックとは排他 */
+    for (i = 0; i < NUM_READERS; i++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "reader", STACK_SIZE, ReadTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(NUM_READERS, max_reading);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_rwlock_try_write_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_lock(rwlock));
+    TEST_ASSERT_EQUAL(0, num_reading);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_rwlock_try_read_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_rwlock_timed_write_lock(rwlock, x_msec_to_ticks(5)));
+
+    /* 書き込みロックの解除で、待っていた読み込みはまとめて起床する */
+    num_order = 0;
+    max_reading = 0;
+    for (i = 0; i < NUM_READERS; i++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "reader", STACK_SIZE, ReadTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(0, num_order);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_unlock(rwlock));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(NUM_READERS, max_reading);
+
+    /* 読み込み優先では、書き込み待ちを読み込みが追い越す */
+    num_order = 0;
+    memset(order, 0, sizeof(order));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "writer", STACK_SIZE, WriteTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "reader", STACK_SIZE, ReadTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_unlock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_lock(rwlock));
+    TEST_ASSERT_EQUAL_STRING("rw", order);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_unlock(rwlock));
+
+    xfiber_rwlock_destroy(rwlock);
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void PreferWriterTaskMain(void* a)
+{
+    X_UNUSED(a);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_create_ex(&rwlock, X_FIBER_WAIT_FIFO, true));
+
+    /* 書き込み待ちがいれば、後から来た読み込みは待たされる */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "writer", STACK_SIZE, WriteTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "reader", STACK_SIZE, ReadTask, NULL));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_rwlock_try_read_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_unlock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_lock(rwlock));
+    TEST_ASSERT_EQUAL_STRING("wr", order);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_unlock(rwlock));
+
+    /* 書き込み待ちがタイムアウトしたら、後ろの読み込み待ちは起床する */
+    num_order = 0;
+    memset(order, 0, sizeof(order));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "reader", STACK_SIZE, ReadTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_rwlock_timed_write_lock(rwlock, x_msec_to_ticks(5)));
+    xfiber_yield();
+    TEST_ASSERT_EQUAL_STRING("r", order);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_read_unlock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_lock(rwlock));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_rwlock_write_unlock(rwlock));
+
+    xfiber_rwlock_destroy(rwlock);
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_rwlock, reader_writer)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, ReaderWriterTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_rwlock, prefer_writer)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, PreferWriterTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST_GROUP_RUNNER(xfiber_rwlock)
+{
+    RUN_TEST_CASE(xfiber_rwlock, reader_writer);
+    RUN_TEST_CASE(xfiber_rwlock, prefer_writer);
+}
@@ -0,0 +1,276 @@
+#include <picox/multitask/xfiber.h>
+#include "testutils.h"
+
+
+#define KERNEL_WORK_SIZE    (1024 * 20)
+#define STACK_SIZE          (2048)
+#define PRIORITY            (4)
+
+
+TEST_GROUP(xfiber_select);
+
+
+static XFiberQueue* s_queue;
+static XFiberChannel* s_channel;
+static XFiberEvent* s_event;
+static XFiberSemaphore* s_semaphore;
+static XFiberMailbox* s_mailbox;
+static XFiberPool* s_pool;
+static XFiberMessage s_message;
+
+
+TEST_SETUP(xfiber_select)
+{
+}
+
+
+TEST_TEAR_DOWN(xfiber_select)
+{
+}
+
+
+static void CreateObjects(void)
+{
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_create(&s_queue, 2, sizeof(int)));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_create(&s_channel, 64, 16));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_event_create(&s_event));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_create(&s_semaphore, 0));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mailbox_create(&s_mailbox));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_pool_create(&s_pool, 16, 1));
+}
+
+
+static void SetItem(XFiberSelectItem* item, void* object, XMode mode, XBits pattern)
+{
+    item->object = object;
+    item->mode = mode;
+    item->pattern = pattern;
+}
+
+
+/* 少しずつ遅延させながら、各オブジェクトを使用可能にしていく */
+static void WakeTask(void* a)
+{
+    const char msg[] = "hello";
+    int value = 100;
+
+    X_UNUSED(a);
+
+    xfiber_delay(x_msec_to_ticks(5));
+    xfiber_queue_send_back(s_queue, &value);
+
+    xfiber_delay(x_msec_to_ticks(5));
+    xfiber_channel_send(s_channel, msg, sizeof(msg));
+
+    xfiber_delay(x_msec_to_ticks(5));
+    xfiber_event_set(s_event, 0x03);
+
+    xfiber_delay(x_msec_to_ticks(5));
+    xfiber_semaphore_give(s_semaphore);
+
+    xfiber_delay(x_msec_to_ticks(5));
+    xfiber_mailbox_send(s_mailbox, &s_message);
+}
+
+
+static void WaitTaskMain(void* a)
+{
+    XFiberSelectItem items[5];
+    XFiberMessage* message;
+    char buf[16];
+    size_t size;
+    XBits bits;
+    int value;
+    int index;
+    int i;
+
+    X_UNUSED(a);
+
+    CreateObjects();
+    SetItem(&items[0], s_queue, X_FIBER_SELECT_READ, 0);
+    SetItem(&items[1], s_channel, X_FIBER_SELECT_READ, 0);
+    SetItem(&items[2], s_event, X_FIBER_EVENT_WAIT_AND, 0x03);
+    SetItem(&items[3], s_semaphore, 0, 0);
+    SetItem(&items[4], s_mailbox, 0, 0);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "wake", STACK_SIZE, WakeTask, NULL));
+
+    /* 使用可能になった順に通知され、通知後のポーリングは成功すること */
+    for (i = 0; i < 5; i++)
+    {
+        index = -1;
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_select(items, 5, &index));
+        TEST_ASSERT_EQUAL(i, index);
+
+        switch (index)
+        {
+            case 0:
+                TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_try_receive(s_queue, &value));
+                TEST_ASSERT_EQUAL(100, value);
+                break;
+            case 1:
+                TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_channel_try_receive(s_channel, buf, &size));
+                TEST_ASSERT_EQUAL_STRING("hello", buf);
+                break;
+            case 2:
+                TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_event_try_wait(s_event, X_FIBER_EVENT_WAIT_AND | X_FIBER_EVENT_CLEAR_ON_EXIT, 0x03, &bits));
+                break;
+            case 3:
+                TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_try_take(s_semaphore));
+                break;
+            case 4:
+                TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mailbox_try_receive(s_mailbox, &message));
+                TEST_ASSERT_EQUAL_PTR(&s_message, message);
+                break;
+        }
+    }
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void PollTaskMain(void* a)
+{
+    XFiberSelectItem items[3];
+    void* mem;
+    int index = -1;
+
+    X_UNUSED(a);
+
+    CreateObjects();
+    SetItem(&items[0], s_event, X_FIBER_EVENT_WAIT_OR, 0x10);
+    SetItem(&items[1], s_pool, 0, 0);
+    SetItem(&items[2], s_semaphore, 0, 0);
+
+    /* 複数が使用可能であればインデックスの小さい方を返す */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_give(s_semaphore));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_select(items, 3, &index));
+    TEST_ASSERT_EQUAL(1, index);
+
+    /* 通知するだけで、オブジェクトの状態は変えない */
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_pool_try_get(s_pool, &mem));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_select(items, 3, &index));
+    TEST_ASSERT_EQUAL(2, index);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_semaphore_try_take(s_semaphore));
+
+    index = -1;
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_try_select(items, 3, &index));
+    TEST_ASSERT_EQUAL(-1, index);
+
+    /* 待ち条件に一致しないイベントでは通知されない */
+    xfiber_event_set(s_event, 0x01);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_timed_select(items, 3, &index, x_msec_to_ticks(10)));
+    xfiber_event_set(s_event, 0x10);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_select(items, 3, &index));
+    TEST_ASSERT_EQUAL(0, index);
+
+    /* ミューテックスは指定できない */
+    {
+        XFiberMutex* mutex;
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_mutex_create(&mutex));
+        SetItem(&items[0], mutex, 0, 0);
+        TEST_ASSERT_EQUAL(X_ERR_INVALID, xfiber_try_select(items, 1, &index));
+        xfiber_mutex_destroy(mutex);
+    }
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void ReceiveTask(void* a)
+{
+    int value;
+
+    X_UNUSED(a);
+
+    xfiber_delay(x_msec_to_ticks(10));
+    xfiber_queue_receive(s_queue, &value);
+    TEST_ASSERT_EQUAL(1, value);
+}
+
+
+static void DestroyTask(void* a)
+{
+    X_UNUSED(a);
+
+    xfiber_delay(x_msec_to_ticks(10));
+    xfiber_semaphore_destroy(s_semaphore);
+}
+
+
+static void WriteTaskMain(void* a)
+{
+    XFiberSelectItem items[2];
+    char buf[16];
+    int value;
+    int index = -1;
+
+    X_UNUSED(a);
+
+    CreateObjects();
+
+    /* 満杯のキューが送信可能になるまで待つ */
+    for (value = 1; value <= 2; value++)
+        TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_try_send_back(s_queue, &value));
+
+    SetItem(&items[0], s_queue, X_FIBER_SELECT_WRITE, 0);
+    SetItem(&items[1], s_channel, X_FIBER_SELECT_READ, 0);
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_try_select(items, 2, &index));
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "recv", STACK_SIZE, ReceiveTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_select(items, 2, &index));
+    TEST_ASSERT_EQUAL(0, index);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_queue_try_send_back(s_queue, &value));
+
+    /* チャンネルは最大サイズのメッセージを格納できれば送信可能 */
+    SetItem(&items[0], s_channel, X_FIBER_SELECT_WRITE, 0);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_select(items, 1, &index));
+    memset(buf, 0, sizeof(buf));
+    while (xfiber_channel_try_send(s_channel, buf, sizeof(buf)) == X_ERR_NONE)
+        ;
+    TEST_ASSERT_EQUAL(X_ERR_TIMED_OUT, xfiber_try_select(items, 1, &index));
+
+    /* 待ち中のオブジェクトが破棄されたらX_ERR_CANCELED */
+    SetItem(&items[0], s_semaphore, 0, 0);
+    SetItem(&items[1], s_mailbox, 0, 0);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "destroy", STACK_SIZE, DestroyTask, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_CANCELED, xfiber_select(items, 2, &index));
+
+    /* 残った待ちノードは外れていること */
+    xfiber_mailbox_send(s_mailbox, &s_message);
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_try_select(&items[1], 1, &index));
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_select, wait)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, WaitTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_select, poll)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, PollTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST(xfiber_select, write_and_cancel)
+{
+    xfiber_kernel_init(NULL, KERNEL_WORK_SIZE, NULL);
+    xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, WriteTaskMain, NULL);
+    xfiber_kernel_start_scheduler();
+}
+
+
+TEST_GROUP_RUNNER(xfiber_select)
+{
+    RUN_TEST_CASE(xfiber_select, wait);
+    RUN_TEST_CASE(xfiber_select, poll);
+    RUN_TEST_CASE(xfiber_select, write_and_cancel);
+}
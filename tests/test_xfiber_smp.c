@@ -0,0 +1,441 @@
+#include <picox/multitask/xfiber.h>
+#include <pthread.h>
+#include <time.h>
+#include "testutils.h"
+
+
+/* X_CONF_FIBER_USE_SMPを有効にしたxfiberのテストです
+ *
+ * ファイバーは複数のワーカースレッドで実行されるので、Unityのアサーションはフ
+ * ァイバー内では使用せず、結果を記録しておいてスケジューラの終了後に検証する。
+ */
+
+
+#define KERNEL_WORK_SIZE    (1024 * 64)
+#define STACK_SIZE          (1024 * 8)
+#define PRIORITY            (4)
+#define NUM_WORKERS         (4)
+
+
+TEST_GROUP(xfiber_smp);
+
+
+static pthread_t s_main_thread;
+
+
+TEST_SETUP(xfiber_smp)
+{
+    s_main_thread = pthread_self();
+}
+
+
+TEST_TEAR_DOWN(xfiber_smp)
+{
+}
+
+
+static void RunSmp(XFiberFunc func, size_t heap_size, int num_workers)
+{
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_kernel_init(NULL, heap_size, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_create(NULL, PRIORITY, "main", STACK_SIZE, func, NULL));
+    TEST_ASSERT_EQUAL(X_ERR_NONE, xfiber_kernel_start_scheduler_smp(num_workers));
+}
+
+
+static uint64_t NowNSec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+/* ファイバーを止めずに、実行中のワーカースレッドだけを塞ぐ */
+static void BlockWorker(int msec)
+{
+    struct timespec ts;
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+
+#define NUM_PAIRS           (4)
+#define NUM_ITEMS           (2000)
+#define QUEUE_LEN           (4)
+
+
+typedef struct Pair
+{
+    XFiberQueue*    queue;
+    long            sum;
+} Pair;
+
+
+static Pair s_pairs[NUM_PAIRS];
+
+
+static void ProducerTask(void* arg)
+{
+    Pair* const pair = arg;
+    int i;
+
+    for (i = 1; i <= NUM_ITEMS; i++)
+        xfiber_queue_send_back(pair->queue, &i);
+}
+
+
+static void ConsumerTask(void* arg)
+{
+    Pair* const pair = arg;
+    int value;
+    int i;
+
+    for (i = 0; i < NUM_ITEMS; i++)
+    {
+        xfiber_queue_receive(pair->queue, &value);
+        pair->sum += value;
+    }
+}
+
+
+static void QueueMainTask(void* arg)
+{
+    XFiber* fibers[NUM_PAIRS * 2];
+    int i;
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        s_pairs[i].sum = 0;
+        xfiber_queue_create(&s_pairs[i].queue, QUEUE_LEN, sizeof(int));
+        xfiber_create_joinable(&fibers[i * 2], PRIORITY, "producer", STACK_SIZE, ProducerTask, &s_pairs[i]);
+        xfiber_create_joinable(&fibers[i * 2 + 1], PRIORITY, "consumer", STACK_SIZE, ConsumerTask, &s_pairs[i]);
+    }
+
+    /* 合流したファイバーは、他のワーカーで実行を終えた直後でも解放できる */
+    for (i = 0; i < NUM_PAIRS * 2; i++)
+        xfiber_join(fibers[i], NULL);
+
+    for (i = 0; i < NUM_PAIRS; i++)
+        xfiber_queue_destroy(s_pairs[i].queue);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_smp, queue)
+{
+    const long expected = (long)NUM_ITEMS * (NUM_ITEMS + 1) / 2;
+    int i;
+
+    RunSmp(QueueMainTask, KERNEL_WORK_SIZE, NUM_WORKERS);
+
+    /* ワーカー間で受け渡しても取りこぼしがない */
+    for (i = 0; i < NUM_PAIRS; i++)
+        TEST_ASSERT_EQUAL(expected, s_pairs[i].sum);
+}
+
+
+#define NUM_LOCKERS         (8)
+#define NUM_LOCKS           (200)
+
+
+static XFiberMutex* s_mutex;
+static int s_counter;
+static pthread_t s_threads[NUM_WORKERS];
+static int s_num_threads;
+
+
+static void RecordThread(void)
+{
+    const pthread_t self = pthread_self();
+    int i;
+
+    for (i = 0; i < s_num_threads; i++)
+    {
+        if (pthread_equal(s_threads[i], self))
+            return;
+    }
+    if (s_num_threads < NUM_WORKERS)
+        s_threads[s_num_threads++] = self;
+}
+
+
+static void LockerTask(void* arg)
+{
+    int i;
+    int value;
+    X_UNUSED(arg);
+
+    for (i = 0; i < NUM_LOCKS; i++)
+    {
+        xfiber_mutex_lock(s_mutex);
+        RecordThread();
+
+        /* ロック中に切り替わっても、他のファイバーに割り込まれない */
+        value = s_counter;
+        if (i == 0)
+        {
+            /* ロックを保持したままワーカーを塞ぎ、他のワーカーに残りのファイ
+             * バーを奪わせる
+             */
+            BlockWorker(5);
+        }
+        xfiber_yield();
+        s_counter = value + 1;
+        xfiber_mutex_unlock(s_mutex);
+
+        /* 実行中のファイバーを奪わせるために、レディキューに戻る */
+        xfiber_yield();
+    }
+}
+
+
+static void MutexMainTask(void* arg)
+{
+    XFiber* fibers[NUM_LOCKERS];
+    int i;
+    X_UNUSED(arg);
+
+    xfiber_mutex_create(&s_mutex);
+    for (i = 0; i < NUM_LOCKERS; i++)
+        xfiber_create_joinable(&fibers[i], PRIORITY, "locker", STACK_SIZE, LockerTask, NULL);
+    for (i = 0; i < NUM_LOCKERS; i++)
+        xfiber_join(fibers[i], NULL);
+    xfiber_mutex_destroy(s_mutex);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_smp, mutex)
+{
+    s_counter = 0;
+    s_num_threads = 0;
+
+    RunSmp(MutexMainTask, KERNEL_WORK_SIZE, NUM_WORKERS);
+
+    TEST_ASSERT_EQUAL(NUM_LOCKERS * NUM_LOCKS, s_counter);
+
+    /* 休止していたワーカーが起こされて、ファイバーを奪っている */
+    TEST_ASSERT_TRUE(s_num_threads >= 2);
+}
+
+
+#define NUM_WAITERS         (8)
+
+
+static XFiberEvent* s_event;
+static int s_num_woken;
+
+
+static void WaiterTask(void* arg)
+{
+    const XBits bit = (XBits)1 << (uintptr_t)arg;
+
+    if (xfiber_event_wait(s_event, X_FIBER_EVENT_WAIT_OR, bit, NULL) == X_ERR_NONE)
+        __atomic_add_fetch(&s_num_woken, 1, __ATOMIC_RELAXED);
+}
+
+
+static void EventMainTask(void* arg)
+{
+    XFiber* fibers[NUM_WAITERS];
+    uintptr_t i;
+    X_UNUSED(arg);
+
+    xfiber_event_create(&s_event);
+    for (i = 0; i < NUM_WAITERS; i++)
+        xfiber_create_joinable(&fibers[i], PRIORITY, "waiter", STACK_SIZE, WaiterTask, (void*)i);
+
+    /* 待ちに入ったファイバーを、それぞれのワーカーのキューに戻す */
+    xfiber_delay(10);
+    for (i = 0; i < NUM_WAITERS; i++)
+        xfiber_event_set(s_event, (XBits)1 << i);
+    for (i = 0; i < NUM_WAITERS; i++)
+        xfiber_join(fibers[i], NULL);
+    xfiber_event_destroy(s_event);
+
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_smp, event)
+{
+    s_num_woken = 0;
+
+    RunSmp(EventMainTask, KERNEL_WORK_SIZE, NUM_WORKERS);
+
+    TEST_ASSERT_EQUAL(NUM_WAITERS, s_num_woken);
+}
+
+
+#define NUM_SHORT_LIVED     (500)
+
+
+static XFiberSemaphore* s_done;
+static int s_num_failures;
+
+
+static void ShortLivedTask(void* arg)
+{
+    X_UNUSED(arg);
+    xfiber_semaphore_give(s_done);
+}
+
+
+static void FreeMainTask(void* arg)
+{
+    XFiber* fiber;
+    int i;
+    X_UNUSED(arg);
+
+    xfiber_semaphore_create(&s_done, 0);
+
+    /* 終了したファイバーは、スイッチ先のワーカーで解放される。解放されなければ
+     * 小さなカーネルヒープはすぐに枯渇する。
+     */
+    for (i = 0; i < NUM_SHORT_LIVED; i++)
+    {
+        if (xfiber_create(NULL, PRIORITY, "detached", STACK_SIZE, ShortLivedTask, NULL) != X_ERR_NONE)
+        {
+            s_num_failures++;
+            break;
+        }
+        xfiber_semaphore_take(s_done);
+    }
+
+    for (i = 0; i < NUM_SHORT_LIVED; i++)
+    {
+        if (xfiber_create_joinable(&fiber, PRIORITY, "joinable", STACK_SIZE, ShortLivedTask, NULL) != X_ERR_NONE)
+        {
+            s_num_failures++;
+            break;
+        }
+        xfiber_semaphore_take(s_done);
+        xfiber_join(fiber, NULL);
+    }
+
+    xfiber_semaphore_destroy(s_done);
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_smp, free_exited)
+{
+    s_num_failures = 0;
+
+    RunSmp(FreeMainTask, STACK_SIZE * 8, NUM_WORKERS);
+
+    TEST_ASSERT_EQUAL(0, s_num_failures);
+}
+
+
+static XFiberSemaphore* s_wakeup;
+static pthread_t s_sleeper_thread;
+static volatile int s_sleeper_waiting;
+static XError s_sleeper_result;
+static uint64_t s_give_time;
+static uint64_t s_wake_time;
+
+
+static void SleeperTask(void* arg)
+{
+    X_UNUSED(arg);
+
+    s_sleeper_thread = pthread_self();
+    __atomic_store_n(&s_sleeper_waiting, 1, __ATOMIC_RELEASE);
+    s_sleeper_result = xfiber_semaphore_timed_take(s_wakeup, 1000);
+    s_wake_time = NowNSec();
+}
+
+
+static void WakeupMainTask(void* arg)
+{
+    XFiber* sleeper;
+    X_UNUSED(arg);
+
+    xfiber_semaphore_create(&s_wakeup, 0);
+    xfiber_create_joinable(&sleeper, PRIORITY, "sleeper", STACK_SIZE, SleeperTask, NULL);
+
+    /* このワーカーを塞いでいる間に、他のワーカーがsleeperを奪って待ちに入り、
+     * 自分は休止する
+     */
+    while (!__atomic_load_n(&s_sleeper_waiting, __ATOMIC_ACQUIRE))
+        BlockWorker(10);
+    BlockWorker(50);
+
+    /* sleeperを起床させた後もこのワーカーは塞いだままにして、休止中のワーカー
+     * 自身に実行させる
+     */
+    s_give_time = NowNSec();
+    xfiber_semaphore_give(s_wakeup);
+    BlockWorker(300);
+
+    xfiber_join(sleeper, NULL);
+    xfiber_semaphore_destroy(s_wakeup);
+    xfiber_kernel_end_scheduler();
+}
+
+
+TEST(xfiber_smp, wakeup_idle_worker)
+{
+    s_sleeper_waiting = 0;
+    s_sleeper_result = X_ERR_OTHER;
+
+    RunSmp(WakeupMainTask, KERNEL_WORK_SIZE, 2);
+
+    TEST_ASSERT_EQUAL(X_ERR_NONE, s_sleeper_result);
+    TEST_ASSERT_TRUE(s_wake_time - s_give_time < 200 * 1000000u);
+}
+
+
+static pthread_t s_ender_thread;
+
+
+static void EnderTask(void* arg)
+{
+    X_UNUSED(arg);
+    s_ender_thread = pthread_self();
+    xfiber_kernel_end_scheduler();
+}
+
+
+static void EndMainTask(void* arg)
+{
+    X_UNUSED(arg);
+
+    /* 最初のワーカー以外で実行されていれば、そのまま終了させる */
+    if (!pthread_equal(pthread_self(), s_main_thread))
+        EnderTask(NULL);
+
+    /* このワーカーを塞いで、enderを他のワーカーで実行させる */
+    xfiber_create(NULL, PRIORITY, "ender", STACK_SIZE, EnderTask, NULL);
+    BlockWorker(50);
+
+    /* 次のスケジューリングで終了要求に気付いて戻る */
+    for (;;)
+        xfiber_yield();
+}
+
+
+TEST(xfiber_smp, end_from_other_worker)
+{
+    s_ender_thread = s_main_thread;
+
+    RunSmp(EndMainTask, KERNEL_WORK_SIZE, 2);
+
+    TEST_ASSERT_FALSE(pthread_equal(s_main_thread, s_ender_thread));
+}
+
+
+TEST_GROUP_RUNNER(xfiber_smp)
+{
+    RUN_TEST_CASE(xfiber_smp, queue);
+    RUN_TEST_CASE(xfiber_smp, mutex);
+    RUN_TEST_CASE(xfiber_smp, event);
+    RUN_TEST_CASE(xfiber_smp, free_exited);
+    RUN_TEST_CASE(xfiber_smp, wakeup_idle_worker);
+    RUN_TEST_CASE(xfiber_smp, end_from_other_worker);
+}
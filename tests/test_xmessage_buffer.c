@@ -254,6 +254,51 @@ TEST(xmsgbuf, boundary)
 }
 
 
+TEST(xmsgbuf, prepare_and_commit)
+{
+    char buf[X__BUF_SIZE];
+    uint8_t expected[100];
+    uint8_t* msg;
+    size_t size;
+    int i;
+
+    /* 空の時は先頭から詰め直される */
+    memset(buf, 0, sizeof(buf));
+    xmsgbuf_push(mbuf, buf, 100);
+    xmsgbuf_pull(mbuf, buf);
+    msg = xmsgbuf_prepare(mbuf, 100);
+    TEST_ASSERT_EQUAL_PTR(xmsgbuf_data(mbuf) + sizeof(XMessageHeader), msg);
+
+    /* 終端をまたぐ場合は詰め物を挟んで先頭に配置される */
+    memset(msg, 1, 100);
+    xmsgbuf_commit(mbuf, msg, 100);
+    msg = xmsgbuf_prepare(mbuf, 100);
+    memset(msg, 2, 100);
+    xmsgbuf_commit(mbuf, msg, 100);
+    xmsgbuf_pull(mbuf, buf);
+
+    msg = xmsgbuf_prepare(mbuf, 100);
+    TEST_ASSERT_EQUAL_PTR(xmsgbuf_data(mbuf) + sizeof(XMessageHeader), msg);
+    memset(msg, 3, 50);
+    xmsgbuf_commit(mbuf, msg, 50);
+    TEST_ASSERT_EQUAL(2, xmsgbuf_num(mbuf));
+
+    /* 連続した領域が足りなければNULL */
+    TEST_ASSERT_NULL(xmsgbuf_prepare(mbuf, 100));
+
+    for (i = 2; i <= 3; i++)
+    {
+        msg = xmsgbuf_peek(mbuf, &size);
+        TEST_ASSERT_EQUAL(i == 2 ? 100 : 50, size);
+        memset(expected, i, sizeof(expected));
+        TEST_ASSERT_EQUAL_MEMORY(expected, msg, size);
+        xmsgbuf_skip(mbuf);
+    }
+    TEST_ASSERT_TRUE(xmsgbuf_empty(mbuf));
+    TEST_ASSERT_NULL(xmsgbuf_peek(mbuf, &size));
+}
+
+
 TEST_GROUP_RUNNER(xmsgbuf)
 {
     RUN_TEST_CASE(xmsgbuf, init);
@@ -270,4 +315,5 @@ TEST_GROUP_RUNNER(xmsgbuf)
     RUN_TEST_CASE(xmsgbuf, push);
     RUN_TEST_CASE(xmsgbuf, pull);
     RUN_TEST_CASE(xmsgbuf, boundary);
+    RUN_TEST_CASE(xmsgbuf, prepare_and_commit);
 }
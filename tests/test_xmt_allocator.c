@@ -0,0 +1,237 @@
+#include <picox/allocator/xmt_allocator.h>
+#include <unity.h>
+#include <unity_fixture.h>
+#include "testutils.h"
+
+
+TEST_GROUP(xmtalloc);
+
+
+#define X__HEAP_SIZE        (1024 * 256)
+#define X__ALIGNMENT        X_ALIGN_OF(XMaxAlign)
+#define X__NUM_THREADS      (4)
+#define X__NUM_SLOTS        (64)
+#define X__NUM_LOOPS        (20000)
+
+
+typedef struct X__Worker
+{
+    pthread_t       thread;
+    unsigned        seed;
+    void*           slots[X__NUM_SLOTS];
+    size_t          sizes[X__NUM_SLOTS];
+    bool            ok;
+} X__Worker;
+
+
+static XMtAllocator alloc;
+static X__Worker workers[X__NUM_THREADS];
+static pthread_barrier_t barrier;
+
+
+TEST_SETUP(xmtalloc)
+{
+    TEST_ASSERT_TRUE(xmtalloc_init(&alloc, NULL, X__HEAP_SIZE, X__ALIGNMENT));
+}
+
+
+TEST_TEAR_DOWN(xmtalloc)
+{
+    xmtalloc_deinit(&alloc);
+}
+
+
+static size_t X__RandomSize(unsigned* seed)
+{
+    /* 大半はキャッシュの対象になるサイズにする */
+    const int r = rand_r(seed);
+    if (r % 8 == 0)
+        return (r % 1024) + 1;
+    return (r % (X__ALIGNMENT * X_CONF_XMTALLOC_NUM_CLASSES)) + 1;
+}
+
+
+/* Unityはスレッドセーフではないので、ワーカーは結果だけを返す */
+static bool X__Fill(void* ptr, size_t size, uint8_t value)
+{
+    if ((!ptr) || (!x_is_aligned(ptr, X__ALIGNMENT)))
+        return false;
+    memset(ptr, value, size);
+    return true;
+}
+
+
+static bool X__Verify(const void* ptr, size_t size, uint8_t value)
+{
+    const uint8_t* p = ptr;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        if (p[i] != value)
+            return false;
+    }
+    return true;
+}
+
+
+static void* X__WorkerMain(void* arg)
+{
+    X__Worker* const worker = arg;
+    X__Worker* const neighbor = &workers[(worker - workers + 1) % X__NUM_THREADS];
+    const uint8_t tag = (uint8_t)(worker - workers + 1);
+    size_t i;
+
+    for (i = 0; i < X__NUM_SLOTS; i++)
+    {
+        worker->sizes[i] = X__RandomSize(&worker->seed);
+        worker->slots[i] = xmtalloc_allocate(&alloc, worker->sizes[i]);
+        worker->ok &= X__Fill(worker->slots[i], worker->sizes[i], tag);
+    }
+
+    /* 他のスレッドが確保したメモリを解放する */
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < X__NUM_SLOTS; i++)
+    {
+        worker->ok &= X__Verify(neighbor->slots[i], neighbor->sizes[i], (uint8_t)(neighbor - workers + 1));
+        xmtalloc_deallocate(&alloc, neighbor->slots[i]);
+    }
+    pthread_barrier_wait(&barrier);
+
+    memset(worker->slots, 0, sizeof(worker->slots));
+    for (i = 0; i < X__NUM_LOOPS; i++)
+    {
+        const size_t slot = rand_r(&worker->seed) % X__NUM_SLOTS;
+
+        if (worker->slots[slot])
+        {
+            worker->ok &= X__Verify(worker->slots[slot], worker->sizes[slot], tag);
+            xmtalloc_deallocate(&alloc, worker->slots[slot]);
+            worker->slots[slot] = NULL;
+        }
+        else
+        {
+            worker->sizes[slot] = X__RandomSize(&worker->seed);
+            worker->slots[slot] = xmtalloc_allocate(&alloc, worker->sizes[slot]);
+            worker->ok &= X__Fill(worker->slots[slot], worker->sizes[slot], tag);
+        }
+    }
+
+    for (i = 0; i < X__NUM_SLOTS; i++)
+        xmtalloc_deallocate(&alloc, worker->slots[i]);
+
+    return NULL;
+}
+
+
+TEST(xmtalloc, allocate)
+{
+    XPicoAllocator* const arena = xmtalloc_arena(&alloc);
+    void* small;
+    void* large;
+
+    X_TEST_ASSERTION_FAILED(xmtalloc_allocate(NULL, 10));
+    X_TEST_ASSERTION_FAILED(xmtalloc_allocate(&alloc, 0));
+
+    small = xmtalloc_allocate(&alloc, 1);
+    large = xmtalloc_allocate(&alloc, X__ALIGNMENT * X_CONF_XMTALLOC_NUM_CLASSES + 1);
+    TEST_ASSERT_TRUE(X__Fill(small, 1, 0xAA));
+    TEST_ASSERT_TRUE(X__Fill(large, X__ALIGNMENT * X_CONF_XMTALLOC_NUM_CLASSES + 1, 0xBB));
+    TEST_ASSERT_TRUE(xmtalloc_is_owner(&alloc, small));
+    TEST_ASSERT_TRUE(xmtalloc_is_owner(&alloc, large));
+
+    /* 解放したブロックはスレッドのキャッシュから再利用される */
+    xmtalloc_deallocate(&alloc, small);
+    TEST_ASSERT_EQUAL_PTR(small, xmtalloc_allocate(&alloc, X__ALIGNMENT));
+    xmtalloc_deallocate(&alloc, small);
+    xmtalloc_deallocate(&alloc, large);
+    X_TEST_ASSERTION_SUCCESS(xmtalloc_deallocate(&alloc, NULL));
+
+    /* キャッシュを返せば、アリーナは空に戻る */
+    TEST_ASSERT_TRUE(xpalloc_reserve(arena) < xpalloc_capacity(arena));
+    xmtalloc_flush_thread_cache(&alloc);
+    TEST_ASSERT_EQUAL(xpalloc_capacity(arena), xpalloc_reserve(arena));
+}
+
+
+TEST(xmtalloc, size_class)
+{
+    XMtAllocator small_alloc;
+    size_t size;
+
+    /* 64bit環境のアライメント8では、最小のブロックが16バイトに切り上げられる */
+    TEST_ASSERT_TRUE(xmtalloc_init(&small_alloc, NULL, X__HEAP_SIZE, X_ALIGN_OF(void*)));
+
+    /* 確保と解放で同じサイズクラスになり、解放したブロックがすぐに再利用され
+     * る */
+    for (size = 1; size <= X_ALIGN_OF(void*) * 4; size++)
+    {
+        void* const p = xmtalloc_allocate(&small_alloc, size);
+        TEST_ASSERT_NOT_NULL(p);
+        xmtalloc_deallocate(&small_alloc, p);
+        TEST_ASSERT_EQUAL_PTR(p, xmtalloc_allocate(&small_alloc, size));
+        xmtalloc_deallocate(&small_alloc, p);
+    }
+
+    xmtalloc_flush_thread_cache(&small_alloc);
+    TEST_ASSERT_EQUAL(xpalloc_capacity(xmtalloc_arena(&small_alloc)), xpalloc_reserve(xmtalloc_arena(&small_alloc)));
+    xmtalloc_deinit(&small_alloc);
+}
+
+
+TEST(xmtalloc, reallocate)
+{
+    uint8_t* p;
+    uint8_t* q;
+    size_t i;
+
+    p = xmtalloc_reallocate(&alloc, NULL, 8);
+    for (i = 0; i < 8; i++)
+        p[i] = (uint8_t)i;
+
+    /* 使用できるサイズに収まる間は移動しない */
+    TEST_ASSERT_EQUAL_PTR(p, xmtalloc_reallocate(&alloc, p, X__ALIGNMENT));
+
+    q = xmtalloc_reallocate(&alloc, p, 1024);
+    TEST_ASSERT_NOT_NULL(q);
+    for (i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL(i, q[i]);
+
+    xmtalloc_deallocate(&alloc, q);
+    xmtalloc_flush_thread_cache(&alloc);
+    TEST_ASSERT_EQUAL(xpalloc_capacity(xmtalloc_arena(&alloc)), xpalloc_reserve(xmtalloc_arena(&alloc)));
+}
+
+
+TEST(xmtalloc, threads)
+{
+    XPicoAllocator* const arena = xmtalloc_arena(&alloc);
+    size_t i;
+
+    pthread_barrier_init(&barrier, NULL, X__NUM_THREADS);
+    for (i = 0; i < X__NUM_THREADS; i++)
+    {
+        workers[i].seed = (unsigned)i + 1;
+        workers[i].ok = true;
+        TEST_ASSERT_EQUAL(0, pthread_create(&workers[i].thread, NULL, X__WorkerMain, &workers[i]));
+    }
+
+    for (i = 0; i < X__NUM_THREADS; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        TEST_ASSERT_TRUE(workers[i].ok);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    /* 終了したスレッドのキャッシュはアリーナに返されている */
+    TEST_ASSERT_EQUAL(xpalloc_capacity(arena), xpalloc_reserve(arena));
+    TEST_ASSERT_TRUE(xpalloc_max_used(arena) > 0);
+}
+
+
+TEST_GROUP_RUNNER(xmtalloc)
+{
+    RUN_TEST_CASE(xmtalloc, allocate);
+    RUN_TEST_CASE(xmtalloc, size_class);
+    RUN_TEST_CASE(xmtalloc, reallocate);
+    RUN_TEST_CASE(xmtalloc, threads);
+}
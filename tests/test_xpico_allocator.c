@@ -63,6 +63,17 @@ static void X__DammyWalkHeap(const uint8_t* chunk, size_t size, void* user)
 }
 
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+static void X__CountChunks(const uint8_t* chunk, size_t size, void* user)
+{
+    X__HeapWalker* walker = user;
+    X_UNUSED(chunk);
+    walker->num_chunks++;
+    walker->total_size += size;
+}
+#endif
+
+
 static uint32_t X__RandomAllocates(void** ptrs)
 {
     size_t i = 0;
@@ -225,6 +236,18 @@ TEST(xpalloc, allocation_overhead)
 }
 
 
+TEST(xpalloc, usable_size)
+{
+    X_TEST_ASSERTION_FAILED(xpalloc_usable_size(&alloc, NULL));
+
+    void* p = xpalloc_allocate(&alloc, 1);
+    TEST_ASSERT_EQUAL(X__ALIGNMENT, xpalloc_usable_size(&alloc, p));
+
+    p = xpalloc_allocate(&alloc, X__ALIGNMENT + 1);
+    TEST_ASSERT_EQUAL(X__ALIGNMENT * 2, xpalloc_usable_size(&alloc, p));
+}
+
+
 TEST(xpalloc, walk_heap)
 {
     X__HeapWalker walker;
@@ -250,6 +273,59 @@ TEST(xpalloc, walk_heap)
 }
 
 
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+
+
+TEST(xpalloc, size_classes)
+{
+    size_t i;
+    void* ptrs[32];
+    void* p;
+    void* q;
+    X__HeapWalker walker;
+
+    xpalloc_set_size_classes(&alloc, X_CONF_XPALLOC_MAX_SIZE_CLASSES);
+
+    /* 解放したブロックは同じサイズの確保に再利用される */
+    xpalloc_allocate(&alloc, 1);
+    p = xpalloc_allocate(&alloc, 1);
+    xpalloc_allocate(&alloc, 1);
+    xpalloc_deallocate(&alloc, p);
+    q = xpalloc_allocate(&alloc, 1);
+    TEST_ASSERT_EQUAL_PTR(p, q);
+
+    /* サイズクラスのブロックも空きとして数える。アドレス順ではなくなる */
+    xpalloc_deallocate(&alloc, q);
+    memset(&walker, 0, sizeof(walker));
+    xpalloc_walk_heap(&alloc, X__CountChunks, &walker);
+    TEST_ASSERT_EQUAL(xpalloc_reserve(&alloc), walker.total_size);
+    TEST_ASSERT_EQUAL(2, walker.num_chunks);
+    xpalloc_clear(&alloc);
+
+    /* 保持しているブロックを結合しないと確保できない場合も成功する */
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        ptrs[i] = NULL;
+    X__RandomAllocates(ptrs);
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        xpalloc_deallocate(&alloc, ptrs[i]);
+    TEST_ASSERT_EQUAL(xpalloc_capacity(&alloc), xpalloc_reserve(&alloc));
+
+    p = xpalloc_allocate(&alloc, X__HEAP_SIZE - X__ALIGNMENT);
+    TEST_ASSERT_NOT_NULL(p);
+    xpalloc_deallocate(&alloc, p);
+
+    /* 無効にすると、保持していたブロックは空きリストに戻される */
+    xpalloc_set_size_classes(&alloc, 0);
+    memset(&walker, 0, sizeof(walker));
+    xpalloc_walk_heap(&alloc, X__WalkHeap, &walker);
+    TEST_ASSERT_EQUAL(X__HEAP_SIZE, walker.total_size);
+    TEST_ASSERT_EQUAL(1, walker.num_chunks);
+}
+
+
+#endif /* if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0 */
+
+
 TEST_GROUP_RUNNER(xpalloc)
 {
     srand((uintptr_t)&alloc);
@@ -261,5 +337,9 @@ TEST_GROUP_RUNNER(xpalloc)
     RUN_TEST_CASE(xpalloc, reserve);
     RUN_TEST_CASE(xpalloc, capacity);
     RUN_TEST_CASE(xpalloc, allocation_overhead);
+    RUN_TEST_CASE(xpalloc, usable_size);
     RUN_TEST_CASE(xpalloc, walk_heap);
+#if X_CONF_XPALLOC_MAX_SIZE_CLASSES > 0
+    RUN_TEST_CASE(xpalloc, size_classes);
+#endif
 }
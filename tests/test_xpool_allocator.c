@@ -0,0 +1,213 @@
+#include <picox/allocator/xpool_allocator.h>
+#include <unity.h>
+#include <unity_fixture.h>
+#include "testutils.h"
+
+
+TEST_GROUP(xpoolalloc);
+
+
+static XPoolAllocator alloc;
+static const XPoolAllocatorSizeClass classes[] = {
+    {  16, 4 },
+    {  32, 4 },
+    {  64, 2 },
+    { 128, 0 },
+};
+static int num_parent_mallocs;
+static int num_parent_frees;
+
+
+TEST_SETUP(xpoolalloc)
+{
+    num_parent_mallocs = 0;
+    num_parent_frees = 0;
+    TEST_ASSERT_TRUE(xpoolalloc_init(&alloc, NULL, xpoolalloc_heap_size(classes, X_COUNT_OF(classes)),
+                                     classes, X_COUNT_OF(classes)));
+}
+
+
+TEST_TEAR_DOWN(xpoolalloc)
+{
+    xpoolalloc_deinit(&alloc);
+}
+
+
+static void* X__ParentMalloc(size_t size)
+{
+    num_parent_mallocs++;
+    return x_malloc(size);
+}
+
+
+static void X__ParentFree(void* ptr)
+{
+    num_parent_frees++;
+    x_free(ptr);
+}
+
+
+static void X__AssertOccupancy(size_t index, size_t num_blocks, size_t used_blocks, size_t num_slabs)
+{
+    XPoolAllocatorOccupancy occupancy;
+
+    xpoolalloc_occupancy(&alloc, index, &occupancy);
+    TEST_ASSERT_EQUAL(classes[index].block_size, occupancy.block_size);
+    TEST_ASSERT_EQUAL(num_blocks, occupancy.num_blocks);
+    TEST_ASSERT_EQUAL(used_blocks, occupancy.used_blocks);
+    TEST_ASSERT_EQUAL(num_slabs, occupancy.num_slabs);
+}
+
+
+TEST(xpoolalloc, init)
+{
+    uint8_t heap[512];
+    X_UNUSED(heap);
+
+    X_TEST_ASSERTION_FAILED(xpoolalloc_init(NULL, heap, sizeof(heap), classes, X_COUNT_OF(classes)));
+    X_TEST_ASSERTION_FAILED(xpoolalloc_init(&alloc, heap, sizeof(heap), classes, 0));
+    X_TEST_ASSERTION_FAILED(xpoolalloc_init(&alloc, heap, 16, classes, X_COUNT_OF(classes)));
+
+    TEST_ASSERT_EQUAL(X_COUNT_OF(classes), xpoolalloc_num_classes(&alloc));
+    X__AssertOccupancy(0, 4, 0, 1);
+    X__AssertOccupancy(3, 0, 0, 0);
+}
+
+
+TEST(xpoolalloc, allocate)
+{
+    void* ptrs[4];
+    void* p;
+    size_t i;
+
+    X_TEST_ASSERTION_FAILED(xpoolalloc_allocate(NULL, 1));
+    X_TEST_ASSERTION_FAILED(xpoolalloc_allocate(&alloc, 0));
+
+    /* 収まる最小のクラスから割り当てる */
+    p = xpoolalloc_allocate(&alloc, 17);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(xpoolalloc_is_owner(&alloc, p));
+    X__AssertOccupancy(0, 4, 0, 1);
+    X__AssertOccupancy(1, 4, 1, 1);
+    xpoolalloc_deallocate(&alloc, p);
+    X__AssertOccupancy(1, 4, 0, 1);
+
+    /* クラスを使い切ったら、次に大きいクラスから割り当てる */
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        ptrs[i] = xpoolalloc_allocate(&alloc, 16);
+    p = xpoolalloc_allocate(&alloc, 16);
+    X__AssertOccupancy(0, 4, 4, 1);
+    X__AssertOccupancy(1, 4, 1, 1);
+
+    /* 親がなければ、最大のクラスを越えるか、全て使い切ったら失敗する */
+    TEST_ASSERT_NULL(xpoolalloc_allocate(&alloc, 100));
+    TEST_ASSERT_NULL(xpoolalloc_allocate(&alloc, 129));
+
+    xpoolalloc_deallocate(&alloc, p);
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        xpoolalloc_deallocate(&alloc, ptrs[i]);
+    X_TEST_ASSERTION_SUCCESS(xpoolalloc_deallocate(&alloc, NULL));
+    X__AssertOccupancy(0, 4, 0, 1);
+    X__AssertOccupancy(1, 4, 0, 1);
+}
+
+
+TEST(xpoolalloc, grow)
+{
+    XPoolAllocatorOccupancy occupancy;
+    void* ptrs[8];
+    void* p;
+    size_t i;
+
+    xpoolalloc_set_parent(&alloc, X__ParentMalloc, X__ParentFree, 3);
+
+    /* ブロックを持たないクラスは、最初の確保で親から拡張する */
+    p = xpoolalloc_allocate(&alloc, 100);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL(1, num_parent_mallocs);
+    X__AssertOccupancy(3, 3, 1, 1);
+
+    /* 使い切ったら、大きいクラスに移らずに拡張する */
+    for (i = 0; i < 6; i++)
+    {
+        ptrs[i] = xpoolalloc_allocate(&alloc, 64);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        TEST_ASSERT_TRUE(x_is_aligned(ptrs[i], X_ALIGN_OF(void*)));
+        memset(ptrs[i], 0xAA, 64);
+    }
+    X__AssertOccupancy(2, 8, 6, 3);
+    X__AssertOccupancy(3, 3, 1, 1);
+    TEST_ASSERT_EQUAL(3, num_parent_mallocs);
+
+    /* 拡張したスラブから解放したブロックも再利用される */
+    xpoolalloc_deallocate(&alloc, ptrs[5]);
+    TEST_ASSERT_EQUAL_PTR(ptrs[5], xpoolalloc_allocate(&alloc, 64));
+
+    /* 使用中のブロックを持つスラブと、ヒープから切り出したスラブは縮小されない */
+    for (i = 0; i < 5; i++)
+        xpoolalloc_deallocate(&alloc, ptrs[i]);
+    TEST_ASSERT_EQUAL(1, xpoolalloc_shrink(&alloc));
+    X__AssertOccupancy(2, 5, 1, 2);
+
+    xpoolalloc_deallocate(&alloc, ptrs[5]);
+    xpoolalloc_deallocate(&alloc, p);
+    TEST_ASSERT_EQUAL(2, xpoolalloc_shrink(&alloc));
+    X__AssertOccupancy(2, 2, 0, 1);
+    X__AssertOccupancy(3, 0, 0, 0);
+    TEST_ASSERT_EQUAL(3, num_parent_frees);
+
+    xpoolalloc_occupancy(&alloc, 2, &occupancy);
+    TEST_ASSERT_EQUAL(6, occupancy.max_used_blocks);
+}
+
+
+TEST(xpoolalloc, deallocate)
+{
+    void* small[6];
+    void* large[6];
+    size_t i;
+
+    xpoolalloc_set_parent(&alloc, X__ParentMalloc, X__ParentFree, 1);
+
+    /* スラブが増えても、解放したブロックは確保したクラスとスラブに戻る */
+    for (i = 0; i < X_COUNT_OF(small); i++)
+    {
+        small[i] = xpoolalloc_allocate(&alloc, 64);
+        large[i] = xpoolalloc_allocate(&alloc, 128);
+    }
+    X__AssertOccupancy(2, 6, 6, 5);
+    X__AssertOccupancy(3, 6, 6, 6);
+
+    for (i = 0; i < X_COUNT_OF(small); i++)
+    {
+        xpoolalloc_deallocate(&alloc, large[X_COUNT_OF(large) - 1 - i]);
+        xpoolalloc_deallocate(&alloc, small[i]);
+    }
+    X__AssertOccupancy(2, 6, 0, 5);
+    X__AssertOccupancy(3, 6, 0, 6);
+    TEST_ASSERT_EQUAL(10, xpoolalloc_shrink(&alloc));
+}
+
+
+TEST(xpoolalloc, deinit)
+{
+    xpoolalloc_set_parent(&alloc, X__ParentMalloc, X__ParentFree, 1);
+    xpoolalloc_allocate(&alloc, 128);
+    xpoolalloc_allocate(&alloc, 128);
+
+    /* 親から確保したスラブも解放される */
+    xpoolalloc_deinit(&alloc);
+    TEST_ASSERT_EQUAL(2, num_parent_frees);
+    TEST_ASSERT_TRUE(xpoolalloc_init(&alloc, NULL, xpoolalloc_heap_size(classes, X_COUNT_OF(classes)),
+                                     classes, X_COUNT_OF(classes)));
+}
+
+
+TEST_GROUP_RUNNER(xpoolalloc)
+{
+    RUN_TEST_CASE(xpoolalloc, init);
+    RUN_TEST_CASE(xpoolalloc, allocate);
+    RUN_TEST_CASE(xpoolalloc, grow);
+    RUN_TEST_CASE(xpoolalloc, deallocate);
+    RUN_TEST_CASE(xpoolalloc, deinit);
+}
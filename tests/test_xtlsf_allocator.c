@@ -0,0 +1,385 @@
+#include <picox/allocator/xtlsf_allocator.h>
+#include <unity.h>
+#include <unity_fixture.h>
+#include "testutils.h"
+
+
+TEST_GROUP(xtalloc);
+
+
+/* xtalloc_walk_heap()で集計した空きブロックの情報 */
+typedef struct X__FreeBlocks
+{
+    size_t          num;
+    size_t          total;
+    const uint8_t*  first;
+    size_t          first_size;
+} X__FreeBlocks;
+
+
+static XTlsfAllocator alloc;
+#define X__HEAP_SIZE    (1024 * 8)
+#define X__ALIGNMENT    X_ALIGN_OF(XMaxAlign)
+
+
+TEST_SETUP(xtalloc)
+{
+    void* buf = x_malloc(X__HEAP_SIZE);
+    TEST_ASSERT_NOT_NULL(buf);
+    memset(buf, 0x00, X__HEAP_SIZE);
+    xtalloc_init(&alloc, buf, X__HEAP_SIZE, X__ALIGNMENT);
+}
+
+
+TEST_TEAR_DOWN(xtalloc)
+{
+    x_free(xtalloc_heap(&alloc));
+}
+
+
+static void X__CountFreeBlock(const uint8_t* chunk, size_t size, void* user)
+{
+    X__FreeBlocks* blocks = user;
+
+    if (blocks->num == 0)
+    {
+        blocks->first = chunk;
+        blocks->first_size = size;
+    }
+    blocks->num++;
+    blocks->total += size;
+}
+
+
+static X__FreeBlocks X__WalkFreeBlocks(void)
+{
+    X__FreeBlocks blocks;
+
+    memset(&blocks, 0, sizeof(blocks));
+    xtalloc_walk_heap(&alloc, X__CountFreeBlock, &blocks);
+
+    return blocks;
+}
+
+
+/* ブロックサイズがsizeになる確保要求のサイズ */
+static size_t X__UserSize(size_t size)
+{
+    return size - xtalloc_allocation_overhead(&alloc, X__ALIGNMENT);
+}
+
+
+TEST(xtalloc, init)
+{
+    uint8_t* heap = xtalloc_heap(&alloc);
+    X_UNUSED(heap);
+    X_TEST_ASSERTION_FAILED(xtalloc_init(NULL, heap, X__HEAP_SIZE, X__ALIGNMENT));
+    X_TEST_ASSERTION_FAILED(xtalloc_init(&alloc, heap, 0, X__ALIGNMENT));
+    X_TEST_ASSERTION_FAILED(xtalloc_init(&alloc, heap, X__HEAP_SIZE, 3));
+    X_TEST_ASSERTION_SUCCESS(xtalloc_init(&alloc, heap, X__HEAP_SIZE, X__ALIGNMENT));
+
+    /* ヒープの末尾には番兵を置くので、容量はヒープより小さい */
+    TEST_ASSERT_TRUE(xtalloc_capacity(&alloc) < X__HEAP_SIZE);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_reserve(&alloc));
+}
+
+
+TEST(xtalloc, allocate)
+{
+    X_TEST_ASSERTION_FAILED(xtalloc_allocate(NULL, 10));
+    X_TEST_ASSERTION_FAILED(xtalloc_allocate(&alloc, 0));
+
+    size_t i;
+    void* ptrs[32];
+
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+    {
+        ptrs[i] = xtalloc_allocate(&alloc, i + 1);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+        TEST_ASSERT_TRUE(x_is_aligned(ptrs[i], X__ALIGNMENT));
+        TEST_ASSERT_TRUE(xtalloc_is_owner(&alloc, ptrs[i]));
+        memset(ptrs[i], 0xAA, i + 1);
+    }
+
+    for (i = 0; i < X_COUNT_OF(ptrs); i++)
+        xtalloc_deallocate(&alloc, ptrs[i]);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_reserve(&alloc));
+
+    /* 容量を越える要求と、ヒープ全体の確保 */
+    TEST_ASSERT_NULL(xtalloc_allocate(&alloc, X__HEAP_SIZE));
+    void* p = xtalloc_allocate(&alloc, xtalloc_capacity(&alloc) - xtalloc_allocation_overhead(&alloc, 1) - 1);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL(0, xtalloc_reserve(&alloc));
+    TEST_ASSERT_NULL(xtalloc_allocate(&alloc, 1));
+    xtalloc_deallocate(&alloc, p);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_max_used(&alloc));
+}
+
+
+TEST(xtalloc, deallocate)
+{
+    size_t reserve = xtalloc_reserve(&alloc);
+    void* p = xtalloc_allocate(&alloc, 10);
+    TEST_ASSERT_NOT_EQUAL(reserve, xtalloc_reserve(&alloc));
+
+    X_TEST_ASSERTION_FAILED(xtalloc_deallocate(NULL, p));
+    X_TEST_ASSERTION_SUCCESS(xtalloc_deallocate(&alloc, NULL));
+
+    xtalloc_deallocate(&alloc, p);
+    TEST_ASSERT_EQUAL(reserve, xtalloc_reserve(&alloc));
+
+    /* 二重解放 */
+    X_TEST_ASSERTION_FAILED(xtalloc_deallocate(&alloc, p));
+}
+
+
+TEST(xtalloc, reallocate)
+{
+    uint8_t* p;
+    uint8_t* q;
+    uint8_t* r;
+    size_t i;
+
+    p = xtalloc_reallocate(&alloc, NULL, 16);
+    TEST_ASSERT_NOT_NULL(p);
+    for (i = 0; i < 16; i++)
+        p[i] = (uint8_t)i;
+
+    /* 後ろが空いていればその場で拡張される */
+    q = xtalloc_reallocate(&alloc, p, 128);
+    TEST_ASSERT_EQUAL_PTR(p, q);
+
+    /* 縮小もその場で行われ、余りは空きに戻る */
+    const size_t reserve = xtalloc_reserve(&alloc);
+    q = xtalloc_reallocate(&alloc, p, 16);
+    TEST_ASSERT_EQUAL_PTR(p, q);
+    TEST_ASSERT_TRUE(xtalloc_reserve(&alloc) > reserve);
+
+    /* 後ろが使用中なら移動して内容をコピーする */
+    r = xtalloc_allocate(&alloc, 16);
+    q = xtalloc_reallocate(&alloc, p, 128);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_TRUE(q != p);
+    for (i = 0; i < 16; i++)
+        TEST_ASSERT_EQUAL(i, q[i]);
+
+    TEST_ASSERT_NULL(xtalloc_reallocate(&alloc, q, X__HEAP_SIZE));
+    xtalloc_deallocate(&alloc, q);
+    xtalloc_deallocate(&alloc, r);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_reserve(&alloc));
+}
+
+
+TEST(xtalloc, class_boundary)
+{
+    /* 第1レベル0はalignment刻み、それ以降は2のべき乗の区間を16等分した刻みで
+     * 分類される。区分の先頭のサイズちょうどの空きブロックは、より大きな空き
+     * ブロックがあっても、同じサイズの要求に対してそのまま再利用される。
+     */
+    const size_t small = X__ALIGNMENT * X_TLSF_SL_COUNT;
+    const size_t sizes[] = {
+        small - X__ALIGNMENT,           /* 第1レベル0の最後の区分 */
+        small,                          /* 第1レベル1の先頭 */
+        small + X__ALIGNMENT,           /* 第1レベル1の2番目の区分 */
+        small * 2,                      /* 第1レベル2の先頭 */
+        small * 2 + X__ALIGNMENT * 2,   /* 第1レベル2の2番目の区分 */
+        small * 4 + X__ALIGNMENT * 4,   /* 第1レベル3の2番目の区分 */
+    };
+    size_t i;
+
+    for (i = 0; i < X_COUNT_OF(sizes); i++)
+    {
+        void* hole;
+        void* p;
+
+        xtalloc_clear(&alloc);
+        xtalloc_allocate(&alloc, 1);
+        hole = xtalloc_allocate(&alloc, X__UserSize(sizes[i]));
+        xtalloc_allocate(&alloc, 1);
+        xtalloc_deallocate(&alloc, hole);
+        TEST_ASSERT_EQUAL(2, X__WalkFreeBlocks().num);
+
+        p = xtalloc_allocate(&alloc, X__UserSize(sizes[i]));
+        TEST_ASSERT_EQUAL_PTR(hole, p);
+        TEST_ASSERT_EQUAL(1, X__WalkFreeBlocks().num);
+    }
+}
+
+
+TEST(xtalloc, good_fit)
+{
+    /* 区分の途中のサイズの空きブロックは、要求を満たすことが保証されないので
+     * リスト内を走査せず、上の区分の空きブロックが優先される。
+     */
+    const size_t size = X__ALIGNMENT * X_TLSF_SL_COUNT * 2 + X__ALIGNMENT;
+    void* hole;
+    void* p;
+
+    xtalloc_allocate(&alloc, 1);
+    hole = xtalloc_allocate(&alloc, X__UserSize(size));
+    xtalloc_allocate(&alloc, 1);
+    xtalloc_deallocate(&alloc, hole);
+
+    p = xtalloc_allocate(&alloc, X__UserSize(size));
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(p != hole);
+
+    /* 他に候補がなければ、同じ区分の先頭ブロックを確認して使用する */
+    xtalloc_allocate(&alloc, X__UserSize(xtalloc_reserve(&alloc) - size));
+    TEST_ASSERT_EQUAL(size, xtalloc_reserve(&alloc));
+    p = xtalloc_allocate(&alloc, X__UserSize(size));
+    TEST_ASSERT_EQUAL_PTR(hole, p);
+    TEST_ASSERT_EQUAL(0, xtalloc_reserve(&alloc));
+}
+
+
+TEST(xtalloc, coalesce)
+{
+    void* p1 = xtalloc_allocate(&alloc, 100);
+    void* p2 = xtalloc_allocate(&alloc, 100);
+    void* p3 = xtalloc_allocate(&alloc, 100);
+    void* p4 = xtalloc_allocate(&alloc, 100);
+    const size_t block_size = 100 + xtalloc_allocation_overhead(&alloc, 100);
+    X__FreeBlocks blocks;
+
+    xtalloc_deallocate(&alloc, p1);
+    xtalloc_deallocate(&alloc, p3);
+    TEST_ASSERT_EQUAL(3, X__WalkFreeBlocks().num);
+
+    /* 前後の空きブロックと結合して1つになる */
+    xtalloc_deallocate(&alloc, p2);
+    blocks = X__WalkFreeBlocks();
+    TEST_ASSERT_EQUAL(2, blocks.num);
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)p1 - xtalloc_allocation_overhead(&alloc, X__ALIGNMENT), blocks.first);
+    TEST_ASSERT_EQUAL(block_size * 3, blocks.first_size);
+
+    /* 末尾の空きブロックとも結合され、ヒープ全体が1ブロックに戻る */
+    xtalloc_deallocate(&alloc, p4);
+    blocks = X__WalkFreeBlocks();
+    TEST_ASSERT_EQUAL(1, blocks.num);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), blocks.total);
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_reserve(&alloc));
+}
+
+
+TEST(xtalloc, split)
+{
+    const size_t capacity = xtalloc_capacity(&alloc);
+    const size_t size = capacity / 2;
+    const size_t block_size = size + xtalloc_allocation_overhead(&alloc, size);
+    X__FreeBlocks blocks;
+    uint8_t* p;
+
+    /* 大きな空きブロックの先頭から切り出され、残りは直後の空きブロックになる */
+    p = xtalloc_allocate(&alloc, size);
+    TEST_ASSERT_NOT_NULL(p);
+    blocks = X__WalkFreeBlocks();
+    TEST_ASSERT_EQUAL(1, blocks.num);
+    TEST_ASSERT_EQUAL(capacity - block_size, blocks.first_size);
+    TEST_ASSERT_TRUE(blocks.first > p);
+    TEST_ASSERT_TRUE(blocks.first < p + block_size);
+    TEST_ASSERT_EQUAL(blocks.first_size, xtalloc_reserve(&alloc));
+
+    /* 残りはそのまま確保できる */
+    TEST_ASSERT_NOT_NULL(xtalloc_allocate(&alloc, X__UserSize(blocks.first_size)));
+    TEST_ASSERT_EQUAL(0, xtalloc_reserve(&alloc));
+    xtalloc_clear(&alloc);
+
+    /* 余りが空きブロックとして管理できないほど小さければ分割しない */
+    p = xtalloc_allocate(&alloc, X__UserSize(capacity - X__ALIGNMENT));
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL(0, xtalloc_reserve(&alloc));
+    TEST_ASSERT_EQUAL(0, X__WalkFreeBlocks().num);
+}
+
+
+TEST(xtalloc, clear)
+{
+    X_TEST_ASSERTION_FAILED(xtalloc_clear(NULL));
+
+    size_t i;
+    X__FreeBlocks blocks;
+
+    for (i = 0; i < 32; i++)
+        xtalloc_allocate(&alloc, i + 1);
+    xtalloc_clear(&alloc);
+
+    blocks = X__WalkFreeBlocks();
+    TEST_ASSERT_EQUAL(xtalloc_capacity(&alloc), xtalloc_reserve(&alloc));
+    TEST_ASSERT_EQUAL(blocks.total, xtalloc_reserve(&alloc));
+    TEST_ASSERT_EQUAL(1, blocks.num);
+    TEST_ASSERT_EQUAL(0, xtalloc_max_used(&alloc));
+}
+
+
+TEST(xtalloc, heap)
+{
+    X_TEST_ASSERTION_FAILED(xtalloc_heap(NULL));
+
+    XTlsfAllocator alloc;
+    char buf[256];
+
+    xtalloc_init(&alloc, buf, sizeof(buf), X__ALIGNMENT);
+    TEST_ASSERT_EQUAL_PTR(buf, xtalloc_heap(&alloc));
+}
+
+
+TEST(xtalloc, allocation_overhead)
+{
+    X_TEST_ASSERTION_FAILED(xtalloc_allocation_overhead(NULL, 1));
+
+    const size_t orig_reserve = xtalloc_reserve(&alloc);
+    void* p = xtalloc_allocate(&alloc, 100);
+    X_UNUSED(p);
+
+    const size_t next_reserve = xtalloc_reserve(&alloc);
+    TEST_ASSERT_EQUAL(orig_reserve - next_reserve, xtalloc_allocation_overhead(&alloc, 100) + 100);
+}
+
+
+TEST(xtalloc, walk_heap)
+{
+    X__FreeBlocks blocks;
+
+    X_TEST_ASSERTION_FAILED(xtalloc_walk_heap(NULL, X__CountFreeBlock, &blocks));
+    X_TEST_ASSERTION_FAILED(xtalloc_walk_heap(&alloc, NULL, &blocks));
+
+    /* 空きブロックだけがアドレス順に報告される */
+    void* p1 = xtalloc_allocate(&alloc, 1);
+    void* p2 = xtalloc_allocate(&alloc, 1);
+    X_UNUSED(p1);
+    xtalloc_deallocate(&alloc, p2);
+
+    blocks = X__WalkFreeBlocks();
+    TEST_ASSERT_EQUAL(1, blocks.num);
+    TEST_ASSERT_EQUAL_PTR((uint8_t*)p2 - xtalloc_allocation_overhead(&alloc, X__ALIGNMENT), blocks.first);
+    TEST_ASSERT_EQUAL(xtalloc_reserve(&alloc), blocks.total);
+}
+
+
+TEST(xtalloc, is_owner)
+{
+    void* p = xtalloc_allocate(&alloc, 1);
+    int dummy;
+
+    TEST_ASSERT_TRUE(xtalloc_is_owner(&alloc, p));
+    TEST_ASSERT_FALSE(xtalloc_is_owner(&alloc, &dummy));
+}
+
+
+TEST_GROUP_RUNNER(xtalloc)
+{
+    RUN_TEST_CASE(xtalloc, init);
+    RUN_TEST_CASE(xtalloc, allocate);
+    RUN_TEST_CASE(xtalloc, deallocate);
+    RUN_TEST_CASE(xtalloc, reallocate);
+    RUN_TEST_CASE(xtalloc, class_boundary);
+    RUN_TEST_CASE(xtalloc, good_fit);
+    RUN_TEST_CASE(xtalloc, coalesce);
+    RUN_TEST_CASE(xtalloc, split);
+    RUN_TEST_CASE(xtalloc, clear);
+    RUN_TEST_CASE(xtalloc, heap);
+    RUN_TEST_CASE(xtalloc, allocation_overhead);
+    RUN_TEST_CASE(xtalloc, walk_heap);
+    RUN_TEST_CASE(xtalloc, is_owner);
+}
@@ -0,0 +1,216 @@
+#include <picox/multitask/xvtimer.h>
+#include "testutils.h"
+
+
+#define X__NUM_REQUESTS     (64)
+
+
+TEST_GROUP(xvtimer);
+
+
+static XVTimer timer;
+static XVTimerRequest requests[X__NUM_REQUESTS];
+static int fired[X__NUM_REQUESTS];
+static int order[X__NUM_REQUESTS];
+static int num_fired;
+
+
+TEST_SETUP(xvtimer)
+{
+    int i;
+
+    xvtimer_init(&timer);
+    for (i = 0; i < X__NUM_REQUESTS; i++)
+    {
+        xvtimer_init_request(&requests[i]);
+        fired[i] = 0;
+        order[i] = -1;
+    }
+    num_fired = 0;
+}
+
+
+TEST_TEAR_DOWN(xvtimer)
+{
+    xvtimer_deinit(&timer);
+}
+
+
+static void CountCallback(void* arg)
+{
+    const int index = (XVTimerRequest*)arg - requests;
+
+    fired[index]++;
+    if (order[index] < 0)
+        order[index] = num_fired;
+    num_fired++;
+}
+
+
+static void RemoveNextCallback(void* arg)
+{
+    XVTimerRequest* const req = arg;
+
+    CountCallback(arg);
+    xvtimer_remove_requst(&timer, req + 1);
+}
+
+
+static void RearmCallback(void* arg)
+{
+    XVTimerRequest* const req = arg;
+
+    CountCallback(arg);
+    xvtimer_add_request(&timer, req, RearmCallback, req, 0, 0, true, NULL);
+}
+
+
+TEST(xvtimer, once)
+{
+    xvtimer_add_request(&timer, &requests[0], CountCallback, &requests[0], 0, 10, true, NULL);
+
+    xvtimer_schedule(&timer, 9);
+    TEST_ASSERT_EQUAL(0, fired[0]);
+    xvtimer_schedule(&timer, 1);
+    TEST_ASSERT_EQUAL(1, fired[0]);
+    xvtimer_schedule(&timer, 100);
+    TEST_ASSERT_EQUAL(1, fired[0]);
+    TEST_ASSERT_EQUAL(110, xvtimer_now(&timer));
+}
+
+
+TEST(xvtimer, delay_and_interval)
+{
+    xvtimer_add_request(&timer, &requests[0], CountCallback, &requests[0], 5, 10, false, NULL);
+
+    xvtimer_schedule(&timer, 14);
+    TEST_ASSERT_EQUAL(0, fired[0]);
+    xvtimer_schedule(&timer, 1);
+    TEST_ASSERT_EQUAL(1, fired[0]);
+    xvtimer_schedule(&timer, 10);
+    TEST_ASSERT_EQUAL(2, fired[0]);
+
+    /* 1回の呼び出しで複数周期が経過してもコールバックは1回だけ */
+    xvtimer_schedule(&timer, 35);
+    TEST_ASSERT_EQUAL(3, fired[0]);
+}
+
+
+static XTicks X__Interval(int i)
+{
+    return ((i * 37) % X__NUM_REQUESTS) + 1;
+}
+
+
+TEST(xvtimer, deadline_order)
+{
+    int i;
+
+    /* 期限の遅いものから追加しても、期限の早い順に呼び出される */
+    for (i = 0; i < X__NUM_REQUESTS; i++)
+    {
+        xvtimer_add_request(&timer, &requests[i], CountCallback, &requests[i], 0, X__Interval(i), true, NULL);
+    }
+
+    /* 奇数番目をキャンセルする */
+    for (i = 1; i < X__NUM_REQUESTS; i += 2)
+        xvtimer_remove_requst(&timer, &requests[i]);
+
+    xvtimer_schedule(&timer, X__NUM_REQUESTS);
+
+    for (i = 0; i < X__NUM_REQUESTS; i++)
+    {
+        if (i % 2)
+        {
+            TEST_ASSERT_EQUAL(0, fired[i]);
+        }
+        else
+        {
+            int j;
+            TEST_ASSERT_EQUAL(1, fired[i]);
+            for (j = 0; j < X__NUM_REQUESTS; j += 2)
+            {
+                if (X__Interval(j) < X__Interval(i))
+                {
+                    TEST_ASSERT_TRUE(order[j] < order[i]);
+                }
+            }
+        }
+    }
+}
+
+
+TEST(xvtimer, remove_in_callback)
+{
+    xvtimer_add_request(&timer, &requests[0], RemoveNextCallback, &requests[0], 0, 10, true, NULL);
+    xvtimer_add_request(&timer, &requests[1], CountCallback, &requests[1], 0, 10, true, NULL);
+    xvtimer_add_request(&timer, &requests[2], CountCallback, &requests[2], 0, 20, true, NULL);
+
+    xvtimer_schedule(&timer, 5);
+    xvtimer_remove_requst(&timer, &requests[2]);
+    xvtimer_schedule(&timer, 100);
+
+    TEST_ASSERT_EQUAL(1, fired[0]);
+    TEST_ASSERT_EQUAL(0, fired[1]);
+    TEST_ASSERT_EQUAL(0, fired[2]);
+    TEST_ASSERT_NULL(requests[1].m_holder);
+}
+
+
+TEST(xvtimer, add_in_callback)
+{
+    /* コールバック中に追加したリクエストは次の呼び出しまで処理されない */
+    xvtimer_add_request(&timer, &requests[0], RearmCallback, &requests[0], 0, 1, true, NULL);
+
+    xvtimer_schedule(&timer, 1);
+    TEST_ASSERT_EQUAL(1, fired[0]);
+    xvtimer_schedule(&timer, 1);
+    TEST_ASSERT_EQUAL(2, fired[0]);
+    xvtimer_schedule(&timer, 1);
+    TEST_ASSERT_EQUAL(3, fired[0]);
+}
+
+
+TEST(xvtimer, wrap_around)
+{
+    timer.m_tick_count = INT32_MAX - 5;
+    xvtimer_add_request(&timer, &requests[0], CountCallback, &requests[0], 0, 10, true, NULL);
+    xvtimer_add_request(&timer, &requests[1], CountCallback, &requests[1], 0, 3, true, NULL);
+
+    xvtimer_schedule(&timer, 3);
+    TEST_ASSERT_EQUAL(0, fired[0]);
+    TEST_ASSERT_EQUAL(1, fired[1]);
+    xvtimer_schedule(&timer, 7);
+    TEST_ASSERT_EQUAL(1, fired[0]);
+}
+
+
+TEST(xvtimer, next_timeout)
+{
+    TEST_ASSERT_EQUAL(X_TICKS_FOREVER, xvtimer_next_timeout(&timer));
+
+    xvtimer_add_request(&timer, &requests[0], CountCallback, &requests[0], 0, 30, true, NULL);
+    xvtimer_add_request(&timer, &requests[1], CountCallback, &requests[1], 5, 10, false, NULL);
+    TEST_ASSERT_EQUAL(15, xvtimer_next_timeout(&timer));
+
+    xvtimer_schedule(&timer, 15);
+    TEST_ASSERT_EQUAL(10, xvtimer_next_timeout(&timer));
+
+    xvtimer_remove_requst(&timer, &requests[1]);
+    TEST_ASSERT_EQUAL(15, xvtimer_next_timeout(&timer));
+
+    xvtimer_schedule(&timer, 15);
+    TEST_ASSERT_EQUAL(X_TICKS_FOREVER, xvtimer_next_timeout(&timer));
+}
+
+
+TEST_GROUP_RUNNER(xvtimer)
+{
+    RUN_TEST_CASE(xvtimer, once);
+    RUN_TEST_CASE(xvtimer, delay_and_interval);
+    RUN_TEST_CASE(xvtimer, deadline_order);
+    RUN_TEST_CASE(xvtimer, remove_in_callback);
+    RUN_TEST_CASE(xvtimer, add_in_callback);
+    RUN_TEST_CASE(xvtimer, wrap_around);
+    RUN_TEST_CASE(xvtimer, next_timeout);
+}